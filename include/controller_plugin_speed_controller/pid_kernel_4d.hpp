@@ -0,0 +1,324 @@
+/*!*******************************************************************************************
+ *  \file       pid_kernel_4d.hpp
+ *  \brief      Four lane (x, y, z, yaw) PID kernel with build-time SIMD selection.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_PID_KERNEL_4D_H__
+#define __SP_PID_KERNEL_4D_H__
+
+#include <algorithm>
+#include <limits>
+
+#include "speed_controller_gains.hpp"
+
+// Backend selection: AVX (4 doubles), SSE2 or NEON (2 x 2 doubles), scalar otherwise.
+// Define SPEED_CONTROLLER_SCALAR_KERNEL to force the scalar fallback.
+#if !defined(SPEED_CONTROLLER_SCALAR_KERNEL) && defined(__AVX__)
+#define SPEED_CONTROLLER_KERNEL_AVX
+#include <immintrin.h>
+#elif !defined(SPEED_CONTROLLER_SCALAR_KERNEL) && (defined(__SSE2__) || defined(_M_X64))
+#define SPEED_CONTROLLER_KERNEL_SSE2
+#include <emmintrin.h>
+#elif !defined(SPEED_CONTROLLER_SCALAR_KERNEL) && defined(__ARM_NEON) && defined(__aarch64__)
+#define SPEED_CONTROLLER_KERNEL_NEON
+#include <arm_neon.h>
+#else
+#define SPEED_CONTROLLER_KERNEL_SCALAR
+#endif
+
+namespace controller_plugin_speed_controller {
+namespace simd {
+
+#if defined(SPEED_CONTROLLER_KERNEL_AVX)
+
+constexpr const char *kBackendName = "avx";
+
+struct Vec4 {
+  __m256d v;
+};
+using Mask4 = Vec4;
+
+inline Vec4 load(const double *_p) { return {_mm256_load_pd(_p)}; }
+inline void store(double *_p, Vec4 _a) { _mm256_store_pd(_p, _a.v); }
+inline Vec4 set1(double _x) { return {_mm256_set1_pd(_x)}; }
+inline Vec4 operator+(Vec4 _a, Vec4 _b) { return {_mm256_add_pd(_a.v, _b.v)}; }
+inline Vec4 operator-(Vec4 _a, Vec4 _b) { return {_mm256_sub_pd(_a.v, _b.v)}; }
+inline Vec4 operator*(Vec4 _a, Vec4 _b) { return {_mm256_mul_pd(_a.v, _b.v)}; }
+inline Vec4 min(Vec4 _a, Vec4 _b) { return {_mm256_min_pd(_a.v, _b.v)}; }
+inline Vec4 max(Vec4 _a, Vec4 _b) { return {_mm256_max_pd(_a.v, _b.v)}; }
+inline Mask4 lessThan(Vec4 _a, Vec4 _b) { return {_mm256_cmp_pd(_a.v, _b.v, _CMP_LT_OQ)}; }
+inline Mask4 operator&(Mask4 _a, Mask4 _b) { return {_mm256_and_pd(_a.v, _b.v)}; }
+inline Vec4 select(Mask4 _mask, Vec4 _a, Vec4 _b) {
+  return {_mm256_blendv_pd(_b.v, _a.v, _mask.v)};
+}
+
+#elif defined(SPEED_CONTROLLER_KERNEL_SSE2)
+
+constexpr const char *kBackendName = "sse2";
+
+struct Vec4 {
+  __m128d lo, hi;
+};
+using Mask4 = Vec4;
+
+inline Vec4 load(const double *_p) { return {_mm_load_pd(_p), _mm_load_pd(_p + 2)}; }
+inline void store(double *_p, Vec4 _a) {
+  _mm_store_pd(_p, _a.lo);
+  _mm_store_pd(_p + 2, _a.hi);
+}
+inline Vec4 set1(double _x) { return {_mm_set1_pd(_x), _mm_set1_pd(_x)}; }
+inline Vec4 operator+(Vec4 _a, Vec4 _b) {
+  return {_mm_add_pd(_a.lo, _b.lo), _mm_add_pd(_a.hi, _b.hi)};
+}
+inline Vec4 operator-(Vec4 _a, Vec4 _b) {
+  return {_mm_sub_pd(_a.lo, _b.lo), _mm_sub_pd(_a.hi, _b.hi)};
+}
+inline Vec4 operator*(Vec4 _a, Vec4 _b) {
+  return {_mm_mul_pd(_a.lo, _b.lo), _mm_mul_pd(_a.hi, _b.hi)};
+}
+inline Vec4 min(Vec4 _a, Vec4 _b) { return {_mm_min_pd(_a.lo, _b.lo), _mm_min_pd(_a.hi, _b.hi)}; }
+inline Vec4 max(Vec4 _a, Vec4 _b) { return {_mm_max_pd(_a.lo, _b.lo), _mm_max_pd(_a.hi, _b.hi)}; }
+inline Mask4 lessThan(Vec4 _a, Vec4 _b) {
+  return {_mm_cmplt_pd(_a.lo, _b.lo), _mm_cmplt_pd(_a.hi, _b.hi)};
+}
+inline Mask4 operator&(Mask4 _a, Mask4 _b) {
+  return {_mm_and_pd(_a.lo, _b.lo), _mm_and_pd(_a.hi, _b.hi)};
+}
+inline Vec4 select(Mask4 _mask, Vec4 _a, Vec4 _b) {
+  return {_mm_or_pd(_mm_and_pd(_mask.lo, _a.lo), _mm_andnot_pd(_mask.lo, _b.lo)),
+          _mm_or_pd(_mm_and_pd(_mask.hi, _a.hi), _mm_andnot_pd(_mask.hi, _b.hi))};
+}
+
+#elif defined(SPEED_CONTROLLER_KERNEL_NEON)
+
+constexpr const char *kBackendName = "neon";
+
+struct Vec4 {
+  float64x2_t lo, hi;
+};
+struct Mask4 {
+  uint64x2_t lo, hi;
+};
+
+inline Vec4 load(const double *_p) { return {vld1q_f64(_p), vld1q_f64(_p + 2)}; }
+inline void store(double *_p, Vec4 _a) {
+  vst1q_f64(_p, _a.lo);
+  vst1q_f64(_p + 2, _a.hi);
+}
+inline Vec4 set1(double _x) { return {vdupq_n_f64(_x), vdupq_n_f64(_x)}; }
+inline Vec4 operator+(Vec4 _a, Vec4 _b) {
+  return {vaddq_f64(_a.lo, _b.lo), vaddq_f64(_a.hi, _b.hi)};
+}
+inline Vec4 operator-(Vec4 _a, Vec4 _b) {
+  return {vsubq_f64(_a.lo, _b.lo), vsubq_f64(_a.hi, _b.hi)};
+}
+inline Vec4 operator*(Vec4 _a, Vec4 _b) {
+  return {vmulq_f64(_a.lo, _b.lo), vmulq_f64(_a.hi, _b.hi)};
+}
+inline Vec4 min(Vec4 _a, Vec4 _b) { return {vminq_f64(_a.lo, _b.lo), vminq_f64(_a.hi, _b.hi)}; }
+inline Vec4 max(Vec4 _a, Vec4 _b) { return {vmaxq_f64(_a.lo, _b.lo), vmaxq_f64(_a.hi, _b.hi)}; }
+inline Mask4 lessThan(Vec4 _a, Vec4 _b) {
+  return {vcltq_f64(_a.lo, _b.lo), vcltq_f64(_a.hi, _b.hi)};
+}
+inline Mask4 operator&(Mask4 _a, Mask4 _b) {
+  return {vandq_u64(_a.lo, _b.lo), vandq_u64(_a.hi, _b.hi)};
+}
+inline Vec4 select(Mask4 _mask, Vec4 _a, Vec4 _b) {
+  return {vbslq_f64(_mask.lo, _a.lo, _b.lo), vbslq_f64(_mask.hi, _a.hi, _b.hi)};
+}
+
+#else
+
+constexpr const char *kBackendName = "scalar";
+
+struct Vec4 {
+  double v[4];
+};
+struct Mask4 {
+  bool v[4];
+};
+
+inline Vec4 load(const double *_p) { return {{_p[0], _p[1], _p[2], _p[3]}}; }
+inline void store(double *_p, Vec4 _a) { std::copy(_a.v, _a.v + 4, _p); }
+inline Vec4 set1(double _x) { return {{_x, _x, _x, _x}}; }
+
+template <typename Op>
+inline Vec4 apply(Vec4 _a, Vec4 _b, Op _op) {
+  return {{_op(_a.v[0], _b.v[0]), _op(_a.v[1], _b.v[1]), _op(_a.v[2], _b.v[2]),
+           _op(_a.v[3], _b.v[3])}};
+}
+inline Vec4 operator+(Vec4 _a, Vec4 _b) {
+  return apply(_a, _b, [](double x, double y) { return x + y; });
+}
+inline Vec4 operator-(Vec4 _a, Vec4 _b) {
+  return apply(_a, _b, [](double x, double y) { return x - y; });
+}
+inline Vec4 operator*(Vec4 _a, Vec4 _b) {
+  return apply(_a, _b, [](double x, double y) { return x * y; });
+}
+inline Vec4 min(Vec4 _a, Vec4 _b) {
+  return apply(_a, _b, [](double x, double y) { return std::min(x, y); });
+}
+inline Vec4 max(Vec4 _a, Vec4 _b) {
+  return apply(_a, _b, [](double x, double y) { return std::max(x, y); });
+}
+inline Mask4 lessThan(Vec4 _a, Vec4 _b) {
+  return {{_a.v[0] < _b.v[0], _a.v[1] < _b.v[1], _a.v[2] < _b.v[2], _a.v[3] < _b.v[3]}};
+}
+inline Mask4 operator&(Mask4 _a, Mask4 _b) {
+  return {{_a.v[0] && _b.v[0], _a.v[1] && _b.v[1], _a.v[2] && _b.v[2], _a.v[3] && _b.v[3]}};
+}
+inline Vec4 select(Mask4 _mask, Vec4 _a, Vec4 _b) {
+  return {{_mask.v[0] ? _a.v[0] : _b.v[0], _mask.v[1] ? _a.v[1] : _b.v[1],
+           _mask.v[2] ? _a.v[2] : _b.v[2], _mask.v[3] ? _a.v[3] : _b.v[3]}};
+}
+
+#endif
+
+}  // namespace simd
+
+// Four doubles laid out as x, y, z, yaw
+struct alignas(32) Lanes4 {
+  double v[4] = {0.0, 0.0, 0.0, 0.0};
+
+  double &operator[](size_t _i) { return v[_i]; }
+  double operator[](size_t _i) const { return v[_i]; }
+};
+
+/**
+ * @brief PID for x, y, z and yaw in one register, with the P, I (reset on sign change and
+ * anti-windup), filtered D and output saturation steps done in one pass.
+ *
+ * The xyz lanes share the 3D gains, the fourth lane takes the yaw gains.
+ */
+class PIDKernel4D {
+public:
+  PIDKernel4D() {
+    for (size_t i = 0; i < 4; i++) {
+      output_limit_[i] = std::numeric_limits<double>::infinity();
+    }
+  }
+
+  void setGains(const PIDGains3D &_gains, const PIDGains &_yaw_gains) {
+    for (size_t i = 0; i < 3; i++) {
+      kp_[i]         = _gains.kp[i];
+      ki_[i]         = _gains.ki[i];
+      kd_[i]         = _gains.kd[i];
+      antiwindup_[i] = antiwindupLimit(_gains.antiwindup_cte);
+      alpha_[i]      = _gains.alpha;
+      reset_flag_[i] = _gains.reset_integral ? 1.0 : 0.0;
+    }
+    kp_[3]         = _yaw_gains.kp;
+    ki_[3]         = _yaw_gains.ki;
+    kd_[3]         = _yaw_gains.kd;
+    antiwindup_[3] = antiwindupLimit(_yaw_gains.antiwindup_cte);
+    alpha_[3]      = _yaw_gains.alpha;
+    reset_flag_[3] = _yaw_gains.reset_integral ? 1.0 : 0.0;
+  }
+
+  // Non-positive limits disable the saturation of that lane
+  void setOutputSaturation(const Lanes4 &_limits) {
+    for (size_t i = 0; i < 4; i++) {
+      output_limit_[i] =
+          _limits[i] > 0.0 ? _limits[i] : std::numeric_limits<double>::infinity();
+    }
+  }
+
+  void reset() {
+    integral_    = Lanes4();
+    last_error_  = Lanes4();
+    filtered_    = Lanes4();
+    initialized_ = false;
+  }
+
+  // Derivative from the finite difference of the error
+  Lanes4 computeControl(double _dt, const Lanes4 &_error) {
+    using namespace simd;
+    const Vec4 error      = load(_error.v);
+    const double inv_dt   = initialized_ && _dt > 0.0 ? 1.0 / _dt : 0.0;
+    const Vec4 derivative = (error - load(last_error_.v)) * set1(inv_dt);
+    return compute(_dt, error, derivative);
+  }
+
+  // Derivative error given explicitly, e.g. the velocity error in trajectory tracking
+  Lanes4 computeControl(double _dt, const Lanes4 &_error, const Lanes4 &_derivative_error) {
+    using namespace simd;
+    return compute(_dt, load(_error.v), load(_derivative_error.v));
+  }
+
+private:
+  Lanes4 kp_, ki_, kd_, antiwindup_, alpha_, reset_flag_, output_limit_;
+  // Controller state
+  Lanes4 integral_, last_error_, filtered_;
+  bool initialized_ = false;
+
+  static double antiwindupLimit(double _antiwindup_cte) {
+    return _antiwindup_cte > 0.0 ? _antiwindup_cte : std::numeric_limits<double>::infinity();
+  }
+
+  Lanes4 compute(double _dt, simd::Vec4 _error, simd::Vec4 _derivative) {
+    using namespace simd;
+    const Vec4 zero       = set1(0.0);
+    const Vec4 last_error = load(last_error_.v);
+
+    // Integral, reset when the error changes sign, clamped by the anti-windup limit
+    Vec4 integral         = load(integral_.v) + _error * set1(_dt);
+    const Mask4 sign_flip = lessThan(_error * last_error, zero);
+    const Mask4 reset     = lessThan(zero, load(reset_flag_.v)) & sign_flip;
+    integral              = select(reset, zero, integral);
+    const Vec4 antiwindup = load(antiwindup_.v);
+    integral              = min(max(integral, zero - antiwindup), antiwindup);
+
+    // Low-pass filtered derivative
+    const Vec4 alpha    = load(alpha_.v);
+    const Vec4 filtered = alpha * _derivative + (set1(1.0) - alpha) * load(filtered_.v);
+
+    Vec4 output = load(kp_.v) * _error + load(ki_.v) * integral + load(kd_.v) * filtered;
+    const Vec4 limit = load(output_limit_.v);
+    output           = min(max(output, zero - limit), limit);
+
+    store(integral_.v, integral);
+    store(filtered_.v, filtered);
+    store(last_error_.v, _error);
+    initialized_ = true;
+
+    Lanes4 result;
+    store(result.v, output);
+    return result;
+  }
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
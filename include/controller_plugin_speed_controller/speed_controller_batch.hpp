@@ -0,0 +1,156 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_batch.hpp
+ *  \brief      Structure-of-arrays speed controller engine for many vehicles.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_BATCH_H__
+#define __SP_BATCH_H__
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "as2_msgs/msg/control_mode.hpp"
+#include "speed_controller_gains.hpp"
+#include "speed_controller_types.hpp"
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief Speed controller for N vehicles with state, references and PID internals stored as
+ * structure of arrays, so one computeOutput call runs every vehicle in a single pass.
+ *
+ * Each slot behaves as a Plugin in POSITION (or HOVER), SPEED or TRAJECTORY mode, with
+ * YAW_ANGLE or YAW_SPEED. Speed limits equal to zero leave that axis unsaturated.
+ */
+class SpeedControllerBatch {
+public:
+  using Array = std::vector<double, Eigen::aligned_allocator<double>>;
+
+  explicit SpeedControllerBatch(size_t _size = 0);
+
+  void resize(size_t _size);
+  size_t size() const { return size_; }
+
+  // Gains are stored per slot and loaded into the active controller on setMode
+  void setGains(size_t _slot, const ControllerGains &_gains);
+  const ControllerGains &getGains(size_t _slot) const { return gains_[_slot]; }
+
+  bool setMode(size_t _slot,
+               uint8_t _control_mode,
+               uint8_t _yaw_mode,
+               bool _use_bypass              = false,
+               bool _proportional_limitation = false);
+
+  void setSpeedLimits(size_t _slot, const Eigen::Vector3d &_speed_limits);
+
+  // Same convention as the plugin: yaw.x() is the angle and yaw.y() the yaw rate
+  void updateState(size_t _slot, const UAV_state &_state);
+  void updateReference(size_t _slot, const UAV_state &_reference);
+
+  void reset(size_t _slot);
+
+  // Compute the command of every slot for the same dt
+  void computeOutput(double _dt);
+
+  UAV_command getOutput(size_t _slot) const;
+
+private:
+  // One axis of every slot
+  struct AxisColumns {
+    Array position;
+    Array velocity;
+    Array ref_position;
+    Array ref_velocity;
+    Array speed_limit;
+    Array kp;
+    Array ki;
+    Array kd;
+    Array integral;
+    Array last_error;
+    Array filtered_derivative;
+    Array command;
+  };
+
+  // Per slot scalars
+  struct SlotColumns {
+    Array antiwindup_cte;
+    Array alpha;
+    Array reset_integral;
+    Array speed_mask;
+    Array trajectory_mask;
+    Array bypass_mask;
+    Array saturation_mask;
+    Array proportional_mask;
+    Array initialized;
+  };
+
+  struct YawColumns {
+    Array yaw;
+    Array ref_yaw;
+    Array ref_yaw_rate;
+    Array kp;
+    Array ki;
+    Array kd;
+    Array antiwindup_cte;
+    Array alpha;
+    Array reset_integral;
+    Array angle_mask;
+    Array integral;
+    Array last_error;
+    Array filtered_derivative;
+    Array command;
+  };
+
+  size_t size_ = 0;
+  std::array<AxisColumns, 3> axes_;
+  SlotColumns slots_;
+  YawColumns yaw_;
+
+  // Cold configuration
+  std::vector<ControllerGains> gains_;
+  std::vector<uint8_t> control_mode_;
+  std::vector<uint8_t> yaw_mode_;
+
+  void loadActiveGains(size_t _slot);
+  void computeAxis(AxisColumns &_axis, double _dt, double _inv_dt);
+  void saturate();
+  void computeYaw(double _dt, double _inv_dt);
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,335 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_control_law.hpp
+ *  \brief      Control law of the speed controller templated on its scalar type.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_CONTROL_LAW_H__
+#define __SP_CONTROL_LAW_H__
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "as2_msgs/msg/control_mode.hpp"
+#include "speed_controller_fixed_point.hpp"
+#include "speed_controller_gains.hpp"
+#include "speed_controller_types.hpp"
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief Position, speed, speed in a plane, trajectory and yaw control law of a single vehicle,
+ * with every internal computed in Scalar (double, float or FixedQ16).
+ *
+ * Same semantics as the plugin pipelines and SpeedControllerBatch: the integral is reset on an
+ * error sign change when reset_integral is set and clamped by a positive antiwindup_cte, the
+ * derivative is low-pass filtered and zero on the first tick after a reset, and POSITION, HOVER
+ * and TRAJECTORY commands are saturated by the speed limits. Only the interface is in double.
+ */
+template <typename Scalar>
+class ControlLaw {
+public:
+  void setGains(const ControllerGains &_gains) {
+    gains_ = _gains;
+    loadActiveGains();
+  }
+
+  bool setMode(uint8_t _control_mode,
+               uint8_t _yaw_mode,
+               bool _use_bypass              = false,
+               bool _proportional_limitation = false) {
+    using as2_msgs::msg::ControlMode;
+
+    switch (_control_mode) {
+      case ControlMode::HOVER:
+      case ControlMode::POSITION:
+      case ControlMode::SPEED:
+      case ControlMode::SPEED_IN_A_PLANE:
+      case ControlMode::TRAJECTORY:
+        break;
+      default:
+        return false;
+    }
+    if (_yaw_mode != ControlMode::YAW_ANGLE && _yaw_mode != ControlMode::YAW_SPEED) {
+      return false;
+    }
+    control_mode_            = _control_mode;
+    use_bypass_              = _use_bypass;
+    proportional_limitation_ = _proportional_limitation;
+    // HOVER always holds the yaw angle, as in the plugin
+    yaw_mode_ = _control_mode == ControlMode::HOVER ? ControlMode::YAW_ANGLE : _yaw_mode;
+    loadActiveGains();
+    reset();
+    return true;
+  }
+
+  // Zero limits leave that axis unsaturated
+  void setSpeedLimits(const Eigen::Vector3d &_speed_limits) {
+    for (size_t i = 0; i < 3; i++) {
+      speed_limits_[i] = Scalar(std::abs(_speed_limits[i]));
+    }
+  }
+
+  // Same convention as the plugin: yaw.x() is the angle and yaw.y() the yaw rate
+  void updateState(const UAV_state &_state) {
+    for (size_t i = 0; i < 3; i++) {
+      position_[i] = Scalar(_state.position[i]);
+      velocity_[i] = Scalar(_state.velocity[i]);
+    }
+    yaw_ = Scalar(_state.yaw.x());
+  }
+
+  void updateReference(const UAV_state &_reference) {
+    for (size_t i = 0; i < 3; i++) {
+      ref_position_[i] = Scalar(_reference.position[i]);
+      ref_velocity_[i] = Scalar(_reference.velocity[i]);
+    }
+    ref_yaw_      = Scalar(_reference.yaw.x());
+    ref_yaw_rate_ = Scalar(_reference.yaw.y());
+  }
+
+  void reset() {
+    for (auto &loop : axes_) {
+      loop.resetState();
+    }
+    yaw_loop_.resetState();
+    command_     = {Scalar(0.0), Scalar(0.0), Scalar(0.0)};
+    yaw_command_ = Scalar(0.0);
+    initialized_ = false;
+  }
+
+  void computeOutput(double _dt) {
+    using as2_msgs::msg::ControlMode;
+
+    const Scalar dt     = Scalar(_dt);
+    const Scalar inv_dt = Scalar(initialized_ && _dt > 0.0 ? 1.0 / _dt : 0.0);
+
+    switch (control_mode_) {
+      case ControlMode::HOVER:
+      case ControlMode::POSITION:
+        for (size_t i = 0; i < 3; i++) {
+          command_[i] = axes_[i].compute(dt, inv_dt, ref_position_[i] - position_[i]);
+        }
+        saturate();
+        break;
+      case ControlMode::SPEED:
+        for (size_t i = 0; i < 3; i++) {
+          command_[i] = use_bypass_
+                            ? ref_velocity_[i]
+                            : axes_[i].compute(dt, inv_dt, ref_velocity_[i] - velocity_[i]);
+        }
+        break;
+      case ControlMode::SPEED_IN_A_PLANE:
+        for (size_t i = 0; i < 2; i++) {
+          command_[i] = use_bypass_
+                            ? ref_velocity_[i]
+                            : axes_[i].compute(dt, inv_dt, ref_velocity_[i] - velocity_[i]);
+        }
+        command_[2] = axes_[2].compute(dt, inv_dt, ref_position_[2] - position_[2]);
+        break;
+      case ControlMode::TRAJECTORY:
+        for (size_t i = 0; i < 3; i++) {
+          command_[i] = axes_[i].computeWithDerivative(dt, ref_position_[i] - position_[i],
+                                                       ref_velocity_[i] - velocity_[i]);
+        }
+        saturate();
+        break;
+      default:
+        return;
+    }
+
+    if (yaw_mode_ == ControlMode::YAW_ANGLE) {
+      using std::floor;
+      // Shortest angular distance, in [-pi, pi)
+      const Scalar raw_error = ref_yaw_ - yaw_;
+      const Scalar error     = raw_error - kTwoPi * floor(raw_error * kInvTwoPi + Scalar(0.5));
+      yaw_command_           = yaw_loop_.compute(dt, inv_dt, error);
+    } else {
+      yaw_command_ = ref_yaw_rate_;
+    }
+    initialized_ = true;
+  }
+
+  UAV_command getOutput() const {
+    UAV_command command;
+    command.velocity  = Eigen::Vector3d(static_cast<double>(command_[0]),
+                                        static_cast<double>(command_[1]),
+                                        static_cast<double>(command_[2]));
+    command.yaw_speed = static_cast<double>(yaw_command_);
+    return command;
+  }
+
+private:
+  using Vector = std::array<Scalar, 3>;
+
+  static constexpr double kTwoPiValue = 2.0 * M_PI;
+  inline static const Scalar kTwoPi    = Scalar(kTwoPiValue);
+  inline static const Scalar kInvTwoPi = Scalar(1.0 / kTwoPiValue);
+
+  // Gains and state of one PID loop
+  struct Loop {
+    Scalar kp           = Scalar(0.0);
+    Scalar ki           = Scalar(0.0);
+    Scalar kd           = Scalar(0.0);
+    Scalar antiwindup   = Scalar(0.0);
+    Scalar alpha        = Scalar(0.0);
+    bool reset_integral = false;
+    Scalar integral     = Scalar(0.0);
+    Scalar last_error   = Scalar(0.0);
+    Scalar filtered     = Scalar(0.0);
+
+    void setGains(const PIDGains3D &_gains, size_t _axis) {
+      setGains(_gains.kp[_axis], _gains.ki[_axis], _gains.kd[_axis], _gains.antiwindup_cte,
+               _gains.alpha, _gains.reset_integral);
+    }
+
+    void setGains(const PIDGains &_gains) {
+      setGains(_gains.kp, _gains.ki, _gains.kd, _gains.antiwindup_cte, _gains.alpha,
+               _gains.reset_integral);
+    }
+
+    void setGains(double _kp,
+                  double _ki,
+                  double _kd,
+                  double _antiwindup,
+                  double _alpha,
+                  bool _reset_integral) {
+      kp             = Scalar(_kp);
+      ki             = Scalar(_ki);
+      kd             = Scalar(_kd);
+      antiwindup     = Scalar(std::max(0.0, _antiwindup));
+      alpha          = Scalar(_alpha);
+      reset_integral = _reset_integral;
+    }
+
+    void resetState() {
+      integral   = Scalar(0.0);
+      last_error = Scalar(0.0);
+      filtered   = Scalar(0.0);
+    }
+
+    // Derivative from the finite difference of the error, _inv_dt is zero on the first tick
+    Scalar compute(Scalar _dt, Scalar _inv_dt, Scalar _error) {
+      return computeWithDerivative(_dt, _error, (_error - last_error) * _inv_dt);
+    }
+
+    Scalar computeWithDerivative(Scalar _dt, Scalar _error, Scalar _derivative) {
+      const Scalar zero  = Scalar(0.0);
+      Scalar accumulated = integral + _error * _dt;
+      if (reset_integral && _error * last_error < zero) {
+        accumulated = zero;
+      }
+      if (antiwindup > zero) {
+        accumulated = std::min(std::max(accumulated, zero - antiwindup), antiwindup);
+      }
+      integral   = accumulated;
+      filtered   = alpha * _derivative + (Scalar(1.0) - alpha) * filtered;
+      last_error = _error;
+      return kp * _error + ki * integral + kd * filtered;
+    }
+  };
+
+  ControllerGains gains_;
+  uint8_t control_mode_         = as2_msgs::msg::ControlMode::UNSET;
+  uint8_t yaw_mode_             = as2_msgs::msg::ControlMode::YAW_ANGLE;
+  bool use_bypass_              = false;
+  bool proportional_limitation_ = false;
+  bool initialized_             = false;
+
+  std::array<Loop, 3> axes_;
+  Loop yaw_loop_;
+
+  Vector position_     = {};
+  Vector velocity_     = {};
+  Vector ref_position_ = {};
+  Vector ref_velocity_ = {};
+  Vector speed_limits_ = {};
+  Scalar yaw_          = Scalar(0.0);
+  Scalar ref_yaw_      = Scalar(0.0);
+  Scalar ref_yaw_rate_ = Scalar(0.0);
+
+  Vector command_     = {};
+  Scalar yaw_command_ = Scalar(0.0);
+
+  void loadActiveGains() {
+    using as2_msgs::msg::ControlMode;
+
+    const PIDGains3D *active = &gains_.position;
+    if (control_mode_ == ControlMode::SPEED) {
+      active = &gains_.speed;
+    } else if (control_mode_ == ControlMode::SPEED_IN_A_PLANE) {
+      active = &gains_.speed_in_a_plane_speed;
+    } else if (control_mode_ == ControlMode::TRAJECTORY) {
+      active = &gains_.trajectory;
+    }
+    for (size_t i = 0; i < 3; i++) {
+      axes_[i].setGains(*active, i);
+    }
+    // The height loop of SPEED_IN_A_PLANE controls the position on z
+    if (control_mode_ == ControlMode::SPEED_IN_A_PLANE) {
+      axes_[2].setGains(gains_.speed_in_a_plane_height);
+    }
+    yaw_loop_.setGains(gains_.yaw);
+  }
+
+  // Per-axis clamp, or uniform scaling of the whole vector with proportional limitation
+  void saturate() {
+    using std::abs;
+    const Scalar zero = Scalar(0.0);
+    if (proportional_limitation_) {
+      Scalar scale = Scalar(1.0);
+      for (size_t i = 0; i < 3; i++) {
+        const Scalar magnitude = abs(command_[i]);
+        if (speed_limits_[i] > zero && magnitude > speed_limits_[i]) {
+          scale = std::min(scale, speed_limits_[i] / magnitude);
+        }
+      }
+      for (auto &value : command_) {
+        value = value * scale;
+      }
+      return;
+    }
+    for (size_t i = 0; i < 3; i++) {
+      if (speed_limits_[i] > zero) {
+        command_[i] = std::min(std::max(command_[i], zero - speed_limits_[i]), speed_limits_[i]);
+      }
+    }
+  }
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,122 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_control_thread.hpp
+ *  \brief      Periodic control thread with real-time scheduling, CPU pinning and locked memory.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_CONTROL_THREAD_H__
+#define __SP_CONTROL_THREAD_H__
+
+#include <pthread.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace controller_plugin_speed_controller {
+
+struct RealtimeSettings {
+  int priority     = 0;     // SCHED_FIFO priority, 0 keeps the default scheduler
+  int cpu          = -1;    // Core the thread is pinned to, negative for any
+  double period    = 0.01;  // [s]
+  bool lock_memory = true;  // mlockall the current and future pages of the process
+};
+
+// What start() could apply, the thread runs without the settings that failed
+struct RealtimeStatus {
+  bool started       = false;
+  bool scheduling    = false;
+  bool affinity      = false;
+  bool memory_locked = false;
+};
+
+/**
+ * @brief Thread calling a tick function at a fixed period, with the measured dt.
+ *
+ * Ticks are scheduled on absolute CLOCK_MONOTONIC deadlines, so the period does not drift with
+ * the tick duration. A tick that ends past the next deadline counts as an overrun and the
+ * schedule restarts from it instead of running the missed ticks back to back.
+ */
+class ControlThread {
+public:
+  using Tick = std::function<void(double)>;
+
+  ControlThread() = default;
+  ControlThread(const ControlThread &) = delete;
+  ControlThread &operator=(const ControlThread &) = delete;
+  ~ControlThread();
+
+  // Stops a running thread first. Not thread safe, start and stop from the same thread
+  RealtimeStatus start(const RealtimeSettings &_settings, Tick _tick);
+  void stop();
+
+  bool running() const { return thread_.joinable(); }
+  uint64_t ticks() const { return ticks_.load(std::memory_order_relaxed); }
+  uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+
+private:
+  void run(int64_t _period_ns);
+
+  Tick tick_;
+  std::thread thread_;
+  std::atomic<bool> stop_requested_{false};
+  std::atomic<uint64_t> ticks_{0};
+  std::atomic<uint64_t> overruns_{0};
+};
+
+/**
+ * @brief Mutex with priority inheritance, usable with the std lock types.
+ *
+ * A thread holding it runs at the priority of the highest priority thread blocked on it, so a
+ * control thread that has to wait only waits for the critical section itself. Without support
+ * for the protocol it behaves as a plain mutex.
+ */
+class PiMutex {
+public:
+  PiMutex();
+  PiMutex(const PiMutex &) = delete;
+  PiMutex &operator=(const PiMutex &) = delete;
+  ~PiMutex();
+
+  void lock();
+  bool try_lock();
+  void unlock();
+
+private:
+  pthread_mutex_t mutex_;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,165 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_dt_conditioner.hpp
+ *  \brief      Clamping and outlier rejection of the control tick dt.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_DT_CONDITIONER_H__
+#define __SP_DT_CONDITIONER_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace controller_plugin_speed_controller {
+
+// Corrections applied to the dt of a tick
+enum class DtCorrection : uint8_t {
+  CLAMPED_LOW = 0,  // Below min_dt
+  CLAMPED_HIGH,     // Above max_dt
+  OUTLIER,          // Too far from the running mean, replaced by it
+  COUNT
+};
+
+/**
+ * @brief Conditions the dt of each control tick before it reaches the PIDs.
+ *
+ * The dt is clamped to [min_dt, max_dt] and then compared to an exponential running mean of
+ * the clamped values: ticks more than outlier_ratio times shorter or longer than the mean use
+ * the mean instead. The mean follows every clamped dt, so a lasting change of rate stops being
+ * rejected after a few ticks. Counters and the mean are relaxed atomics, readable from another
+ * thread.
+ */
+class DtConditioner {
+public:
+  static constexpr double kMeanWeight     = 1.0 / 16.0;
+  static constexpr size_t kNumCorrections = static_cast<size_t>(DtCorrection::COUNT);
+
+  void setMinDt(double _min_dt) { min_dt_ = std::max(0.0, _min_dt); }
+  // Non-positive values leave dt unbounded above
+  void setMaxDt(double _max_dt) {
+    max_dt_ = _max_dt > 0.0 ? _max_dt : std::numeric_limits<double>::max();
+  }
+
+  // Ratios not above 1 disable the outlier rejection
+  void setOutlierRatio(double _ratio) { outlier_ratio_ = _ratio; }
+
+  // Rate the filters are tuned for, also the starting value of the running mean
+  void setNominalDt(double _nominal_dt) {
+    nominal_dt_ = _nominal_dt > 0.0 ? _nominal_dt : kDefaultNominalDt;
+    mean_dt_.store(nominal_dt_, std::memory_order_relaxed);
+  }
+
+  double nominalDt() const { return nominal_dt_; }
+  double meanDt() const { return mean_dt_.load(std::memory_order_relaxed); }
+
+  double condition(double _dt) {
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+
+    bool corrected = false;
+    double dt      = _dt;
+    if (dt < min_dt_) {
+      dt = min_dt_;
+      count(DtCorrection::CLAMPED_LOW, corrected);
+    } else if (dt > max_dt_) {
+      dt = max_dt_;
+      count(DtCorrection::CLAMPED_HIGH, corrected);
+    }
+
+    // Only condition() writes the mean, a load and a store need no read-modify-write
+    const double mean = mean_dt_.load(std::memory_order_relaxed);
+    mean_dt_.store(mean + kMeanWeight * (dt - mean), std::memory_order_relaxed);
+    if (outlier_ratio_ > 1.0 && (dt > mean * outlier_ratio_ || dt * outlier_ratio_ < mean)) {
+      dt = mean;
+      count(DtCorrection::OUTLIER, corrected);
+    }
+
+    if (corrected) {
+      corrected_ticks_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return dt;
+  }
+
+  uint64_t ticks() const { return ticks_.load(std::memory_order_relaxed); }
+  // Ticks with at least one correction
+  uint64_t correctedTicks() const { return corrected_ticks_.load(std::memory_order_relaxed); }
+  uint64_t corrections(DtCorrection _correction) const {
+    return corrections_[static_cast<size_t>(_correction)].load(std::memory_order_relaxed);
+  }
+
+  void resetCounters() {
+    ticks_.store(0, std::memory_order_relaxed);
+    corrected_ticks_.store(0, std::memory_order_relaxed);
+    for (auto &counter : corrections_) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  static constexpr double kDefaultNominalDt = 0.01;
+
+  void count(DtCorrection _correction, bool &_corrected) {
+    corrections_[static_cast<size_t>(_correction)].fetch_add(1, std::memory_order_relaxed);
+    _corrected = true;
+  }
+
+  double min_dt_        = 0.0;
+  double max_dt_        = std::numeric_limits<double>::max();
+  double outlier_ratio_ = 0.0;
+  double nominal_dt_    = kDefaultNominalDt;
+
+  std::atomic<double> mean_dt_{kDefaultNominalDt};
+  std::atomic<uint64_t> ticks_{0};
+  std::atomic<uint64_t> corrected_ticks_{0};
+  std::array<std::atomic<uint64_t>, kNumCorrections> corrections_{};
+};
+
+/**
+ * @brief Weight of the new sample in a first-order filter tuned as _alpha at _nominal_dt, for a
+ * tick of _dt: the filter pole (1 - alpha) is raised to dt / nominal_dt, so the filter keeps its
+ * time constant whatever the tick length.
+ */
+inline double discreteFilterAlpha(double _alpha, double _dt, double _nominal_dt) {
+  if (_nominal_dt <= 0.0 || _alpha <= 0.0 || _alpha >= 1.0) {
+    return _alpha;
+  }
+  return 1.0 - std::pow(1.0 - _alpha, _dt / _nominal_dt);
+}
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
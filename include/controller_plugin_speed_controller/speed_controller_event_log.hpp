@@ -0,0 +1,152 @@
+/*!*******************************************************************************************
+ *  \file       include/controller_plugin_speed_controller/speed_controller_event_log.hpp
+ *  \brief      Throttled, non-blocking log events for the control path.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#ifndef __SP_EVENT_LOG_H__
+#define __SP_EVENT_LOG_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace controller_plugin_speed_controller {
+
+// Errors and warnings of the control path, formatted by the drain thread
+enum class LogEvent : uint8_t {
+  POSE_FRAME_MISMATCH = 0,  // frame: received, expected_frame: desired
+  TWIST_CONVERSION,         // expected_frame: target, detail: TF error
+  JOINT_TRAJECTORY_WITHOUT_XYZ,
+  REFERENCE_QUEUE_FULL,
+  TRAJECTORY_BUFFER_FULL,
+  LIMIT_PROFILE_REJECTED,  // Knots out of order or more than the profile capacity
+  STATE_NOT_RECEIVED,
+  REFERENCE_NOT_RECEIVED,
+  UNKNOWN_CONTROL_MODE,
+  UNKNOWN_YAW_MODE,
+  COUNT
+};
+
+struct LogRecord {
+  static constexpr size_t kDetailSize = 96;
+  static constexpr uint8_t kNoFrame   = 0xff;  // Not one of the plugin frames, or not relevant
+
+  LogEvent event         = LogEvent::COUNT;
+  uint8_t frame          = kNoFrame;  // Frame ids are captured by their index in the plugin
+  uint8_t expected_frame = kNoFrame;
+  uint64_t suppressed    = 0;  // Throttled reports of the same event since the previous record
+  std::array<char, kDetailSize> detail{};  // Truncated, always NUL terminated
+};
+
+/**
+ * @brief Rate-limited channel of log events from the control path to a low-priority thread.
+ *
+ * report() counts the event and, at most once per throttle period and event, copies a record
+ * into a preallocated multi-producer ring, without locking nor allocating. The drain thread
+ * pops the records and hands them to the sink, which does the formatting and the actual logging
+ * away from the control loop. Records that do not fit in the ring are counted as dropped.
+ *
+ * A single drain thread serves every started log of the process, it runs while at least one is
+ * started.
+ */
+class EventLog {
+public:
+  static constexpr size_t kCapacity  = 64;
+  static constexpr size_t kNumEvents = static_cast<size_t>(LogEvent::COUNT);
+
+  using Sink = std::function<void(const LogRecord &)>;
+
+  explicit EventLog(std::chrono::nanoseconds _throttle_period = std::chrono::seconds(5));
+  EventLog(const EventLog &)            = delete;
+  EventLog &operator=(const EventLog &) = delete;
+  ~EventLog();
+
+  void setThrottlePeriod(std::chrono::nanoseconds _throttle_period) {
+    throttle_period_ns_.store(_throttle_period.count(), std::memory_order_relaxed);
+  }
+
+  // Safe from any thread. True if a record was queued, false if throttled or dropped
+  bool report(LogEvent _event,
+              uint8_t _frame          = LogRecord::kNoFrame,
+              uint8_t _expected_frame = LogRecord::kNoFrame,
+              const char *_detail     = nullptr);
+
+  // Hands the queued records to _sink, from a single consumer. Returns the records drained
+  size_t drain(const Sink &_sink);
+
+  // Drained every _period, or the shortest period of the started logs, on the shared thread at
+  // the lowest scheduling priority. Not thread safe, start and stop from the same thread; stop
+  // drains what is left and returns once the thread no longer uses the sink
+  void start(Sink _sink, std::chrono::milliseconds _period = std::chrono::milliseconds(100));
+  void stop();
+
+  uint64_t count(LogEvent _event) const {
+    return counts_[static_cast<size_t>(_event)].load(std::memory_order_relaxed);
+  }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  friend class EventLogDrain;
+
+  struct Slot {
+    std::atomic<size_t> sequence{0};
+    LogRecord record;
+  };
+
+  static constexpr size_t kMask = kCapacity - 1;
+  static_assert((kCapacity & kMask) == 0, "EventLog capacity must be a power of two");
+
+  bool push(const LogRecord &_record);
+  bool pop(LogRecord &_record);
+
+  std::atomic<int64_t> throttle_period_ns_;
+  std::array<std::atomic<uint64_t>, kNumEvents> counts_{};
+  std::array<std::atomic<uint64_t>, kNumEvents> suppressed_{};
+  std::array<std::atomic<int64_t>, kNumEvents> last_report_ns_{};
+  std::atomic<uint64_t> dropped_{0};
+
+  // Bounded ring with a sequence number per slot, producers claim slots on tail_
+  std::array<Slot, kCapacity> slots_;
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) size_t head_ = 0;
+
+  Sink sink_;
+  bool started_ = false;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
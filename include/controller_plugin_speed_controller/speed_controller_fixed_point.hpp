@@ -0,0 +1,137 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_fixed_point.hpp
+ *  \brief      Q16.16 fixed point scalar for the portable control law.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_FIXED_POINT_H__
+#define __SP_FIXED_POINT_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief Signed Q16.16 fixed point number: 16 integer bits, 16 fractional bits, resolution
+ * 1.5e-5 and range [-32768, 32768).
+ *
+ * Arithmetic saturates at the range limits instead of wrapping, products and quotients are
+ * rounded to the nearest representable value.
+ */
+class FixedQ16 {
+public:
+  static constexpr int kFractionalBits = 16;
+  static constexpr int32_t kOne        = int32_t{1} << kFractionalBits;
+
+  constexpr FixedQ16() = default;
+  constexpr explicit FixedQ16(double _value) : raw_(roundSaturated(_value)) {}
+
+  static constexpr FixedQ16 fromRaw(int32_t _raw) {
+    FixedQ16 value;
+    value.raw_ = _raw;
+    return value;
+  }
+
+  constexpr int32_t raw() const { return raw_; }
+  constexpr explicit operator double() const { return static_cast<double>(raw_) / kOne; }
+
+  friend constexpr FixedQ16 operator+(FixedQ16 _a, FixedQ16 _b) {
+    return fromRaw(saturate(int64_t{_a.raw_} + _b.raw_));
+  }
+  friend constexpr FixedQ16 operator-(FixedQ16 _a, FixedQ16 _b) {
+    return fromRaw(saturate(int64_t{_a.raw_} - _b.raw_));
+  }
+  friend constexpr FixedQ16 operator-(FixedQ16 _a) { return fromRaw(saturate(-int64_t{_a.raw_})); }
+  friend constexpr FixedQ16 operator*(FixedQ16 _a, FixedQ16 _b) {
+    const int64_t product = int64_t{_a.raw_} * _b.raw_;
+    return fromRaw(saturate((product + (int64_t{1} << (kFractionalBits - 1))) >> kFractionalBits));
+  }
+  friend constexpr FixedQ16 operator/(FixedQ16 _a, FixedQ16 _b) {
+    if (_b.raw_ == 0) {
+      return fromRaw(_a.raw_ < 0 ? std::numeric_limits<int32_t>::min()
+                                 : std::numeric_limits<int32_t>::max());
+    }
+    const int64_t numerator = int64_t{_a.raw_} * kOne;
+    const int64_t half      = (_b.raw_ < 0 ? -int64_t{_b.raw_} : int64_t{_b.raw_}) / 2;
+    const int64_t rounded   =
+        (numerator < 0) == (_b.raw_ < 0) ? numerator + half : numerator - half;
+    return fromRaw(saturate(rounded / _b.raw_));
+  }
+
+  FixedQ16 &operator+=(FixedQ16 _b) { return *this = *this + _b; }
+  FixedQ16 &operator-=(FixedQ16 _b) { return *this = *this - _b; }
+  FixedQ16 &operator*=(FixedQ16 _b) { return *this = *this * _b; }
+
+  friend constexpr bool operator==(FixedQ16 _a, FixedQ16 _b) { return _a.raw_ == _b.raw_; }
+  friend constexpr bool operator!=(FixedQ16 _a, FixedQ16 _b) { return _a.raw_ != _b.raw_; }
+  friend constexpr bool operator<(FixedQ16 _a, FixedQ16 _b) { return _a.raw_ < _b.raw_; }
+  friend constexpr bool operator>(FixedQ16 _a, FixedQ16 _b) { return _a.raw_ > _b.raw_; }
+  friend constexpr bool operator<=(FixedQ16 _a, FixedQ16 _b) { return _a.raw_ <= _b.raw_; }
+  friend constexpr bool operator>=(FixedQ16 _a, FixedQ16 _b) { return _a.raw_ >= _b.raw_; }
+
+  // Found by argument dependent lookup from the scalar-generic control law
+  friend constexpr FixedQ16 abs(FixedQ16 _a) { return _a.raw_ < 0 ? -_a : _a; }
+  friend constexpr FixedQ16 floor(FixedQ16 _a) {
+    // Arithmetic shift rounds towards negative infinity
+    return fromRaw(saturate(int64_t{_a.raw_ >> kFractionalBits} * kOne));
+  }
+
+private:
+  int32_t raw_ = 0;
+
+  static constexpr int32_t saturate(int64_t _raw) {
+    return static_cast<int32_t>(std::clamp<int64_t>(_raw, std::numeric_limits<int32_t>::min(),
+                                                    std::numeric_limits<int32_t>::max()));
+  }
+
+  // Rounded and clamped in double, the conversion is undefined out of range. NaN maps to zero
+  static constexpr int32_t roundSaturated(double _value) {
+    const double raw = _value * kOne + (_value < 0.0 ? -0.5 : 0.5);
+    if (raw != raw) {
+      return 0;
+    }
+    if (raw >= std::numeric_limits<int32_t>::max()) {
+      return std::numeric_limits<int32_t>::max();
+    }
+    if (raw <= std::numeric_limits<int32_t>::min()) {
+      return std::numeric_limits<int32_t>::min();
+    }
+    return static_cast<int32_t>(raw);
+  }
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,141 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_gains.hpp
+ *  \brief      Complete PID gain sets and lock-free hand-off between parameter and control threads.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_GAINS_H__
+#define __SP_GAINS_H__
+
+#include <Eigen/Dense>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "pid_controller/PID.hpp"
+#include "pid_controller/PID_3D.hpp"
+
+namespace controller_plugin_speed_controller {
+
+struct PIDGains {
+  double kp             = 0.0;
+  double ki             = 0.0;
+  double kd             = 0.0;
+  double antiwindup_cte = 0.0;
+  double alpha          = 0.0;
+  bool reset_integral   = false;
+};
+
+struct PIDGains3D {
+  Eigen::Vector3d kp    = Eigen::Vector3d::Zero();
+  Eigen::Vector3d ki    = Eigen::Vector3d::Zero();
+  Eigen::Vector3d kd    = Eigen::Vector3d::Zero();
+  double antiwindup_cte = 0.0;
+  double alpha          = 0.0;
+  bool reset_integral   = false;
+};
+
+// Gains of every controller of the plugin, published as a whole
+struct ControllerGains {
+  PIDGains3D position;
+  PIDGains3D speed;
+  PIDGains3D trajectory;
+  PIDGains3D speed_in_a_plane_speed;
+  PIDGains speed_in_a_plane_height;
+  PIDGains yaw;
+};
+
+inline void applyGains(const PIDGains &_gains, pid_controller::PIDController &_pid) {
+  _pid.setGainKp(_gains.kp);
+  _pid.setGainKi(_gains.ki);
+  _pid.setGainKd(_gains.kd);
+  _pid.setAntiWindup(_gains.antiwindup_cte);
+  _pid.setAlpha(_gains.alpha);
+  _pid.setResetIntegralSaturationFlag(_gains.reset_integral);
+}
+
+inline void applyGains(const PIDGains3D &_gains, pid_controller::PIDController3D &_pid) {
+  _pid.setGainKpX(_gains.kp.x());
+  _pid.setGainKpY(_gains.kp.y());
+  _pid.setGainKpZ(_gains.kp.z());
+  _pid.setGainKiX(_gains.ki.x());
+  _pid.setGainKiY(_gains.ki.y());
+  _pid.setGainKiZ(_gains.ki.z());
+  _pid.setGainKdX(_gains.kd.x());
+  _pid.setGainKdY(_gains.kd.y());
+  _pid.setGainKdZ(_gains.kd.z());
+  _pid.setAntiWindup(_gains.antiwindup_cte);
+  _pid.setAlpha(_gains.alpha);
+  _pid.setResetIntegralSaturationFlag(_gains.reset_integral);
+}
+
+/**
+ * @brief Wait-free single producer / single consumer triple buffer
+ *
+ * The producer fills back() and calls publish(), the consumer calls update() and reads front().
+ * Neither side ever blocks and the consumer always sees a complete value.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+  // Producer side
+  T &back() { return buffers_[back_]; }
+
+  void publish() {
+    back_ = middle_.exchange(back_ | kDirtyBit, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  // Consumer side, returns true if a new value was taken
+  bool update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kDirtyBit)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  const T &front() const { return buffers_[front_]; }
+
+private:
+  static constexpr uint8_t kIndexMask = 0x03;
+  static constexpr uint8_t kDirtyBit  = 0x04;
+
+  std::array<T, 3> buffers_{};
+  uint8_t back_  = 0;
+  uint8_t front_ = 1;
+  std::atomic<uint8_t> middle_{2};
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,127 @@
+/*!*******************************************************************************************
+ *  \file       include/controller_plugin_speed_controller/speed_controller_limit_profile.hpp
+ *  \brief      Time-scheduled speed limit profiles.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#ifndef __SP_LIMIT_PROFILE_H__
+#define __SP_LIMIT_PROFILE_H__
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstddef>
+
+namespace controller_plugin_speed_controller {
+
+struct SpeedLimitKnot {
+  double time            = 0.0;  // [s], on the clock of the trajectory references
+  Eigen::Vector3d limits = Eigen::Vector3d::Zero();
+};
+
+/**
+ * @brief Speed limits scheduled over time, e.g. ramping the maximum speed along a segment.
+ *
+ * The limits are linearly interpolated between knots, the first one is held before the
+ * profile starts and the last one after it ends. Evaluation is lazy: update() only
+ * interpolates the knots around the requested time, moving forward through them as time
+ * advances, and reports whether the limits changed since the previous call, so the
+ * controllers are only reconfigured on actual changes. Once past the last knot it costs a
+ * single comparison.
+ */
+class SpeedLimitProfile {
+public:
+  static constexpr size_t kCapacity = 32;
+
+  void clear() {
+    size_      = 0;
+    cursor_    = 0;
+    settled_   = false;
+    last_time_ = 0.0;
+  }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // Knots must be strictly increasing in time, a full profile or a knot out of order is
+  // rejected
+  bool push(const SpeedLimitKnot &_knot) {
+    if (size_ == kCapacity || (size_ > 0 && _knot.time <= knots_[size_ - 1].time)) {
+      return false;
+    }
+    knots_[size_++] = _knot;
+    settled_        = false;
+    return true;
+  }
+
+  // Limits at _time into _limits, true if they differ from the ones previously written. Time
+  // is expected to move forward, going back restarts the search from the first knot
+  bool update(double _time, Eigen::Vector3d &_limits) {
+    if (size_ == 0 || (settled_ && _time >= knots_[size_ - 1].time)) {
+      return false;
+    }
+    if (_time < last_time_) {
+      cursor_ = 0;
+    }
+    last_time_ = _time;
+    while (cursor_ + 1 < size_ && knots_[cursor_ + 1].time <= _time) {
+      cursor_++;
+    }
+
+    const SpeedLimitKnot &start = knots_[cursor_];
+    Eigen::Vector3d limits      = start.limits;
+    settled_                    = _time >= knots_[size_ - 1].time;
+    if (settled_) {
+      limits = knots_[size_ - 1].limits;
+    } else if (_time > start.time) {
+      const SpeedLimitKnot &end = knots_[cursor_ + 1];
+      const double s            = (_time - start.time) / (end.time - start.time);
+      limits                    = start.limits + s * (end.limits - start.limits);
+    }
+
+    if (limits == _limits) {
+      return false;
+    }
+    _limits = limits;
+    return true;
+  }
+
+private:
+  std::array<SpeedLimitKnot, kCapacity> knots_;
+  size_t size_      = 0;
+  size_t cursor_    = 0;      // Knot at or before the last updated time
+  bool settled_     = false;  // Past the last knot, the limits no longer change
+  double last_time_ = 0.0;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,201 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_metrics.hpp
+ *  \brief      Lock-free latency histograms and rejection counters for the speed controller hot path.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_METRICS_H__
+#define __SP_METRICS_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief HDR-style histogram of durations in nanoseconds.
+ *
+ * Values below 2 * kSubBuckets are counted exactly, larger values fall in one of kSubBuckets
+ * linear sub-buckets of their power of two, bounding the relative error to 1 / kSubBuckets.
+ * Recording is a couple of relaxed atomic increments, so it is safe to read the histogram
+ * from another thread while the control loop writes to it.
+ */
+class LatencyHistogram {
+public:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets    = 1 << kSubBucketBits;
+  static constexpr int kMaxExponent   = 40;  // ~18 minutes, larger values are clamped
+  static constexpr size_t kNumBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+  static constexpr uint64_t kMaxValue = (uint64_t{1} << (kMaxExponent + 1)) - 1;
+
+  void record(uint64_t _value) {
+    _value = std::min(_value, kMaxValue);
+    buckets_[bucketIndex(_value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (_value > max && !max_.compare_exchange_weak(max, _value, std::memory_order_relaxed)) {
+    }
+  }
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  // Highest value equivalent to the requested quantile, 0 if nothing was recorded
+  uint64_t percentile(double _quantile) const {
+    const uint64_t total = count();
+    if (total == 0) {
+      return 0;
+    }
+    const double rank     = std::clamp(_quantile, 0.0, 1.0) * static_cast<double>(total);
+    const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(rank + 0.5));
+
+    uint64_t accumulated = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+      accumulated += buckets_[i].load(std::memory_order_relaxed);
+      if (accumulated >= target) {
+        return std::min(bucketUpperBound(i), max());
+      }
+    }
+    return max();
+  }
+
+  void reset() {
+    for (auto &bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  static constexpr size_t bucketIndex(uint64_t _value) {
+    if (_value < 2 * kSubBuckets) {
+      return static_cast<size_t>(_value);
+    }
+    const int exponent = 63 - __builtin_clzll(_value);
+    const uint64_t sub = (_value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return static_cast<size_t>((exponent - kSubBucketBits + 1) * kSubBuckets + sub);
+  }
+
+  static constexpr uint64_t bucketUpperBound(size_t _index) {
+    if (_index < 2 * kSubBuckets) {
+      return _index;
+    }
+    const int exponent  = static_cast<int>(_index / kSubBuckets) + kSubBucketBits - 1;
+    const uint64_t sub  = _index % kSubBuckets;
+    const uint64_t step = uint64_t{1} << (exponent - kSubBucketBits);
+    return (kSubBuckets + sub) * step + step - 1;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+// Measured entry points of the plugin
+enum class LatencyProbe : uint8_t {
+  UPDATE_STATE = 0,
+  UPDATE_REFERENCE,
+  COMPUTE_OUTPUT,
+  DT_JITTER,      // |dt - previous dt| passed to computeOutput
+  INPUT_LATENCY,  // Age of the state when a command is computed from it
+  COUNT
+};
+
+// Calls that returned without producing a command or that dropped their input
+enum class RejectedCall : uint8_t {
+  STATE_NOT_RECEIVED = 0,
+  REFERENCE_NOT_RECEIVED,
+  FRAME_MISMATCH,
+  QUEUE_FULL,    // Input not queued to the real-time control thread
+  CONTROL_BUSY,  // Real-time tick held while the configuration was being updated
+  COUNT
+};
+
+struct LatencyMetrics {
+  // Control modes are 4 bits in as2_msgs::msg::ControlMode, only the first 8 are defined
+  static constexpr size_t kNumControlModes = 8;
+  static constexpr size_t kNumProbes       = static_cast<size_t>(LatencyProbe::COUNT);
+  static constexpr size_t kNumRejections   = static_cast<size_t>(RejectedCall::COUNT);
+
+  std::array<std::array<LatencyHistogram, kNumProbes>, kNumControlModes> histograms;
+  std::array<std::atomic<uint64_t>, kNumRejections> rejected_calls{};
+
+  LatencyHistogram &histogram(uint8_t _control_mode, LatencyProbe _probe) {
+    return histograms[_control_mode % kNumControlModes][static_cast<size_t>(_probe)];
+  }
+  const LatencyHistogram &histogram(uint8_t _control_mode, LatencyProbe _probe) const {
+    return histograms[_control_mode % kNumControlModes][static_cast<size_t>(_probe)];
+  }
+
+  void reject(RejectedCall _call) {
+    rejected_calls[static_cast<size_t>(_call)].fetch_add(1, std::memory_order_relaxed);
+  }
+  uint64_t rejected(RejectedCall _call) const {
+    return rejected_calls[static_cast<size_t>(_call)].load(std::memory_order_relaxed);
+  }
+};
+
+// Records the lifetime of the scope into a histogram, does nothing for a null histogram
+class ScopedLatency {
+public:
+  explicit ScopedLatency(LatencyHistogram *_histogram) : histogram_(_histogram) {
+    if (histogram_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedLatency() {
+    if (histogram_ != nullptr) {
+      const auto elapsed = std::chrono::steady_clock::now() - start_;
+      histogram_->record(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+  }
+
+  ScopedLatency(const ScopedLatency &)            = delete;
+  ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+  LatencyHistogram *histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,419 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_parameters.hpp
+ *  \brief      Static parameter schema and dispatch table for the speed controller plugin.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_PARAMETERS_H__
+#define __SP_PARAMETERS_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace controller_plugin_speed_controller {
+namespace parameters {
+
+// Group of parameters that must be completely read before a controller can be used
+enum class ParameterGroup : uint8_t {
+  PLUGIN = 0,
+  POSITION,
+  SPEED,
+  SPEED_IN_A_PLANE,
+  TRAJECTORY,
+  YAW,
+  OPTIONAL,  // Not required to set a mode
+  COUNT
+};
+
+// Object that receives the parameter value
+enum class ParameterTarget : uint8_t {
+  PLUGIN = 0,
+  YAW,
+  POSITION,
+  SPEED,
+  SPEED_IN_A_PLANE_HEIGHT,
+  SPEED_IN_A_PLANE_SPEED,
+  SPEED_IN_A_PLANE_BOTH,
+  TRAJECTORY
+};
+
+// Setter called on the target
+enum class ParameterField : uint8_t {
+  PROPORTIONAL_LIMITATION = 0,
+  USE_BYPASS,
+  STAGED_GAINS,
+  LATENCY_METRICS,
+  LATENCY_METRICS_PERIOD,
+  TRANSLATION_RATE_DIVIDER,
+  YAW_RATE_DIVIDER,
+  STATE_TRIGGERED,
+  PREDICTION,
+  PREDICTION_TIME_CONSTANT,
+  MODE_HANDOFF,
+  MODE_HANDOFF_TIME_CONSTANT,
+  DT_CONDITIONING,
+  DT_MIN,
+  DT_MAX,
+  DT_OUTLIER_RATIO,
+  DT_NOMINAL,
+  DT_EXACT_DISCRETIZATION,
+  REALTIME,
+  REALTIME_PRIORITY,
+  REALTIME_CPU,
+  REALTIME_PERIOD,
+  REALTIME_LOCK_MEMORY,
+  TELEMETRY,
+  TELEMETRY_FILE,
+  FEEDFORWARD_LOOK_AHEAD,
+  FEEDFORWARD_YAW_RATE,
+  RESET_INTEGRAL,
+  ANTIWINDUP_CTE,
+  ALPHA,
+  KP,
+  KI,
+  KD
+};
+
+// Value type every parameter must be declared with
+enum class ParameterType : uint8_t { BOOL = 0, INTEGER, DOUBLE, STRING };
+
+constexpr ParameterType fieldType(ParameterField _field) {
+  switch (_field) {
+    case ParameterField::PROPORTIONAL_LIMITATION:
+    case ParameterField::USE_BYPASS:
+    case ParameterField::STAGED_GAINS:
+    case ParameterField::LATENCY_METRICS:
+    case ParameterField::STATE_TRIGGERED:
+    case ParameterField::PREDICTION:
+    case ParameterField::MODE_HANDOFF:
+    case ParameterField::DT_CONDITIONING:
+    case ParameterField::DT_EXACT_DISCRETIZATION:
+    case ParameterField::REALTIME:
+    case ParameterField::REALTIME_LOCK_MEMORY:
+    case ParameterField::TELEMETRY:
+    case ParameterField::FEEDFORWARD_YAW_RATE:
+    case ParameterField::RESET_INTEGRAL:
+      return ParameterType::BOOL;
+    case ParameterField::TRANSLATION_RATE_DIVIDER:
+    case ParameterField::YAW_RATE_DIVIDER:
+    case ParameterField::REALTIME_PRIORITY:
+    case ParameterField::REALTIME_CPU:
+      return ParameterType::INTEGER;
+    case ParameterField::TELEMETRY_FILE:
+      return ParameterType::STRING;
+    default:
+      return ParameterType::DOUBLE;
+  }
+}
+
+struct ParameterDescriptor {
+  std::string_view name;
+  ParameterGroup group;
+  ParameterTarget target;
+  ParameterField field;
+  uint8_t axis;  // 0, 1, 2 for x, y, z gains, 0 for scalar parameters
+
+  constexpr ParameterType type() const { return fieldType(field); }
+};
+
+// The short names of the schema rows do not leak into the parameters namespace
+namespace detail {
+
+using G = ParameterGroup;
+using T = ParameterTarget;
+using F = ParameterField;
+
+// clang-format off
+constexpr std::array<ParameterDescriptor, 81> kParameterSchema = {{
+    {"proportional_limitation",                  G::PLUGIN,           T::PLUGIN,                  F::PROPORTIONAL_LIMITATION,    0},
+    {"use_bypass",                               G::PLUGIN,           T::PLUGIN,                  F::USE_BYPASS,                 0},
+
+    {"position_control.reset_integral",          G::POSITION,         T::POSITION,                F::RESET_INTEGRAL,             0},
+    {"position_control.antiwindup_cte",          G::POSITION,         T::POSITION,                F::ANTIWINDUP_CTE,             0},
+    {"position_control.alpha",                   G::POSITION,         T::POSITION,                F::ALPHA,                      0},
+    {"position_control.kp.x",                    G::POSITION,         T::POSITION,                F::KP,                         0},
+    {"position_control.kp.y",                    G::POSITION,         T::POSITION,                F::KP,                         1},
+    {"position_control.kp.z",                    G::POSITION,         T::POSITION,                F::KP,                         2},
+    {"position_control.ki.x",                    G::POSITION,         T::POSITION,                F::KI,                         0},
+    {"position_control.ki.y",                    G::POSITION,         T::POSITION,                F::KI,                         1},
+    {"position_control.ki.z",                    G::POSITION,         T::POSITION,                F::KI,                         2},
+    {"position_control.kd.x",                    G::POSITION,         T::POSITION,                F::KD,                         0},
+    {"position_control.kd.y",                    G::POSITION,         T::POSITION,                F::KD,                         1},
+    {"position_control.kd.z",                    G::POSITION,         T::POSITION,                F::KD,                         2},
+
+    {"speed_control.reset_integral",             G::SPEED,            T::SPEED,                   F::RESET_INTEGRAL,             0},
+    {"speed_control.antiwindup_cte",             G::SPEED,            T::SPEED,                   F::ANTIWINDUP_CTE,             0},
+    {"speed_control.alpha",                      G::SPEED,            T::SPEED,                   F::ALPHA,                      0},
+    {"speed_control.kp.x",                       G::SPEED,            T::SPEED,                   F::KP,                         0},
+    {"speed_control.kp.y",                       G::SPEED,            T::SPEED,                   F::KP,                         1},
+    {"speed_control.kp.z",                       G::SPEED,            T::SPEED,                   F::KP,                         2},
+    {"speed_control.ki.x",                       G::SPEED,            T::SPEED,                   F::KI,                         0},
+    {"speed_control.ki.y",                       G::SPEED,            T::SPEED,                   F::KI,                         1},
+    {"speed_control.ki.z",                       G::SPEED,            T::SPEED,                   F::KI,                         2},
+    {"speed_control.kd.x",                       G::SPEED,            T::SPEED,                   F::KD,                         0},
+    {"speed_control.kd.y",                       G::SPEED,            T::SPEED,                   F::KD,                         1},
+    {"speed_control.kd.z",                       G::SPEED,            T::SPEED,                   F::KD,                         2},
+
+    {"speed_in_a_plane_control.reset_integral",  G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_BOTH,   F::RESET_INTEGRAL,             0},
+    {"speed_in_a_plane_control.antiwindup_cte",  G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_BOTH,   F::ANTIWINDUP_CTE,             0},
+    {"speed_in_a_plane_control.alpha",           G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_BOTH,   F::ALPHA,                      0},
+    {"speed_in_a_plane_control.height.kp",       G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_HEIGHT, F::KP,                         0},
+    {"speed_in_a_plane_control.height.ki",       G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_HEIGHT, F::KI,                         0},
+    {"speed_in_a_plane_control.height.kd",       G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_HEIGHT, F::KD,                         0},
+    {"speed_in_a_plane_control.speed.kp.x",      G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_SPEED,  F::KP,                         0},
+    {"speed_in_a_plane_control.speed.kp.y",      G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_SPEED,  F::KP,                         1},
+    {"speed_in_a_plane_control.speed.ki.x",      G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_SPEED,  F::KI,                         0},
+    {"speed_in_a_plane_control.speed.ki.y",      G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_SPEED,  F::KI,                         1},
+    {"speed_in_a_plane_control.speed.kd.x",      G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_SPEED,  F::KD,                         0},
+    {"speed_in_a_plane_control.speed.kd.y",      G::SPEED_IN_A_PLANE, T::SPEED_IN_A_PLANE_SPEED,  F::KD,                         1},
+
+    {"trajectory_control.reset_integral",        G::TRAJECTORY,       T::TRAJECTORY,              F::RESET_INTEGRAL,             0},
+    {"trajectory_control.antiwindup_cte",        G::TRAJECTORY,       T::TRAJECTORY,              F::ANTIWINDUP_CTE,             0},
+    {"trajectory_control.alpha",                 G::TRAJECTORY,       T::TRAJECTORY,              F::ALPHA,                      0},
+    {"trajectory_control.kp.x",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KP,                         0},
+    {"trajectory_control.kp.y",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KP,                         1},
+    {"trajectory_control.kp.z",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KP,                         2},
+    {"trajectory_control.ki.x",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KI,                         0},
+    {"trajectory_control.ki.y",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KI,                         1},
+    {"trajectory_control.ki.z",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KI,                         2},
+    {"trajectory_control.kd.x",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KD,                         0},
+    {"trajectory_control.kd.y",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KD,                         1},
+    {"trajectory_control.kd.z",                  G::TRAJECTORY,       T::TRAJECTORY,              F::KD,                         2},
+
+    {"yaw_control.reset_integral",               G::YAW,              T::YAW,                     F::RESET_INTEGRAL,             0},
+    {"yaw_control.antiwindup_cte",               G::YAW,              T::YAW,                     F::ANTIWINDUP_CTE,             0},
+    {"yaw_control.alpha",                        G::YAW,              T::YAW,                     F::ALPHA,                      0},
+    {"yaw_control.kp",                           G::YAW,              T::YAW,                     F::KP,                         0},
+    {"yaw_control.ki",                           G::YAW,              T::YAW,                     F::KI,                         0},
+    {"yaw_control.kd",                           G::YAW,              T::YAW,                     F::KD,                         0},
+
+    {"staged_gains",                             G::OPTIONAL,         T::PLUGIN,                  F::STAGED_GAINS,               0},
+    {"latency_metrics.enabled",                  G::OPTIONAL,         T::PLUGIN,                  F::LATENCY_METRICS,            0},
+    {"latency_metrics.period",                   G::OPTIONAL,         T::PLUGIN,                  F::LATENCY_METRICS_PERIOD,     0},
+    {"position_control.rate_divider",            G::OPTIONAL,         T::PLUGIN,                  F::TRANSLATION_RATE_DIVIDER,   0},
+    {"yaw_control.rate_divider",                 G::OPTIONAL,         T::PLUGIN,                  F::YAW_RATE_DIVIDER,           0},
+    {"state_triggered",                          G::OPTIONAL,         T::PLUGIN,                  F::STATE_TRIGGERED,            0},
+    {"state_prediction.enabled",                 G::OPTIONAL,         T::PLUGIN,                  F::PREDICTION,                 0},
+    {"state_prediction.time_constant",           G::OPTIONAL,         T::PLUGIN,                  F::PREDICTION_TIME_CONSTANT,   0},
+    {"mode_handoff.enabled",                     G::OPTIONAL,         T::PLUGIN,                  F::MODE_HANDOFF,               0},
+    {"mode_handoff.time_constant",               G::OPTIONAL,         T::PLUGIN,                  F::MODE_HANDOFF_TIME_CONSTANT, 0},
+    {"dt_conditioning.enabled",                  G::OPTIONAL,         T::PLUGIN,                  F::DT_CONDITIONING,            0},
+    {"dt_conditioning.min_dt",                   G::OPTIONAL,         T::PLUGIN,                  F::DT_MIN,                     0},
+    {"dt_conditioning.max_dt",                   G::OPTIONAL,         T::PLUGIN,                  F::DT_MAX,                     0},
+    {"dt_conditioning.outlier_ratio",            G::OPTIONAL,         T::PLUGIN,                  F::DT_OUTLIER_RATIO,           0},
+    {"dt_conditioning.nominal_dt",               G::OPTIONAL,         T::PLUGIN,                  F::DT_NOMINAL,                 0},
+    {"dt_conditioning.exact_discretization",     G::OPTIONAL,         T::PLUGIN,                  F::DT_EXACT_DISCRETIZATION,    0},
+    {"realtime.enabled",                         G::OPTIONAL,         T::PLUGIN,                  F::REALTIME,                   0},
+    {"realtime.priority",                        G::OPTIONAL,         T::PLUGIN,                  F::REALTIME_PRIORITY,          0},
+    {"realtime.cpu",                             G::OPTIONAL,         T::PLUGIN,                  F::REALTIME_CPU,               0},
+    {"realtime.period",                          G::OPTIONAL,         T::PLUGIN,                  F::REALTIME_PERIOD,            0},
+    {"realtime.lock_memory",                     G::OPTIONAL,         T::PLUGIN,                  F::REALTIME_LOCK_MEMORY,       0},
+    {"telemetry.enabled",                        G::OPTIONAL,         T::PLUGIN,                  F::TELEMETRY,                  0},
+    {"telemetry.file",                           G::OPTIONAL,         T::PLUGIN,                  F::TELEMETRY_FILE,             0},
+    {"trajectory_feedforward.look_ahead",        G::OPTIONAL,         T::PLUGIN,                  F::FEEDFORWARD_LOOK_AHEAD,     0},
+    {"trajectory_feedforward.yaw_rate",          G::OPTIONAL,         T::PLUGIN,                  F::FEEDFORWARD_YAW_RATE,       0},
+}};
+// clang-format on
+
+}  // namespace detail
+
+using detail::kParameterSchema;
+
+constexpr size_t kNumParameters = kParameterSchema.size();
+
+// One bit per schema entry, in schema order
+class ParameterMask {
+public:
+  static constexpr size_t kNumWords = 2;
+  static constexpr size_t kCapacity = 64 * kNumWords;
+
+  constexpr ParameterMask() = default;
+
+  static constexpr ParameterMask bit(size_t _index) {
+    ParameterMask mask;
+    mask.words_[_index / 64] = uint64_t{1} << (_index % 64);
+    return mask;
+  }
+
+  constexpr bool any() const {
+    for (uint64_t word : words_) {
+      if (word != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+  constexpr bool none() const { return !any(); }
+
+  constexpr ParameterMask operator~() const {
+    ParameterMask mask;
+    for (size_t i = 0; i < kNumWords; i++) {
+      mask.words_[i] = ~words_[i];
+    }
+    return mask;
+  }
+  constexpr ParameterMask &operator|=(const ParameterMask &_other) {
+    for (size_t i = 0; i < kNumWords; i++) {
+      words_[i] |= _other.words_[i];
+    }
+    return *this;
+  }
+  constexpr ParameterMask &operator&=(const ParameterMask &_other) {
+    for (size_t i = 0; i < kNumWords; i++) {
+      words_[i] &= _other.words_[i];
+    }
+    return *this;
+  }
+  friend constexpr ParameterMask operator|(ParameterMask _a, const ParameterMask &_b) {
+    return _a |= _b;
+  }
+  friend constexpr ParameterMask operator&(ParameterMask _a, const ParameterMask &_b) {
+    return _a &= _b;
+  }
+  friend constexpr bool operator==(const ParameterMask &_a, const ParameterMask &_b) {
+    for (size_t i = 0; i < kNumWords; i++) {
+      if (_a.words_[i] != _b.words_[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  friend constexpr bool operator!=(const ParameterMask &_a, const ParameterMask &_b) {
+    return !(_a == _b);
+  }
+
+private:
+  uint64_t words_[kNumWords] = {};
+};
+static_assert(kNumParameters <= ParameterMask::kCapacity,
+              "Parameter schema does not fit in the parameter mask");
+
+constexpr ParameterMask parameterBit(size_t _index) { return ParameterMask::bit(_index); }
+
+constexpr ParameterMask groupMask(ParameterGroup _group) {
+  ParameterMask mask;
+  for (size_t i = 0; i < kNumParameters; i++) {
+    if (kParameterSchema[i].group == _group) {
+      mask |= parameterBit(i);
+    }
+  }
+  return mask;
+}
+
+constexpr ParameterMask allParametersMask() {
+  ParameterMask mask;
+  for (size_t i = 0; i < kNumParameters; i++) {
+    mask |= parameterBit(i);
+  }
+  return mask;
+}
+
+constexpr ParameterMask kAllParametersMask = allParametersMask();
+
+// Perfect hash: FNV-1a with a seed searched at compile time so that every schema name falls in
+// its own slot of the lookup table
+constexpr size_t kLookupTableSize = 512;
+constexpr uint8_t kEmptySlot      = 0xFF;
+static_assert((kLookupTableSize & (kLookupTableSize - 1)) == 0, "Table size must be 2^n");
+static_assert(kNumParameters < kEmptySlot, "Schema index does not fit in a table slot");
+
+constexpr uint32_t hashName(std::string_view _name, uint32_t _seed) {
+  uint32_t hash = 2166136261u ^ _seed;
+  for (char c : _name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  return hash ^ (hash >> 15);
+}
+
+constexpr size_t hashSlot(std::string_view _name, uint32_t _seed) {
+  return hashName(_name, _seed) & (kLookupTableSize - 1);
+}
+
+constexpr bool isCollisionFree(uint32_t _seed) {
+  std::array<bool, kLookupTableSize> used{};
+  for (const auto &descriptor : kParameterSchema) {
+    size_t slot = hashSlot(descriptor.name, _seed);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr uint32_t findHashSeed() {
+  for (uint32_t seed = 1; seed < (1u << 16); seed++) {
+    if (isCollisionFree(seed)) {
+      return seed;
+    }
+  }
+  return 0;
+}
+
+constexpr uint32_t kHashSeed = findHashSeed();
+static_assert(kHashSeed != 0, "No perfect hash seed found for the parameter schema");
+
+constexpr std::array<uint8_t, kLookupTableSize> buildLookupTable() {
+  std::array<uint8_t, kLookupTableSize> table{};
+  for (auto &slot : table) {
+    slot = kEmptySlot;
+  }
+  for (size_t i = 0; i < kNumParameters; i++) {
+    table[hashSlot(kParameterSchema[i].name, kHashSeed)] = static_cast<uint8_t>(i);
+  }
+  return table;
+}
+
+constexpr std::array<uint8_t, kLookupTableSize> kLookupTable = buildLookupTable();
+
+/**
+ * @brief Find the schema index of a full parameter name in O(1)
+ *
+ * @param _name Full parameter name, e.g. "position_control.kp.x"
+ * @return Index in kParameterSchema, or -1 if the parameter is not part of the schema
+ */
+constexpr int findParameter(std::string_view _name) {
+  uint8_t index = kLookupTable[hashSlot(_name, kHashSeed)];
+  if (index == kEmptySlot || kParameterSchema[index].name != _name) {
+    return -1;
+  }
+  return index;
+}
+
+}  // namespace parameters
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -37,7 +37,12 @@
 #ifndef __SP_PLUGIN_H__
 #define __SP_PLUGIN_H__
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <rclcpp/logging.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <vector>
@@ -48,35 +53,78 @@
 #include "as2_msgs/msg/thrust.hpp"
 #include "as2_msgs/msg/trajectory_point.hpp"
 #include "controller_plugin_base/controller_base.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "pid_controller/PID.hpp"
 #include "pid_controller/PID_3D.hpp"
-
+#include "speed_controller_control_thread.hpp"
+#include "speed_controller_dt_conditioner.hpp"
+#include "speed_controller_event_log.hpp"
+#include "speed_controller_gains.hpp"
+#include "speed_controller_limit_profile.hpp"
+#include "speed_controller_metrics.hpp"
+#include "speed_controller_parameters.hpp"
+#include "speed_controller_saturation.hpp"
+#include "speed_controller_spsc_queue.hpp"
+#include "speed_controller_telemetry.hpp"
+#include "speed_controller_trajectory_buffer.hpp"
+#include "speed_controller_types.hpp"
+#include "trajectory_msgs/msg/joint_trajectory.hpp"
+
+#include <tf2/exceptions.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <geometry_msgs/msg/pose_stamped.hpp>
 #include <geometry_msgs/msg/twist_stamped.hpp>
 
 namespace controller_plugin_speed_controller {
 
-struct UAV_state {
+struct Control_flags {
+  bool state_received = false;
+  bool ref_received   = false;
+  // One bit per entry of parameters::kParameterSchema
+  parameters::ParameterMask parameters_read;
+};
+
+// Frame ids are generated once in ownInitialize and referenced by index afterwards
+enum class FrameId : uint8_t { ENU = 0, FLU = 1, COUNT = 2 };
+
+// State converted to the input frames of the mode, applied by the control loop
+struct StateInput {
   Eigen::Vector3d position = Eigen::Vector3d::Zero();
   Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
-  Eigen::Vector3d yaw      = Eigen::Vector3d::Zero();
+  double yaw               = 0.0;
+  double yaw_rate          = 0.0;
+  double time              = 0.0;  // [s]
+  YawRotation yaw_rotation;
 };
 
-struct UAV_command {
-  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
-  double yaw_speed         = 0.0;
+// Reference converted on the caller thread, applied by the control loop
+struct ReferenceInput {
+  enum class Kind : uint8_t {
+    POSE,
+    TWIST,
+    SPEED_LIMITS,
+    TRAJECTORY_POINT,
+    SEGMENT_SAMPLE,
+    LIMIT_KNOT,
+    CLEAR_LIMIT_PROFILE
+  };
+
+  Kind kind         = Kind::POSE;
+  bool has_position = false;  // POSE: position reference
+  bool has_yaw      = false;  // POSE: yaw angle, TWIST: yaw rate, SEGMENT_SAMPLE: sample yaw
+  bool first        = false;  // SEGMENT_SAMPLE, LIMIT_KNOT: first one of a segment or profile
+
+  Eigen::Vector3d vector = Eigen::Vector3d::Zero();  // Position, velocity or speed limits
+  double yaw             = 0.0;                      // Yaw angle or yaw rate
+  TrajectorySample sample;                           // Also the time of a LIMIT_KNOT
 };
 
-struct Control_flags {
-  bool state_received                              = false;
-  bool ref_received                                = false;
-  bool plugin_parameters_read                      = false;
-  bool position_controller_parameters_read         = false;
-  bool velocity_controller_parameters_read         = false;
-  bool speed_in_a_plane_controller_parameters_read = false;
-  bool trajectory_controller_parameters_read       = false;
-  bool yaw_controller_parameters_read              = false;
+// Command published by the real-time control thread
+struct ControlOutput {
+  UAV_command command;
+  FrameId frame_id    = FrameId::ENU;
+  uint32_t generation = 0;  // Of the mode the command was computed in
+  bool valid          = false;
 };
 
 class Plugin : public controller_plugin_base::ControllerBase {
@@ -85,6 +133,11 @@ public:
   ~Plugin(){};
 
 public:
+  // TF handler converting the twists, e.g. one shared by the plugins of several drones. Set it
+  // before initialize, otherwise the plugins attached to the same node share one handler
+  void setTfHandler(std::shared_ptr<as2::tf::TfHandler> _tf_handler);
+  const std::shared_ptr<as2::tf::TfHandler> &getTfHandler() const;
+
   void ownInitialize() override;
   void updateState(const geometry_msgs::msg::PoseStamped &pose_msg,
                    const geometry_msgs::msg::TwistStamped &twist_msg) override;
@@ -93,131 +146,354 @@ public:
   void updateReference(const geometry_msgs::msg::TwistStamped &ref) override;
   void updateReference(const as2_msgs::msg::TrajectoryPoint &ref) override;
 
+  // Whole trajectory segments, consumed tick by tick in TRAJECTORY mode. Joint trajectories
+  // use the x, y, z and (optional) yaw joints, timed from header.stamp + time_from_start
+  void updateReference(const std::vector<as2_msgs::msg::TrajectoryPoint> &ref);
+  void updateReference(const trajectory_msgs::msg::JointTrajectory &ref);
+
+  // Speed limits scheduled over time in POSITION and TRAJECTORY modes, replacing the ones of
+  // the twist references until an empty profile, setMode or reset. The last knot is held
+  void updateSpeedLimitProfile(const std::vector<SpeedLimitKnot> &profile);
+
   bool setMode(const as2_msgs::msg::ControlMode &mode_in,
                const as2_msgs::msg::ControlMode &mode_out) override;
 
   std::string getDesiredPoseFrameId();
   std::string getDesiredTwistFrameId();
 
+  // Allocation-free accessors to the interned frame ids
+  const std::string &getInputPoseFrameId() const;
+  const std::string &getInputTwistFrameId() const;
+  const std::string &getOutputTwistFrameId() const;
+
   bool computeOutput(double dt,
                      geometry_msgs::msg::PoseStamped &pose,
                      geometry_msgs::msg::TwistStamped &twist,
                      as2_msgs::msg::Thrust &thrust) override;
 
+  // Zero-copy variant of computeOutput for messages loaned from the publisher: only the twist
+  // is written each tick, the header is preset with presetOutputHeader after every setMode
+  bool computeLoanedOutput(double dt, geometry_msgs::msg::Twist &twist);
+  void presetOutputHeader(std_msgs::msg::Header &header) const;
+
   bool updateParams(const std::vector<std::string> &_params_list) override;
   void reset() override;
 
   rcl_interfaces::msg::SetParametersResult parametersCallback(
       const std::vector<rclcpp::Parameter> &parameters);
 
-private:
-  as2_msgs::msg::ControlMode control_mode_in_;
-  as2_msgs::msg::ControlMode control_mode_out_;
+  // Read every schema parameter declared on the node in one pass. Returns false if any value is
+  // rejected or a required parameter is still missing
+  bool loadParameters();
 
-  Control_flags flags_;
+  // Schema bits of the required parameters not read yet, in total or for a given input mode
+  parameters::ParameterMask getMissingParameters() const;
+  parameters::ParameterMask getMissingParameters(const as2_msgs::msg::ControlMode &_mode) const;
 
-  std::shared_ptr<pid_controller::PIDController> pid_yaw_handler_;
-  std::shared_ptr<pid_controller::PIDController3D> pid_3D_position_handler_;
-  std::shared_ptr<pid_controller::PIDController3D> pid_3D_velocity_handler_;
-  std::shared_ptr<pid_controller::PIDController> pid_1D_speed_in_a_plane_handler_;
-  std::shared_ptr<pid_controller::PIDController3D> pid_3D_speed_in_a_plane_handler_;
-  std::shared_ptr<pid_controller::PIDController3D> pid_3D_trajectory_handler_;
+  // Latest gains received through parameters, e.g. to configure a SpeedControllerBatch slot
+  const ControllerGains &getGains() const;
 
-  std::shared_ptr<as2::tf::TfHandler> tf_handler_;
+  // Hot path latencies and rejected calls, recorded while latency_metrics.enabled is set. The
+  // histograms are only allocated once the metrics are enabled, all empty before
+  const LatencyMetrics &getLatencyMetrics() const;
+
+  // Errors and warnings of the control path, counted always and logged at most every 5 s
+  const EventLog &getEventLog() const;
+
+  // Age of the state [s] at the last computed tick, measured while state_prediction.enabled or
+  // latency_metrics.enabled is set
+  double getInputLatency() const;
+
+  // Recorder of the tick internals while telemetry.enabled is set, null if never enabled
+  const TelemetryRecorder *getTelemetryRecorder() const;
+
+  // dt corrections counted while dt_conditioning.enabled is set
+  const DtConditioner &getDtConditioner() const;
+
+  // True while realtime.enabled runs the control law on the plugin's own thread
+  bool isRealtimeActive() const;
+  const ControlThread &getControlThread() const;
+
+  // Time [s] unstamped references are taken at and the state age is measured against, the node
+  // clock if empty. Set before the first update, e.g. to the trace time by a replay
+  void setClock(std::function<double()> _clock);
 
-  std::vector<std::string> plugin_parameters_list_ = {"proportional_limitation", "use_bypass"};
-
-  const std::vector<std::string> position_control_parameters_list_ = {
-      "position_control.reset_integral", "position_control.antiwindup_cte",
-      "position_control.alpha",          "position_control.kp.x",
-      "position_control.kp.y",           "position_control.kp.z",
-      "position_control.ki.x",           "position_control.ki.y",
-      "position_control.ki.z",           "position_control.kd.x",
-      "position_control.kd.y",           "position_control.kd.z"};
-
-  const std::vector<std::string> velocity_control_parameters_list_ = {
-      "speed_control.reset_integral", "speed_control.antiwindup_cte", "speed_control.alpha",
-      "speed_control.kp.x",           "speed_control.kp.y",           "speed_control.kp.z",
-      "speed_control.ki.x",           "speed_control.ki.y",           "speed_control.ki.z",
-      "speed_control.kd.x",           "speed_control.kd.y",           "speed_control.kd.z"};
-
-  const std::vector<std::string> speed_in_a_plane_control_parameters_list_ = {
-      "speed_in_a_plane_control.reset_integral", "speed_in_a_plane_control.antiwindup_cte",
-      "speed_in_a_plane_control.alpha",          "speed_in_a_plane_control.height.kp",
-      "speed_in_a_plane_control.height.ki",      "speed_in_a_plane_control.height.kd",
-      "speed_in_a_plane_control.speed.kp.x",     "speed_in_a_plane_control.speed.kp.y",
-      "speed_in_a_plane_control.speed.ki.x",     "speed_in_a_plane_control.speed.ki.y",
-      "speed_in_a_plane_control.speed.kd.x",     "speed_in_a_plane_control.speed.kd.y"};
-
-  const std::vector<std::string> trajectory_control_parameters_list_ = {
-      "trajectory_control.reset_integral", "trajectory_control.antiwindup_cte",
-      "trajectory_control.alpha",          "trajectory_control.kp.x",
-      "trajectory_control.kp.y",           "trajectory_control.kp.z",
-      "trajectory_control.ki.x",           "trajectory_control.ki.y",
-      "trajectory_control.ki.z",           "trajectory_control.kd.x",
-      "trajectory_control.kd.y",           "trajectory_control.kd.z"};
-
-  const std::vector<std::string> yaw_control_parameters_list_ = {"yaw_control.reset_integral",
-                                                                 "yaw_control.antiwindup_cte",
-                                                                 "yaw_control.alpha",
-                                                                 "yaw_control.kp",
-                                                                 "yaw_control.ki",
-                                                                 "yaw_control.kd"};
-
-  std::vector<std::string> plugin_parameters_to_read_{plugin_parameters_list_};
-  std::vector<std::string> position_control_parameters_to_read_{position_control_parameters_list_};
-  std::vector<std::string> velocity_control_parameters_to_read_{velocity_control_parameters_list_};
-  std::vector<std::string> speed_in_a_plane_control_parameters_to_read_{
-      speed_in_a_plane_control_parameters_list_};
-  std::vector<std::string> trajectory_control_parameters_to_read_{
-      trajectory_control_parameters_list_};
-  std::vector<std::string> yaw_control_parameters_to_read_{yaw_control_parameters_list_};
+private:
+  // One straight-line control law per (mode, yaw mode, bypass, proportional limitation)
+  using ComputePipeline = bool (*)(Plugin &, double);
+
+private:
+  // Control loop: what updateState and computeOutput touch on every call, packed from a cache
+  // line boundary. Configuration and cold-path members follow it
+
+  // Selected in setMode and when the plugin parameters change, run on every tick
+  alignas(64) std::atomic<ComputePipeline> compute_pipeline_{&Plugin::unknownControlModePipeline};
+
+  Control_flags flags_;
 
   UAV_state uav_state_;
   UAV_state control_ref_;
   UAV_command control_command_;
+  // ENU <-> FLU rotation for the yaw of the last state received
+  YawRotation yaw_rotation_;
+  // Time of the current tick [s]: the last state stamp, advanced by dt on every tick
+  double control_time_ = 0.0;
+
+  // Set while telemetry is recording, every tick that runs the pipeline is recorded. Ticks that
+  // use the recorder count themselves in telemetry_users_, which updateTelemetry waits to drop
+  // to zero before the recorder is stopped
+  std::atomic<TelemetryRecorder *> telemetry_{nullptr};
+  std::atomic<uint32_t> telemetry_users_{0};
+  // Left by the pipeline for the telemetry: TelemetryFlag bits of the loops that ran, and the
+  // controller output before the speed limits in POSITION and TRAJECTORY
+  uint8_t loops_run_ = 0;
+  UAV_command controller_output_;
+
+  // Limits the controllers saturate to, from the twist references or the limit profile
+  Eigen::Vector3d speed_limits_;
+  Eigen::Vector3d reference_speed_limits_ = Eigen::Vector3d::Zero();
+  SpeedLimitProfile limit_profile_;
+  double yaw_speed_limit_;
+
+  FrameId input_pose_frame_id_  = FrameId::ENU;
+  FrameId input_twist_frame_id_ = FrameId::ENU;
+
+  FrameId output_twist_frame_id_ = FrameId::ENU;
 
   bool hover_flag_ = false;
 
-  Eigen::Vector3d speed_limits_;
-  double yaw_speed_limit_;
+  // Translation and yaw loops run on one tick out of their divider and hold their command
+  // in between
+  std::atomic<uint32_t> translation_rate_divider_{1};
+  std::atomic<uint32_t> yaw_rate_divider_{1};
+  RateDivider translation_rate_;
+  RateDivider yaw_rate_;
+
+  // When state triggered, ticks without a new state hold the last output and the others use
+  // the time between state stamps as dt
+  std::atomic<bool> state_triggered_{false};
+  bool last_output_valid_     = false;
+  double state_time_          = 0.0;   // Stamp of the last state [s]
+  double computed_state_time_ = -1.0;  // Stamp of the last state computed, negative if none
+
+  // The state is extrapolated to the compute time over at most kMaxPredictionHorizon
+  static constexpr double kMaxPredictionHorizon = 0.2;  // [s]
+  std::atomic<bool> state_prediction_enabled_{false};
+  double state_prediction_time_constant_ = 0.0;
+  double input_latency_                  = 0.0;
+  std::function<double()> clock_;
+
+  // Bumpless mode switching: setMode keeps the state, seeds the new references from the
+  // outgoing command and the output blends from that command with a decaying weight
+  static constexpr double kMinHandoffWeight = 1e-3;
+  std::atomic<bool> mode_handoff_enabled_{false};
+  double mode_handoff_time_constant_ = 0.2;
+  double handoff_weight_             = 0.0;  // Weight of the outgoing command, 0 when done
+  UAV_command handoff_command_;
+  UAV_command handoff_output_;
+
+  // TRAJECTORY feed-forward, computed on each translation tick: the velocity the reference
+  // gains over the look-ahead horizon and, when enabled, the yaw rate of the reference
+  std::atomic<bool> yaw_rate_feedforward_{false};
+  double feedforward_look_ahead_ = 0.0;  // [s], 0 to disable
+  UAV_command feedforward_;
+
+  // The PIDs run on the conditioned dt, the control time keeps advancing by the raw one
+  std::atomic<bool> dt_conditioning_enabled_{false};
+  std::atomic<bool> exact_discretization_{false};
+  DtConditioner dt_conditioner_;
+
+  std::atomic<bool> latency_metrics_enabled_{false};
+  double last_dt_ = 0.0;
+
+  // Controllers are held by value, only the ones of the active mode are touched
+  pid_controller::PIDController3D pid_3D_position_handler_;
+  pid_controller::PIDController3D pid_3D_velocity_handler_;
+  pid_controller::PIDController3D pid_3D_speed_in_a_plane_handler_;
+  pid_controller::PIDController pid_1D_speed_in_a_plane_handler_;
+  pid_controller::PIDController3D pid_3D_trajectory_handler_;
+  pid_controller::PIDController pid_yaw_handler_;
+
+  // Last state received, uav_state_ is extrapolated from it when state prediction is enabled
+  UAV_state measured_state_;
+
+  std::array<std::string, static_cast<size_t>(FrameId::COUNT)> frame_ids_ = {"odom", "base_link"};
+
+  // Gains published to the control loop, polled on every tick while staging is enabled
+  std::atomic<bool> use_staged_gains_{false};
+  TripleBuffer<ControllerGains> gains_buffer_;
+
+  // Trajectory references, sampled at the time of each TRAJECTORY tick
+  TrajectoryBuffer trajectory_buffer_;
+
+  // Configuration, only written from setMode and parametersCallback. Starts on its own cache
+  // line so that parameter updates do not invalidate the control loop lines
+  alignas(64) as2_msgs::msg::ControlMode control_mode_in_;
+  as2_msgs::msg::ControlMode control_mode_out_;
+
+  // Gains being edited by parametersCallback, published as a whole to the control loop
+  ControllerGains staged_gains_;
 
   bool use_bypass_              = true;
   bool proportional_limitation_ = false;
 
-  std::string enu_frame_id_ = "odom";
-  std::string flu_frame_id_ = "base_link";
-
-  std::string input_pose_frame_id_  = enu_frame_id_;
-  std::string input_twist_frame_id_ = enu_frame_id_;
+  std::shared_ptr<as2::tf::TfHandler> tf_handler_;
 
-  std::string output_twist_frame_id_ = enu_frame_id_;
+  bool telemetry_enabled_     = false;
+  std::string telemetry_file_ = "speed_controller_telemetry.bin";
+  std::unique_ptr<TelemetryRecorder> telemetry_recorder_;
+
+  // Null until latency_metrics.enabled is first set
+  std::unique_ptr<LatencyMetrics> latency_metrics_;
+  double latency_metrics_period_ = 1.0;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr latency_metrics_pub_;
+  rclcpp::TimerBase::SharedPtr latency_metrics_timer_;
+
+  // Real-time mode: updateState and updateReference convert their messages on the caller
+  // thread and queue them, the control thread drains the queues on every tick, runs the control
+  // law and publishes the command, that computeOutput only reads. setMode, reset and parameter
+  // updates hold control_mutex_ only to write the values the control loop reads, without I/O
+  // nor allocations. The control thread only tries the lock and holds its tick when it is taken.
+  // Parameter updates and setMode are serialized by config_mutex_, never taken by the thread.
+  // The queues take a single producer, input callbacks running on several executor threads are
+  // serialized by input_lock_. setMode, reset and the thread shutdown also hold it while they
+  // change the input frames or discard the queues. Locks are taken in the order config_mutex_,
+  // input_lock_, control_mutex_
+  static constexpr size_t kStateQueueSize     = 16;
+  static constexpr size_t kReferenceQueueSize = 2 * TrajectoryBuffer::kCapacity;
+
+  // Allocated when the control thread first starts, only plugins in real-time mode pay for them
+  struct RealtimeInputs {
+    SpscQueue<StateInput, kStateQueueSize> state;
+    SpscQueue<ReferenceInput, kReferenceQueueSize> reference;
+  };
+
+  bool realtime_enabled_ = false;
+  RealtimeSettings realtime_settings_;
+  std::atomic<bool> realtime_active_{false};
+  std::atomic<uint32_t> mode_generation_{0};  // Incremented by every setMode, under the lock
+  PiMutex control_mutex_;
+  std::mutex config_mutex_;
+  double held_dt_ = 0.0;            // Of the ticks held since the last one that ran
+  SpinLock input_lock_;             // Held by the callers of updateState and updateReference
+  YawRotation input_yaw_rotation_;  // Of the last state received, for the caller thread
+  bool segment_dropped_ = false;    // The end of the current segment did not fit
+  std::unique_ptr<RealtimeInputs> realtime_inputs_;
+  TripleBuffer<ControlOutput> output_buffer_;
+
+  // Control path errors, logged from the drain thread shared by every plugin of the process.
+  // Outlives the control thread
+  EventLog event_log_;
+
+  // Last member, so the thread is joined before anything it uses is destroyed
+  ControlThread control_thread_;
 
 private:
-  void checkParamList(const std::string &param,
-                      std::vector<std::string> &_params_list,
-                      bool &_all_params_read);
+  bool parametersRead(parameters::ParameterGroup _group) const;
+  void logUnreadParameters(parameters::ParameterGroup _group) const;
+  void logMissingParameters(const as2_msgs::msg::ControlMode &_mode) const;
+
+  void updateParameter(const parameters::ParameterDescriptor &_descriptor,
+                       const rclcpp::Parameter &_param);
 
-  void updateControllerParameter(const std::shared_ptr<pid_controller::PIDController> &_pid_handler,
-                                 const std::string &_parameter_name,
+  void updateControllerParameter(PIDGains &_gains,
+                                 const parameters::ParameterDescriptor &_descriptor,
                                  const rclcpp::Parameter &_param);
 
-  void updateController3DParameter(
-      const std::shared_ptr<pid_controller::PIDController3D> &_pid_handler,
-      const std::string &_parameter_name,
-      const rclcpp::Parameter &_param);
+  void updateController3DParameter(PIDGains3D &_gains,
+                                   const parameters::ParameterDescriptor &_descriptor,
+                                   const rclcpp::Parameter &_param);
+
+  void publishGains();
+  void updateGains();
+  const ControllerGains &currentGains() const;
+  void applyControllerGains(const ControllerGains &_gains);
+
+  void updatePipeline();
+
+  // Null while the metrics are disabled, so the probes cost a single branch
+  LatencyHistogram *latencyHistogram(LatencyProbe _probe);
+  void rejectCall(RejectedCall _call);
+  void updateLatencyMetricsPublisher();
+  void publishLatencyMetrics();
+
+  // Starts, restarts or stops the recorder after the telemetry parameters change
+  void updateTelemetry();
+  void recordTelemetry(TelemetryRecorder &_recorder, double _dt, bool _valid);
+
+  // Index of _frame_id in frame_ids_, LogRecord::kNoFrame if it is not one of them
+  uint8_t frameIndex(const std::string &_frame_id) const;
+  void logEvent(const LogRecord &_record) const;
 
-  void updateSpeedInAPlaneParameter(
-      const std::shared_ptr<pid_controller::PIDController> &_pid_1d_handler,
-      const std::shared_ptr<pid_controller::PIDController3D> &_pid_3d_handler,
-      const std::string &_parameter_name,
-      const rclcpp::Parameter &_param);
+  static ComputePipeline selectPipeline(uint8_t _control_mode,
+                                        uint8_t _yaw_mode,
+                                        bool _use_bypass,
+                                        bool _proportional_limitation);
+
+  template <uint8_t _control_mode, bool _use_bypass, bool _proportional_limitation>
+  static ComputePipeline selectYawPipeline(uint8_t _yaw_mode);
+
+  template <uint8_t _control_mode, uint8_t _yaw_mode, bool _use_bypass,
+            bool _proportional_limitation>
+  static bool runPipeline(Plugin &_plugin, double _dt) {
+    return _plugin.computePipeline<_control_mode, _yaw_mode, _use_bypass,
+                                   _proportional_limitation>(_dt);
+  }
+
+  template <uint8_t _control_mode, uint8_t _yaw_mode, bool _use_bypass,
+            bool _proportional_limitation>
+  bool computePipeline(double _dt);
+
+  // Sets the filter weight of _pid for a tick of _dt from the one tuned at the nominal dt
+  template <typename PID>
+  void discretizeFilter(PID &_pid, double _alpha, double _dt);
+
+  static bool unknownControlModePipeline(Plugin &_plugin, double _dt);
+  static bool unknownYawModePipeline(Plugin &_plugin, double _dt);
+
+  const std::string &getFrameId(FrameId _frame_id) const;
+
+  bool convertTwist(const geometry_msgs::msg::TwistStamped &_twist_msg,
+                    FrameId _frame_id,
+                    Eigen::Vector3d &_linear,
+                    double &_yaw_rate);
+
+  double now() const;
+  double trajectoryTime(const builtin_interfaces::msg::Time &_stamp);
+  bool pushSegmentSample(const TrajectorySample &_sample);
+
+  // Only reconfigures the controllers when the limits change
+  void setSpeedLimits(const Eigen::Vector3d &_speed_limits);
+  void clearLimitProfile();
+  void sampleTrajectoryReference();
+
+  void predictState(double _horizon);
+
+  void applyState(const StateInput &_state);
+  void applyReference(const ReferenceInput &_reference);
+  bool dispatchReference(const ReferenceInput &_reference);
+
+  void updateControlThread();
+  void realtimeTick(double _dt);
+  // Applies the queued inputs, the newest state only
+  void drainInputs();
+  void discardInputs();
+  bool getRealtimeOutput(geometry_msgs::msg::Twist &_twist_msg, FrameId &_frame_id);
 
   void resetState();
   void resetReferences();
   void resetCommands();
 
+  // Runs one tick of the control law, false if no valid command is available
+  bool computeCommand(double dt);
+
+  void handOffMode(FrameId _previous_twist_frame_id);
+  void blendHandoff(double _dt);
+
   bool getOutput(geometry_msgs::msg::TwistStamped &twist_msg);
+  bool getOutput(geometry_msgs::msg::Twist &twist_msg) const;
+  const UAV_command &currentCommand() const;
+  void updateOutputFrameId(std_msgs::msg::Header &_header, FrameId _frame_id) const;
 };
 };  // namespace controller_plugin_speed_controller
 
@@ -0,0 +1,205 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_replay.hpp
+ *  \brief      Offline replay of recorded control streams through the speed controller plugin.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_REPLAY_H__
+#define __SP_REPLAY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include "as2_core/node.hpp"
+#include "speed_controller_plugin.hpp"
+
+namespace controller_plugin_speed_controller {
+namespace replay {
+
+enum class TraceRecordType : uint8_t {
+  MODE = 0,              // control_mode, yaw_mode, reference_frame, output reference_frame
+  STATE,                 // position xyz, orientation xyzw, linear velocity xyz, yaw rate
+  POSE_REFERENCE,        // position xyz, orientation xyzw
+  TWIST_REFERENCE,       // linear velocity xyz, yaw rate
+  TRAJECTORY_REFERENCE,  // position xyz, velocity xyz, acceleration xyz, yaw
+  TICK                   // dt
+};
+
+// Frame of the velocities in STATE and TWIST_REFERENCE records
+enum class TraceFrame : uint8_t { ENU = 0, FLU = 1 };
+
+// Fixed size record, stored as is (host byte order) after a TraceHeader
+struct TraceRecord {
+  double time = 0.0;  // [s], stamp of the message or time of the tick
+  TraceRecordType type = TraceRecordType::TICK;
+  TraceFrame frame     = TraceFrame::ENU;
+  uint8_t reserved[6]  = {};
+  double data[12]      = {};
+};
+static_assert(sizeof(TraceRecord) == 112, "Trace records must keep their on-disk layout");
+
+struct TraceHeader {
+  char magic[8]         = {'S', 'P', 'C', 'T', 'R', 'A', 'C', 'E'};
+  uint32_t version      = 1;
+  uint32_t record_size  = sizeof(TraceRecord);
+  uint64_t record_count = 0;
+};
+
+/**
+ * @brief Read-only view of a trace, either memory mapped from a file or owned in memory.
+ */
+class Trace {
+public:
+  explicit Trace(std::vector<TraceRecord> _records);
+  ~Trace();
+
+  Trace(Trace &&_other) noexcept;
+  Trace &operator=(Trace &&_other) noexcept;
+  Trace(const Trace &)            = delete;
+  Trace &operator=(const Trace &) = delete;
+
+  // Throws std::runtime_error if the file can not be mapped or is not a valid trace
+  static Trace open(const std::string &_path);
+
+  const TraceRecord *begin() const { return records_; }
+  const TraceRecord *end() const { return records_ + size_; }
+  size_t size() const { return size_; }
+
+private:
+  Trace() = default;
+
+  std::vector<TraceRecord> owned_;
+  const TraceRecord *records_ = nullptr;
+  size_t size_                = 0;
+  void *mapping_              = nullptr;
+  size_t mapping_size_        = 0;
+};
+
+// Throws std::runtime_error if the file can not be written
+void writeTrace(const std::string &_path, const std::vector<TraceRecord> &_records);
+
+struct ReplayCase {
+  std::string name;
+  std::vector<rclcpp::Parameter> parameters;
+};
+
+// Commanded twist of every TICK record, one column per field
+struct ReplayOutput {
+  std::string name;
+  std::vector<double> time;
+  std::vector<uint8_t> valid;
+  std::vector<double> linear_x;
+  std::vector<double> linear_y;
+  std::vector<double> linear_z;
+  std::vector<double> yaw_rate;
+
+  size_t size() const { return time.size(); }
+
+  // Drops the ticks and keeps the capacity, for callers that only read the last one
+  void clear() {
+    time.clear();
+    valid.clear();
+    linear_x.clear();
+    linear_y.clear();
+    linear_z.clear();
+    yaw_rate.clear();
+  }
+
+  // Throws std::runtime_error if the file can not be written
+  void writeCsv(const std::string &_path) const;
+};
+
+/**
+ * @brief Plugin attached to a node that is never spun: the node only provides the logger and
+ * the parameters the plugin reads through node_ptr_. The plugin clock is the time of the record
+ * being applied
+ */
+class Replayer {
+public:
+  explicit Replayer(const ReplayCase &_case);
+
+  // TICK records append the commanded twist to _output
+  void apply(const TraceRecord &_record, ReplayOutput &_output);
+
+  Plugin &plugin() { return plugin_; }
+
+private:
+  const std::string &frameId(TraceFrame _frame) const;
+
+  std::shared_ptr<as2::Node> node_;
+  Plugin plugin_;
+  std::string frame_ids_[2];
+  double time_ = 0.0;  // [s], of the record being applied
+
+  geometry_msgs::msg::PoseStamped pose_;
+  geometry_msgs::msg::TwistStamped twist_;
+  geometry_msgs::msg::PoseStamped pose_ref_;
+  geometry_msgs::msg::TwistStamped twist_ref_;
+  as2_msgs::msg::TrajectoryPoint trajectory_ref_;
+
+  geometry_msgs::msg::PoseStamped pose_cmd_;
+  geometry_msgs::msg::TwistStamped twist_cmd_;
+  as2_msgs::msg::Thrust thrust_cmd_;
+};
+
+/**
+ * @brief Run a trace through a new plugin configured with the case parameters.
+ *
+ * Records are applied in order and synchronously: no executor is spun and the plugin time is
+ * taken from the record stamps, so the same trace and parameters always give the same output.
+ * rclcpp must be initialized.
+ */
+ReplayOutput replay(const Trace &_trace, const ReplayCase &_case);
+
+// Cases are distributed over _threads workers, 0 uses every hardware thread
+std::vector<ReplayOutput> replay(const Trace &_trace,
+                                 const std::vector<ReplayCase> &_cases,
+                                 size_t _threads = 0);
+
+// Runs _task(0) .. _task(_count - 1) on _threads workers (0: every hardware thread) and rethrows
+// the first exception once all of them are done
+void parallelFor(size_t _count, size_t _threads, const std::function<void(size_t)> &_task);
+
+// Values of every schema parameter declared on _node, e.g. loaded from a params file
+std::vector<rclcpp::Parameter> schemaParameters(const rclcpp::Node &_node);
+
+}  // namespace replay
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,133 @@
+/*!*******************************************************************************************
+ *  \file       include/controller_plugin_speed_controller/speed_controller_saturation.hpp
+ *  \brief      Branch-free speed saturation of one or many commands.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#ifndef __SP_SATURATION_H__
+#define __SP_SATURATION_H__
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief Per-axis clamp, or uniform scaling of the whole vector with proportional limitation.
+ *
+ * Same result as PIDController3D::saturateOutput, without data-dependent branches. Both
+ * saturations are folded into clamp(command * factor, limit), where the factor is the
+ * proportional scale or 1, and the masks select with m * a + (1 - m) * b, which is exact for
+ * masks of 0 or 1 and finite values. The compiler can not speculate floating point ops out of
+ * a select under -ftrapping-math, so the array version has no selects at all: it is a single
+ * loop of min, max, mul and div that vectorizes, and saturated commands cost the same as
+ * unsaturated ones. Unlimited axes take a limit of kUnlimited.
+ */
+namespace saturation {
+
+constexpr double kUnlimited = std::numeric_limits<double>::infinity();
+
+// Limits <= 0 leave their axis unsaturated
+inline double effectiveLimit(double _limit) { return _limit > 0.0 ? _limit : kUnlimited; }
+
+inline double clamp(double _value, double _limit) {
+  return std::min(std::max(_value, -_limit), _limit);
+}
+
+// Largest factor that keeps _value within _limit, at most 1
+inline double ratio(double _value, double _limit) {
+  return std::min(1.0, _limit / std::abs(_value));
+}
+
+inline double blend(double _mask, double _a, double _b) { return _mask * _a + (1.0 - _mask) * _b; }
+
+inline void saturate(double &_x,
+                     double &_y,
+                     double &_z,
+                     double _limit_x,
+                     double _limit_y,
+                     double _limit_z,
+                     double _proportional_mask,
+                     double _active_mask) {
+  const double scale =
+      std::min(std::min(ratio(_x, _limit_x), ratio(_y, _limit_y)), ratio(_z, _limit_z));
+  // The clamp is a no-op on scaled commands, up to rounding
+  const double factor = blend(_proportional_mask, scale, 1.0);
+
+  _x = blend(_active_mask, clamp(_x * factor, _limit_x), _x);
+  _y = blend(_active_mask, clamp(_y * factor, _limit_y), _y);
+  _z = blend(_active_mask, clamp(_z * factor, _limit_z), _z);
+}
+
+}  // namespace saturation
+
+// Single vehicle, in place. Limits <= 0 leave their axis unsaturated
+inline void saturateCommand(Eigen::Vector3d &_command,
+                            const Eigen::Vector3d &_limits,
+                            bool _proportional_limitation) {
+  saturation::saturate(_command.x(), _command.y(), _command.z(),
+                       saturation::effectiveLimit(_limits.x()),
+                       saturation::effectiveLimit(_limits.y()),
+                       saturation::effectiveLimit(_limits.z()),
+                       _proportional_limitation ? 1.0 : 0.0, 1.0);
+}
+
+// Commands and limits of _count vehicles stored as one column per axis, saturated in place.
+// Limits are kUnlimited for unsaturated axes, masks are 1 to enable proportional limitation and
+// saturation of each vehicle, 0 otherwise
+inline void saturateCommands(double *__restrict__ _x,
+                             double *__restrict__ _y,
+                             double *__restrict__ _z,
+                             const double *__restrict__ _limit_x,
+                             const double *__restrict__ _limit_y,
+                             const double *__restrict__ _limit_z,
+                             const double *__restrict__ _proportional_mask,
+                             const double *__restrict__ _active_mask,
+                             size_t _count) {
+  for (size_t i = 0; i < _count; i++) {
+    double x = _x[i];
+    double y = _y[i];
+    double z = _z[i];
+    saturation::saturate(x, y, z, _limit_x[i], _limit_y[i], _limit_z[i], _proportional_mask[i],
+                         _active_mask[i]);
+    _x[i] = x;
+    _y[i] = y;
+    _z[i] = z;
+  }
+}
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,132 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_spsc_queue.hpp
+ *  \brief      Bounded lock-free single producer / single consumer queue.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_SPSC_QUEUE_H__
+#define __SP_SPSC_QUEUE_H__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief Wait-free bounded single producer / single consumer ring buffer
+ *
+ * The producer calls push(), the consumer pop(). Each side caches the index of the other one
+ * and only reloads it when the queue looks full or empty, so an uncontended call touches a
+ * single shared cache line. Slots are preallocated, nothing is allocated after construction.
+ */
+template <typename T, size_t kCapacity>
+class SpscQueue {
+  static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+                "Queue capacity must be 2^n");
+
+public:
+  static constexpr size_t capacity() { return kCapacity; }
+
+  // Producer side, false if the queue is full and the value was dropped
+  bool push(const T &_value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == kCapacity) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == kCapacity) {
+        return false;
+      }
+    }
+    slots_[tail & kIndexMask] = _value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, false if the queue is empty
+  bool pop(T &_value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    _value = slots_[head & kIndexMask];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Exact from either side while the other one is idle, a snapshot otherwise
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+
+private:
+  static constexpr size_t kIndexMask = kCapacity - 1;
+
+  // Consumer line: next slot to pop and the last tail seen
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+
+  // Producer line: next slot to push and the last head seen
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+
+  alignas(64) std::array<T, kCapacity> slots_{};
+};
+
+/**
+ * @brief Lock that serializes the producers of SpscQueue instances
+ *
+ * Only the non real-time side takes it, several executor threads may be calling into the
+ * producer side at once. It yields while taken, usable with the std lock types.
+ */
+class SpinLock {
+public:
+  void lock() {
+    while (flag_.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  bool try_lock() { return !flag_.test_and_set(std::memory_order_acquire); }
+  void unlock() { flag_.clear(std::memory_order_release); }
+
+private:
+  std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
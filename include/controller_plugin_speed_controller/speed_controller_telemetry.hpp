@@ -0,0 +1,197 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_telemetry.hpp
+ *  \brief      Binary telemetry of the control loop internals, flushed to a memory-mapped file.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_TELEMETRY_H__
+#define __SP_TELEMETRY_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "speed_controller_spsc_queue.hpp"
+
+namespace controller_plugin_speed_controller {
+
+// TelemetryRecord::flags
+enum TelemetryFlag : uint8_t {
+  TELEMETRY_TRANSLATION_LOOP = 1 << 0,  // The translation loop ran on this tick
+  TELEMETRY_YAW_LOOP         = 1 << 1,  // The yaw loop ran on this tick
+  TELEMETRY_BYPASS           = 1 << 2,  // Speed reference forwarded without PID
+  TELEMETRY_HANDOFF          = 1 << 3,  // Command blended from the previous mode
+  TELEMETRY_VALID            = 1 << 4,  // computeOutput returned a command
+};
+
+/**
+ * @brief Internals of one control tick, as written to the telemetry file.
+ *
+ * Vectors of four are x, y, z and yaw. In SPEED_IN_A_PLANE the z axis is the height loop, its
+ * error is a position error. The PID terms are derived from the error and the gains of the
+ * tick: proportional = kp * error, integral_derivative is the rest of the controller output
+ * without the TRAJECTORY feed-forward, which is output - proportional - integral_derivative. It
+ * also carries the output saturation of the PID when the saturated bit of the axis is set.
+ */
+struct TelemetryRecord {
+  uint64_t tick        = 0;    // Ticks since the recorder started, gaps are dropped records
+  double time          = 0.0;  // Control time [s]
+  double dt            = 0.0;  // dt of the tick [s], before conditioning
+  uint8_t control_mode = 0;
+  uint8_t yaw_mode     = 0;
+  uint8_t flags        = 0;  // TelemetryFlag bits
+  uint8_t saturated    = 0;  // Bit per axis: the command was limited to the speed limits
+  uint32_t reserved    = 0;
+
+  double reference_position[3] = {};
+  double reference_velocity[3] = {};
+  double reference_yaw         = 0.0;
+  double reference_yaw_rate    = 0.0;
+  double state_position[3]     = {};
+  double state_velocity[3]     = {};
+  double state_yaw             = 0.0;
+  double state_yaw_rate        = 0.0;
+
+  double error[4]               = {};
+  double proportional[4]        = {};
+  double integral_derivative[4] = {};
+  double controller_output[4]   = {};  // Before the speed limits of the plugin
+  double command[4]             = {};  // As published
+};
+static_assert(sizeof(TelemetryRecord) == 320, "Telemetry records are five cache lines");
+
+// Self-describing file layout: a header page with the schema, then the records back to back
+enum class TelemetryFieldType : uint8_t { UINT8 = 0, UINT64, DOUBLE };
+
+struct TelemetryField {
+  static constexpr size_t kNameSize = 32;
+
+  char name[kNameSize];  // NUL terminated
+  uint32_t offset;       // In the record [bytes]
+  TelemetryFieldType type;
+  uint8_t reserved[3];
+};
+static_assert(sizeof(TelemetryField) == 40, "Telemetry fields are part of the file format");
+
+struct TelemetryFileHeader {
+  static constexpr uint32_t kSize = 4096;  // Header and schema, one page
+
+  char magic[8]         = {'S', 'P', 'C', 'T', 'E', 'L', 'E', 'M'};
+  uint32_t version      = 1;
+  uint32_t header_size  = kSize;
+  uint32_t record_size  = sizeof(TelemetryRecord);
+  uint32_t field_count  = 0;
+  uint64_t record_count = 0;  // Updated after every flush
+  // TelemetryField[field_count] follow, inside the header page
+};
+
+// Schema of TelemetryRecord, one field per column of the exported table
+extern const std::array<TelemetryField, 43> kTelemetrySchema;
+static_assert(sizeof(TelemetryFileHeader) + sizeof(kTelemetrySchema) <= TelemetryFileHeader::kSize,
+              "Telemetry schema does not fit in the header page");
+
+/**
+ * @brief Recorder of TelemetryRecord from the control loop to a file.
+ *
+ * record() copies the tick into a preallocated single producer ring, without locking nor
+ * allocating. A background thread at the lowest scheduling priority appends the ring to a
+ * memory-mapped file, growing it as needed, and keeps the record count of the header up to
+ * date so a file left by a crash is still readable. Records that do not fit in the ring are
+ * counted as dropped.
+ */
+class TelemetryRecorder {
+public:
+  static constexpr size_t kCapacity = 4096;  // Records in the ring, 4 s at 1 kHz
+
+  TelemetryRecorder();
+  TelemetryRecorder(const TelemetryRecorder &)            = delete;
+  TelemetryRecorder &operator=(const TelemetryRecorder &) = delete;
+  ~TelemetryRecorder();
+
+  // Truncates _path, writes the schema and starts flushing every _period. False if the file can
+  // not be created. Not thread safe, start and stop from the same thread
+  bool start(const std::string &_path,
+             std::chrono::milliseconds _period = std::chrono::milliseconds(50));
+  // Flushes what is left, trims and closes the file
+  void stop();
+
+  bool active() const { return active_.load(std::memory_order_relaxed); }
+  const std::string &path() const { return path_; }
+
+  // Control loop only. Sets the tick of _record, false if inactive or dropped
+  bool record(TelemetryRecord &_record);
+
+  // Appends the queued records to the file, from a single consumer. Returns the records written
+  size_t flush();
+
+  uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  using Ring = SpscQueue<TelemetryRecord, kCapacity>;
+
+  bool reserve(size_t _records);
+  void closeFile();
+  void run(std::chrono::milliseconds _period);
+
+  // Producer side
+  std::atomic<bool> active_{false};
+  uint64_t tick_ = 0;
+  std::atomic<uint64_t> dropped_{0};
+
+  // Heap allocated once, so the plugin only pays for it when telemetry is used
+  std::unique_ptr<Ring> ring_;
+
+  // Consumer side: the file is mapped from its start, header included
+  std::string path_;
+  int fd_          = -1;
+  uint8_t *map_    = nullptr;
+  size_t map_size_ = 0;
+  std::atomic<uint64_t> written_{0};
+
+  std::thread thread_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool stop_requested_ = false;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,95 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_telemetry_reader.hpp
+ *  \brief      Offline reader of the telemetry files, with CSV export.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_TELEMETRY_READER_H__
+#define __SP_TELEMETRY_READER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "speed_controller_telemetry.hpp"
+
+namespace controller_plugin_speed_controller {
+
+/**
+ * @brief Read-only view of a telemetry file, memory mapped.
+ *
+ * Columns come from the schema stored in the file rather than from TelemetryRecord, so files
+ * written before a field was added are still read. Records past the last flush of a recorder
+ * that did not stop cleanly are ignored.
+ */
+class TelemetryReader {
+public:
+  ~TelemetryReader();
+
+  TelemetryReader(TelemetryReader &&_other) noexcept;
+  TelemetryReader &operator=(TelemetryReader &&_other) noexcept;
+  TelemetryReader(const TelemetryReader &)            = delete;
+  TelemetryReader &operator=(const TelemetryReader &) = delete;
+
+  // Throws std::runtime_error if the file can not be mapped or is not a telemetry file
+  static TelemetryReader open(const std::string &_path);
+
+  const std::vector<TelemetryField> &fields() const { return fields_; }
+  size_t size() const { return size_; }
+
+  // Index of the field called _name, -1 if the file does not have it
+  int findField(std::string_view _name) const;
+  double value(size_t _record, size_t _field) const;
+
+  // Header row with the field names, then one row per record. Throws std::runtime_error if the
+  // file can not be written
+  void writeCsv(std::ostream &_stream) const;
+  void writeCsv(const std::string &_path) const;
+
+private:
+  TelemetryReader() = default;
+
+  std::vector<TelemetryField> fields_;
+  const uint8_t *records_ = nullptr;
+  size_t record_size_     = 0;
+  size_t size_            = 0;
+  void *mapping_          = nullptr;
+  size_t mapping_size_    = 0;
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,218 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_trajectory_buffer.hpp
+ *  \brief      Time-indexed look-ahead buffer of trajectory references with Hermite interpolation.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_TRAJECTORY_BUFFER_H__
+#define __SP_TRAJECTORY_BUFFER_H__
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace controller_plugin_speed_controller {
+
+struct TrajectorySample {
+  double time                  = 0.0;  // [s]
+  Eigen::Vector3d position     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d acceleration = Eigen::Vector3d::Zero();
+  double yaw                   = 0.0;
+  double yaw_rate              = 0.0;  // [rad/s] of the interpolated yaw, zero when held
+};
+
+/**
+ * @brief Fixed size ring buffer of trajectory samples ordered by time.
+ *
+ * Between two samples the position and velocity follow the cubic Hermite spline defined by
+ * their positions and velocities, the acceleration and yaw are linearly interpolated. Past the
+ * newest sample the reference is extrapolated with its velocity and acceleration for at most
+ * max_extrapolation seconds, after that it is held at rest. Before the oldest sample that one is
+ * held.
+ */
+class TrajectoryBuffer {
+public:
+  // Enough for a few seconds of a whole trajectory segment at the usual generator rates
+  static constexpr size_t kCapacity = 128;
+
+  explicit TrajectoryBuffer(double _max_extrapolation = 0.1)
+      : max_extrapolation_(_max_extrapolation) {}
+
+  void clear() {
+    head_ = 0;
+    size_ = 0;
+  }
+
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == kCapacity; }
+
+  const TrajectorySample &newest() const { return samples_[(head_ + size_ - 1) % kCapacity]; }
+  size_t size() const { return size_; }
+
+  // A sample older than the newest one starts a new trajectory, a full buffer drops the oldest
+  void push(const TrajectorySample &_sample) {
+    if (size_ > 0) {
+      TrajectorySample &newest = at(size_ - 1);
+      if (_sample.time == newest.time) {
+        newest = _sample;
+        return;
+      }
+      if (_sample.time < newest.time) {
+        clear();
+      }
+    }
+    if (size_ == kCapacity) {
+      head_ = (head_ + 1) % kCapacity;
+      size_--;
+    }
+    samples_[(head_ + size_) % kCapacity] = _sample;
+    size_++;
+  }
+
+  // Reference at _time, discarding the samples that can no longer be used. False when empty
+  bool sample(double _time, TrajectorySample &_sample) {
+    if (size_ == 0) {
+      return false;
+    }
+    release(_time);
+    return evaluate(_time, _sample);
+  }
+
+  // Reference at _time without discarding samples, used to look ahead of the current segment
+  bool evaluate(double _time, TrajectorySample &_sample) const {
+    if (size_ == 0) {
+      return false;
+    }
+    const TrajectorySample &start = at(0);
+    if (_time <= start.time) {
+      _sample          = start;
+      _sample.time     = _time;
+      _sample.yaw_rate = 0.0;
+      return true;
+    }
+    size_t segment = 0;
+    while (segment + 1 < size_ && at(segment + 1).time <= _time) {
+      segment++;
+    }
+    if (segment + 1 == size_) {
+      extrapolate(at(segment), _time, _sample);
+      return true;
+    }
+    interpolate(at(segment), at(segment + 1), _time, _sample);
+    return true;
+  }
+
+  // Keep the latest sample at or before _time as the start of the current segment
+  void release(double _time) {
+    while (size_ > 1 && at(1).time <= _time) {
+      head_ = (head_ + 1) % kCapacity;
+      size_--;
+    }
+  }
+
+  // Drop the samples at or after _time, which a segment starting at _time replaces
+  void truncate(double _time) {
+    while (size_ > 0 && at(size_ - 1).time >= _time) {
+      size_--;
+    }
+  }
+
+  static void interpolate(const TrajectorySample &_start,
+                          const TrajectorySample &_end,
+                          double _time,
+                          TrajectorySample &_sample) {
+    const double h  = _end.time - _start.time;
+    const double s  = (_time - _start.time) / h;
+    const double s2 = s * s;
+    const double s3 = s2 * s;
+
+    const double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+    const double h10 = s3 - 2.0 * s2 + s;
+    const double h01 = -2.0 * s3 + 3.0 * s2;
+    const double h11 = s3 - s2;
+
+    const double dh00 = (6.0 * s2 - 6.0 * s) / h;
+    const double dh10 = 3.0 * s2 - 4.0 * s + 1.0;
+    const double dh01 = (-6.0 * s2 + 6.0 * s) / h;
+    const double dh11 = 3.0 * s2 - 2.0 * s;
+
+    _sample.time         = _time;
+    _sample.position     = h00 * _start.position + h10 * h * _start.velocity +
+                           h01 * _end.position + h11 * h * _end.velocity;
+    _sample.velocity     = dh00 * _start.position + dh10 * _start.velocity +
+                           dh01 * _end.position + dh11 * _end.velocity;
+    _sample.acceleration = (1.0 - s) * _start.acceleration + s * _end.acceleration;
+    _sample.yaw          = _start.yaw + s * wrapAngle(_end.yaw - _start.yaw);
+    _sample.yaw_rate     = wrapAngle(_end.yaw - _start.yaw) / h;
+  }
+
+  void extrapolate(const TrajectorySample &_start, double _time, TrajectorySample &_sample) const {
+    const double dt = std::min(_time - _start.time, max_extrapolation_);
+
+    _sample.time = _time;
+    _sample.position =
+        _start.position + dt * _start.velocity + 0.5 * dt * dt * _start.acceleration;
+    _sample.yaw      = _start.yaw;
+    _sample.yaw_rate = 0.0;
+    if (_time - _start.time > max_extrapolation_) {
+      // A stalled generator leaves the reference at rest instead of pulling it along
+      _sample.velocity     = Eigen::Vector3d::Zero();
+      _sample.acceleration = Eigen::Vector3d::Zero();
+      return;
+    }
+    _sample.velocity     = _start.velocity + dt * _start.acceleration;
+    _sample.acceleration = _start.acceleration;
+  }
+
+private:
+  std::array<TrajectorySample, kCapacity> samples_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+  double max_extrapolation_;
+
+  TrajectorySample &at(size_t _index) { return samples_[(head_ + _index) % kCapacity]; }
+  const TrajectorySample &at(size_t _index) const {
+    return samples_[(head_ + _index) % kCapacity];
+  }
+
+  static double wrapAngle(double _angle) {
+    return _angle - 2.0 * M_PI * std::floor((_angle + M_PI) / (2.0 * M_PI));
+  }
+};
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
@@ -0,0 +1,129 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_tuner.hpp
+ *  \brief      Closed-loop evaluation and random search of the speed controller gains.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_TUNER_H__
+#define __SP_TUNER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include "speed_controller_replay.hpp"
+
+namespace controller_plugin_speed_controller {
+namespace tuning {
+
+/**
+ * @brief Point mass whose velocity and yaw rate follow the commanded twist (ENU or FLU) with a
+ * first order lag
+ */
+struct PlantModel {
+  double velocity_time_constant = 0.1;   // [s]
+  double yaw_rate_time_constant = 0.05;  // [s]
+  // Weight of the squared yaw (rate) error against the squared position (velocity) error
+  double yaw_weight = 1.0;
+  // Tracking errors above this distance [m] or speed [m/s] mark the candidate as diverged
+  double divergence_error = 100.0;
+};
+
+// State of the PlantModel point mass, in ENU
+struct PlantState {
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  double yaw               = 0.0;
+  double yaw_rate          = 0.0;
+};
+
+// Advances _state by _dt with the commanded ENU velocity and yaw rate, stable for any dt
+void stepPlant(const PlantModel &_plant,
+               const Eigen::Vector3d &_velocity,
+               double _yaw_rate,
+               double _dt,
+               PlantState &_state);
+
+// Sampled uniformly (or log-uniformly) in [min, max], the same value is set to all names
+struct GainRange {
+  std::vector<std::string> names;
+  double min       = 0.0;
+  double max       = 1.0;
+  bool logarithmic = false;
+};
+
+struct TuningConfig {
+  // Configuration the candidates are cloned from, also evaluated as the first candidate
+  std::vector<rclcpp::Parameter> base;
+  std::vector<GainRange> ranges;
+  size_t candidates = 1000;
+  uint64_t seed     = 0;
+  size_t threads    = 0;  // 0 uses every hardware thread
+  PlantModel plant;
+};
+
+struct TuningResult {
+  std::vector<rclcpp::Parameter> gains;  // Values of the ranges, in TuningConfig::ranges order
+  double cost = 0.0;
+};
+
+/**
+ * @brief Closed loop replay of a trace: MODE, reference and TICK records come from the trace,
+ * the state fed back on every tick from the plant, seeded with the first STATE record.
+ *
+ * @return Mean squared tracking error of the mode in use over the valid ticks, infinity if the
+ * plugin never produced an output or the plant diverged.
+ */
+double evaluate(const replay::Trace &_trace,
+                const replay::ReplayCase &_case,
+                const PlantModel &_plant);
+
+// Every candidate evaluated on the trace, best (lowest cost) first
+std::vector<TuningResult> tune(const replay::Trace &_trace, const TuningConfig &_config);
+
+// _base with the values of _overrides, which are appended if missing
+std::vector<rclcpp::Parameter> mergeParameters(const std::vector<rclcpp::Parameter> &_base,
+                                               const std::vector<rclcpp::Parameter> &_overrides);
+
+// ROS 2 parameters file for every node (/**), nesting the parameter names on their dots. Throws
+// std::runtime_error if the file can not be written
+void writeParametersYaml(const std::string &_path,
+                         const std::vector<rclcpp::Parameter> &_parameters);
+
+}  // namespace tuning
+}  // namespace controller_plugin_speed_controller
+
+#endif
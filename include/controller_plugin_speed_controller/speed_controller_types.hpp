@@ -0,0 +1,118 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_types.hpp
+ *  \brief      State and command types shared by the speed controller plugin and engines.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_TYPES_H__
+#define __SP_TYPES_H__
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <cstdint>
+
+namespace controller_plugin_speed_controller {
+
+struct UAV_state {
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  Eigen::Vector3d yaw      = Eigen::Vector3d::Zero();
+};
+
+struct UAV_command {
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  double yaw_speed         = 0.0;
+};
+
+// Rotation between the ENU and FLU frames about the vertical axis, when both frames are
+// related by the UAV yaw only
+struct YawRotation {
+  double cos_yaw = 1.0;
+  double sin_yaw = 0.0;
+
+  void update(double _yaw) {
+    cos_yaw = std::cos(_yaw);
+    sin_yaw = std::sin(_yaw);
+  }
+
+  Eigen::Vector3d enuToFlu(const Eigen::Vector3d &_vector) const {
+    return Eigen::Vector3d(cos_yaw * _vector.x() + sin_yaw * _vector.y(),
+                           -sin_yaw * _vector.x() + cos_yaw * _vector.y(), _vector.z());
+  }
+
+  Eigen::Vector3d fluToEnu(const Eigen::Vector3d &_vector) const {
+    return Eigen::Vector3d(cos_yaw * _vector.x() - sin_yaw * _vector.y(),
+                           sin_yaw * _vector.x() + cos_yaw * _vector.y(), _vector.z());
+  }
+};
+
+// Runs a loop on one tick out of _divider, the first one right after a reset, and accumulates
+// the dt of the skipped ticks for the next run
+struct RateDivider {
+  uint32_t countdown = 0;
+  double elapsed     = 0.0;
+
+  bool tick(double _dt, uint32_t _divider, double &_loop_dt) {
+    elapsed += _dt;
+    if (countdown > 0) {
+      countdown--;
+      return false;
+    }
+    countdown = _divider > 0 ? _divider - 1 : 0;
+    _loop_dt  = elapsed;
+    elapsed   = 0.0;
+    return true;
+  }
+
+  void reset() {
+    countdown = 0;
+    elapsed   = 0.0;
+  }
+};
+
+// Value following _target with a first order lag of time constant _tau (held if _tau is 0),
+// _horizon seconds later. _integral is set to its integral over the horizon
+template <typename T>
+T predictFirstOrder(const T &_value, const T &_target, double _tau, double _horizon, T &_integral) {
+  if (_tau <= 0.0) {
+    _integral = _value * _horizon;
+    return _value;
+  }
+  const double decay = std::exp(-_horizon / _tau);
+  _integral          = _target * _horizon + (_value - _target) * (_tau * (1.0 - decay));
+  return _target + (_value - _target) * decay;
+}
+
+}  // namespace controller_plugin_speed_controller
+
+#endif
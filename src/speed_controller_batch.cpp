@@ -0,0 +1,305 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_batch.cpp
+ *  \brief      Structure-of-arrays speed controller engine for many vehicles.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "speed_controller_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "speed_controller_saturation.hpp"
+
+namespace controller_plugin_speed_controller {
+
+namespace {
+
+constexpr double kTwoPi    = 2.0 * M_PI;
+constexpr double kInvTwoPi = 1.0 / kTwoPi;
+
+void resizeColumns(std::initializer_list<SpeedControllerBatch::Array *> _columns, size_t _size) {
+  for (auto *column : _columns) {
+    column->resize(_size, 0.0);
+  }
+}
+
+}  // namespace
+
+SpeedControllerBatch::SpeedControllerBatch(size_t _size) { resize(_size); }
+
+void SpeedControllerBatch::resize(size_t _size) {
+  for (auto &axis : axes_) {
+    resizeColumns({&axis.position, &axis.velocity, &axis.ref_position, &axis.ref_velocity,
+                   &axis.kp, &axis.ki, &axis.kd, &axis.integral, &axis.last_error,
+                   &axis.filtered_derivative, &axis.command},
+                  _size);
+    // Stored as the saturation kernel takes them, unlimited until setSpeedLimits
+    axis.speed_limit.resize(_size, saturation::kUnlimited);
+  }
+  resizeColumns({&slots_.antiwindup_cte, &slots_.alpha, &slots_.reset_integral,
+                 &slots_.speed_mask, &slots_.trajectory_mask, &slots_.bypass_mask,
+                 &slots_.saturation_mask, &slots_.proportional_mask, &slots_.initialized},
+                _size);
+  resizeColumns({&yaw_.yaw, &yaw_.ref_yaw, &yaw_.ref_yaw_rate, &yaw_.kp, &yaw_.ki, &yaw_.kd,
+                 &yaw_.antiwindup_cte, &yaw_.alpha, &yaw_.reset_integral, &yaw_.angle_mask,
+                 &yaw_.integral, &yaw_.last_error, &yaw_.filtered_derivative, &yaw_.command},
+                _size);
+  gains_.resize(_size);
+  control_mode_.resize(_size, as2_msgs::msg::ControlMode::UNSET);
+  yaw_mode_.resize(_size, as2_msgs::msg::ControlMode::YAW_ANGLE);
+  size_ = _size;
+}
+
+void SpeedControllerBatch::setGains(size_t _slot, const ControllerGains &_gains) {
+  gains_[_slot] = _gains;
+  loadActiveGains(_slot);
+}
+
+bool SpeedControllerBatch::setMode(size_t _slot,
+                                   uint8_t _control_mode,
+                                   uint8_t _yaw_mode,
+                                   bool _use_bypass,
+                                   bool _proportional_limitation) {
+  using as2_msgs::msg::ControlMode;
+
+  switch (_control_mode) {
+    case ControlMode::HOVER:
+    case ControlMode::POSITION:
+    case ControlMode::SPEED:
+    case ControlMode::TRAJECTORY:
+      break;
+    default:
+      return false;
+  }
+  if (_yaw_mode != ControlMode::YAW_ANGLE && _yaw_mode != ControlMode::YAW_SPEED) {
+    return false;
+  }
+
+  const bool speed_mode = _control_mode == ControlMode::SPEED;
+  control_mode_[_slot]  = _control_mode;
+  // HOVER always holds the yaw angle, as in the plugin
+  yaw_mode_[_slot] = _control_mode == ControlMode::HOVER ? ControlMode::YAW_ANGLE : _yaw_mode;
+
+  slots_.speed_mask[_slot]        = speed_mode ? 1.0 : 0.0;
+  slots_.trajectory_mask[_slot]   = _control_mode == ControlMode::TRAJECTORY ? 1.0 : 0.0;
+  slots_.bypass_mask[_slot]       = speed_mode && _use_bypass ? 1.0 : 0.0;
+  slots_.saturation_mask[_slot]   = speed_mode ? 0.0 : 1.0;
+  slots_.proportional_mask[_slot] = _proportional_limitation ? 1.0 : 0.0;
+  yaw_.angle_mask[_slot]          = yaw_mode_[_slot] == ControlMode::YAW_ANGLE ? 1.0 : 0.0;
+
+  loadActiveGains(_slot);
+  reset(_slot);
+  return true;
+}
+
+void SpeedControllerBatch::setSpeedLimits(size_t _slot, const Eigen::Vector3d &_speed_limits) {
+  for (size_t i = 0; i < 3; i++) {
+    axes_[i].speed_limit[_slot] = saturation::effectiveLimit(std::abs(_speed_limits[i]));
+  }
+}
+
+void SpeedControllerBatch::updateState(size_t _slot, const UAV_state &_state) {
+  for (size_t i = 0; i < 3; i++) {
+    axes_[i].position[_slot] = _state.position[i];
+    axes_[i].velocity[_slot] = _state.velocity[i];
+  }
+  yaw_.yaw[_slot] = _state.yaw.x();
+}
+
+void SpeedControllerBatch::updateReference(size_t _slot, const UAV_state &_reference) {
+  for (size_t i = 0; i < 3; i++) {
+    axes_[i].ref_position[_slot] = _reference.position[i];
+    axes_[i].ref_velocity[_slot] = _reference.velocity[i];
+  }
+  yaw_.ref_yaw[_slot]      = _reference.yaw.x();
+  yaw_.ref_yaw_rate[_slot] = _reference.yaw.y();
+}
+
+void SpeedControllerBatch::reset(size_t _slot) {
+  for (auto &axis : axes_) {
+    axis.integral[_slot]            = 0.0;
+    axis.last_error[_slot]          = 0.0;
+    axis.filtered_derivative[_slot] = 0.0;
+    axis.command[_slot]             = 0.0;
+  }
+  yaw_.integral[_slot]            = 0.0;
+  yaw_.last_error[_slot]          = 0.0;
+  yaw_.filtered_derivative[_slot] = 0.0;
+  yaw_.command[_slot]             = 0.0;
+  slots_.initialized[_slot]       = 0.0;
+}
+
+void SpeedControllerBatch::loadActiveGains(size_t _slot) {
+  using as2_msgs::msg::ControlMode;
+
+  const ControllerGains &gains = gains_[_slot];
+  const PIDGains3D *active     = &gains.position;
+  if (control_mode_[_slot] == ControlMode::SPEED) {
+    active = &gains.speed;
+  } else if (control_mode_[_slot] == ControlMode::TRAJECTORY) {
+    active = &gains.trajectory;
+  }
+
+  for (size_t i = 0; i < 3; i++) {
+    axes_[i].kp[_slot] = active->kp[i];
+    axes_[i].ki[_slot] = active->ki[i];
+    axes_[i].kd[_slot] = active->kd[i];
+  }
+  slots_.antiwindup_cte[_slot] = active->antiwindup_cte;
+  slots_.alpha[_slot]          = active->alpha;
+  slots_.reset_integral[_slot] = active->reset_integral ? 1.0 : 0.0;
+
+  yaw_.kp[_slot]             = gains.yaw.kp;
+  yaw_.ki[_slot]             = gains.yaw.ki;
+  yaw_.kd[_slot]             = gains.yaw.kd;
+  yaw_.antiwindup_cte[_slot] = gains.yaw.antiwindup_cte;
+  yaw_.alpha[_slot]          = gains.yaw.alpha;
+  yaw_.reset_integral[_slot] = gains.yaw.reset_integral ? 1.0 : 0.0;
+}
+
+void SpeedControllerBatch::computeOutput(double _dt) {
+  const double inv_dt = _dt > 0.0 ? 1.0 / _dt : 0.0;
+  for (auto &axis : axes_) {
+    computeAxis(axis, _dt, inv_dt);
+  }
+  saturate();
+  computeYaw(_dt, inv_dt);
+
+  double *__restrict__ initialized = slots_.initialized.data();
+  for (size_t i = 0; i < size_; i++) {
+    initialized[i] = 1.0;
+  }
+}
+
+// Branch-free PID over one axis of every slot. The proportional error is the position error,
+// or the velocity error in SPEED. The derivative is the filtered finite difference of that error,
+// or the velocity error in TRAJECTORY.
+void SpeedControllerBatch::computeAxis(AxisColumns &_axis, double _dt, double _inv_dt) {
+  const double *__restrict__ position     = _axis.position.data();
+  const double *__restrict__ velocity     = _axis.velocity.data();
+  const double *__restrict__ ref_position = _axis.ref_position.data();
+  const double *__restrict__ ref_velocity = _axis.ref_velocity.data();
+  const double *__restrict__ kp           = _axis.kp.data();
+  const double *__restrict__ ki           = _axis.ki.data();
+  const double *__restrict__ kd           = _axis.kd.data();
+  const double *__restrict__ antiwindup   = slots_.antiwindup_cte.data();
+  const double *__restrict__ alpha        = slots_.alpha.data();
+  const double *__restrict__ reset_flag   = slots_.reset_integral.data();
+  const double *__restrict__ speed_mask   = slots_.speed_mask.data();
+  const double *__restrict__ traj_mask    = slots_.trajectory_mask.data();
+  const double *__restrict__ bypass_mask  = slots_.bypass_mask.data();
+  const double *__restrict__ initialized  = slots_.initialized.data();
+  double *__restrict__ integral           = _axis.integral.data();
+  double *__restrict__ last_error         = _axis.last_error.data();
+  double *__restrict__ filtered           = _axis.filtered_derivative.data();
+  double *__restrict__ command            = _axis.command.data();
+
+  for (size_t i = 0; i < size_; i++) {
+    const double position_error = ref_position[i] - position[i];
+    const double velocity_error = ref_velocity[i] - velocity[i];
+    const double error = position_error + speed_mask[i] * (velocity_error - position_error);
+
+    const double finite_difference = (error - last_error[i]) * _inv_dt * initialized[i];
+    const double derivative =
+        finite_difference + traj_mask[i] * (velocity_error - finite_difference);
+
+    double accumulated = integral[i] + error * _dt;
+    const bool sign_change = reset_flag[i] > 0.0 && error * last_error[i] < 0.0;
+    accumulated            = sign_change ? 0.0 : accumulated;
+    const double limit     = antiwindup[i];
+    accumulated = limit > 0.0 ? std::min(std::max(accumulated, -limit), limit) : accumulated;
+    integral[i] = accumulated;
+
+    filtered[i]   = alpha[i] * derivative + (1.0 - alpha[i]) * filtered[i];
+    last_error[i] = error;
+
+    const double output = kp[i] * error + ki[i] * accumulated + kd[i] * filtered[i];
+    command[i]          = output + bypass_mask[i] * (ref_velocity[i] - output);
+  }
+}
+
+void SpeedControllerBatch::saturate() {
+  saturateCommands(axes_[0].command.data(), axes_[1].command.data(), axes_[2].command.data(),
+                   axes_[0].speed_limit.data(), axes_[1].speed_limit.data(),
+                   axes_[2].speed_limit.data(), slots_.proportional_mask.data(),
+                   slots_.saturation_mask.data(), size_);
+}
+
+void SpeedControllerBatch::computeYaw(double _dt, double _inv_dt) {
+  const double *__restrict__ yaw          = yaw_.yaw.data();
+  const double *__restrict__ ref_yaw      = yaw_.ref_yaw.data();
+  const double *__restrict__ ref_yaw_rate = yaw_.ref_yaw_rate.data();
+  const double *__restrict__ kp           = yaw_.kp.data();
+  const double *__restrict__ ki           = yaw_.ki.data();
+  const double *__restrict__ kd           = yaw_.kd.data();
+  const double *__restrict__ antiwindup   = yaw_.antiwindup_cte.data();
+  const double *__restrict__ alpha        = yaw_.alpha.data();
+  const double *__restrict__ reset_flag   = yaw_.reset_integral.data();
+  const double *__restrict__ angle_mask   = yaw_.angle_mask.data();
+  const double *__restrict__ initialized  = slots_.initialized.data();
+  double *__restrict__ integral           = yaw_.integral.data();
+  double *__restrict__ last_error         = yaw_.last_error.data();
+  double *__restrict__ filtered           = yaw_.filtered_derivative.data();
+  double *__restrict__ command            = yaw_.command.data();
+
+  for (size_t i = 0; i < size_; i++) {
+    // Shortest angular distance, in [-pi, pi)
+    const double raw_error  = ref_yaw[i] - yaw[i];
+    const double error      = raw_error - kTwoPi * std::floor(raw_error * kInvTwoPi + 0.5);
+    const double derivative = (error - last_error[i]) * _inv_dt * initialized[i];
+
+    double accumulated     = integral[i] + error * _dt;
+    const bool sign_change = reset_flag[i] > 0.0 && error * last_error[i] < 0.0;
+    accumulated            = sign_change ? 0.0 : accumulated;
+    const double limit     = antiwindup[i];
+    accumulated = limit > 0.0 ? std::min(std::max(accumulated, -limit), limit) : accumulated;
+    integral[i] = accumulated;
+
+    filtered[i]   = alpha[i] * derivative + (1.0 - alpha[i]) * filtered[i];
+    last_error[i] = error;
+
+    const double output = kp[i] * error + ki[i] * accumulated + kd[i] * filtered[i];
+    command[i]          = angle_mask[i] * output + (1.0 - angle_mask[i]) * ref_yaw_rate[i];
+  }
+}
+
+UAV_command SpeedControllerBatch::getOutput(size_t _slot) const {
+  UAV_command command;
+  command.velocity =
+      Eigen::Vector3d(axes_[0].command[_slot], axes_[1].command[_slot], axes_[2].command[_slot]);
+  command.yaw_speed = yaw_.command[_slot];
+  return command;
+}
+
+}  // namespace controller_plugin_speed_controller
@@ -0,0 +1,154 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_control_thread.cpp
+ *  \brief      Periodic control thread with real-time scheduling, CPU pinning and locked memory.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "speed_controller_control_thread.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace controller_plugin_speed_controller {
+
+namespace {
+
+constexpr int64_t kNanosecondsPerSecond = 1000000000;
+
+int64_t toNanoseconds(const timespec &_time) {
+  return static_cast<int64_t>(_time.tv_sec) * kNanosecondsPerSecond + _time.tv_nsec;
+}
+
+timespec toTimespec(int64_t _nanoseconds) {
+  timespec time;
+  time.tv_sec  = static_cast<time_t>(_nanoseconds / kNanosecondsPerSecond);
+  time.tv_nsec = static_cast<long>(_nanoseconds % kNanosecondsPerSecond);
+  return time;
+}
+
+int64_t monotonicNow() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return toNanoseconds(now);
+}
+
+}  // namespace
+
+ControlThread::~ControlThread() { stop(); }
+
+RealtimeStatus ControlThread::start(const RealtimeSettings &_settings, Tick _tick) {
+  stop();
+
+  RealtimeStatus status;
+  // Page faults in the control path are what mlockall avoids, so it goes before the thread
+  // touches its stack
+  if (_settings.lock_memory) {
+    status.memory_locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+  }
+
+  const int64_t period_ns = std::max<int64_t>(
+      1, static_cast<int64_t>(_settings.period * static_cast<double>(kNanosecondsPerSecond)));
+  tick_ = std::move(_tick);
+  stop_requested_.store(false, std::memory_order_relaxed);
+  thread_ = std::thread([this, period_ns]() { run(period_ns); });
+  status.started = true;
+
+  const pthread_t handle = thread_.native_handle();
+  if (_settings.priority > 0) {
+    sched_param param{};
+    param.sched_priority =
+        std::clamp(_settings.priority, sched_get_priority_min(SCHED_FIFO),
+                   sched_get_priority_max(SCHED_FIFO));
+    status.scheduling = pthread_setschedparam(handle, SCHED_FIFO, &param) == 0;
+  }
+  if (_settings.cpu >= 0 && _settings.cpu < CPU_SETSIZE) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(_settings.cpu, &cpus);
+    status.affinity = pthread_setaffinity_np(handle, sizeof(cpus), &cpus) == 0;
+  }
+  return status;
+}
+
+void ControlThread::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  stop_requested_.store(true, std::memory_order_relaxed);
+  thread_.join();
+}
+
+void ControlThread::run(int64_t _period_ns) {
+  int64_t last     = monotonicNow();
+  int64_t deadline = last;
+  while (!stop_requested_.load(std::memory_order_relaxed)) {
+    deadline += _period_ns;
+    const timespec wake_up = toTimespec(deadline);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_up, nullptr) == EINTR) {
+    }
+
+    const int64_t now = monotonicNow();
+    tick_(static_cast<double>(now - last) / static_cast<double>(kNanosecondsPerSecond));
+    last = now;
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+
+    const int64_t end = monotonicNow();
+    if (end > deadline + _period_ns) {
+      overruns_.fetch_add(1, std::memory_order_relaxed);
+      deadline = end;
+    }
+  }
+}
+
+PiMutex::PiMutex() {
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_setprotocol(&attributes, PTHREAD_PRIO_INHERIT);
+  pthread_mutex_init(&mutex_, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+}
+
+PiMutex::~PiMutex() { pthread_mutex_destroy(&mutex_); }
+
+void PiMutex::lock() { pthread_mutex_lock(&mutex_); }
+
+bool PiMutex::try_lock() { return pthread_mutex_trylock(&mutex_) == 0; }
+
+void PiMutex::unlock() { pthread_mutex_unlock(&mutex_); }
+
+}  // namespace controller_plugin_speed_controller
@@ -0,0 +1,245 @@
+/*!*******************************************************************************************
+ *  \file       src/speed_controller_event_log.cpp
+ *  \brief      Throttled, non-blocking log events for the control path.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#include "speed_controller_event_log.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace controller_plugin_speed_controller {
+
+namespace {
+
+int64_t steadyNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+/**
+ * @brief The drain thread shared by every started EventLog of the process.
+ *
+ * Started with the first log and joined when the last one stops, so plugins that are created
+ * by the hundred do not bring a thread each. The records are drained under mutex_, which is
+ * what lets remove() guarantee that the sink of a stopped log is no longer called.
+ */
+class EventLogDrain {
+public:
+  static EventLogDrain &instance() {
+    static EventLogDrain drain;
+    return drain;
+  }
+
+  void add(EventLog *_log, std::chrono::milliseconds _period) {
+    std::lock_guard<std::mutex> lifecycle_lock(lifecycle_mutex_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      logs_.emplace_back(_log, _period);
+    }
+    if (thread_.joinable()) {
+      // The thread may have to wake up sooner
+      wake_.notify_one();
+      return;
+    }
+    stop_requested_ = false;
+    thread_         = std::thread([this]() { run(); });
+  }
+
+  void remove(EventLog *_log) {
+    std::lock_guard<std::mutex> lifecycle_lock(lifecycle_mutex_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      _log->drain(_log->sink_);
+      logs_.erase(std::remove_if(logs_.begin(), logs_.end(),
+                                 [_log](const Entry &_entry) { return _entry.first == _log; }),
+                  logs_.end());
+      if (!logs_.empty()) {
+        return;
+      }
+      stop_requested_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+
+private:
+  using Entry = std::pair<EventLog *, std::chrono::milliseconds>;
+
+  EventLogDrain() = default;
+
+  void run() {
+#ifdef SCHED_IDLE
+    // Logging only gets the CPU time nothing else wants
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_requested_) {
+      std::chrono::milliseconds period = std::chrono::hours(1);
+      for (const Entry &entry : logs_) {
+        period = std::min(period, entry.second);
+      }
+      wake_.wait_for(lock, period, [this]() { return stop_requested_; });
+      for (const Entry &entry : logs_) {
+        entry.first->drain(entry.first->sink_);
+      }
+    }
+  }
+
+  std::mutex lifecycle_mutex_;  // Serializes add and remove, held while the thread starts or joins
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<Entry> logs_;
+  bool stop_requested_ = false;
+  std::thread thread_;
+};
+
+EventLog::EventLog(std::chrono::nanoseconds _throttle_period)
+    : throttle_period_ns_(_throttle_period.count()) {
+  for (size_t i = 0; i < kCapacity; i++) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  // The first report of every event goes through
+  for (auto &last_report : last_report_ns_) {
+    last_report.store(std::numeric_limits<int64_t>::min(), std::memory_order_relaxed);
+  }
+}
+
+EventLog::~EventLog() { stop(); }
+
+bool EventLog::report(LogEvent _event,
+                      uint8_t _frame,
+                      uint8_t _expected_frame,
+                      const char *_detail) {
+  const size_t index = static_cast<size_t>(_event);
+  counts_[index].fetch_add(1, std::memory_order_relaxed);
+
+  // A single reporter wins the slot of the period, the others are only counted
+  const int64_t now    = steadyNow();
+  const int64_t period = throttle_period_ns_.load(std::memory_order_relaxed);
+  int64_t last         = last_report_ns_[index].load(std::memory_order_relaxed);
+  if ((last != std::numeric_limits<int64_t>::min() && now - last < period) ||
+      !last_report_ns_[index].compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+    suppressed_[index].fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  LogRecord record;
+  record.event          = _event;
+  record.frame          = _frame;
+  record.expected_frame = _expected_frame;
+  record.suppressed     = suppressed_[index].exchange(0, std::memory_order_relaxed);
+  if (_detail != nullptr) {
+    std::strncpy(record.detail.data(), _detail, LogRecord::kDetailSize - 1);
+  }
+  if (!push(record)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+bool EventLog::push(const LogRecord &_record) {
+  size_t position = tail_.load(std::memory_order_relaxed);
+  Slot *slot      = nullptr;
+  while (true) {
+    slot                   = &slots_[position & kMask];
+    const size_t sequence  = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t pending = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+    if (pending == 0) {
+      if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (pending < 0) {
+      // The consumer has not released the slot yet: full
+      return false;
+    } else {
+      position = tail_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->record = _record;
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+bool EventLog::pop(LogRecord &_record) {
+  Slot &slot = slots_[head_ & kMask];
+  if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+    return false;
+  }
+  _record = slot.record;
+  slot.sequence.store(head_ + kCapacity, std::memory_order_release);
+  head_++;
+  return true;
+}
+
+size_t EventLog::drain(const Sink &_sink) {
+  size_t drained = 0;
+  LogRecord record;
+  while (pop(record)) {
+    _sink(record);
+    drained++;
+  }
+  return drained;
+}
+
+void EventLog::start(Sink _sink, std::chrono::milliseconds _period) {
+  stop();
+  sink_    = std::move(_sink);
+  started_ = true;
+  EventLogDrain::instance().add(this, _period);
+}
+
+void EventLog::stop() {
+  if (!started_) {
+    return;
+  }
+  EventLogDrain::instance().remove(this);
+  started_ = false;
+}
+
+}  // namespace controller_plugin_speed_controller
@@ -36,27 +36,125 @@
 
 #include "speed_controller_plugin.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <thread>
+#include <utility>
+
 namespace controller_plugin_speed_controller {
 
+namespace {
+
+// Indexed by as2_msgs::msg::ControlMode::control_mode
+constexpr std::array<const char *, LatencyMetrics::kNumControlModes> kControlModeNames = {
+    "unset", "hover", "acro", "attitude", "speed", "speed_in_a_plane", "position", "trajectory"};
+
+constexpr std::array<const char *, LatencyMetrics::kNumProbes> kLatencyProbeNames = {
+    "update_state", "update_reference", "compute_output", "dt_jitter", "input_latency"};
+
+constexpr std::array<const char *, LatencyMetrics::kNumRejections> kRejectedCallNames = {
+    "state_not_received", "reference_not_received", "frame_mismatch", "queue_full",
+    "control_busy"};
+
+constexpr std::array<const char *, DtConditioner::kNumCorrections> kDtCorrectionNames = {
+    "clamped_low", "clamped_high", "outliers"};
+
+constexpr std::array<const char *, EventLog::kNumEvents> kLogEventNames = {
+    "pose_frame_mismatch", "twist_conversion", "joint_trajectory_without_xyz",
+    "reference_queue_full", "trajectory_buffer_full", "limit_profile_rejected",
+    "state_not_received", "reference_not_received", "unknown_control_mode", "unknown_yaw_mode"};
+
+void addValue(diagnostic_msgs::msg::DiagnosticStatus &_status,
+              const std::string &_key,
+              const std::string &_value) {
+  diagnostic_msgs::msg::KeyValue key_value;
+  key_value.key   = _key;
+  key_value.value = _value;
+  _status.values.push_back(key_value);
+}
+
+bool isRealtimeField(parameters::ParameterField _field) {
+  using parameters::ParameterField;
+  return _field == ParameterField::REALTIME || _field == ParameterField::REALTIME_PRIORITY ||
+         _field == ParameterField::REALTIME_CPU || _field == ParameterField::REALTIME_PERIOD ||
+         _field == ParameterField::REALTIME_LOCK_MEMORY;
+}
+
+// Read by the configuration side only, or by the control loop through an atomic stored after
+// the value it publishes
+bool isConfigurationField(parameters::ParameterField _field) {
+  using parameters::ParameterField;
+  return isRealtimeField(_field) || _field == ParameterField::LATENCY_METRICS ||
+         _field == ParameterField::LATENCY_METRICS_PERIOD || _field == ParameterField::TELEMETRY ||
+         _field == ParameterField::TELEMETRY_FILE;
+}
+
+int integerParameter(const rclcpp::Parameter &_param) {
+  return static_cast<int>(std::clamp<int64_t>(_param.get_value<int64_t>(),
+                                              std::numeric_limits<int>::min(),
+                                              std::numeric_limits<int>::max()));
+}
+
+// Dividers below 1 run the loop on every tick
+uint32_t rateDivider(const rclcpp::Parameter &_param) {
+  return static_cast<uint32_t>(std::clamp<int64_t>(_param.get_value<int64_t>(), 1,
+                                                   std::numeric_limits<uint32_t>::max()));
+}
+
+// One TF handler, buffer and listener per node, shared by every plugin attached to it
+std::shared_ptr<as2::tf::TfHandler> sharedTfHandler(as2::Node *_node) {
+  static std::mutex mutex;
+  static std::map<as2::Node *, std::weak_ptr<as2::tf::TfHandler>> handlers;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = handlers.begin(); it != handlers.end();) {
+    it = it->second.expired() ? handlers.erase(it) : std::next(it);
+  }
+  std::shared_ptr<as2::tf::TfHandler> handler = handlers[_node].lock();
+  if (!handler) {
+    handler         = std::make_shared<as2::tf::TfHandler>(_node);
+    handlers[_node] = handler;
+  }
+  return handler;
+}
+
+bool hasSchemaType(const rclcpp::Parameter &_param, parameters::ParameterType _type) {
+  switch (_type) {
+    case parameters::ParameterType::BOOL:
+      return _param.get_type() == rclcpp::ParameterType::PARAMETER_BOOL;
+    case parameters::ParameterType::INTEGER:
+      return _param.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER;
+    case parameters::ParameterType::DOUBLE:
+      return _param.get_type() == rclcpp::ParameterType::PARAMETER_DOUBLE;
+    case parameters::ParameterType::STRING:
+      return _param.get_type() == rclcpp::ParameterType::PARAMETER_STRING;
+  }
+  return false;
+}
+
+}  // namespace
+
 void Plugin::ownInitialize() {
   speed_limits_ = Eigen::Vector3d::Zero();
 
-  pid_yaw_handler_                 = std::make_shared<pid_controller::PIDController>();
-  pid_3D_position_handler_         = std::make_shared<pid_controller::PIDController3D>();
-  pid_3D_velocity_handler_         = std::make_shared<pid_controller::PIDController3D>();
-  pid_1D_speed_in_a_plane_handler_ = std::make_shared<pid_controller::PIDController>();
-  pid_3D_speed_in_a_plane_handler_ = std::make_shared<pid_controller::PIDController3D>();
-  pid_3D_trajectory_handler_       = std::make_shared<pid_controller::PIDController3D>();
+  pid_yaw_handler_                 = pid_controller::PIDController();
+  pid_3D_position_handler_         = pid_controller::PIDController3D();
+  pid_3D_velocity_handler_         = pid_controller::PIDController3D();
+  pid_1D_speed_in_a_plane_handler_ = pid_controller::PIDController();
+  pid_3D_speed_in_a_plane_handler_ = pid_controller::PIDController3D();
+  pid_3D_trajectory_handler_       = pid_controller::PIDController3D();
 
-  tf_handler_ = std::make_shared<as2::tf::TfHandler>(node_ptr_);
-
-  enu_frame_id_ = as2::tf::generateTfName(node_ptr_, enu_frame_id_);
-  flu_frame_id_ = as2::tf::generateTfName(node_ptr_, flu_frame_id_);
+  if (!tf_handler_) {
+    tf_handler_ = sharedTfHandler(node_ptr_);
+  }
 
-  input_pose_frame_id_  = as2::tf::generateTfName(node_ptr_, input_pose_frame_id_);
-  input_twist_frame_id_ = as2::tf::generateTfName(node_ptr_, input_twist_frame_id_);
+  for (auto &frame_id : frame_ids_) {
+    frame_id = as2::tf::generateTfName(node_ptr_, frame_id);
+  }
 
-  output_twist_frame_id_ = as2::tf::generateTfName(node_ptr_, output_twist_frame_id_);
+  event_log_.start([this](const LogRecord &_record) { logEvent(_record); });
 
   reset();
   return;
@@ -67,176 +165,791 @@ bool Plugin::updateParams(const std::vector<std::string> &_params_list) {
   return result.successful;
 };
 
-void Plugin::checkParamList(const std::string &param,
-                            std::vector<std::string> &_params_list,
-                            bool &_all_params_read) {
-  if (find(_params_list.begin(), _params_list.end(), param) != _params_list.end()) {
-    // Remove the parameter from the list of parameters to be read
-    _params_list.erase(std::remove(_params_list.begin(), _params_list.end(), param),
-                       _params_list.end());
-  };
-  if (_params_list.size() == 0) {
-    _all_params_read = true;
+bool Plugin::loadParameters() {
+  // Every declared schema parameter goes through a single get_parameters call and a single
+  // callback, so gains, pipeline and metrics publisher are rebuilt once
+  std::vector<std::string> names;
+  names.reserve(parameters::kNumParameters);
+  for (const auto &descriptor : parameters::kParameterSchema) {
+    std::string name(descriptor.name);
+    if (node_ptr_->has_parameter(name)) {
+      names.push_back(std::move(name));
+    }
+  }
+  return updateParams(names) && getMissingParameters().none();
+}
+
+parameters::ParameterMask Plugin::getMissingParameters() const {
+  return ~flags_.parameters_read & parameters::kAllParametersMask &
+         ~parameters::groupMask(parameters::ParameterGroup::OPTIONAL);
+}
+
+parameters::ParameterMask Plugin::getMissingParameters(
+    const as2_msgs::msg::ControlMode &_mode) const {
+  using parameters::groupMask;
+  using parameters::ParameterGroup;
+
+  parameters::ParameterMask required =
+      groupMask(ParameterGroup::PLUGIN) | groupMask(ParameterGroup::POSITION);
+  if (_mode.control_mode == as2_msgs::msg::ControlMode::TRAJECTORY) {
+    required |= groupMask(ParameterGroup::TRAJECTORY);
+  } else if ((_mode.control_mode == as2_msgs::msg::ControlMode::SPEED ||
+              _mode.control_mode == as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE) &&
+             !use_bypass_) {
+    required |= groupMask(ParameterGroup::SPEED);
+  }
+  if (_mode.yaw_mode == as2_msgs::msg::ControlMode::YAW_ANGLE) {
+    required |= groupMask(ParameterGroup::YAW);
+  }
+  return required & ~flags_.parameters_read;
+}
+
+bool Plugin::parametersRead(parameters::ParameterGroup _group) const {
+  const parameters::ParameterMask mask = parameters::groupMask(_group);
+  return (flags_.parameters_read & mask) == mask;
+}
+
+void Plugin::logUnreadParameters(parameters::ParameterGroup _group) const {
+  for (size_t i = 0; i < parameters::kNumParameters; i++) {
+    const auto &descriptor = parameters::kParameterSchema[i];
+    const bool read        = (flags_.parameters_read & parameters::parameterBit(i)).any();
+    if (descriptor.group == _group && !read) {
+      RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %.*s not read",
+                  static_cast<int>(descriptor.name.size()), descriptor.name.data());
+    }
+  }
+}
+
+void Plugin::logMissingParameters(const as2_msgs::msg::ControlMode &_mode) const {
+  using parameters::ParameterGroup;
+
+  if (!parametersRead(ParameterGroup::PLUGIN)) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Plugin parameters not read yet, can not set mode");
+    return;
+  }
+
+  if (!parametersRead(ParameterGroup::POSITION)) {
+    RCLCPP_WARN(node_ptr_->get_logger(),
+                "Position controller parameters not read, can not set mode");
+    logUnreadParameters(ParameterGroup::POSITION);
+    return;
   }
-};
+
+  if (_mode.control_mode == as2_msgs::msg::ControlMode::TRAJECTORY &&
+      !parametersRead(ParameterGroup::TRAJECTORY)) {
+    RCLCPP_WARN(node_ptr_->get_logger(),
+                "Trajectory controller parameters not read yet, can not set mode to TRAJECTORY");
+    logUnreadParameters(ParameterGroup::TRAJECTORY);
+    return;
+  } else if ((_mode.control_mode == as2_msgs::msg::ControlMode::SPEED ||
+              _mode.control_mode == as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE) &&
+             (!parametersRead(ParameterGroup::SPEED) && !use_bypass_)) {
+    RCLCPP_WARN(node_ptr_->get_logger(),
+                "Velocity controller parameters not read yet and bypass is not used, can not set "
+                "mode to SPEED or SPEED_IN_A_PLANE");
+    if (_mode.control_mode == as2_msgs::msg::ControlMode::SPEED) {
+      logUnreadParameters(ParameterGroup::SPEED);
+    } else {
+      logUnreadParameters(ParameterGroup::SPEED_IN_A_PLANE);
+    }
+    return;
+  }
+
+  if (_mode.yaw_mode == as2_msgs::msg::ControlMode::YAW_ANGLE &&
+      !parametersRead(ParameterGroup::YAW)) {
+    RCLCPP_WARN(node_ptr_->get_logger(),
+                "Yaw controller parameters not read yet, can not set mode to YAW_ANGLE");
+  }
+}
 
 rcl_interfaces::msg::SetParametersResult Plugin::parametersCallback(
     const std::vector<rclcpp::Parameter> &parameters) {
+  std::lock_guard<std::mutex> config_lock(config_mutex_);
+
   rcl_interfaces::msg::SetParametersResult result;
   result.successful = true;
   result.reason     = "success";
 
+  // Reject the whole update if any value does not match its schema type
   for (auto &param : parameters) {
-    std::string param_name = param.get_name();
+    const int index = parameters::findParameter(param.get_name());
+    if (index >= 0 && !hasSchemaType(param, parameters::kParameterSchema[index].type())) {
+      result.successful = false;
+      result.reason     = "Parameter " + param.get_name() + " has an invalid type";
+      RCLCPP_ERROR(node_ptr_->get_logger(), "%s", result.reason.c_str());
+      return result;
+    }
+  }
+
+  // The parameters the control loop does not read are applied without the control lock, so
+  // their allocations do not hold it
+  bool metrics_changed   = false;
+  bool telemetry_changed = false;
+  bool realtime_changed  = false;
+  for (auto &param : parameters) {
+    const int index = parameters::findParameter(param.get_name());
+    if (index < 0) {
+      continue;
+    }
+    const auto &descriptor = parameters::kParameterSchema[index];
+    if (isConfigurationField(descriptor.field)) {
+      updateParameter(descriptor, param);
+    }
+    metrics_changed |= descriptor.field == parameters::ParameterField::LATENCY_METRICS ||
+                       descriptor.field == parameters::ParameterField::LATENCY_METRICS_PERIOD;
+    telemetry_changed |= descriptor.field == parameters::ParameterField::TELEMETRY ||
+                         descriptor.field == parameters::ParameterField::TELEMETRY_FILE;
+    realtime_changed |= isRealtimeField(descriptor.field);
+  }
+
+  {
+    // The control thread holds its ticks while the parameters change
+    std::lock_guard<PiMutex> lock(control_mutex_);
 
-    if (param.get_name() == "proportional_limitation") {
-      proportional_limitation_ = param.get_value<bool>();
-      if (!flags_.plugin_parameters_read) {
-        checkParamList(param_name, plugin_parameters_to_read_, flags_.plugin_parameters_read);
+    bool gains_changed  = false;
+    bool plugin_changed = false;
+    for (auto &param : parameters) {
+      const int index = parameters::findParameter(param.get_name());
+      if (index < 0) {
+        continue;
       }
-    } else if (param.get_name() == "use_bypass") {
-      use_bypass_ = param.get_value<bool>();
-      if (!flags_.plugin_parameters_read) {
-        checkParamList(param_name, plugin_parameters_to_read_, flags_.plugin_parameters_read);
+      const auto &descriptor = parameters::kParameterSchema[index];
+      if (!isConfigurationField(descriptor.field)) {
+        updateParameter(descriptor, param);
       }
-    } else {
-      std::string controller    = param_name.substr(0, param_name.find("."));
-      std::string param_subname = param_name.substr(param_name.find(".") + 1);
-      if (controller == "position_control") {
-        updateController3DParameter(pid_3D_position_handler_, param_subname, param);
-        if (!flags_.position_controller_parameters_read) {
-          checkParamList(param_name, position_control_parameters_to_read_,
-                         flags_.position_controller_parameters_read);
-        }
-      } else if (controller == "speed_control") {
-        updateController3DParameter(pid_3D_velocity_handler_, param_subname, param);
-        if (!flags_.velocity_controller_parameters_read) {
-          checkParamList(param_name, velocity_control_parameters_to_read_,
-                         flags_.velocity_controller_parameters_read);
-        }
-      } else if (controller == "speed_in_a_plane_control") {
-        updateSpeedInAPlaneParameter(pid_1D_speed_in_a_plane_handler_,
-                                     pid_3D_speed_in_a_plane_handler_, param_subname, param);
-        if (!flags_.speed_in_a_plane_controller_parameters_read) {
-          checkParamList(param_name, speed_in_a_plane_control_parameters_to_read_,
-                         flags_.speed_in_a_plane_controller_parameters_read);
-        }
-      } else if (controller == "trajectory_control") {
-        updateController3DParameter(pid_3D_trajectory_handler_, param_subname, param);
-        if (!flags_.trajectory_controller_parameters_read) {
-          checkParamList(param_name, trajectory_control_parameters_to_read_,
-                         flags_.trajectory_controller_parameters_read);
-        }
-      } else if (controller == "yaw_control") {
-        updateControllerParameter(pid_yaw_handler_, param_subname, param);
-        if (!flags_.yaw_controller_parameters_read) {
-          checkParamList(param_name, yaw_control_parameters_to_read_,
-                         flags_.yaw_controller_parameters_read);
+      // Filter weights discretized for the last dt are restored from the gains, and a staging
+      // switch hands the current set to the path it now takes
+      gains_changed |= descriptor.target != parameters::ParameterTarget::PLUGIN ||
+                       descriptor.field == parameters::ParameterField::STAGED_GAINS ||
+                       descriptor.field == parameters::ParameterField::DT_CONDITIONING ||
+                       descriptor.field == parameters::ParameterField::DT_EXACT_DISCRETIZATION;
+      plugin_changed |= descriptor.target == parameters::ParameterTarget::PLUGIN;
+      flags_.parameters_read |= parameters::parameterBit(index);
+    }
+
+    if (gains_changed) {
+      publishGains();
+    }
+    // use_bypass and proportional_limitation are baked into the running pipeline
+    if (plugin_changed) {
+      updatePipeline();
+    }
+  }
+
+  // Timers, files and threads are created and stopped without the lock
+  if (metrics_changed) {
+    updateLatencyMetricsPublisher();
+  }
+  if (telemetry_changed) {
+    updateTelemetry();
+  }
+  if (realtime_changed) {
+    updateControlThread();
+  }
+  return result;
+}
+
+void Plugin::updateParameter(const parameters::ParameterDescriptor &_descriptor,
+                             const rclcpp::Parameter &_param) {
+  using parameters::ParameterField;
+  using parameters::ParameterTarget;
+
+  switch (_descriptor.target) {
+    case ParameterTarget::PLUGIN:
+      if (_descriptor.field == ParameterField::PROPORTIONAL_LIMITATION) {
+        proportional_limitation_ = _param.get_value<bool>();
+      } else if (_descriptor.field == ParameterField::USE_BYPASS) {
+        use_bypass_ = _param.get_value<bool>();
+      } else if (_descriptor.field == ParameterField::STAGED_GAINS) {
+        use_staged_gains_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::LATENCY_METRICS) {
+        // Allocated on first use, published to the control loop by the flag
+        const bool enabled = _param.get_value<bool>();
+        if (enabled && !latency_metrics_) {
+          latency_metrics_ = std::make_unique<LatencyMetrics>();
         }
+        latency_metrics_enabled_.store(enabled, std::memory_order_release);
+      } else if (_descriptor.field == ParameterField::LATENCY_METRICS_PERIOD) {
+        latency_metrics_period_ = _param.get_value<double>();
+      } else if (_descriptor.field == ParameterField::TRANSLATION_RATE_DIVIDER) {
+        translation_rate_divider_.store(rateDivider(_param), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::YAW_RATE_DIVIDER) {
+        yaw_rate_divider_.store(rateDivider(_param), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::STATE_TRIGGERED) {
+        state_triggered_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::PREDICTION) {
+        state_prediction_enabled_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::PREDICTION_TIME_CONSTANT) {
+        state_prediction_time_constant_ = std::max(0.0, _param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::MODE_HANDOFF) {
+        mode_handoff_enabled_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::MODE_HANDOFF_TIME_CONSTANT) {
+        mode_handoff_time_constant_ = std::max(0.0, _param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::DT_CONDITIONING) {
+        dt_conditioning_enabled_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::DT_MIN) {
+        dt_conditioner_.setMinDt(_param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::DT_MAX) {
+        dt_conditioner_.setMaxDt(_param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::DT_OUTLIER_RATIO) {
+        dt_conditioner_.setOutlierRatio(_param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::DT_NOMINAL) {
+        dt_conditioner_.setNominalDt(_param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::DT_EXACT_DISCRETIZATION) {
+        exact_discretization_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      } else if (_descriptor.field == ParameterField::REALTIME) {
+        realtime_enabled_ = _param.get_value<bool>();
+      } else if (_descriptor.field == ParameterField::REALTIME_PRIORITY) {
+        realtime_settings_.priority = integerParameter(_param);
+      } else if (_descriptor.field == ParameterField::REALTIME_CPU) {
+        realtime_settings_.cpu = integerParameter(_param);
+      } else if (_descriptor.field == ParameterField::REALTIME_PERIOD) {
+        realtime_settings_.period = _param.get_value<double>();
+      } else if (_descriptor.field == ParameterField::REALTIME_LOCK_MEMORY) {
+        realtime_settings_.lock_memory = _param.get_value<bool>();
+      } else if (_descriptor.field == ParameterField::TELEMETRY) {
+        telemetry_enabled_ = _param.get_value<bool>();
+      } else if (_descriptor.field == ParameterField::TELEMETRY_FILE) {
+        telemetry_file_ = _param.get_value<std::string>();
+      } else if (_descriptor.field == ParameterField::FEEDFORWARD_LOOK_AHEAD) {
+        feedforward_look_ahead_ = std::max(0.0, _param.get_value<double>());
+      } else if (_descriptor.field == ParameterField::FEEDFORWARD_YAW_RATE) {
+        yaw_rate_feedforward_.store(_param.get_value<bool>(), std::memory_order_relaxed);
+      }
+      break;
+    case ParameterTarget::YAW:
+      updateControllerParameter(staged_gains_.yaw, _descriptor, _param);
+      break;
+    case ParameterTarget::POSITION:
+      updateController3DParameter(staged_gains_.position, _descriptor, _param);
+      break;
+    case ParameterTarget::SPEED:
+      updateController3DParameter(staged_gains_.speed, _descriptor, _param);
+      break;
+    case ParameterTarget::SPEED_IN_A_PLANE_HEIGHT:
+      updateControllerParameter(staged_gains_.speed_in_a_plane_height, _descriptor, _param);
+      break;
+    case ParameterTarget::SPEED_IN_A_PLANE_SPEED:
+      updateController3DParameter(staged_gains_.speed_in_a_plane_speed, _descriptor, _param);
+      break;
+    case ParameterTarget::SPEED_IN_A_PLANE_BOTH:
+      updateControllerParameter(staged_gains_.speed_in_a_plane_height, _descriptor, _param);
+      updateController3DParameter(staged_gains_.speed_in_a_plane_speed, _descriptor, _param);
+      break;
+    case ParameterTarget::TRAJECTORY:
+      updateController3DParameter(staged_gains_.trajectory, _descriptor, _param);
+      break;
+  }
+  return;
+}
+
+void Plugin::updateControllerParameter(PIDGains &_gains,
+                                       const parameters::ParameterDescriptor &_descriptor,
+                                       const rclcpp::Parameter &_param) {
+  using parameters::ParameterField;
+
+  switch (_descriptor.field) {
+    case ParameterField::RESET_INTEGRAL:
+      _gains.reset_integral = _param.get_value<bool>();
+      break;
+    case ParameterField::ANTIWINDUP_CTE:
+      _gains.antiwindup_cte = _param.get_value<double>();
+      break;
+    case ParameterField::ALPHA:
+      _gains.alpha = _param.get_value<double>();
+      break;
+    case ParameterField::KP:
+      _gains.kp = _param.get_value<double>();
+      break;
+    case ParameterField::KI:
+      _gains.ki = _param.get_value<double>();
+      break;
+    case ParameterField::KD:
+      _gains.kd = _param.get_value<double>();
+      break;
+    default:
+      break;
+  }
+  return;
+}
+
+void Plugin::updateController3DParameter(PIDGains3D &_gains,
+                                         const parameters::ParameterDescriptor &_descriptor,
+                                         const rclcpp::Parameter &_param) {
+  using parameters::ParameterField;
+
+  switch (_descriptor.field) {
+    case ParameterField::RESET_INTEGRAL:
+      _gains.reset_integral = _param.get_value<bool>();
+      break;
+    case ParameterField::ANTIWINDUP_CTE:
+      _gains.antiwindup_cte = _param.get_value<double>();
+      break;
+    case ParameterField::ALPHA:
+      _gains.alpha = _param.get_value<double>();
+      break;
+    case ParameterField::KP:
+      _gains.kp[_descriptor.axis] = _param.get_value<double>();
+      break;
+    case ParameterField::KI:
+      _gains.ki[_descriptor.axis] = _param.get_value<double>();
+      break;
+    case ParameterField::KD:
+      _gains.kd[_descriptor.axis] = _param.get_value<double>();
+      break;
+    default:
+      break;
+  }
+  return;
+}
+
+const ControllerGains &Plugin::getGains() const { return staged_gains_; }
+
+void Plugin::publishGains() {
+  // Without staging the gains are applied right away, from the parameters thread. The tick is
+  // the only consumer of gains_buffer_
+  if (!use_staged_gains_.load(std::memory_order_relaxed)) {
+    applyControllerGains(staged_gains_);
+    return;
+  }
+  gains_buffer_.back() = staged_gains_;
+  gains_buffer_.publish();
+  return;
+}
+
+void Plugin::updateGains() {
+  if (!use_staged_gains_.load(std::memory_order_relaxed) || !gains_buffer_.update()) {
+    return;
+  }
+  applyControllerGains(gains_buffer_.front());
+  return;
+}
+
+const ControllerGains &Plugin::currentGains() const {
+  return use_staged_gains_.load(std::memory_order_relaxed) ? gains_buffer_.front() : staged_gains_;
+}
+
+void Plugin::applyControllerGains(const ControllerGains &_gains) {
+  applyGains(_gains.position, pid_3D_position_handler_);
+  applyGains(_gains.speed, pid_3D_velocity_handler_);
+  applyGains(_gains.trajectory, pid_3D_trajectory_handler_);
+  applyGains(_gains.speed_in_a_plane_speed, pid_3D_speed_in_a_plane_handler_);
+  applyGains(_gains.speed_in_a_plane_height, pid_1D_speed_in_a_plane_handler_);
+  applyGains(_gains.yaw, pid_yaw_handler_);
+  return;
+}
+
+const LatencyMetrics &Plugin::getLatencyMetrics() const {
+  // Plugins that never enabled the metrics do not pay for the histograms
+  static const LatencyMetrics kNoMetrics;
+  return latency_metrics_ ? *latency_metrics_ : kNoMetrics;
+}
+
+void Plugin::setTfHandler(std::shared_ptr<as2::tf::TfHandler> _tf_handler) {
+  tf_handler_ = std::move(_tf_handler);
+}
+
+const std::shared_ptr<as2::tf::TfHandler> &Plugin::getTfHandler() const { return tf_handler_; }
+
+const EventLog &Plugin::getEventLog() const { return event_log_; }
+
+const TelemetryRecorder *Plugin::getTelemetryRecorder() const {
+  return telemetry_recorder_.get();
+}
+
+double Plugin::getInputLatency() const { return input_latency_; }
+
+void Plugin::setClock(std::function<double()> _clock) { clock_ = std::move(_clock); }
+
+const DtConditioner &Plugin::getDtConditioner() const { return dt_conditioner_; }
+
+bool Plugin::isRealtimeActive() const { return realtime_active_.load(std::memory_order_acquire); }
+
+const ControlThread &Plugin::getControlThread() const { return control_thread_; }
+
+void Plugin::updateControlThread() {
+  if (realtime_active_.load(std::memory_order_relaxed)) {
+    control_thread_.stop();
+    // Inputs queued before the thread stopped are still applied, a producer that saw the
+    // thread running has pushed by the time the lock is taken
+    std::lock_guard<SpinLock> producer_lock(input_lock_);
+    realtime_active_.store(false, std::memory_order_release);
+    std::lock_guard<PiMutex> lock(control_mutex_);
+    drainInputs();
+  }
+  if (!realtime_enabled_) {
+    return;
+  }
+
+  if (realtime_settings_.period <= 0.0) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "realtime.period must be positive, using 0.01 s");
+    realtime_settings_.period = 0.01;
+  }
+  // Inputs are queued from here on, the thread picks them up on its first tick
+  if (!realtime_inputs_) {
+    realtime_inputs_ = std::make_unique<RealtimeInputs>();
+  }
+  held_dt_ = 0.0;
+  realtime_active_.store(true, std::memory_order_release);
+  const RealtimeStatus status =
+      control_thread_.start(realtime_settings_, [this](double _dt) { realtimeTick(_dt); });
+
+  RCLCPP_INFO(node_ptr_->get_logger(), "Control thread running every %.4f s",
+              realtime_settings_.period);
+  if (realtime_settings_.priority > 0 && !status.scheduling) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Could not set SCHED_FIFO priority %d",
+                realtime_settings_.priority);
+  }
+  if (realtime_settings_.cpu >= 0 && !status.affinity) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Could not pin the control thread to CPU %d",
+                realtime_settings_.cpu);
+  }
+  if (realtime_settings_.lock_memory && !status.memory_locked) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Could not lock the process memory");
+  }
+  return;
+}
+
+void Plugin::realtimeTick(double _dt) {
+  // Never waits for a configuration update: the tick is held, the published command stays and
+  // the dt is carried to the next tick
+  std::unique_lock<PiMutex> lock(control_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    held_dt_ += _dt;
+    rejectCall(RejectedCall::CONTROL_BUSY);
+    return;
+  }
+  const double dt = _dt + held_dt_;
+  held_dt_        = 0.0;
+  drainInputs();
+
+  ControlOutput &output = output_buffer_.back();
+  output.valid          = computeCommand(dt);
+  output.command        = currentCommand();
+  output.frame_id       = output_twist_frame_id_;
+  output.generation     = mode_generation_.load(std::memory_order_relaxed);
+  output_buffer_.publish();
+  return;
+}
+
+void Plugin::drainInputs() {
+  if (!realtime_inputs_) {
+    return;
+  }
+  StateInput state;
+  bool state_received = false;
+  while (realtime_inputs_->state.pop(state)) {
+    state_received = true;
+  }
+  if (state_received) {
+    applyState(state);
+  }
+
+  ReferenceInput reference;
+  while (realtime_inputs_->reference.pop(reference)) {
+    applyReference(reference);
+  }
+  return;
+}
+
+void Plugin::discardInputs() {
+  if (!realtime_inputs_) {
+    return;
+  }
+  StateInput state;
+  while (realtime_inputs_->state.pop(state)) {
+  }
+  ReferenceInput reference;
+  while (realtime_inputs_->reference.pop(reference)) {
+  }
+  return;
+}
+
+LatencyHistogram *Plugin::latencyHistogram(LatencyProbe _probe) {
+  if (!latency_metrics_enabled_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return &latency_metrics_->histogram(control_mode_in_.control_mode, _probe);
+}
+
+void Plugin::rejectCall(RejectedCall _call) {
+  if (latency_metrics_enabled_.load(std::memory_order_acquire)) {
+    latency_metrics_->reject(_call);
+  }
+  return;
+}
+
+void Plugin::updateLatencyMetricsPublisher() {
+  if (!latency_metrics_enabled_.load(std::memory_order_relaxed)) {
+    latency_metrics_timer_.reset();
+    return;
+  }
+
+  if (latency_metrics_period_ <= 0.0) {
+    RCLCPP_WARN(node_ptr_->get_logger(),
+                "latency_metrics.period must be positive, publishing every second");
+    latency_metrics_period_ = 1.0;
+  }
+  if (!latency_metrics_pub_) {
+    latency_metrics_pub_ =
+        node_ptr_->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+  }
+  latency_metrics_timer_ =
+      node_ptr_->create_wall_timer(std::chrono::duration<double>(latency_metrics_period_),
+                                   [this]() { publishLatencyMetrics(); });
+  return;
+}
+
+void Plugin::publishLatencyMetrics() {
+  const std::string prefix = std::string(node_ptr_->get_name()) + "/speed_controller/";
+
+  diagnostic_msgs::msg::DiagnosticArray msg;
+  msg.header.stamp = node_ptr_->now();
+
+  diagnostic_msgs::msg::DiagnosticStatus rejected;
+  rejected.name  = prefix + "rejected_calls";
+  rejected.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  for (size_t i = 0; i < LatencyMetrics::kNumRejections; i++) {
+    addValue(rejected, kRejectedCallNames[i],
+             std::to_string(latency_metrics_->rejected(static_cast<RejectedCall>(i))));
+  }
+  msg.status.push_back(rejected);
+
+  diagnostic_msgs::msg::DiagnosticStatus dt_corrections;
+  dt_corrections.name  = prefix + "dt_conditioning";
+  dt_corrections.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  addValue(dt_corrections, "ticks", std::to_string(dt_conditioner_.ticks()));
+  addValue(dt_corrections, "corrected_ticks", std::to_string(dt_conditioner_.correctedTicks()));
+  for (size_t i = 0; i < DtConditioner::kNumCorrections; i++) {
+    addValue(dt_corrections, kDtCorrectionNames[i],
+             std::to_string(dt_conditioner_.corrections(static_cast<DtCorrection>(i))));
+  }
+  addValue(dt_corrections, "mean_dt_ms", std::to_string(dt_conditioner_.meanDt() * 1e3));
+  msg.status.push_back(dt_corrections);
+
+  diagnostic_msgs::msg::DiagnosticStatus log_events;
+  log_events.name  = prefix + "log_events";
+  log_events.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  for (size_t i = 0; i < EventLog::kNumEvents; i++) {
+    addValue(log_events, kLogEventNames[i],
+             std::to_string(event_log_.count(static_cast<LogEvent>(i))));
+  }
+  addValue(log_events, "dropped", std::to_string(event_log_.dropped()));
+  msg.status.push_back(log_events);
+
+  if (telemetry_recorder_) {
+    diagnostic_msgs::msg::DiagnosticStatus telemetry;
+    telemetry.name  = prefix + "telemetry";
+    telemetry.level = telemetry_recorder_->dropped() == 0
+                          ? diagnostic_msgs::msg::DiagnosticStatus::OK
+                          : diagnostic_msgs::msg::DiagnosticStatus::WARN;
+    addValue(telemetry, "file", telemetry_recorder_->path());
+    addValue(telemetry, "active", telemetry_recorder_->active() ? "true" : "false");
+    addValue(telemetry, "written", std::to_string(telemetry_recorder_->written()));
+    addValue(telemetry, "dropped", std::to_string(telemetry_recorder_->dropped()));
+    msg.status.push_back(telemetry);
+  }
+
+  // Latencies in microseconds, one status per control mode that has been used
+  for (size_t mode = 0; mode < LatencyMetrics::kNumControlModes; mode++) {
+    diagnostic_msgs::msg::DiagnosticStatus status;
+    status.name  = prefix + kControlModeNames[mode];
+    status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    for (size_t probe = 0; probe < LatencyMetrics::kNumProbes; probe++) {
+      const LatencyHistogram &histogram =
+          latency_metrics_->histogram(static_cast<uint8_t>(mode), static_cast<LatencyProbe>(probe));
+      if (histogram.count() == 0) {
+        continue;
       }
+      const std::string name = kLatencyProbeNames[probe];
+      addValue(status, name + ".count", std::to_string(histogram.count()));
+      addValue(status, name + ".p50_us", std::to_string(histogram.percentile(0.5) * 1e-3));
+      addValue(status, name + ".p99_us", std::to_string(histogram.percentile(0.99) * 1e-3));
+      addValue(status, name + ".max_us", std::to_string(histogram.max() * 1e-3));
+    }
+    if (!status.values.empty()) {
+      msg.status.push_back(status);
     }
   }
-  return result;
+
+  latency_metrics_pub_->publish(msg);
+  return;
 }
 
-void Plugin::updateControllerParameter(
-    const std::shared_ptr<pid_controller::PIDController> &_pid_handler,
-    const std::string &_parameter_name,
-    const rclcpp::Parameter &_param) {
-  if (_parameter_name == "reset_integral") {
-    _pid_handler->setResetIntegralSaturationFlag(_param.get_value<bool>());
-  } else if (_parameter_name == "antiwindup_cte") {
-    _pid_handler->setAntiWindup(_param.get_value<double>());
-  } else if (_parameter_name == "alpha") {
-    _pid_handler->setAlpha(_param.get_value<double>());
-  } else if (_parameter_name == "kp") {
-    _pid_handler->setGainKp(_param.get_value<double>());
-  } else if (_parameter_name == "ki") {
-    _pid_handler->setGainKi(_param.get_value<double>());
-  } else if (_parameter_name == "kd") {
-    _pid_handler->setGainKd(_param.get_value<double>());
-  }
-  return;
-}
-
-void Plugin::updateController3DParameter(
-    const std::shared_ptr<pid_controller::PIDController3D> &_pid_handler,
-    const std::string &_parameter_name,
-    const rclcpp::Parameter &_param) {
-  if (_parameter_name == "reset_integral") {
-    _pid_handler->setResetIntegralSaturationFlag(_param.get_value<bool>());
-  } else if (_parameter_name == "antiwindup_cte") {
-    _pid_handler->setAntiWindup(_param.get_value<double>());
-  } else if (_parameter_name == "alpha") {
-    _pid_handler->setAlpha(_param.get_value<double>());
-  } else if (_parameter_name == "kp.x") {
-    _pid_handler->setGainKpX(_param.get_value<double>());
-  } else if (_parameter_name == "kp.y") {
-    _pid_handler->setGainKpY(_param.get_value<double>());
-  } else if (_parameter_name == "kp.z") {
-    _pid_handler->setGainKpZ(_param.get_value<double>());
-  } else if (_parameter_name == "ki.x") {
-    _pid_handler->setGainKiX(_param.get_value<double>());
-  } else if (_parameter_name == "ki.y") {
-    _pid_handler->setGainKiY(_param.get_value<double>());
-  } else if (_parameter_name == "ki.z") {
-    _pid_handler->setGainKiZ(_param.get_value<double>());
-  } else if (_parameter_name == "kd.x") {
-    _pid_handler->setGainKdX(_param.get_value<double>());
-  } else if (_parameter_name == "kd.y") {
-    _pid_handler->setGainKdY(_param.get_value<double>());
-  } else if (_parameter_name == "kd.z") {
-    _pid_handler->setGainKdZ(_param.get_value<double>());
-  }
-  return;
-}
-
-void Plugin::updateSpeedInAPlaneParameter(
-    const std::shared_ptr<pid_controller::PIDController> &_pid_1d_handler,
-    const std::shared_ptr<pid_controller::PIDController3D> &_pid_3d_handler,
-    const std::string &_parameter_name,
-    const rclcpp::Parameter &_param) {
-  if (_parameter_name == "reset_integral") {
-    _pid_1d_handler->setResetIntegralSaturationFlag(_param.get_value<bool>());
-    _pid_3d_handler->setResetIntegralSaturationFlag(_param.get_value<bool>());
-  } else if (_parameter_name == "antiwindup_cte") {
-    _pid_1d_handler->setAntiWindup(_param.get_value<double>());
-    _pid_3d_handler->setAntiWindup(_param.get_value<double>());
-  } else if (_parameter_name == "alpha") {
-    _pid_1d_handler->setAlpha(_param.get_value<double>());
-    _pid_3d_handler->setAlpha(_param.get_value<double>());
-  } else if (_parameter_name == "height.kp") {
-    _pid_1d_handler->setGainKp(_param.get_value<double>());
-  } else if (_parameter_name == "height.ki") {
-    _pid_1d_handler->setGainKi(_param.get_value<double>());
-  } else if (_parameter_name == "height.kd") {
-    _pid_1d_handler->setGainKd(_param.get_value<double>());
-  } else if (_parameter_name == "speed.kp.x") {
-    _pid_3d_handler->setGainKpX(_param.get_value<double>());
-  } else if (_parameter_name == "speed.kp.y") {
-    _pid_3d_handler->setGainKpY(_param.get_value<double>());
-  } else if (_parameter_name == "speed.ki.x") {
-    _pid_3d_handler->setGainKiX(_param.get_value<double>());
-  } else if (_parameter_name == "speed.ki.y") {
-    _pid_3d_handler->setGainKiY(_param.get_value<double>());
-  } else if (_parameter_name == "speed.kd.x") {
-    _pid_3d_handler->setGainKdX(_param.get_value<double>());
-  } else if (_parameter_name == "speed.kd.y") {
-    _pid_3d_handler->setGainKdY(_param.get_value<double>());
+void Plugin::updateTelemetry() {
+  TelemetryRecorder *recorder = telemetry_recorder_.get();
+  if (telemetry_enabled_ && recorder != nullptr && recorder->active() &&
+      recorder->path() == telemetry_file_) {
+    // Same file, keep recording into it
+    return;
+  }
+
+  // The control loop stops recording, and the tick in progress finishes its record, before the
+  // file is closed
+  telemetry_.store(nullptr, std::memory_order_seq_cst);
+  while (telemetry_users_.load(std::memory_order_seq_cst) != 0) {
+    std::this_thread::yield();
+  }
+  if (recorder != nullptr) {
+    recorder->stop();
+  }
+  if (!telemetry_enabled_) {
+    return;
+  }
+
+  if (recorder == nullptr) {
+    telemetry_recorder_ = std::make_unique<TelemetryRecorder>();
+    recorder            = telemetry_recorder_.get();
   }
+  if (!recorder->start(telemetry_file_)) {
+    RCLCPP_ERROR(node_ptr_->get_logger(), "Could not create telemetry file %s",
+                 telemetry_file_.c_str());
+    return;
+  }
+  telemetry_.store(recorder, std::memory_order_seq_cst);
   return;
 }
 
+void Plugin::recordTelemetry(TelemetryRecorder &_recorder, double _dt, bool _valid) {
+  using as2_msgs::msg::ControlMode;
+
+  TelemetryRecord record;
+  record.time         = control_time_;
+  record.dt           = _dt;
+  record.control_mode = control_mode_in_.control_mode;
+  record.yaw_mode     = control_mode_in_.yaw_mode;
+  record.flags        = loops_run_;
+  if (_valid) {
+    record.flags |= TELEMETRY_VALID;
+  }
+  if (handoff_weight_ > 0.0) {
+    record.flags |= TELEMETRY_HANDOFF;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    record.reference_position[i] = control_ref_.position[i];
+    record.reference_velocity[i] = control_ref_.velocity[i];
+    record.state_position[i]     = uav_state_.position[i];
+    record.state_velocity[i]     = uav_state_.velocity[i];
+  }
+  record.reference_yaw      = control_ref_.yaw.x();
+  record.reference_yaw_rate = control_ref_.yaw.y();
+  record.state_yaw          = uav_state_.yaw.x();
+  record.state_yaw_rate     = uav_state_.yaw.y();
+
+  const UAV_command &command = currentCommand();
+  for (int i = 0; i < 3; i++) {
+    record.command[i] = command.velocity[i];
+  }
+  record.command[3] = command.yaw_speed;
+
+  // Error and proportional gain of each axis, as in the pipeline of the mode
+  const ControllerGains &gains = currentGains();
+  Eigen::Vector3d error        = Eigen::Vector3d::Zero();
+  Eigen::Vector3d kp           = Eigen::Vector3d::Zero();
+  Eigen::Vector3d output       = control_command_.velocity;
+  bool saturable               = false;
+  UAV_command feedforward;
+  switch (control_mode_in_.control_mode) {
+    case ControlMode::HOVER:
+    case ControlMode::POSITION:
+      error     = control_ref_.position - uav_state_.position;
+      kp        = gains.position.kp;
+      output    = controller_output_.velocity;
+      saturable = true;
+      break;
+    case ControlMode::SPEED:
+      error = control_ref_.velocity - uav_state_.velocity;
+      if (!use_bypass_) {
+        kp = gains.speed.kp;
+      }
+      break;
+    case ControlMode::SPEED_IN_A_PLANE:
+      error = control_ref_.velocity - uav_state_.velocity;
+      if (!use_bypass_) {
+        kp = gains.speed_in_a_plane_speed.kp;
+      }
+      // Height loop
+      error.z() = control_ref_.position.z() - uav_state_.position.z();
+      kp.z()    = gains.speed_in_a_plane_height.kp;
+      break;
+    case ControlMode::TRAJECTORY:
+      error       = control_ref_.position - uav_state_.position;
+      kp          = gains.trajectory.kp;
+      output      = controller_output_.velocity;
+      feedforward = feedforward_;
+      saturable   = true;
+      break;
+    default:
+      break;
+  }
+  if (use_bypass_ && (control_mode_in_.control_mode == ControlMode::SPEED ||
+                      control_mode_in_.control_mode == ControlMode::SPEED_IN_A_PLANE)) {
+    record.flags |= TELEMETRY_BYPASS;
+  }
+
+  const bool translation_ran = (loops_run_ & TELEMETRY_TRANSLATION_LOOP) != 0;
+  for (int i = 0; i < 3; i++) {
+    record.error[i]             = error[i];
+    record.controller_output[i] = output[i];
+    if (translation_ran && kp[i] != 0.0) {
+      record.proportional[i]        = kp[i] * error[i];
+      record.integral_derivative[i] = output[i] - record.proportional[i] - feedforward.velocity[i];
+    }
+    if (saturable && (std::abs(output[i]) >= saturation::effectiveLimit(speed_limits_[i]) ||
+                      control_command_.velocity[i] != output[i])) {
+      record.saturated |= static_cast<uint8_t>(1u << i);
+    }
+  }
+
+  if (control_mode_in_.yaw_mode == ControlMode::YAW_ANGLE) {
+    record.error[3] = as2::frame::angleMinError(control_ref_.yaw.x(), uav_state_.yaw.x());
+    if ((loops_run_ & TELEMETRY_YAW_LOOP) != 0) {
+      record.proportional[3]        = gains.yaw.kp * record.error[3];
+      record.integral_derivative[3] =
+          control_command_.yaw_speed - record.proportional[3] - feedforward.yaw_speed;
+    }
+  } else {
+    record.error[3] = control_ref_.yaw.y() - uav_state_.yaw.y();
+  }
+  record.controller_output[3] = control_command_.yaw_speed;
+
+  _recorder.record(record);
+}
+
 void Plugin::reset() {
+  // No input converted before the reset is queued after it
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+  std::lock_guard<PiMutex> lock(control_mutex_);
+  discardInputs();
+  trajectory_buffer_.clear();
+  clearLimitProfile();
   resetReferences();
   resetState();
   resetCommands();
-  pid_yaw_handler_->resetController();
-  pid_3D_position_handler_->resetController();
-  pid_3D_velocity_handler_->resetController();
-  pid_3D_trajectory_handler_->resetController();
+  pid_yaw_handler_.resetController();
+  pid_3D_position_handler_.resetController();
+  pid_3D_velocity_handler_.resetController();
+  pid_3D_trajectory_handler_.resetController();
   // Info: Yaw rate limit could be set if needed
-  // pid_yaw_handler_->setOutputSaturation(yaw_speed_limit_);
+  // pid_yaw_handler_.setOutputSaturation(yaw_speed_limit_);
+}
+
+void Plugin::predictState(double _horizon) {
+  // Commands and measured twists share a frame in every mode, the displacement is taken to ENU
+  const double tau = state_prediction_time_constant_;
+  Eigen::Vector3d displacement;
+  uav_state_.velocity = predictFirstOrder(measured_state_.velocity, control_command_.velocity, tau,
+                                          _horizon, displacement);
+  if (input_twist_frame_id_ == FrameId::FLU) {
+    displacement = yaw_rotation_.fluToEnu(displacement);
+  }
+  uav_state_.position = measured_state_.position + displacement;
+
+  double yaw_displacement;
+  uav_state_.yaw.y() = predictFirstOrder(measured_state_.yaw.y(), control_command_.yaw_speed, tau,
+                                         _horizon, yaw_displacement);
+  uav_state_.yaw.x() = measured_state_.yaw.x() + yaw_displacement;
 }
 
 void Plugin::resetState() {
@@ -247,33 +960,69 @@ void Plugin::resetState() {
 void Plugin::resetReferences() {
   control_ref_.position = uav_state_.position;
   control_ref_.velocity = Eigen::Vector3d::Zero();
-  control_ref_.yaw      = uav_state_.yaw;
+  // Hold the current yaw, without yaw rate
+  control_ref_.yaw = Eigen::Vector3d(uav_state_.yaw.x(), 0.0, 0.0);
   return;
 }
 
 void Plugin::resetCommands() {
   control_command_.velocity  = Eigen::Vector3d::Zero();
   control_command_.yaw_speed = 0.0;
+  // No command to hold: both loops run on the next tick
+  translation_rate_.reset();
+  yaw_rate_.reset();
+  computed_state_time_ = -1.0;
+  last_output_valid_   = false;
+  handoff_weight_      = 0.0;
+  feedforward_         = UAV_command();
   return;
 }
 
 void Plugin::updateState(const geometry_msgs::msg::PoseStamped &pose_msg,
                          const geometry_msgs::msg::TwistStamped &twist_msg) {
-  if (pose_msg.header.frame_id != input_pose_frame_id_ &&
-      twist_msg.header.frame_id != input_twist_frame_id_) {
-    RCLCPP_ERROR(node_ptr_->get_logger(), "Pose and Twist frame_id are not desired ones");
-    RCLCPP_ERROR(node_ptr_->get_logger(), "Recived: %s, %s", pose_msg.header.frame_id.c_str(),
-                 twist_msg.header.frame_id.c_str());
-    RCLCPP_ERROR(node_ptr_->get_logger(), "Desired: %s, %s", input_pose_frame_id_.c_str(),
-                 input_twist_frame_id_.c_str());
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_STATE));
+  // Callbacks may run on several executor threads, the queues take a single producer
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+
+  // The yaw used to rotate the twist is only meaningful in the desired pose frame
+  if (pose_msg.header.frame_id != getInputPoseFrameId()) {
+    rejectCall(RejectedCall::FRAME_MISMATCH);
+    // Only a frame that is not one of the plugin's is copied by name
+    const uint8_t frame = frameIndex(pose_msg.header.frame_id);
+    event_log_.report(LogEvent::POSE_FRAME_MISMATCH, frame,
+                      static_cast<uint8_t>(input_pose_frame_id_),
+                      frame == LogRecord::kNoFrame ? pose_msg.header.frame_id.c_str() : nullptr);
     return;
   }
 
-  uav_state_.position =
+  StateInput state;
+  state.position =
       Eigen::Vector3d(pose_msg.pose.position.x, pose_msg.pose.position.y, pose_msg.pose.position.z);
-  uav_state_.velocity =
-      Eigen::Vector3d(twist_msg.twist.linear.x, twist_msg.twist.linear.y, twist_msg.twist.linear.z);
-  uav_state_.yaw.x() = as2::frame::getYawFromQuaternion(pose_msg.pose.orientation);
+  state.yaw = as2::frame::getYawFromQuaternion(pose_msg.pose.orientation);
+  input_yaw_rotation_.update(state.yaw);
+  state.yaw_rotation = input_yaw_rotation_;
+  state.time         = trajectoryTime(pose_msg.header.stamp);
+
+  if (!convertTwist(twist_msg, input_twist_frame_id_, state.velocity, state.yaw_rate)) {
+    rejectCall(RejectedCall::FRAME_MISMATCH);
+    return;
+  }
+
+  if (!realtime_active_.load(std::memory_order_acquire)) {
+    applyState(state);
+  } else if (!realtime_inputs_->state.push(state)) {
+    rejectCall(RejectedCall::QUEUE_FULL);
+  }
+  return;
+};
+
+void Plugin::applyState(const StateInput &_state) {
+  uav_state_.position = _state.position;
+  uav_state_.velocity = _state.velocity;
+  uav_state_.yaw.x()  = _state.yaw;
+  yaw_rotation_       = _state.yaw_rotation;
+  state_time_         = _state.time;
+  control_time_       = state_time_;
 
   if (hover_flag_) {
     resetReferences();
@@ -281,35 +1030,86 @@ void Plugin::updateState(const geometry_msgs::msg::PoseStamped &pose_msg,
     hover_flag_         = false;
   }
 
-  flags_.state_received = true;
-  return;
-};
+  uav_state_.yaw.y()    = _state.yaw_rate;
+  measured_state_       = uav_state_;
+  flags_.state_received = true;
+  return;
+}
+
+bool Plugin::convertTwist(const geometry_msgs::msg::TwistStamped &_twist_msg,
+                          FrameId _frame_id,
+                          Eigen::Vector3d &_linear,
+                          double &_yaw_rate) {
+  const std::string &frame_id = _twist_msg.header.frame_id;
+  const Eigen::Vector3d linear(_twist_msg.twist.linear.x, _twist_msg.twist.linear.y,
+                               _twist_msg.twist.linear.z);
+
+  // ENU and FLU only differ by the cached yaw rotation, which leaves the yaw rate unchanged
+  _yaw_rate = _twist_msg.twist.angular.z;
+  if (frame_id == getFrameId(_frame_id)) {
+    _linear = linear;
+    return true;
+  }
+  if (_frame_id == FrameId::FLU && frame_id == getFrameId(FrameId::ENU)) {
+    _linear = input_yaw_rotation_.enuToFlu(linear);
+    return true;
+  }
+  if (_frame_id == FrameId::ENU && frame_id == getFrameId(FrameId::FLU)) {
+    _linear = input_yaw_rotation_.fluToEnu(linear);
+    return true;
+  }
+
+  // Any other frame needs the full transform from the TF buffer
+  try {
+    const geometry_msgs::msg::TwistStamped twist =
+        tf_handler_->convert(_twist_msg, getFrameId(_frame_id));
+    _linear   = Eigen::Vector3d(twist.twist.linear.x, twist.twist.linear.y, twist.twist.linear.z);
+    _yaw_rate = twist.twist.angular.z;
+  } catch (const tf2::TransformException &ex) {
+    event_log_.report(LogEvent::TWIST_CONVERSION, frameIndex(frame_id),
+                      static_cast<uint8_t>(_frame_id), ex.what());
+    return false;
+  }
+  return true;
+}
 
 void Plugin::updateReference(const geometry_msgs::msg::PoseStamped &pose_msg) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_REFERENCE));
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+
+  ReferenceInput reference;
+  reference.kind = ReferenceInput::Kind::POSE;
   if (control_mode_in_.control_mode == as2_msgs::msg::ControlMode::POSITION ||
       control_mode_in_.control_mode == as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE) {
-    control_ref_.position = Eigen::Vector3d(pose_msg.pose.position.x, pose_msg.pose.position.y,
-                                            pose_msg.pose.position.z);
-    flags_.ref_received   = true;
+    reference.has_position = true;
+    reference.vector       = Eigen::Vector3d(pose_msg.pose.position.x, pose_msg.pose.position.y,
+                                             pose_msg.pose.position.z);
   }
 
   if ((control_mode_in_.control_mode == as2_msgs::msg::ControlMode::SPEED ||
        control_mode_in_.control_mode == as2_msgs::msg::ControlMode::POSITION ||
        control_mode_in_.control_mode == as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE) &&
       control_mode_in_.yaw_mode == as2_msgs::msg::ControlMode::YAW_ANGLE) {
-    control_ref_.yaw.x() = as2::frame::getYawFromQuaternion(pose_msg.pose.orientation);
+    reference.has_yaw = true;
+    reference.yaw     = as2::frame::getYawFromQuaternion(pose_msg.pose.orientation);
   }
 
+  if (reference.has_position || reference.has_yaw) {
+    dispatchReference(reference);
+  }
   return;
 };
 
 void Plugin::updateReference(const geometry_msgs::msg::TwistStamped &twist_msg) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_REFERENCE));
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+
+  ReferenceInput reference;
   if (control_mode_in_.control_mode == as2_msgs::msg::ControlMode::POSITION) {
-    speed_limits_ = Eigen::Vector3d(twist_msg.twist.linear.x, twist_msg.twist.linear.y,
-                                    twist_msg.twist.linear.z);
-    pid_3D_position_handler_->setOutputSaturation(speed_limits_);
-    pid_3D_velocity_handler_->setOutputSaturation(speed_limits_);
-    pid_3D_trajectory_handler_->setOutputSaturation(speed_limits_);
+    reference.kind   = ReferenceInput::Kind::SPEED_LIMITS;
+    reference.vector = Eigen::Vector3d(twist_msg.twist.linear.x, twist_msg.twist.linear.y,
+                                       twist_msg.twist.linear.z);
+    dispatchReference(reference);
     return;
   }
 
@@ -318,82 +1118,318 @@ void Plugin::updateReference(const geometry_msgs::msg::TwistStamped &twist_msg)
     return;
   }
 
-  control_ref_.velocity =
-      Eigen::Vector3d(twist_msg.twist.linear.x, twist_msg.twist.linear.y, twist_msg.twist.linear.z);
+  reference.kind = ReferenceInput::Kind::TWIST;
+  if (!convertTwist(twist_msg, input_twist_frame_id_, reference.vector, reference.yaw)) {
+    rejectCall(RejectedCall::FRAME_MISMATCH);
+    return;
+  }
+  reference.has_yaw = control_mode_in_.yaw_mode == as2_msgs::msg::ControlMode::YAW_SPEED;
+  dispatchReference(reference);
+  return;
+};
+
+void Plugin::updateReference(const as2_msgs::msg::TrajectoryPoint &traj_msg) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_REFERENCE));
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
 
-  if (control_mode_in_.yaw_mode == as2_msgs::msg::ControlMode::YAW_SPEED) {
-    control_ref_.yaw.y() = twist_msg.twist.angular.z;
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) {
+    return;
   }
 
-  flags_.ref_received = true;
+  ReferenceInput reference;
+  reference.kind = ReferenceInput::Kind::TRAJECTORY_POINT;
+
+  TrajectorySample &sample = reference.sample;
+
+  sample.time     = trajectoryTime(traj_msg.header.stamp);
+  sample.position = Eigen::Vector3d(traj_msg.position.x, traj_msg.position.y, traj_msg.position.z);
+  sample.velocity = Eigen::Vector3d(traj_msg.twist.x, traj_msg.twist.y, traj_msg.twist.z);
+  sample.yaw      = traj_msg.yaw_angle;
+
+  sample.acceleration = Eigen::Vector3d(traj_msg.acceleration.x, traj_msg.acceleration.y,
+                                        traj_msg.acceleration.z);
+  dispatchReference(reference);
   return;
 };
 
-void Plugin::updateReference(const as2_msgs::msg::TrajectoryPoint &traj_msg) {
+void Plugin::updateReference(const std::vector<as2_msgs::msg::TrajectoryPoint> &traj_msg) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_REFERENCE));
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+
   if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) {
     return;
   }
 
-  control_ref_.position =
-      Eigen::Vector3d(traj_msg.position.x, traj_msg.position.y, traj_msg.position.z);
+  ReferenceInput reference;
+  reference.kind    = ReferenceInput::Kind::SEGMENT_SAMPLE;
+  reference.has_yaw = true;
+  reference.first   = true;
 
-  control_ref_.velocity = Eigen::Vector3d(traj_msg.twist.x, traj_msg.twist.y, traj_msg.twist.z);
+  TrajectorySample &sample = reference.sample;
+  for (const auto &point : traj_msg) {
+    sample.time         = trajectoryTime(point.header.stamp);
+    sample.position     = Eigen::Vector3d(point.position.x, point.position.y, point.position.z);
+    sample.velocity     = Eigen::Vector3d(point.twist.x, point.twist.y, point.twist.z);
+    sample.acceleration = Eigen::Vector3d(point.acceleration.x, point.acceleration.y,
+                                          point.acceleration.z);
+    sample.yaw          = point.yaw_angle;
+    if (!dispatchReference(reference)) {
+      break;
+    }
+    reference.first = false;
+  }
+  return;
+};
 
-  control_ref_.yaw.x() = traj_msg.yaw_angle;
+void Plugin::updateReference(const trajectory_msgs::msg::JointTrajectory &traj_msg) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_REFERENCE));
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
 
-  flags_.ref_received = true;
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) {
+    return;
+  }
+
+  // Joint index of x, y, z and yaw, -1 when missing
+  std::array<int, 4> joints = {-1, -1, -1, -1};
+  static constexpr std::array<const char *, 4> kJointNames = {"x", "y", "z", "yaw"};
+  for (size_t i = 0; i < traj_msg.joint_names.size(); i++) {
+    for (size_t j = 0; j < kJointNames.size(); j++) {
+      if (traj_msg.joint_names[i] == kJointNames[j]) {
+        joints[j] = static_cast<int>(i);
+      }
+    }
+  }
+  if (joints[0] < 0 || joints[1] < 0 || joints[2] < 0) {
+    event_log_.report(LogEvent::JOINT_TRAJECTORY_WITHOUT_XYZ);
+    return;
+  }
+
+  auto value = [](const std::vector<double> &_values, int _joint) {
+    return _joint >= 0 && static_cast<size_t>(_joint) < _values.size() ? _values[_joint] : 0.0;
+  };
+
+  // Without a yaw joint the samples keep the yaw reference of the control loop
+  const double start = trajectoryTime(traj_msg.header.stamp);
+  ReferenceInput reference;
+  reference.kind    = ReferenceInput::Kind::SEGMENT_SAMPLE;
+  reference.has_yaw = joints[3] >= 0;
+  reference.first   = true;
+
+  TrajectorySample &sample = reference.sample;
+  for (const auto &point : traj_msg.points) {
+    sample.time = start + rclcpp::Duration(point.time_from_start).seconds();
+    for (int axis = 0; axis < 3; axis++) {
+      sample.position[axis]     = value(point.positions, joints[axis]);
+      sample.velocity[axis]     = value(point.velocities, joints[axis]);
+      sample.acceleration[axis] = value(point.accelerations, joints[axis]);
+    }
+    sample.yaw = reference.has_yaw ? value(point.positions, joints[3]) : 0.0;
+    if (!dispatchReference(reference)) {
+      break;
+    }
+    reference.first = false;
+  }
   return;
 };
 
-bool Plugin::setMode(const as2_msgs::msg::ControlMode &in_mode,
-                     const as2_msgs::msg::ControlMode &out_mode) {
-  if (!flags_.plugin_parameters_read) {
-    RCLCPP_WARN(node_ptr_->get_logger(), "Plugin parameters not read yet, can not set mode");
-    return false;
+void Plugin::updateSpeedLimitProfile(const std::vector<SpeedLimitKnot> &profile) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::UPDATE_REFERENCE));
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::POSITION &&
+      control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) {
+    return;
   }
 
-  if (!flags_.position_controller_parameters_read) {
-    RCLCPP_WARN(node_ptr_->get_logger(),
-                "Position controller parameters not read, can not set mode");
-    for (auto &param : position_control_parameters_to_read_) {
-      RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %s not read", param.c_str());
+  ReferenceInput reference;
+  if (profile.empty()) {
+    reference.kind = ReferenceInput::Kind::CLEAR_LIMIT_PROFILE;
+    dispatchReference(reference);
+    return;
+  }
+
+  reference.kind  = ReferenceInput::Kind::LIMIT_KNOT;
+  reference.first = true;
+  for (const auto &knot : profile) {
+    reference.sample.time = knot.time;
+    reference.vector      = knot.limits;
+    if (!dispatchReference(reference)) {
+      break;
     }
+    reference.first = false;
+  }
+  return;
+}
+
+bool Plugin::dispatchReference(const ReferenceInput &_reference) {
+  if (!realtime_active_.load(std::memory_order_acquire)) {
+    applyReference(_reference);
+    return true;
+  }
+  if (!realtime_inputs_->reference.push(_reference)) {
+    rejectCall(RejectedCall::QUEUE_FULL);
+    event_log_.report(LogEvent::REFERENCE_QUEUE_FULL);
     return false;
   }
+  return true;
+}
 
-  if (in_mode.control_mode == as2_msgs::msg::ControlMode::TRAJECTORY &&
-      !flags_.trajectory_controller_parameters_read) {
-    RCLCPP_WARN(node_ptr_->get_logger(),
-                "Trajectory controller parameters not read yet, can not set mode to TRAJECTORY");
-    for (auto &param : trajectory_control_parameters_to_read_) {
-      RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %s not read", param.c_str());
+void Plugin::applyReference(const ReferenceInput &_reference) {
+  switch (_reference.kind) {
+    case ReferenceInput::Kind::POSE:
+      if (_reference.has_position) {
+        control_ref_.position = _reference.vector;
+        flags_.ref_received   = true;
+      }
+      if (_reference.has_yaw) {
+        control_ref_.yaw.x() = _reference.yaw;
+      }
+      break;
+    case ReferenceInput::Kind::SPEED_LIMITS:
+      // Planners may re-send unchanged limits with every reference
+      reference_speed_limits_ = _reference.vector;
+      if (limit_profile_.empty()) {
+        setSpeedLimits(reference_speed_limits_);
+      }
+      break;
+    case ReferenceInput::Kind::TWIST:
+      control_ref_.velocity = _reference.vector;
+      if (_reference.has_yaw) {
+        control_ref_.yaw.y() = _reference.yaw;
+      }
+      flags_.ref_received = true;
+      break;
+    case ReferenceInput::Kind::TRAJECTORY_POINT:
+      control_ref_.position = _reference.sample.position;
+      control_ref_.velocity = _reference.sample.velocity;
+      control_ref_.yaw.x()  = _reference.sample.yaw;
+      trajectory_buffer_.push(_reference.sample);
+      flags_.ref_received = true;
+      break;
+    case ReferenceInput::Kind::SEGMENT_SAMPLE: {
+      // A new segment replaces the buffered samples from its first stamp on. The ones between
+      // the control time and that stamp are kept, the reference runs into the new segment
+      if (_reference.first) {
+        trajectory_buffer_.release(control_time_);
+        trajectory_buffer_.truncate(_reference.sample.time);
+        segment_dropped_ = false;
+      }
+      if (segment_dropped_) {
+        break;
+      }
+      TrajectorySample sample = _reference.sample;
+      if (!_reference.has_yaw) {
+        sample.yaw = control_ref_.yaw.x();
+      }
+      segment_dropped_ = !pushSegmentSample(sample);
+      break;
     }
-    return false;
-  } else if ((in_mode.control_mode == as2_msgs::msg::ControlMode::SPEED ||
-              in_mode.control_mode == as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE) &&
-             (!flags_.velocity_controller_parameters_read && !use_bypass_)) {
-    RCLCPP_WARN(node_ptr_->get_logger(),
-                "Velocity controller parameters not read yet and bypass is not used, can not set "
-                "mode to SPEED or SPEED_IN_A_PLANE");
-    if (in_mode.control_mode == as2_msgs::msg::ControlMode::SPEED) {
-      for (auto &param : velocity_control_parameters_to_read_) {
-        RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %s not read", param.c_str());
+    case ReferenceInput::Kind::LIMIT_KNOT: {
+      // Evaluated on the next ticks, a profile that does not fit keeps its first knots
+      if (_reference.first) {
+        limit_profile_.clear();
       }
-    } else {
-      for (auto &param : speed_in_a_plane_control_parameters_to_read_) {
-        RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %s not read", param.c_str());
+      SpeedLimitKnot knot;
+      knot.time   = _reference.sample.time;
+      knot.limits = _reference.vector;
+      if (!limit_profile_.push(knot)) {
+        event_log_.report(LogEvent::LIMIT_PROFILE_REJECTED);
       }
+      break;
     }
+    case ReferenceInput::Kind::CLEAR_LIMIT_PROFILE:
+      clearLimitProfile();
+      break;
+  }
+  return;
+}
+
+void Plugin::setSpeedLimits(const Eigen::Vector3d &_speed_limits) {
+  if (_speed_limits == speed_limits_) {
+    return;
+  }
+  speed_limits_ = _speed_limits;
+  pid_3D_position_handler_.setOutputSaturation(speed_limits_);
+  pid_3D_velocity_handler_.setOutputSaturation(speed_limits_);
+  pid_3D_trajectory_handler_.setOutputSaturation(speed_limits_);
+  return;
+}
+
+void Plugin::clearLimitProfile() {
+  limit_profile_.clear();
+  setSpeedLimits(reference_speed_limits_);
+  return;
+}
+
+double Plugin::now() const { return clock_ ? clock_() : node_ptr_->now().seconds(); }
+
+double Plugin::trajectoryTime(const builtin_interfaces::msg::Time &_stamp) {
+  // Unstamped references are taken for the time they arrive
+  const rclcpp::Time stamp(_stamp);
+  return stamp.nanoseconds() == 0 ? now() : stamp.seconds();
+}
+
+bool Plugin::pushSegmentSample(const TrajectorySample &_sample) {
+  // Keep the beginning of a segment that does not fit, the next one continues from there
+  if (trajectory_buffer_.full() && _sample.time > trajectory_buffer_.newest().time) {
+    event_log_.report(LogEvent::TRAJECTORY_BUFFER_FULL);
     return false;
   }
+  trajectory_buffer_.push(_sample);
+  flags_.ref_received = true;
+  return true;
+}
+
+void Plugin::sampleTrajectoryReference() {
+  TrajectorySample sample;
+  if (!trajectory_buffer_.sample(control_time_, sample)) {
+    feedforward_ = UAV_command();
+    return;
+  }
+  control_ref_.position = sample.position;
+  control_ref_.velocity = sample.velocity;
+  control_ref_.yaw.x()  = sample.yaw;
 
-  if (in_mode.yaw_mode == as2_msgs::msg::ControlMode::YAW_ANGLE &&
-      !flags_.yaw_controller_parameters_read) {
-    RCLCPP_WARN(node_ptr_->get_logger(),
-                "Yaw controller parameters not read yet, can not set mode to YAW_ANGLE");
+  // Velocity change over the horizon, taken at its midpoint where it is exact for the linearly
+  // interpolated acceleration of a segment
+  const double look_ahead = feedforward_look_ahead_;
+  if (look_ahead > 0.0) {
+    TrajectorySample midpoint;
+    trajectory_buffer_.evaluate(control_time_ + 0.5 * look_ahead, midpoint);
+    feedforward_.velocity = look_ahead * midpoint.acceleration;
+  } else {
+    feedforward_.velocity = Eigen::Vector3d::Zero();
+  }
+  feedforward_.yaw_speed =
+      yaw_rate_feedforward_.load(std::memory_order_relaxed) ? sample.yaw_rate : 0.0;
+  return;
+}
+
+bool Plugin::setMode(const as2_msgs::msg::ControlMode &in_mode,
+                     const as2_msgs::msg::ControlMode &out_mode) {
+  std::lock_guard<std::mutex> config_lock(config_mutex_);
+
+  // Every group the mode needs is checked with a single mask, the per-group checks only run to
+  // report what is missing
+  if (getMissingParameters(in_mode).any()) {
+    logMissingParameters(in_mode);
     return false;
   }
 
+  // The producers read the mode and the input frames under input_lock_, so no input converted
+  // for the previous mode is queued once discardInputs() has run. Lock order: config_mutex_,
+  // input_lock_, control_mutex_
+  std::lock_guard<SpinLock> producer_lock(input_lock_);
+  std::lock_guard<PiMutex> lock(control_mutex_);
+
+  // Hand-off needs a command computed on a valid state in the outgoing mode
+  const bool hand_off = mode_handoff_enabled_.load(std::memory_order_relaxed) &&
+                        flags_.state_received && last_output_valid_;
+  if (hand_off) {
+    handoff_command_ = handoff_weight_ > 0.0 ? handoff_output_ : control_command_;
+  }
+  const FrameId previous_twist_frame_id = input_twist_frame_id_;
+
   if (in_mode.control_mode == as2_msgs::msg::ControlMode::HOVER) {
     control_mode_in_.control_mode    = in_mode.control_mode;
     control_mode_in_.yaw_mode        = as2_msgs::msg::ControlMode::YAW_ANGLE;
@@ -406,131 +1442,484 @@ bool Plugin::setMode(const as2_msgs::msg::ControlMode &in_mode,
   flags_.state_received = false;
   flags_.ref_received   = false;
   control_mode_out_     = out_mode;
+  trajectory_buffer_.clear();
+  clearLimitProfile();
+  resetCommands();
+  // Queued inputs were converted to the frames of the previous mode
+  discardInputs();
 
   if (control_mode_in_.control_mode == as2_msgs::msg::ControlMode::HOVER ||
       control_mode_in_.control_mode == as2_msgs::msg::ControlMode::POSITION ||
       control_mode_in_.control_mode == as2_msgs::msg::ControlMode::TRAJECTORY) {
-    input_pose_frame_id_   = enu_frame_id_;
-    output_twist_frame_id_ = enu_frame_id_;
+    input_pose_frame_id_   = FrameId::ENU;
+    input_twist_frame_id_  = FrameId::ENU;
+    output_twist_frame_id_ = FrameId::ENU;
   } else if (control_mode_in_.control_mode == as2_msgs::msg::ControlMode::SPEED ||
              control_mode_in_.control_mode == as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE) {
-    input_pose_frame_id_ = enu_frame_id_;
+    input_pose_frame_id_ = FrameId::ENU;
     switch (control_mode_out_.reference_frame) {
       case as2_msgs::msg::ControlMode::BODY_FLU_FRAME:
-        input_twist_frame_id_  = flu_frame_id_;
-        output_twist_frame_id_ = flu_frame_id_;
+        input_twist_frame_id_  = FrameId::FLU;
+        output_twist_frame_id_ = FrameId::FLU;
         break;
       case as2_msgs::msg::ControlMode::LOCAL_ENU_FRAME:
       default:
-        input_twist_frame_id_  = enu_frame_id_;
-        output_twist_frame_id_ = enu_frame_id_;
+        input_twist_frame_id_  = FrameId::ENU;
+        output_twist_frame_id_ = FrameId::ENU;
         break;
     }
   }
 
+  if (hand_off) {
+    handOffMode(previous_twist_frame_id);
+  }
+  updatePipeline();
+  mode_generation_.fetch_add(1, std::memory_order_release);
   return true;
 };
 
-std::string Plugin::getDesiredPoseFrameId() { return input_pose_frame_id_; }
+void Plugin::handOffMode(FrameId _previous_twist_frame_id) {
+  // Twists are kept in the input twist frame of the mode
+  if (_previous_twist_frame_id == FrameId::FLU && input_twist_frame_id_ == FrameId::ENU) {
+    uav_state_.velocity       = yaw_rotation_.fluToEnu(uav_state_.velocity);
+    measured_state_.velocity  = yaw_rotation_.fluToEnu(measured_state_.velocity);
+    handoff_command_.velocity = yaw_rotation_.fluToEnu(handoff_command_.velocity);
+  } else if (_previous_twist_frame_id == FrameId::ENU && input_twist_frame_id_ == FrameId::FLU) {
+    uav_state_.velocity       = yaw_rotation_.enuToFlu(uav_state_.velocity);
+    measured_state_.velocity  = yaw_rotation_.enuToFlu(measured_state_.velocity);
+    handoff_command_.velocity = yaw_rotation_.enuToFlu(handoff_command_.velocity);
+  }
+  flags_.state_received = true;
+
+  // Hold the current position and yaw, keep the outgoing velocity and yaw rate until the new
+  // references arrive
+  control_ref_.position = uav_state_.position;
+  control_ref_.velocity = handoff_command_.velocity;
+  control_ref_.yaw      = Eigen::Vector3d(uav_state_.yaw.x(), handoff_command_.yaw_speed, 0.0);
+  flags_.ref_received   = true;
+  hover_flag_           = false;
+
+  // The incoming controllers start clean, the blend covers the jump to their output
+  pid_yaw_handler_.resetController();
+  pid_3D_position_handler_.resetController();
+  pid_3D_velocity_handler_.resetController();
+  pid_3D_speed_in_a_plane_handler_.resetController();
+  pid_1D_speed_in_a_plane_handler_.resetController();
+  pid_3D_trajectory_handler_.resetController();
+  handoff_weight_ = 1.0;
+}
+
+void Plugin::blendHandoff(double _dt) {
+  const double weight = handoff_weight_;
+
+  handoff_output_.velocity =
+      weight * handoff_command_.velocity + (1.0 - weight) * control_command_.velocity;
+  handoff_output_.yaw_speed =
+      weight * handoff_command_.yaw_speed + (1.0 - weight) * control_command_.yaw_speed;
+
+  // Weights below kMinHandoffWeight end the blend, the output then jumps by less than that
+  // fraction of the gap between both commands
+  const double tau = mode_handoff_time_constant_;
+  handoff_weight_  = tau > 0.0 ? weight * std::exp(-_dt / tau) : 0.0;
+  if (handoff_weight_ < kMinHandoffWeight) {
+    handoff_weight_ = 0.0;
+  }
+}
+
+std::string Plugin::getDesiredPoseFrameId() { return getInputPoseFrameId(); }
+
+std::string Plugin::getDesiredTwistFrameId() { return getInputTwistFrameId(); }
+
+const std::string &Plugin::getFrameId(FrameId _frame_id) const {
+  return frame_ids_[static_cast<size_t>(_frame_id)];
+}
+
+uint8_t Plugin::frameIndex(const std::string &_frame_id) const {
+  for (size_t i = 0; i < frame_ids_.size(); i++) {
+    if (frame_ids_[i] == _frame_id) {
+      return static_cast<uint8_t>(i);
+    }
+  }
+  return LogRecord::kNoFrame;
+}
+
+void Plugin::logEvent(const LogRecord &_record) const {
+  // Runs on the drain thread of the event log, frame_ids_ is only written on initialization
+  const char *detail = _record.detail.data();
+  auto frame_name    = [this](uint8_t _frame, const char *_fallback) {
+    return _frame < frame_ids_.size() ? frame_ids_[_frame].c_str() : _fallback;
+  };
+
+  switch (_record.event) {
+    case LogEvent::POSE_FRAME_MISMATCH:
+      RCLCPP_ERROR(node_ptr_->get_logger(),
+                   "Pose frame_id is not the desired one. Received: %s, Desired: %s",
+                   frame_name(_record.frame, detail), frame_name(_record.expected_frame, "?"));
+      break;
+    case LogEvent::TWIST_CONVERSION:
+      RCLCPP_ERROR(node_ptr_->get_logger(), "Could not convert twist to %s: %s",
+                   frame_name(_record.expected_frame, "?"), detail);
+      break;
+    case LogEvent::JOINT_TRAJECTORY_WITHOUT_XYZ:
+      RCLCPP_ERROR(node_ptr_->get_logger(), "Joint trajectory without x, y and z joints");
+      break;
+    case LogEvent::REFERENCE_QUEUE_FULL:
+      RCLCPP_WARN(node_ptr_->get_logger(),
+                  "Reference queue of the control thread full, dropping references");
+      break;
+    case LogEvent::TRAJECTORY_BUFFER_FULL:
+      RCLCPP_WARN(node_ptr_->get_logger(),
+                  "Trajectory buffer full, dropping the end of the segment");
+      break;
+    case LogEvent::LIMIT_PROFILE_REJECTED:
+      RCLCPP_WARN(node_ptr_->get_logger(),
+                  "Speed limit knot out of order or beyond %zu knots, dropped",
+                  SpeedLimitProfile::kCapacity);
+      break;
+    case LogEvent::STATE_NOT_RECEIVED:
+      RCLCPP_WARN(node_ptr_->get_logger(), "State not received yet");
+      break;
+    case LogEvent::REFERENCE_NOT_RECEIVED:
+      RCLCPP_WARN(node_ptr_->get_logger(), "State changed, but ref not recived yet");
+      break;
+    case LogEvent::UNKNOWN_CONTROL_MODE:
+      RCLCPP_ERROR(node_ptr_->get_logger(), "Unknown control mode");
+      break;
+    case LogEvent::UNKNOWN_YAW_MODE:
+      RCLCPP_ERROR(node_ptr_->get_logger(), "Unknown yaw mode");
+      break;
+    case LogEvent::COUNT:
+      break;
+  }
+  if (_record.suppressed > 0) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "%s repeated %llu times since the last report",
+                kLogEventNames[static_cast<size_t>(_record.event)],
+                static_cast<unsigned long long>(_record.suppressed));
+  }
+  return;
+}
+
+const std::string &Plugin::getInputPoseFrameId() const { return getFrameId(input_pose_frame_id_); }
+
+const std::string &Plugin::getInputTwistFrameId() const {
+  return getFrameId(input_twist_frame_id_);
+}
 
-std::string Plugin::getDesiredTwistFrameId() { return input_twist_frame_id_; }
+const std::string &Plugin::getOutputTwistFrameId() const {
+  return getFrameId(output_twist_frame_id_);
+}
 
 bool Plugin::computeOutput(double dt,
                            geometry_msgs::msg::PoseStamped &pose,
                            geometry_msgs::msg::TwistStamped &twist,
                            as2_msgs::msg::Thrust &thrust) {
+  // The control thread keeps its own period, dt is only used by the caller's timer
+  if (realtime_active_.load(std::memory_order_acquire)) {
+    FrameId frame_id = FrameId::ENU;
+    if (!getRealtimeOutput(twist.twist, frame_id)) {
+      return false;
+    }
+    updateOutputFrameId(twist.header, frame_id);
+    return true;
+  }
+  return computeCommand(dt) && getOutput(twist);
+}
+
+bool Plugin::computeLoanedOutput(double dt, geometry_msgs::msg::Twist &twist) {
+  if (realtime_active_.load(std::memory_order_acquire)) {
+    FrameId frame_id = FrameId::ENU;
+    return getRealtimeOutput(twist, frame_id);
+  }
+  return computeCommand(dt) && getOutput(twist);
+}
+
+bool Plugin::getRealtimeOutput(geometry_msgs::msg::Twist &_twist_msg, FrameId &_frame_id) {
+  output_buffer_.update();
+  const ControlOutput &output = output_buffer_.front();
+  // Commands computed before the last setMode belong to the previous mode. The frame of the
+  // command is the one it was computed in, the mode members are only read by the control thread
+  if (!output.valid || output.generation != mode_generation_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  _frame_id            = output.frame_id;
+  _twist_msg.linear.x  = output.command.velocity.x();
+  _twist_msg.linear.y  = output.command.velocity.y();
+  _twist_msg.linear.z  = output.command.velocity.z();
+  _twist_msg.angular.x = 0;
+  _twist_msg.angular.y = 0;
+  _twist_msg.angular.z = output.command.yaw_speed;
+  return true;
+}
+
+void Plugin::presetOutputHeader(std_msgs::msg::Header &header) const {
+  header.frame_id = getOutputTwistFrameId();
+}
+
+bool Plugin::computeCommand(double dt) {
+  ScopedLatency latency(latencyHistogram(LatencyProbe::COMPUTE_OUTPUT));
+  if (LatencyHistogram *jitter = latencyHistogram(LatencyProbe::DT_JITTER)) {
+    if (last_dt_ > 0.0) {
+      jitter->record(static_cast<uint64_t>(std::abs(dt - last_dt_) * 1e9));
+    }
+    last_dt_ = dt;
+  }
+
+  // Pick up a complete gain set published since the last tick
+  updateGains();
+
   if (!flags_.state_received) {
-    auto &clk = *node_ptr_->get_clock();
-    RCLCPP_WARN_THROTTLE(node_ptr_->get_logger(), clk, 5000, "State not received yet");
+    rejectCall(RejectedCall::STATE_NOT_RECEIVED);
+    event_log_.report(LogEvent::STATE_NOT_RECEIVED);
     return false;
   }
 
   if (!flags_.ref_received) {
-    auto &clk = *node_ptr_->get_clock();
-    RCLCPP_WARN_THROTTLE(node_ptr_->get_logger(), clk, 5000,
-                         "State changed, but ref not recived yet");
+    rejectCall(RejectedCall::REFERENCE_NOT_RECEIVED);
+    event_log_.report(LogEvent::REFERENCE_NOT_RECEIVED);
     return false;
   }
 
-  resetCommands();
+  if (state_triggered_.load(std::memory_order_relaxed)) {
+    // Nothing new to control on: hold the last output
+    if (state_time_ == computed_state_time_) {
+      return last_output_valid_;
+    }
+    if (computed_state_time_ >= 0.0 && state_time_ > computed_state_time_) {
+      dt = state_time_ - computed_state_time_;
+    }
+    computed_state_time_ = state_time_;
+  }
 
-  switch (control_mode_in_.control_mode) {
-    case as2_msgs::msg::ControlMode::HOVER:
-    case as2_msgs::msg::ControlMode::POSITION:
-      control_command_.velocity =
-          pid_3D_position_handler_->computeControl(dt, uav_state_.position, control_ref_.position);
+  const bool predict              = state_prediction_enabled_.load(std::memory_order_relaxed);
+  LatencyHistogram *input_latency = latencyHistogram(LatencyProbe::INPUT_LATENCY);
+  if (predict || input_latency != nullptr) {
+    input_latency_ = std::max(0.0, now() - state_time_);
+    if (input_latency != nullptr) {
+      input_latency->record(static_cast<uint64_t>(input_latency_ * 1e9));
+    }
+    if (predict) {
+      predictState(std::min(input_latency_, kMaxPredictionHorizon));
+    }
+  }
 
-      control_command_.velocity = pid_3D_position_handler_->saturateOutput(
-          control_command_.velocity, speed_limits_, proportional_limitation_);
-      break;
-    case as2_msgs::msg::ControlMode::SPEED: {
-      if (use_bypass_) {
+  const double control_dt =
+      dt_conditioning_enabled_.load(std::memory_order_relaxed) ? dt_conditioner_.condition(dt) : dt;
+
+  // The profile is only evaluated here, at the time of the tick
+  Eigen::Vector3d scheduled_limits = speed_limits_;
+  if (limit_profile_.update(control_time_, scheduled_limits)) {
+    setSpeedLimits(scheduled_limits);
+  }
+
+  const ComputePipeline pipeline = compute_pipeline_.load(std::memory_order_acquire);
+  last_output_valid_             = pipeline(*this, control_dt);
+  if (last_output_valid_ && handoff_weight_ > 0.0) {
+    blendHandoff(dt);
+  }
+  if (telemetry_.load(std::memory_order_relaxed) != nullptr) {
+    // Sequentially consistent with updateTelemetry: either it sees this tick as a user or the
+    // tick sees the recorder cleared
+    telemetry_users_.fetch_add(1, std::memory_order_seq_cst);
+    if (TelemetryRecorder *telemetry = telemetry_.load(std::memory_order_seq_cst)) {
+      recordTelemetry(*telemetry, dt, last_output_valid_);
+    }
+    telemetry_users_.fetch_sub(1, std::memory_order_release);
+  }
+  control_time_ += dt;
+  return last_output_valid_;
+}
+
+void Plugin::updatePipeline() {
+  compute_pipeline_.store(
+      selectPipeline(control_mode_in_.control_mode, control_mode_in_.yaw_mode, use_bypass_,
+                     proportional_limitation_),
+      std::memory_order_release);
+  return;
+}
+
+Plugin::ComputePipeline Plugin::selectPipeline(uint8_t _control_mode,
+                                               uint8_t _yaw_mode,
+                                               bool _use_bypass,
+                                               bool _proportional_limitation) {
+  using as2_msgs::msg::ControlMode;
+
+  // Flags that do not affect a mode are folded to false, so each control law is
+  // instantiated once
+  switch (_control_mode) {
+    case ControlMode::HOVER:
+    case ControlMode::POSITION:
+      return _proportional_limitation
+                 ? selectYawPipeline<ControlMode::POSITION, false, true>(_yaw_mode)
+                 : selectYawPipeline<ControlMode::POSITION, false, false>(_yaw_mode);
+    case ControlMode::SPEED:
+      return _use_bypass ? selectYawPipeline<ControlMode::SPEED, true, false>(_yaw_mode)
+                         : selectYawPipeline<ControlMode::SPEED, false, false>(_yaw_mode);
+    case ControlMode::SPEED_IN_A_PLANE:
+      return _use_bypass
+                 ? selectYawPipeline<ControlMode::SPEED_IN_A_PLANE, true, false>(_yaw_mode)
+                 : selectYawPipeline<ControlMode::SPEED_IN_A_PLANE, false, false>(_yaw_mode);
+    case ControlMode::TRAJECTORY:
+      return _proportional_limitation
+                 ? selectYawPipeline<ControlMode::TRAJECTORY, false, true>(_yaw_mode)
+                 : selectYawPipeline<ControlMode::TRAJECTORY, false, false>(_yaw_mode);
+    default:
+      return &Plugin::unknownControlModePipeline;
+  }
+}
+
+template <uint8_t _control_mode, bool _use_bypass, bool _proportional_limitation>
+Plugin::ComputePipeline Plugin::selectYawPipeline(uint8_t _yaw_mode) {
+  using as2_msgs::msg::ControlMode;
+
+  switch (_yaw_mode) {
+    case ControlMode::YAW_ANGLE:
+      return &Plugin::runPipeline<_control_mode, ControlMode::YAW_ANGLE, _use_bypass,
+                                  _proportional_limitation>;
+    case ControlMode::YAW_SPEED:
+      return &Plugin::runPipeline<_control_mode, ControlMode::YAW_SPEED, _use_bypass,
+                                  _proportional_limitation>;
+    default:
+      return &Plugin::unknownYawModePipeline;
+  }
+}
+
+template <typename PID>
+void Plugin::discretizeFilter(PID &_pid, double _alpha, double _dt) {
+  _pid.setAlpha(discreteFilterAlpha(_alpha, _dt, dt_conditioner_.nominalDt()));
+}
+
+template <uint8_t _control_mode, uint8_t _yaw_mode, bool _use_bypass,
+          bool _proportional_limitation>
+bool Plugin::computePipeline(double dt) {
+  using as2_msgs::msg::ControlMode;
+
+  // Loops that are not due keep their last command, the others see the dt since their last run
+  double translation_dt      = 0.0;
+  double yaw_dt              = 0.0;
+  const bool translation_due = translation_rate_.tick(
+      dt, translation_rate_divider_.load(std::memory_order_relaxed), translation_dt);
+  const bool yaw_due         = yaw_rate_.tick(
+      dt, yaw_rate_divider_.load(std::memory_order_relaxed), yaw_dt);
+  loops_run_ =
+      (translation_due ? TELEMETRY_TRANSLATION_LOOP : 0) | (yaw_due ? TELEMETRY_YAW_LOOP : 0);
+
+  // Filter weights follow the dt of the loop when exactly discretized
+  const bool discretize = exact_discretization_.load(std::memory_order_relaxed) &&
+                          dt_conditioning_enabled_.load(std::memory_order_relaxed);
+  const ControllerGains &gains = currentGains();
+
+  if (translation_due) {
+    if constexpr (_control_mode == ControlMode::POSITION) {
+      if (discretize) {
+        discretizeFilter(pid_3D_position_handler_, gains.position.alpha, translation_dt);
+      }
+      control_command_.velocity = pid_3D_position_handler_.computeControl(
+          translation_dt, uav_state_.position, control_ref_.position);
+
+      controller_output_.velocity = control_command_.velocity;
+      saturateCommand(control_command_.velocity, speed_limits_, _proportional_limitation);
+    } else if constexpr (_control_mode == ControlMode::SPEED) {
+      if constexpr (_use_bypass) {
         control_command_.velocity = control_ref_.velocity;
       } else {
-        control_command_.velocity = pid_3D_velocity_handler_->computeControl(
-            dt, uav_state_.velocity, control_ref_.velocity);
+        if (discretize) {
+          discretizeFilter(pid_3D_velocity_handler_, gains.speed.alpha, translation_dt);
+        }
+        control_command_.velocity = pid_3D_velocity_handler_.computeControl(
+            translation_dt, uav_state_.velocity, control_ref_.velocity);
       }
-      break;
-    }
-    case as2_msgs::msg::ControlMode::SPEED_IN_A_PLANE: {
-      if (use_bypass_) {
+    } else if constexpr (_control_mode == ControlMode::SPEED_IN_A_PLANE) {
+      if constexpr (_use_bypass) {
         control_command_.velocity = control_ref_.velocity;
       } else {
-        control_command_.velocity = pid_3D_speed_in_a_plane_handler_->computeControl(
-            dt, uav_state_.velocity, control_ref_.velocity);
+        if (discretize) {
+          discretizeFilter(pid_3D_speed_in_a_plane_handler_, gains.speed_in_a_plane_speed.alpha,
+                           translation_dt);
+        }
+        control_command_.velocity = pid_3D_speed_in_a_plane_handler_.computeControl(
+            translation_dt, uav_state_.velocity, control_ref_.velocity);
       }
 
-      control_command_.velocity.z() = pid_1D_speed_in_a_plane_handler_->computeControl(
-          dt, uav_state_.position.z(), control_ref_.position.z());
-
-      break;
-    }
-    case as2_msgs::msg::ControlMode::TRAJECTORY: {
+      if (discretize) {
+        discretizeFilter(pid_1D_speed_in_a_plane_handler_, gains.speed_in_a_plane_height.alpha,
+                         translation_dt);
+      }
+      control_command_.velocity.z() = pid_1D_speed_in_a_plane_handler_.computeControl(
+          translation_dt, uav_state_.position.z(), control_ref_.position.z());
+    } else {
+      static_assert(_control_mode == ControlMode::TRAJECTORY, "Unsupported control mode");
+      sampleTrajectoryReference();
+      if (discretize) {
+        discretizeFilter(pid_3D_trajectory_handler_, gains.trajectory.alpha, translation_dt);
+      }
       control_command_.velocity =
-          pid_3D_trajectory_handler_->computeControl(dt, uav_state_.position, control_ref_.position,
-                                                     uav_state_.velocity, control_ref_.velocity);
+          pid_3D_trajectory_handler_.computeControl(translation_dt, uav_state_.position,
+                                                    control_ref_.position, uav_state_.velocity,
+                                                    control_ref_.velocity) +
+          feedforward_.velocity;
 
-      control_command_.velocity = pid_3D_trajectory_handler_->saturateOutput(
-          control_command_.velocity, speed_limits_, proportional_limitation_);
-      break;
+      controller_output_.velocity = control_command_.velocity;
+      saturateCommand(control_command_.velocity, speed_limits_, _proportional_limitation);
     }
-    default:
-      auto &clk = *node_ptr_->get_clock();
-      RCLCPP_ERROR_THROTTLE(node_ptr_->get_logger(), clk, 5000, "Unknown control mode");
-      return false;
-      break;
   }
 
-  switch (control_mode_in_.yaw_mode) {
-    case as2_msgs::msg::ControlMode::YAW_ANGLE: {
+  if (yaw_due) {
+    if constexpr (_yaw_mode == ControlMode::YAW_ANGLE) {
       double yaw_error = as2::frame::angleMinError(control_ref_.yaw.x(), uav_state_.yaw.x());
-      control_command_.yaw_speed = pid_yaw_handler_->computeControl(dt, yaw_error);
-      break;
-    }
-    case as2_msgs::msg::ControlMode::YAW_SPEED: {
+      if (discretize) {
+        discretizeFilter(pid_yaw_handler_, gains.yaw.alpha, yaw_dt);
+      }
+      control_command_.yaw_speed = pid_yaw_handler_.computeControl(yaw_dt, yaw_error);
+      if constexpr (_control_mode == ControlMode::TRAJECTORY) {
+        control_command_.yaw_speed += feedforward_.yaw_speed;
+      }
+    } else {
+      static_assert(_yaw_mode == ControlMode::YAW_SPEED, "Unsupported yaw mode");
       control_command_.yaw_speed = control_ref_.yaw.y();
-      break;
     }
-    default:
-      auto &clk = *node_ptr_->get_clock();
-      RCLCPP_ERROR_THROTTLE(node_ptr_->get_logger(), clk, 5000, "Unknown yaw mode");
-      return false;
-      break;
   }
+  return true;
+}
+
+bool Plugin::unknownControlModePipeline(Plugin &_plugin, double /*_dt*/) {
+  _plugin.event_log_.report(LogEvent::UNKNOWN_CONTROL_MODE);
+  return false;
+}
 
-  return getOutput(twist);
+bool Plugin::unknownYawModePipeline(Plugin &_plugin, double /*_dt*/) {
+  _plugin.event_log_.report(LogEvent::UNKNOWN_YAW_MODE);
+  return false;
 }
 
 bool Plugin::getOutput(geometry_msgs::msg::TwistStamped &_twist_msg) {
-  _twist_msg.header.frame_id = output_twist_frame_id_;
+  updateOutputFrameId(_twist_msg.header, output_twist_frame_id_);
+  return getOutput(_twist_msg.twist);
+};
+
+void Plugin::updateOutputFrameId(std_msgs::msg::Header &_header, FrameId _frame_id) const {
+  // Only touch the frame id when it differs (i.e. after a mode change), so a reused output
+  // message is never reallocated on the control path
+  const std::string &output_frame_id = getFrameId(_frame_id);
+  if (_header.frame_id != output_frame_id) {
+    _header.frame_id = output_frame_id;
+  }
+}
+
+const UAV_command &Plugin::currentCommand() const {
+  // The blended output is only kept up to date while a hand-off is in progress
+  return handoff_weight_ > 0.0 ? handoff_output_ : control_command_;
+}
+
+bool Plugin::getOutput(geometry_msgs::msg::Twist &_twist_msg) const {
+  const UAV_command &command = currentCommand();
 
-  _twist_msg.twist.linear.x = control_command_.velocity.x();
-  _twist_msg.twist.linear.y = control_command_.velocity.y();
-  _twist_msg.twist.linear.z = control_command_.velocity.z();
+  _twist_msg.linear.x = command.velocity.x();
+  _twist_msg.linear.y = command.velocity.y();
+  _twist_msg.linear.z = command.velocity.z();
 
-  _twist_msg.twist.angular.x = 0;
-  _twist_msg.twist.angular.y = 0;
-  _twist_msg.twist.angular.z = control_command_.yaw_speed;
+  _twist_msg.angular.x = 0;
+  _twist_msg.angular.y = 0;
+  _twist_msg.angular.z = command.yaw_speed;
   return true;
 };
 
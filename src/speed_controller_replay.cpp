@@ -0,0 +1,376 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_replay.cpp
+ *  \brief      Offline replay of recorded control streams through the speed controller plugin.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "speed_controller_replay.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+
+namespace controller_plugin_speed_controller {
+namespace replay {
+
+namespace {
+
+std::runtime_error systemError(const std::string &_what, const std::string &_path) {
+  return std::runtime_error(_what + " " + _path + ": " + std::strerror(errno));
+}
+
+builtin_interfaces::msg::Time toStamp(double _time) {
+  builtin_interfaces::msg::Time stamp;
+  const double sec = std::floor(_time);
+  stamp.sec        = static_cast<int32_t>(sec);
+  stamp.nanosec    = static_cast<uint32_t>(std::min((_time - sec) * 1e9, 999999999.0));
+  return stamp;
+}
+
+void toPose(const TraceRecord &_record, geometry_msgs::msg::Pose &_pose) {
+  _pose.position.x    = _record.data[0];
+  _pose.position.y    = _record.data[1];
+  _pose.position.z    = _record.data[2];
+  _pose.orientation.x = _record.data[3];
+  _pose.orientation.y = _record.data[4];
+  _pose.orientation.z = _record.data[5];
+  _pose.orientation.w = _record.data[6];
+}
+
+void toTwist(const double *_data, geometry_msgs::msg::Twist &_twist) {
+  _twist.linear.x  = _data[0];
+  _twist.linear.y  = _data[1];
+  _twist.linear.z  = _data[2];
+  _twist.angular.z = _data[3];
+}
+
+as2_msgs::msg::ControlMode toMode(uint8_t _control_mode,
+                                  uint8_t _yaw_mode,
+                                  uint8_t _reference_frame) {
+  as2_msgs::msg::ControlMode mode;
+  mode.control_mode    = _control_mode;
+  mode.yaw_mode        = _yaw_mode;
+  mode.reference_frame = _reference_frame;
+  return mode;
+}
+
+}  // namespace
+
+Replayer::Replayer(const ReplayCase &_case) {
+  rclcpp::NodeOptions options;
+  options.use_global_arguments(false)
+      .start_parameter_services(false)
+      .start_parameter_event_publisher(false);
+  node_ = std::make_shared<as2::Node>("speed_controller_replay", options);
+  plugin_.initialize(node_.get());
+  // The state age and the unstamped references follow the trace, not the wall clock
+  plugin_.setClock([this]() { return time_; });
+  plugin_.parametersCallback(_case.parameters);
+
+  frame_ids_[static_cast<size_t>(TraceFrame::ENU)] = as2::tf::generateTfName(node_.get(), "odom");
+  frame_ids_[static_cast<size_t>(TraceFrame::FLU)] =
+      as2::tf::generateTfName(node_.get(), "base_link");
+}
+
+void Replayer::apply(const TraceRecord &_record, ReplayOutput &_output) {
+  time_ = _record.time;
+  switch (_record.type) {
+    case TraceRecordType::MODE: {
+      const auto mode_in =
+          toMode(static_cast<uint8_t>(_record.data[0]), static_cast<uint8_t>(_record.data[1]),
+                 static_cast<uint8_t>(_record.data[2]));
+      const auto mode_out = toMode(as2_msgs::msg::ControlMode::SPEED,
+                                   as2_msgs::msg::ControlMode::YAW_SPEED,
+                                   static_cast<uint8_t>(_record.data[3]));
+      if (!plugin_.setMode(mode_in, mode_out)) {
+        RCLCPP_WARN(node_->get_logger(), "Replay: mode at t = %f rejected", _record.time);
+      }
+      break;
+    }
+    case TraceRecordType::STATE:
+      pose_.header.stamp     = toStamp(_record.time);
+      pose_.header.frame_id  = frameId(TraceFrame::ENU);
+      twist_.header.stamp    = pose_.header.stamp;
+      twist_.header.frame_id = frameId(_record.frame);
+      toPose(_record, pose_.pose);
+      toTwist(&_record.data[7], twist_.twist);
+      plugin_.updateState(pose_, twist_);
+      break;
+    case TraceRecordType::POSE_REFERENCE:
+      pose_ref_.header.stamp    = toStamp(_record.time);
+      pose_ref_.header.frame_id = frameId(TraceFrame::ENU);
+      toPose(_record, pose_ref_.pose);
+      plugin_.updateReference(pose_ref_);
+      break;
+    case TraceRecordType::TWIST_REFERENCE:
+      twist_ref_.header.stamp    = toStamp(_record.time);
+      twist_ref_.header.frame_id = frameId(_record.frame);
+      toTwist(&_record.data[0], twist_ref_.twist);
+      plugin_.updateReference(twist_ref_);
+      break;
+    case TraceRecordType::TRAJECTORY_REFERENCE:
+      trajectory_ref_.header.stamp    = toStamp(_record.time);
+      trajectory_ref_.header.frame_id = frameId(TraceFrame::ENU);
+      trajectory_ref_.position.x      = _record.data[0];
+      trajectory_ref_.position.y      = _record.data[1];
+      trajectory_ref_.position.z      = _record.data[2];
+      trajectory_ref_.twist.x         = _record.data[3];
+      trajectory_ref_.twist.y         = _record.data[4];
+      trajectory_ref_.twist.z         = _record.data[5];
+      trajectory_ref_.acceleration.x  = _record.data[6];
+      trajectory_ref_.acceleration.y  = _record.data[7];
+      trajectory_ref_.acceleration.z  = _record.data[8];
+      trajectory_ref_.yaw_angle       = _record.data[9];
+      plugin_.updateReference(trajectory_ref_);
+      break;
+    case TraceRecordType::TICK: {
+      const bool valid = plugin_.computeOutput(_record.data[0], pose_cmd_, twist_cmd_, thrust_cmd_);
+      _output.time.push_back(_record.time);
+      _output.valid.push_back(valid ? 1 : 0);
+      _output.linear_x.push_back(valid ? twist_cmd_.twist.linear.x : 0.0);
+      _output.linear_y.push_back(valid ? twist_cmd_.twist.linear.y : 0.0);
+      _output.linear_z.push_back(valid ? twist_cmd_.twist.linear.z : 0.0);
+      _output.yaw_rate.push_back(valid ? twist_cmd_.twist.angular.z : 0.0);
+      break;
+    }
+    default:
+      RCLCPP_WARN(node_->get_logger(), "Replay: unknown record type %d at t = %f",
+                  static_cast<int>(_record.type), _record.time);
+      break;
+  }
+}
+
+const std::string &Replayer::frameId(TraceFrame _frame) const {
+  return frame_ids_[_frame == TraceFrame::FLU ? 1 : 0];
+}
+
+Trace::Trace(std::vector<TraceRecord> _records) : owned_(std::move(_records)) {
+  records_ = owned_.data();
+  size_    = owned_.size();
+}
+
+Trace::~Trace() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+Trace::Trace(Trace &&_other) noexcept { *this = std::move(_other); }
+
+Trace &Trace::operator=(Trace &&_other) noexcept {
+  if (this == &_other) {
+    return *this;
+  }
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+  const bool owned = _other.records_ == _other.owned_.data();
+  owned_           = std::move(_other.owned_);
+  records_         = owned ? owned_.data() : _other.records_;
+  size_            = _other.size_;
+  mapping_         = _other.mapping_;
+  mapping_size_    = _other.mapping_size_;
+
+  _other.records_      = nullptr;
+  _other.size_         = 0;
+  _other.mapping_      = nullptr;
+  _other.mapping_size_ = 0;
+  return *this;
+}
+
+Trace Trace::open(const std::string &_path) {
+  const int fd = ::open(_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw systemError("Could not open trace", _path);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    ::close(fd);
+    throw systemError("Could not stat trace", _path);
+  }
+  const size_t file_size = static_cast<size_t>(file_stat.st_size);
+  if (file_size < sizeof(TraceHeader)) {
+    ::close(fd);
+    throw std::runtime_error("Trace " + _path + " is too short");
+  }
+  void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    throw systemError("Could not map trace", _path);
+  }
+  madvise(mapping, file_size, MADV_SEQUENTIAL);
+
+  Trace trace;
+  trace.mapping_      = mapping;
+  trace.mapping_size_ = file_size;
+
+  TraceHeader header;
+  const TraceHeader expected;
+  std::memcpy(&header, mapping, sizeof(header));
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.version != expected.version || header.record_size != expected.record_size) {
+    throw std::runtime_error("Trace " + _path + " has an unsupported format");
+  }
+  if (header.record_count > (file_size - sizeof(TraceHeader)) / sizeof(TraceRecord)) {
+    throw std::runtime_error("Trace " + _path + " is truncated");
+  }
+  trace.records_ =
+      reinterpret_cast<const TraceRecord *>(static_cast<const char *>(mapping) + sizeof(header));
+  trace.size_ = header.record_count;
+  return trace;
+}
+
+void writeTrace(const std::string &_path, const std::vector<TraceRecord> &_records) {
+  std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw systemError("Could not create trace", _path);
+  }
+  TraceHeader header;
+  header.record_count = _records.size();
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(_records.data()),
+             static_cast<std::streamsize>(_records.size() * sizeof(TraceRecord)));
+  if (!file) {
+    throw systemError("Could not write trace", _path);
+  }
+}
+
+void ReplayOutput::writeCsv(const std::string &_path) const {
+  std::ofstream file(_path, std::ios::trunc);
+  if (!file) {
+    throw systemError("Could not create", _path);
+  }
+  file.precision(std::numeric_limits<double>::max_digits10);
+  file << "time,valid,linear_x,linear_y,linear_z,yaw_rate\n";
+  for (size_t i = 0; i < size(); i++) {
+    file << time[i] << ',' << static_cast<int>(valid[i]) << ',' << linear_x[i] << ','
+         << linear_y[i] << ',' << linear_z[i] << ',' << yaw_rate[i] << '\n';
+  }
+  if (!file) {
+    throw systemError("Could not write", _path);
+  }
+}
+
+ReplayOutput replay(const Trace &_trace, const ReplayCase &_case) {
+  ReplayOutput output;
+  output.name = _case.name;
+
+  const size_t ticks = std::count_if(_trace.begin(), _trace.end(), [](const TraceRecord &_r) {
+    return _r.type == TraceRecordType::TICK;
+  });
+  output.time.reserve(ticks);
+  output.valid.reserve(ticks);
+  output.linear_x.reserve(ticks);
+  output.linear_y.reserve(ticks);
+  output.linear_z.reserve(ticks);
+  output.yaw_rate.reserve(ticks);
+
+  Replayer replayer(_case);
+  for (const TraceRecord &record : _trace) {
+    replayer.apply(record, output);
+  }
+  return output;
+}
+
+void parallelFor(size_t _count, size_t _threads, const std::function<void(size_t)> &_task) {
+  std::vector<std::exception_ptr> errors(_count);
+  std::atomic<size_t> next_task{0};
+
+  auto worker = [&]() {
+    for (size_t i = next_task++; i < _count; i = next_task++) {
+      try {
+        _task(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  if (_threads == 0) {
+    _threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  _threads = std::min(_threads, _count);
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < _threads; i++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : workers) {
+    thread.join();
+  }
+
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+std::vector<ReplayOutput> replay(const Trace &_trace,
+                                 const std::vector<ReplayCase> &_cases,
+                                 size_t _threads) {
+  std::vector<ReplayOutput> outputs(_cases.size());
+  parallelFor(_cases.size(), _threads,
+              [&](size_t _index) { outputs[_index] = replay(_trace, _cases[_index]); });
+  return outputs;
+}
+
+std::vector<rclcpp::Parameter> schemaParameters(const rclcpp::Node &_node) {
+  std::vector<rclcpp::Parameter> parameters;
+  for (const auto &descriptor : parameters::kParameterSchema) {
+    const std::string name(descriptor.name);
+    if (_node.has_parameter(name)) {
+      parameters.push_back(_node.get_parameter(name));
+    }
+  }
+  return parameters;
+}
+
+}  // namespace replay
+}  // namespace controller_plugin_speed_controller
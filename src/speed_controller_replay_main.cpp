@@ -0,0 +1,167 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_replay_main.cpp
+ *  \brief      Command line tool replaying a trace with one or more sets of gains.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "speed_controller_replay.hpp"
+
+namespace replay = controller_plugin_speed_controller::replay;
+
+namespace {
+
+struct Sweep {
+  std::string name;
+  std::vector<rclcpp::Parameter> values;
+};
+
+void printUsage(const std::string &_program) {
+  std::cerr << "Usage: " << _program
+            << " <trace> <output_prefix> [--threads N] [--sweep name=v1,v2,...]..."
+               " --ros-args --params-file <gains.yaml>\n"
+               "Writes <output_prefix>_<case>.csv for every combination of the swept values\n";
+}
+
+rclcpp::Parameter parseValue(const rclcpp::Parameter &_base, const std::string &_value) {
+  if (_base.get_type() == rclcpp::ParameterType::PARAMETER_BOOL) {
+    return rclcpp::Parameter(_base.get_name(), _value == "true" || _value == "1");
+  }
+  if (_base.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER) {
+    return rclcpp::Parameter(_base.get_name(), static_cast<int64_t>(std::stoll(_value)));
+  }
+  return rclcpp::Parameter(_base.get_name(), std::stod(_value));
+}
+
+Sweep parseSweep(const std::string &_arg, const std::vector<rclcpp::Parameter> &_base) {
+  const size_t equal = _arg.find('=');
+  if (equal == std::string::npos) {
+    throw std::invalid_argument("Sweep " + _arg + " is not name=v1,v2,...");
+  }
+  Sweep sweep;
+  sweep.name = _arg.substr(0, equal);
+  auto base  = std::find_if(_base.begin(), _base.end(), [&](const rclcpp::Parameter &_p) {
+    return _p.get_name() == sweep.name;
+  });
+  if (base == _base.end()) {
+    throw std::invalid_argument("Sweep parameter " + sweep.name + " is not set in the params file");
+  }
+  std::stringstream values(_arg.substr(equal + 1));
+  std::string value;
+  while (std::getline(values, value, ',')) {
+    sweep.values.push_back(parseValue(*base, value));
+  }
+  return sweep;
+}
+
+// Cartesian product of the swept values, applied on top of the base parameters
+std::vector<replay::ReplayCase> makeCases(const std::vector<rclcpp::Parameter> &_base,
+                                          const std::vector<Sweep> &_sweeps) {
+  std::vector<replay::ReplayCase> cases = {{"", _base}};
+  for (const Sweep &sweep : _sweeps) {
+    std::vector<replay::ReplayCase> swept;
+    for (const auto &replay_case : cases) {
+      for (const auto &value : sweep.values) {
+        replay::ReplayCase new_case = replay_case;
+        std::stringstream name;
+        name << replay_case.name << (replay_case.name.empty() ? "" : ",") << sweep.name << "=";
+        if (value.get_type() == rclcpp::ParameterType::PARAMETER_BOOL) {
+          name << (value.as_bool() ? "true" : "false");
+        } else if (value.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER) {
+          name << value.as_int();
+        } else {
+          name << value.as_double();
+        }
+        new_case.name = name.str();
+        new_case.parameters.push_back(value);
+        swept.push_back(new_case);
+      }
+    }
+    cases = std::move(swept);
+  }
+  return cases;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  rclcpp::init(argc, argv);
+  const std::vector<std::string> args = rclcpp::remove_ros_arguments(argc, argv);
+  if (args.size() < 3) {
+    printUsage(args.empty() ? "speed_controller_replay" : args[0]);
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  int result = 0;
+  try {
+    // Gains come from --ros-args --params-file, as for the controller manager
+    auto config_node = std::make_shared<rclcpp::Node>(
+        "speed_controller_replay",
+        rclcpp::NodeOptions().automatically_declare_parameters_from_overrides(true));
+    const std::vector<rclcpp::Parameter> base = replay::schemaParameters(*config_node);
+
+    size_t threads = 0;
+    std::vector<Sweep> sweeps;
+    for (size_t i = 3; i < args.size(); i++) {
+      if (args[i] == "--threads" && i + 1 < args.size()) {
+        threads = std::stoul(args[++i]);
+      } else if (args[i] == "--sweep" && i + 1 < args.size()) {
+        sweeps.push_back(parseSweep(args[++i], base));
+      } else {
+        throw std::invalid_argument("Unknown argument " + args[i]);
+      }
+    }
+
+    const replay::Trace trace = replay::Trace::open(args[1]);
+    const auto cases          = makeCases(base, sweeps);
+    const auto outputs        = replay::replay(trace, cases, threads);
+    for (size_t i = 0; i < outputs.size(); i++) {
+      const std::string path = args[2] + "_" + std::to_string(i) + ".csv";
+      outputs[i].writeCsv(path);
+      std::cout << path << ": " << (cases[i].name.empty() ? "base" : cases[i].name) << "\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    result = 1;
+  }
+
+  rclcpp::shutdown();
+  return result;
+}
@@ -0,0 +1,265 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_telemetry.cpp
+ *  \brief      Telemetry recorder: ring buffer and memory-mapped file writer.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "speed_controller_telemetry.hpp"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace controller_plugin_speed_controller {
+
+namespace {
+
+constexpr size_t kMinFileSize = size_t{1} << 20;  // [bytes], the file grows by doubling
+
+constexpr TelemetryField makeField(std::string_view _name,
+                                   size_t _offset,
+                                   TelemetryFieldType _type) {
+  TelemetryField field{};
+  for (size_t i = 0; i < _name.size() && i + 1 < TelemetryField::kNameSize; i++) {
+    field.name[i] = _name[i];
+  }
+  field.offset = static_cast<uint32_t>(_offset);
+  field.type   = _type;
+  return field;
+}
+
+constexpr TelemetryField doubleField(std::string_view _name, size_t _offset) {
+  return makeField(_name, _offset, TelemetryFieldType::DOUBLE);
+}
+
+constexpr TelemetryField byteField(std::string_view _name, size_t _offset) {
+  return makeField(_name, _offset, TelemetryFieldType::UINT8);
+}
+
+}  // namespace
+
+using R = TelemetryRecord;
+
+const std::array<TelemetryField, 43> kTelemetrySchema = {{
+    makeField("tick", offsetof(R, tick), TelemetryFieldType::UINT64),
+    doubleField("time", offsetof(R, time)),
+    doubleField("dt", offsetof(R, dt)),
+    byteField("control_mode", offsetof(R, control_mode)),
+    byteField("yaw_mode", offsetof(R, yaw_mode)),
+    byteField("flags", offsetof(R, flags)),
+    byteField("saturated", offsetof(R, saturated)),
+    doubleField("reference.position.x", offsetof(R, reference_position[0])),
+    doubleField("reference.position.y", offsetof(R, reference_position[1])),
+    doubleField("reference.position.z", offsetof(R, reference_position[2])),
+    doubleField("reference.velocity.x", offsetof(R, reference_velocity[0])),
+    doubleField("reference.velocity.y", offsetof(R, reference_velocity[1])),
+    doubleField("reference.velocity.z", offsetof(R, reference_velocity[2])),
+    doubleField("reference.yaw", offsetof(R, reference_yaw)),
+    doubleField("reference.yaw_rate", offsetof(R, reference_yaw_rate)),
+    doubleField("state.position.x", offsetof(R, state_position[0])),
+    doubleField("state.position.y", offsetof(R, state_position[1])),
+    doubleField("state.position.z", offsetof(R, state_position[2])),
+    doubleField("state.velocity.x", offsetof(R, state_velocity[0])),
+    doubleField("state.velocity.y", offsetof(R, state_velocity[1])),
+    doubleField("state.velocity.z", offsetof(R, state_velocity[2])),
+    doubleField("state.yaw", offsetof(R, state_yaw)),
+    doubleField("state.yaw_rate", offsetof(R, state_yaw_rate)),
+    doubleField("error.x", offsetof(R, error[0])),
+    doubleField("error.y", offsetof(R, error[1])),
+    doubleField("error.z", offsetof(R, error[2])),
+    doubleField("error.yaw", offsetof(R, error[3])),
+    doubleField("proportional.x", offsetof(R, proportional[0])),
+    doubleField("proportional.y", offsetof(R, proportional[1])),
+    doubleField("proportional.z", offsetof(R, proportional[2])),
+    doubleField("proportional.yaw", offsetof(R, proportional[3])),
+    doubleField("integral_derivative.x", offsetof(R, integral_derivative[0])),
+    doubleField("integral_derivative.y", offsetof(R, integral_derivative[1])),
+    doubleField("integral_derivative.z", offsetof(R, integral_derivative[2])),
+    doubleField("integral_derivative.yaw", offsetof(R, integral_derivative[3])),
+    doubleField("controller_output.x", offsetof(R, controller_output[0])),
+    doubleField("controller_output.y", offsetof(R, controller_output[1])),
+    doubleField("controller_output.z", offsetof(R, controller_output[2])),
+    doubleField("controller_output.yaw", offsetof(R, controller_output[3])),
+    doubleField("command.x", offsetof(R, command[0])),
+    doubleField("command.y", offsetof(R, command[1])),
+    doubleField("command.z", offsetof(R, command[2])),
+    doubleField("command.yaw", offsetof(R, command[3])),
+}};
+
+TelemetryRecorder::TelemetryRecorder() : ring_(std::make_unique<Ring>()) {}
+
+TelemetryRecorder::~TelemetryRecorder() { stop(); }
+
+bool TelemetryRecorder::start(const std::string &_path, std::chrono::milliseconds _period) {
+  stop();
+  fd_ = ::open(_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  path_ = _path;
+  written_.store(0, std::memory_order_relaxed);
+  if (!reserve(kCapacity)) {
+    closeFile();
+    return false;
+  }
+
+  TelemetryFileHeader header;
+  header.field_count = static_cast<uint32_t>(kTelemetrySchema.size());
+  std::memcpy(map_, &header, sizeof(header));
+  std::memcpy(map_ + sizeof(header), kTelemetrySchema.data(), sizeof(kTelemetrySchema));
+
+  // Left from a previous file
+  TelemetryRecord discarded;
+  while (ring_->pop(discarded)) {
+  }
+
+  stop_requested_ = false;
+  active_.store(true, std::memory_order_relaxed);
+  thread_ = std::thread([this, _period]() { run(_period); });
+  return true;
+}
+
+void TelemetryRecorder::stop() {
+  active_.store(false, std::memory_order_relaxed);
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      stop_requested_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+  flush();
+  closeFile();
+}
+
+bool TelemetryRecorder::record(TelemetryRecord &_record) {
+  if (!active()) {
+    return false;
+  }
+  _record.tick = tick_++;
+  if (!ring_->push(_record)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+size_t TelemetryRecorder::flush() {
+  const size_t pending = ring_->size();
+  if (pending == 0 || fd_ < 0) {
+    return 0;
+  }
+
+  // Records that can not be written are dropped, so the ring never stalls the control loop
+  const bool writable = reserve(pending);
+  uint64_t written    = written_.load(std::memory_order_relaxed);
+  TelemetryRecord record;
+  for (size_t i = 0; i < pending && ring_->pop(record); i++) {
+    if (!writable) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    std::memcpy(map_ + TelemetryFileHeader::kSize + written * sizeof(TelemetryRecord), &record,
+                sizeof(record));
+    written++;
+  }
+  std::memcpy(map_ + offsetof(TelemetryFileHeader, record_count), &written, sizeof(written));
+  const uint64_t flushed = written - written_.load(std::memory_order_relaxed);
+  written_.store(written, std::memory_order_relaxed);
+  return flushed;
+}
+
+bool TelemetryRecorder::reserve(size_t _records) {
+  const size_t needed =
+      TelemetryFileHeader::kSize + (written() + _records) * sizeof(TelemetryRecord);
+  if (needed <= map_size_) {
+    return true;
+  }
+  size_t size = std::max(kMinFileSize, map_size_);
+  while (size < needed) {
+    size *= 2;
+  }
+  if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+    return false;
+  }
+  void *map = map_ == nullptr ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0)
+                              : ::mremap(map_, map_size_, size, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  map_      = static_cast<uint8_t *>(map);
+  map_size_ = size;
+  return true;
+}
+
+void TelemetryRecorder::closeFile() {
+  if (map_ != nullptr) {
+    ::munmap(map_, map_size_);
+    map_      = nullptr;
+    map_size_ = 0;
+  }
+  if (fd_ >= 0) {
+    // Trim the preallocated tail
+    const size_t size = TelemetryFileHeader::kSize + written() * sizeof(TelemetryRecord);
+    if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+      // The file keeps its zeroed tail, beyond record_count
+    }
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void TelemetryRecorder::run(std::chrono::milliseconds _period) {
+#ifdef SCHED_IDLE
+  // File writes only get the CPU time nothing else wants
+  sched_param param{};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  while (!stop_requested_) {
+    wake_.wait_for(lock, _period, [this]() { return stop_requested_; });
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+}  // namespace controller_plugin_speed_controller
@@ -0,0 +1,224 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_telemetry_reader.cpp
+ *  \brief      Offline reader of the telemetry files, with CSV export.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "speed_controller_telemetry_reader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace controller_plugin_speed_controller {
+
+namespace {
+
+std::runtime_error systemError(const std::string &_what, const std::string &_path) {
+  return std::runtime_error(_what + " " + _path + ": " + std::strerror(errno));
+}
+
+size_t fieldSize(TelemetryFieldType _type) {
+  switch (_type) {
+    case TelemetryFieldType::UINT8:
+      return sizeof(uint8_t);
+    case TelemetryFieldType::UINT64:
+      return sizeof(uint64_t);
+    case TelemetryFieldType::DOUBLE:
+      return sizeof(double);
+  }
+  return 0;
+}
+
+}  // namespace
+
+TelemetryReader::~TelemetryReader() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+TelemetryReader::TelemetryReader(TelemetryReader &&_other) noexcept { *this = std::move(_other); }
+
+TelemetryReader &TelemetryReader::operator=(TelemetryReader &&_other) noexcept {
+  if (this == &_other) {
+    return *this;
+  }
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+  fields_       = std::move(_other.fields_);
+  records_      = _other.records_;
+  record_size_  = _other.record_size_;
+  size_         = _other.size_;
+  mapping_      = _other.mapping_;
+  mapping_size_ = _other.mapping_size_;
+
+  _other.records_      = nullptr;
+  _other.size_         = 0;
+  _other.mapping_      = nullptr;
+  _other.mapping_size_ = 0;
+  return *this;
+}
+
+TelemetryReader TelemetryReader::open(const std::string &_path) {
+  const int fd = ::open(_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw systemError("Could not open telemetry", _path);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    ::close(fd);
+    throw systemError("Could not stat telemetry", _path);
+  }
+  const size_t file_size = static_cast<size_t>(file_stat.st_size);
+  if (file_size < TelemetryFileHeader::kSize) {
+    ::close(fd);
+    throw std::runtime_error("Telemetry " + _path + " is too short");
+  }
+  void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    throw systemError("Could not map telemetry", _path);
+  }
+  madvise(mapping, file_size, MADV_SEQUENTIAL);
+
+  TelemetryReader reader;
+  reader.mapping_      = mapping;
+  reader.mapping_size_ = file_size;
+
+  TelemetryFileHeader header;
+  const TelemetryFileHeader expected;
+  std::memcpy(&header, mapping, sizeof(header));
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.version != expected.version || header.header_size < sizeof(header) ||
+      header.header_size > file_size || header.record_size == 0 ||
+      sizeof(header) + header.field_count * sizeof(TelemetryField) > header.header_size) {
+    throw std::runtime_error(_path + " is not a telemetry file of version " +
+                             std::to_string(expected.version));
+  }
+
+  const uint8_t *bytes = static_cast<const uint8_t *>(mapping);
+  reader.fields_.resize(header.field_count);
+  std::memcpy(reader.fields_.data(), bytes + sizeof(header),
+              header.field_count * sizeof(TelemetryField));
+  for (auto &field : reader.fields_) {
+    field.name[TelemetryField::kNameSize - 1] = '\0';
+    if (field.offset + fieldSize(field.type) > header.record_size) {
+      throw std::runtime_error("Telemetry " + _path + " has a field out of its records");
+    }
+  }
+
+  reader.records_     = bytes + header.header_size;
+  reader.record_size_ = header.record_size;
+  reader.size_        = std::min<size_t>(header.record_count,
+                                         (file_size - header.header_size) / header.record_size);
+  return reader;
+}
+
+int TelemetryReader::findField(std::string_view _name) const {
+  for (size_t i = 0; i < fields_.size(); i++) {
+    if (_name == fields_[i].name) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+double TelemetryReader::value(size_t _record, size_t _field) const {
+  const TelemetryField &field = fields_[_field];
+  const uint8_t *data         = records_ + _record * record_size_ + field.offset;
+  switch (field.type) {
+    case TelemetryFieldType::UINT8:
+      return *data;
+    case TelemetryFieldType::UINT64: {
+      uint64_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return static_cast<double>(value);
+    }
+    case TelemetryFieldType::DOUBLE: {
+      double value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+  }
+  return 0.0;
+}
+
+void TelemetryReader::writeCsv(std::ostream &_stream) const {
+  _stream.precision(std::numeric_limits<double>::max_digits10);
+  for (size_t i = 0; i < fields_.size(); i++) {
+    _stream << (i == 0 ? "" : ",") << fields_[i].name;
+  }
+  _stream << '\n';
+
+  for (size_t record = 0; record < size_; record++) {
+    const uint8_t *data = records_ + record * record_size_;
+    for (size_t i = 0; i < fields_.size(); i++) {
+      if (i != 0) {
+        _stream << ',';
+      }
+      const TelemetryField &field = fields_[i];
+      if (field.type == TelemetryFieldType::UINT8) {
+        _stream << static_cast<int>(data[field.offset]);
+      } else if (field.type == TelemetryFieldType::UINT64) {
+        uint64_t value;
+        std::memcpy(&value, data + field.offset, sizeof(value));
+        _stream << value;
+      } else {
+        _stream << value(record, i);
+      }
+    }
+    _stream << '\n';
+  }
+}
+
+void TelemetryReader::writeCsv(const std::string &_path) const {
+  std::ofstream file(_path, std::ios::trunc);
+  if (!file) {
+    throw systemError("Could not create", _path);
+  }
+  writeCsv(file);
+  if (!file) {
+    throw systemError("Could not write", _path);
+  }
+}
+
+}  // namespace controller_plugin_speed_controller
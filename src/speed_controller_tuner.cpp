@@ -0,0 +1,407 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_tuner.cpp
+ *  \brief      Closed-loop evaluation and random search of the speed controller gains.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "speed_controller_tuner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace controller_plugin_speed_controller {
+namespace tuning {
+
+using as2_msgs::msg::ControlMode;
+using replay::TraceFrame;
+using replay::TraceRecord;
+using replay::TraceRecordType;
+
+namespace {
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+
+double wrapAngle(double _angle) {
+  return _angle - 2.0 * M_PI * std::floor((_angle + M_PI) / (2.0 * M_PI));
+}
+
+double yawFromQuaternion(const double *_q) {
+  return std::atan2(2.0 * (_q[3] * _q[2] + _q[0] * _q[1]),
+                    1.0 - 2.0 * (_q[1] * _q[1] + _q[2] * _q[2]));
+}
+
+Eigen::Vector3d fluToEnu(const Eigen::Vector3d &_flu, double _yaw) {
+  const double c = std::cos(_yaw);
+  const double s = std::sin(_yaw);
+  return Eigen::Vector3d(c * _flu.x() - s * _flu.y(), s * _flu.x() + c * _flu.y(), _flu.z());
+}
+
+// What the controller is asked to follow, as seen in the trace
+struct Reference {
+  uint8_t control_mode = ControlMode::UNSET;
+  uint8_t yaw_mode     = ControlMode::NONE;
+  bool flu_output      = false;
+
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  double yaw               = 0.0;
+  double yaw_rate          = 0.0;
+  TrajectoryBuffer trajectory;
+};
+
+TraceRecord stateRecord(double _time, const PlantState &_state) {
+  TraceRecord record;
+  record.type     = TraceRecordType::STATE;
+  record.time     = _time;
+  record.frame    = TraceFrame::ENU;
+  record.data[0]  = _state.position.x();
+  record.data[1]  = _state.position.y();
+  record.data[2]  = _state.position.z();
+  record.data[5]  = std::sin(0.5 * _state.yaw);
+  record.data[6]  = std::cos(0.5 * _state.yaw);
+  record.data[7]  = _state.velocity.x();
+  record.data[8]  = _state.velocity.y();
+  record.data[9]  = _state.velocity.z();
+  record.data[10] = _state.yaw_rate;
+  return record;
+}
+
+// Squared tracking error of the translational and yaw references, negative if not applicable
+double trackingError(double _time, const PlantState &_state, Reference &_reference,
+                     const PlantModel &_plant, bool &_diverged) {
+  double error = 0.0;
+  switch (_reference.control_mode) {
+    case ControlMode::POSITION:
+      error = (_state.position - _reference.position).squaredNorm();
+      break;
+    case ControlMode::TRAJECTORY: {
+      TrajectorySample sample;
+      _reference.trajectory.release(_time);
+      if (!_reference.trajectory.sample(_time, sample)) {
+        return -1.0;
+      }
+      error = (_state.position - sample.position).squaredNorm();
+      if (_reference.yaw_mode == ControlMode::YAW_ANGLE) {
+        _reference.yaw = sample.yaw;
+      }
+      break;
+    }
+    case ControlMode::SPEED:
+      error = (_state.velocity - _reference.velocity).squaredNorm();
+      break;
+    case ControlMode::SPEED_IN_A_PLANE:
+      error = (_state.velocity - _reference.velocity).head<2>().squaredNorm() +
+              std::pow(_state.position.z() - _reference.position.z(), 2);
+      break;
+    default:
+      return -1.0;
+  }
+  _diverged = !std::isfinite(error) || error > _plant.divergence_error * _plant.divergence_error;
+
+  if (_reference.yaw_mode == ControlMode::YAW_ANGLE) {
+    error += _plant.yaw_weight * std::pow(wrapAngle(_state.yaw - _reference.yaw), 2);
+  } else if (_reference.yaw_mode == ControlMode::YAW_SPEED) {
+    error += _plant.yaw_weight * std::pow(_state.yaw_rate - _reference.yaw_rate, 2);
+  }
+  return error;
+}
+
+// Steps the plant with the last command of _command
+void stepCommand(const replay::ReplayOutput &_command, double _dt, bool _flu_output,
+                 const PlantModel &_plant, PlantState &_state) {
+  Eigen::Vector3d velocity(_command.linear_x.back(), _command.linear_y.back(),
+                           _command.linear_z.back());
+  if (_flu_output) {
+    velocity = fluToEnu(velocity, _state.yaw);
+  }
+  stepPlant(_plant, velocity, _command.yaw_rate.back(), _dt, _state);
+}
+
+std::string formatValue(const rclcpp::Parameter &_parameter) {
+  switch (_parameter.get_type()) {
+    case rclcpp::ParameterType::PARAMETER_BOOL:
+      return _parameter.as_bool() ? "true" : "false";
+    case rclcpp::ParameterType::PARAMETER_INTEGER:
+      return std::to_string(_parameter.as_int());
+    case rclcpp::ParameterType::PARAMETER_DOUBLE: {
+      // Shortest representation that reads back to the same double, always with a decimal
+      // point so that it is not loaded as an integer parameter
+      const double value = _parameter.as_double();
+      std::ostringstream stream;
+      for (int precision = 1; precision <= std::numeric_limits<double>::max_digits10;
+           precision++) {
+        stream.str("");
+        stream.precision(precision);
+        stream << value;
+        if (std::stod(stream.str()) == value) {
+          break;
+        }
+      }
+      std::string text = stream.str();
+      if (text.find_first_of(".en") == std::string::npos) {
+        text += ".0";
+      }
+      return text;
+    }
+    case rclcpp::ParameterType::PARAMETER_STRING:
+      return "\"" + _parameter.as_string() + "\"";
+    default:
+      throw std::runtime_error("Parameter " + _parameter.get_name() +
+                               " has a type that can not be written");
+  }
+}
+
+// Parameter names split on their dots, children kept in insertion order
+struct YamlNode {
+  std::string key;
+  std::string value;
+  std::vector<YamlNode> children;
+
+  YamlNode &child(const std::string &_key) {
+    for (auto &node : children) {
+      if (node.key == _key) {
+        return node;
+      }
+    }
+    children.push_back({_key, "", {}});
+    return children.back();
+  }
+
+  void write(std::ostream &_stream, size_t _indent) const {
+    for (const auto &node : children) {
+      _stream << std::string(_indent, ' ') << node.key << ":";
+      if (node.children.empty()) {
+        _stream << " " << node.value << "\n";
+      } else {
+        _stream << "\n";
+        node.write(_stream, _indent + 2);
+      }
+    }
+  }
+};
+
+}  // namespace
+
+void stepPlant(const PlantModel &_plant,
+               const Eigen::Vector3d &_velocity,
+               double _yaw_rate,
+               double _dt,
+               PlantState &_state) {
+  // Implicit Euler
+  _state.velocity += (_velocity - _state.velocity) * (_dt / (_plant.velocity_time_constant + _dt));
+  _state.yaw_rate += (_yaw_rate - _state.yaw_rate) * (_dt / (_plant.yaw_rate_time_constant + _dt));
+  _state.position += _state.velocity * _dt;
+  _state.yaw = wrapAngle(_state.yaw + _state.yaw_rate * _dt);
+}
+
+double evaluate(const replay::Trace &_trace,
+                const replay::ReplayCase &_case,
+                const PlantModel &_plant) {
+  replay::Replayer replayer(_case);
+  replay::ReplayOutput command;
+  replay::ReplayOutput unused;
+
+  PlantState state;
+  bool seeded = false;
+  Reference reference;
+
+  double error_sum   = 0.0;
+  size_t error_count = 0;
+  for (const TraceRecord &record : _trace) {
+    switch (record.type) {
+      case TraceRecordType::STATE:
+        // Later states are replaced by the plant
+        if (!seeded) {
+          state.position = Eigen::Vector3d(record.data[0], record.data[1], record.data[2]);
+          state.yaw      = yawFromQuaternion(&record.data[3]);
+          state.velocity = Eigen::Vector3d(record.data[7], record.data[8], record.data[9]);
+          if (record.frame == TraceFrame::FLU) {
+            state.velocity = fluToEnu(state.velocity, state.yaw);
+          }
+          state.yaw_rate = record.data[10];
+          seeded         = true;
+        }
+        break;
+      case TraceRecordType::MODE:
+        reference.control_mode = static_cast<uint8_t>(record.data[0]);
+        reference.yaw_mode     = static_cast<uint8_t>(record.data[1]);
+        reference.flu_output =
+            static_cast<uint8_t>(record.data[3]) == ControlMode::BODY_FLU_FRAME;
+        reference.trajectory.clear();
+        // HOVER holds the position the plant is at when the mode is set
+        if (reference.control_mode == ControlMode::HOVER) {
+          reference.control_mode = ControlMode::POSITION;
+          reference.position     = state.position;
+          reference.yaw          = state.yaw;
+        }
+        replayer.apply(record, unused);
+        break;
+      case TraceRecordType::POSE_REFERENCE:
+        reference.position = Eigen::Vector3d(record.data[0], record.data[1], record.data[2]);
+        reference.yaw      = yawFromQuaternion(&record.data[3]);
+        replayer.apply(record, unused);
+        break;
+      case TraceRecordType::TWIST_REFERENCE:
+        reference.velocity = Eigen::Vector3d(record.data[0], record.data[1], record.data[2]);
+        if (record.frame == TraceFrame::FLU) {
+          reference.velocity = fluToEnu(reference.velocity, state.yaw);
+        }
+        reference.yaw_rate = record.data[3];
+        replayer.apply(record, unused);
+        break;
+      case TraceRecordType::TRAJECTORY_REFERENCE: {
+        TrajectorySample sample;
+        sample.time         = record.time;
+        sample.position     = Eigen::Vector3d(record.data[0], record.data[1], record.data[2]);
+        sample.velocity     = Eigen::Vector3d(record.data[3], record.data[4], record.data[5]);
+        sample.acceleration = Eigen::Vector3d(record.data[6], record.data[7], record.data[8]);
+        sample.yaw          = record.data[9];
+        reference.trajectory.push(sample);
+        replayer.apply(record, unused);
+        break;
+      }
+      case TraceRecordType::TICK: {
+        replayer.apply(stateRecord(record.time, state), unused);
+        // Only the command of this tick steps the plant
+        command.clear();
+        replayer.apply(record, command);
+        if (!command.valid.back()) {
+          break;
+        }
+        bool diverged      = false;
+        const double error = trackingError(record.time, state, reference, _plant, diverged);
+        if (diverged) {
+          return kInfinity;
+        }
+        if (error >= 0.0) {
+          error_sum += error;
+          error_count++;
+        }
+        stepCommand(command, record.data[0], reference.flu_output, _plant, state);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return error_count > 0 ? error_sum / error_count : kInfinity;
+}
+
+std::vector<TuningResult> tune(const replay::Trace &_trace, const TuningConfig &_config) {
+  // Candidates are drawn up front so that the results only depend on the seed
+  std::vector<TuningResult> results(std::max<size_t>(_config.candidates, 1));
+  std::mt19937_64 generator(_config.seed);
+  for (size_t i = 0; i < results.size(); i++) {
+    for (const GainRange &range : _config.ranges) {
+      double value;
+      if (range.logarithmic) {
+        std::uniform_real_distribution<double> distribution(std::log(range.min),
+                                                            std::log(range.max));
+        value = std::exp(distribution(generator));
+      } else {
+        std::uniform_real_distribution<double> distribution(range.min, range.max);
+        value = distribution(generator);
+      }
+      for (const std::string &name : range.names) {
+        results[i].gains.emplace_back(name, value);
+      }
+    }
+  }
+  // The first candidate keeps the base values, where there are any
+  for (rclcpp::Parameter &gain : results.front().gains) {
+    auto base = std::find_if(_config.base.begin(), _config.base.end(), [&](const auto &_p) {
+      return _p.get_name() == gain.get_name();
+    });
+    if (base != _config.base.end()) {
+      gain = *base;
+    }
+  }
+
+  replay::parallelFor(results.size(), _config.threads, [&](size_t _index) {
+    const replay::ReplayCase candidate{"", mergeParameters(_config.base, results[_index].gains)};
+    results[_index].cost = evaluate(_trace, candidate, _config.plant);
+  });
+
+  std::stable_sort(results.begin(), results.end(), [](const auto &_a, const auto &_b) {
+    return _a.cost < _b.cost;
+  });
+  return results;
+}
+
+std::vector<rclcpp::Parameter> mergeParameters(const std::vector<rclcpp::Parameter> &_base,
+                                               const std::vector<rclcpp::Parameter> &_overrides) {
+  std::vector<rclcpp::Parameter> merged = _base;
+  for (const auto &parameter : _overrides) {
+    auto it = std::find_if(merged.begin(), merged.end(), [&](const rclcpp::Parameter &_p) {
+      return _p.get_name() == parameter.get_name();
+    });
+    if (it != merged.end()) {
+      *it = parameter;
+    } else {
+      merged.push_back(parameter);
+    }
+  }
+  return merged;
+}
+
+void writeParametersYaml(const std::string &_path,
+                         const std::vector<rclcpp::Parameter> &_parameters) {
+  YamlNode root;
+  for (const auto &parameter : _parameters) {
+    YamlNode *node = &root;
+    std::stringstream name(parameter.get_name());
+    std::string key;
+    while (std::getline(name, key, '.')) {
+      node = &node->child(key);
+    }
+    node->value = formatValue(parameter);
+  }
+
+  std::ofstream file(_path, std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Could not create " + _path);
+  }
+  file << "/**:\n  ros__parameters:\n";
+  root.write(file, 4);
+  if (!file) {
+    throw std::runtime_error("Could not write " + _path);
+  }
+}
+
+}  // namespace tuning
+}  // namespace controller_plugin_speed_controller
@@ -0,0 +1,143 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_tuner_main.cpp
+ *  \brief      Command line tool ranking random gain sets on a trace and writing the best one.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "speed_controller_tuner.hpp"
+
+namespace replay = controller_plugin_speed_controller::replay;
+namespace tuning = controller_plugin_speed_controller::tuning;
+
+namespace {
+
+void printUsage(const std::string &_program) {
+  std::cerr << "Usage: " << _program
+            << " <trace> <output.yaml> --range name[,name...]=min:max[:log]..."
+               " [--candidates N] [--seed S] [--threads N] [--time-constant T]"
+               " --ros-args --params-file <base.yaml>\n"
+               "Evaluates random gain sets in closed loop with a point mass plant and writes the"
+               " best one merged into the base parameters\n";
+}
+
+tuning::GainRange parseRange(const std::string &_arg) {
+  const size_t equal = _arg.find('=');
+  if (equal == std::string::npos) {
+    throw std::invalid_argument("Range " + _arg + " is not name[,name...]=min:max[:log]");
+  }
+  tuning::GainRange range;
+  std::stringstream names(_arg.substr(0, equal));
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    range.names.push_back(name);
+  }
+
+  std::stringstream bounds(_arg.substr(equal + 1));
+  std::string min, max, scale;
+  if (!std::getline(bounds, min, ':') || !std::getline(bounds, max, ':')) {
+    throw std::invalid_argument("Range " + _arg + " is not name[,name...]=min:max[:log]");
+  }
+  range.min         = std::stod(min);
+  range.max         = std::stod(max);
+  range.logarithmic = std::getline(bounds, scale) && scale == "log";
+  if (range.min > range.max || (range.logarithmic && range.min <= 0.0)) {
+    throw std::invalid_argument("Range " + _arg + " has invalid bounds");
+  }
+  return range;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  rclcpp::init(argc, argv);
+  const std::vector<std::string> args = rclcpp::remove_ros_arguments(argc, argv);
+  if (args.size() < 3) {
+    printUsage(args.empty() ? "speed_controller_tuner" : args[0]);
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  int result = 0;
+  try {
+    auto config_node = std::make_shared<rclcpp::Node>(
+        "speed_controller_tuner",
+        rclcpp::NodeOptions().automatically_declare_parameters_from_overrides(true));
+
+    tuning::TuningConfig config;
+    config.base = replay::schemaParameters(*config_node);
+    for (size_t i = 3; i < args.size(); i++) {
+      const bool has_value = i + 1 < args.size();
+      if (args[i] == "--range" && has_value) {
+        config.ranges.push_back(parseRange(args[++i]));
+      } else if (args[i] == "--candidates" && has_value) {
+        config.candidates = std::stoul(args[++i]);
+      } else if (args[i] == "--seed" && has_value) {
+        config.seed = std::stoull(args[++i]);
+      } else if (args[i] == "--threads" && has_value) {
+        config.threads = std::stoul(args[++i]);
+      } else if (args[i] == "--time-constant" && has_value) {
+        config.plant.velocity_time_constant = std::stod(args[++i]);
+      } else {
+        throw std::invalid_argument("Unknown argument " + args[i]);
+      }
+    }
+    if (config.ranges.empty()) {
+      throw std::invalid_argument("No --range given");
+    }
+
+    const replay::Trace trace = replay::Trace::open(args[1]);
+    const auto results        = tuning::tune(trace, config);
+    for (size_t i = 0; i < std::min<size_t>(results.size(), 5); i++) {
+      std::cout << "#" << i << " cost " << results[i].cost << ":";
+      for (const auto &gain : results[i].gains) {
+        std::cout << " " << gain.get_name() << "=" << gain.as_double();
+      }
+      std::cout << "\n";
+    }
+    tuning::writeParametersYaml(args[2], tuning::mergeParameters(config.base, results[0].gains));
+    std::cout << "Best gains written to " << args[2] << "\n";
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    result = 1;
+  }
+
+  rclcpp::shutdown();
+  return result;
+}
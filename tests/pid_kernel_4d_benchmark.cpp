@@ -0,0 +1,132 @@
+/*!*******************************************************************************************
+ *  \file       pid_kernel_4d_benchmark.cpp
+ *  \brief      Benchmark of the four lane PID kernel against pid_controller.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+
+#include "pid_controller/PID.hpp"
+#include "pid_controller/PID_3D.hpp"
+#include "pid_kernel_4d.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller;
+
+constexpr int kNumSamples = 256;
+
+struct Samples {
+  Eigen::Vector3d state[kNumSamples];
+  Eigen::Vector3d reference[kNumSamples];
+  double yaw_error[kNumSamples];
+
+  Samples() {
+    for (int i = 0; i < kNumSamples; i++) {
+      state[i]     = Eigen::Vector3d(std::sin(0.1 * i), std::cos(0.1 * i), 0.01 * i);
+      reference[i] = Eigen::Vector3d(1.0, -1.0, 2.0);
+      yaw_error[i] = 0.5 * std::sin(0.05 * i);
+    }
+  }
+};
+
+PIDGains3D makeGains() {
+  PIDGains3D gains;
+  gains.kp             = Eigen::Vector3d(1.0, 1.0, 2.0);
+  gains.ki             = Eigen::Vector3d(0.01, 0.01, 0.02);
+  gains.kd             = Eigen::Vector3d(0.1, 0.1, 0.2);
+  gains.antiwindup_cte = 5.0;
+  gains.alpha          = 0.1;
+  return gains;
+}
+
+PIDGains makeYawGains() {
+  PIDGains gains;
+  gains.kp             = 1.0;
+  gains.ki             = 0.01;
+  gains.kd             = 0.1;
+  gains.antiwindup_cte = 5.0;
+  gains.alpha          = 0.1;
+  return gains;
+}
+
+void BM_PIDController3DAndYaw(benchmark::State &state) {
+  const Samples samples;
+  pid_controller::PIDController3D pid_3d;
+  pid_controller::PIDController pid_yaw;
+  applyGains(makeGains(), pid_3d);
+  applyGains(makeYawGains(), pid_yaw);
+  pid_3d.setOutputSaturation(Eigen::Vector3d(1.0, 1.0, 0.5));
+
+  int i = 0;
+  for (auto _ : state) {
+    Eigen::Vector3d velocity = pid_3d.computeControl(0.001, samples.state[i], samples.reference[i]);
+    double yaw_speed         = pid_yaw.computeControl(0.001, samples.yaw_error[i]);
+    benchmark::DoNotOptimize(velocity);
+    benchmark::DoNotOptimize(yaw_speed);
+    i = (i + 1) % kNumSamples;
+  }
+}
+
+void BM_PIDKernel4D(benchmark::State &state) {
+  const Samples samples;
+  PIDKernel4D kernel;
+  kernel.setGains(makeGains(), makeYawGains());
+  Lanes4 limits;
+  limits[0] = 1.0;
+  limits[1] = 1.0;
+  limits[2] = 0.5;
+  kernel.setOutputSaturation(limits);
+
+  int i = 0;
+  for (auto _ : state) {
+    Lanes4 error;
+    for (int axis = 0; axis < 3; axis++) {
+      error[axis] = samples.reference[i][axis] - samples.state[i][axis];
+    }
+    error[3]      = samples.yaw_error[i];
+    Lanes4 output = kernel.computeControl(0.001, error);
+    benchmark::DoNotOptimize(output);
+    i = (i + 1) % kNumSamples;
+  }
+  state.SetLabel(simd::kBackendName);
+}
+
+}  // namespace
+
+BENCHMARK(BM_PIDController3DAndYaw);
+BENCHMARK(BM_PIDKernel4D);
+
+BENCHMARK_MAIN();
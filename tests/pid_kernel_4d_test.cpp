@@ -0,0 +1,162 @@
+/*!*******************************************************************************************
+ *  \file       pid_kernel_4d_test.cpp
+ *  \brief      Tests for the four lane PID kernel against a scalar reference.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "pid_kernel_4d.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller;
+
+// Straightforward scalar PID with the kernel semantics
+struct ReferencePID {
+  double kp, ki, kd, antiwindup, alpha, limit;
+  bool reset_integral;
+  double integral = 0.0, last_error = 0.0, filtered = 0.0;
+  bool initialized = false;
+
+  double compute(double dt, double error, double derivative) {
+    integral += error * dt;
+    if (reset_integral && error * last_error < 0.0) {
+      integral = 0.0;
+    }
+    if (antiwindup > 0.0) {
+      integral = std::clamp(integral, -antiwindup, antiwindup);
+    }
+    filtered     = alpha * derivative + (1.0 - alpha) * filtered;
+    double out   = kp * error + ki * integral + kd * filtered;
+    if (limit > 0.0) {
+      out = std::clamp(out, -limit, limit);
+    }
+    last_error  = error;
+    initialized = true;
+    return out;
+  }
+
+  double compute(double dt, double error) {
+    double derivative = initialized ? (error - last_error) / dt : 0.0;
+    return compute(dt, error, derivative);
+  }
+};
+
+class PIDKernel4DTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    gains_.kp             = Eigen::Vector3d(1.0, 2.0, 3.0);
+    gains_.ki             = Eigen::Vector3d(0.5, 0.1, 0.2);
+    gains_.kd             = Eigen::Vector3d(0.3, 0.2, 0.1);
+    gains_.antiwindup_cte = 0.4;
+    gains_.alpha          = 0.3;
+    gains_.reset_integral = true;
+    yaw_gains_.kp         = 1.5;
+    yaw_gains_.ki         = 0.05;
+    yaw_gains_.kd         = 0.4;
+    yaw_gains_.alpha      = 0.6;
+    kernel_.setGains(gains_, yaw_gains_);
+
+    limits_[0] = 1.0;
+    limits_[1] = 2.0;
+    limits_[2] = 0.0;
+    limits_[3] = 0.8;
+    kernel_.setOutputSaturation(limits_);
+
+    for (size_t i = 0; i < 3; i++) {
+      reference_[i] = {gains_.kp[i],   gains_.ki[i], gains_.kd[i],          gains_.antiwindup_cte,
+                       gains_.alpha,   limits_[i],   gains_.reset_integral};
+    }
+    reference_[3] = {yaw_gains_.kp,    yaw_gains_.ki, yaw_gains_.kd, yaw_gains_.antiwindup_cte,
+                     yaw_gains_.alpha, limits_[3],    yaw_gains_.reset_integral};
+  }
+
+  PIDGains3D gains_;
+  PIDGains yaw_gains_;
+  Lanes4 limits_;
+  PIDKernel4D kernel_;
+  ReferencePID reference_[4];
+};
+
+TEST_F(PIDKernel4DTest, MatchesScalarReferenceWithFiniteDifference) {
+  for (int tick = 0; tick < 500; tick++) {
+    const double dt = 0.001 + 0.0005 * (tick % 7);
+    Lanes4 error;
+    for (size_t i = 0; i < 4; i++) {
+      error[i] = std::sin(0.05 * tick + i) * (1.0 + i);
+    }
+    const Lanes4 output = kernel_.computeControl(dt, error);
+    for (size_t i = 0; i < 4; i++) {
+      ASSERT_NEAR(output[i], reference_[i].compute(dt, error[i]), 1e-12)
+          << "lane " << i << " tick " << tick;
+    }
+  }
+}
+
+TEST_F(PIDKernel4DTest, MatchesScalarReferenceWithExplicitDerivative) {
+  for (int tick = 0; tick < 500; tick++) {
+    const double dt = 0.002;
+    Lanes4 error, derivative;
+    for (size_t i = 0; i < 4; i++) {
+      error[i]      = std::cos(0.03 * tick + i);
+      derivative[i] = -0.03 * std::sin(0.03 * tick + i) / dt;
+    }
+    const Lanes4 output = kernel_.computeControl(dt, error, derivative);
+    for (size_t i = 0; i < 4; i++) {
+      ASSERT_NEAR(output[i], reference_[i].compute(dt, error[i], derivative[i]), 1e-12);
+    }
+  }
+}
+
+TEST_F(PIDKernel4DTest, ResetClearsStateButKeepsSaturation) {
+  Lanes4 error;
+  error[0] = 100.0;
+  kernel_.computeControl(0.01, error);
+  kernel_.reset();
+  const Lanes4 output = kernel_.computeControl(0.01, error);
+  EXPECT_DOUBLE_EQ(output[0], limits_[0]);
+  EXPECT_DOUBLE_EQ(output[1], 0.0);
+}
+
+TEST(PIDKernel4DBackendTest, ReportsBackend) {
+  const std::string backend = simd::kBackendName;
+  EXPECT_FALSE(backend.empty());
+  RecordProperty("simd_backend", backend);
+}
+
+}  // namespace
@@ -1,7 +1,7 @@
 find_package(benchmark QUIET)
-if (${benckmark_FOUND})
+if (${benchmark_FOUND})
   MESSAGE(STATUS "Found Google Benchmark.")
-else (${benckmark_FOUND})
+else (${benchmark_FOUND})
   MESSAGE(STATUS "Could not find Google Benchmark.")
   include(FetchContent)
   FetchContent_Declare(
@@ -12,26 +12,23 @@ else (${benckmark_FOUND})
   FetchContent_MakeAvailable(benchmark)
 
 
-endif(${benckmark_FOUND})
+endif(${benchmark_FOUND})
 
-include(GoogleTest)
+# find all *benchmark.cpp files in the tests directory
 
-enable_testing()
-# find all *.cpp files in the tests directory
+file(GLOB BENCHMARK_SOURCES tests/*benchmark.cpp )
 
-file(GLOB TEST_SOURCES tests/*benchmark.cpp )
+# create a benchmark executable for each benchmark file
+foreach(BENCHMARK_SOURCE ${BENCHMARK_SOURCES})
 
-# create a test executable for each test file
-foreach(TEST_SOURCE ${TEST_SOURCES})
-
-  get_filename_component(_src_filename ${TEST_SOURCE} NAME)
+  get_filename_component(_src_filename ${BENCHMARK_SOURCE} NAME)
   string(LENGTH ${_src_filename} name_length)
   math(EXPR final_length  "${name_length}-4") # remove .cpp of the name
-  string(SUBSTRING ${_src_filename} 0 ${final_length} TEST_NAME)
+  string(SUBSTRING ${_src_filename} 0 ${final_length} BENCHMARK_NAME)
   
-  add_executable(${TEST_NAME}_test ${TEST_SOURCE} ${SOURCE_CPP_FILES})
-  ament_target_dependencies(${TEST_NAME}_test  ${PROJECT_DEPENDENCIES})
-  target_link_libraries(${TEST_NAME}_test benchmark::benchmark )
+  add_executable(${BENCHMARK_NAME} ${BENCHMARK_SOURCE})
+  ament_target_dependencies(${BENCHMARK_NAME} ${PROJECT_DEPENDENCIES})
+  target_link_libraries(${BENCHMARK_NAME} ${PROJECT_NAME} ${PROJECT_NAME}_replay benchmark::benchmark)
 
 
-  endforeach()
\ No newline at end of file
+  endforeach()
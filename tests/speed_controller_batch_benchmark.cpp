@@ -0,0 +1,120 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_batch_benchmark.cpp
+ *  \brief      Benchmarks of the batched engine against one plugin per vehicle.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+#include "speed_controller_batch.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller;
+using namespace speed_controller_test_utils;
+
+const uint8_t kModes[] = {ControlMode::POSITION, ControlMode::SPEED, ControlMode::TRAJECTORY};
+
+void BM_PluginsComputeOutput(benchmark::State &state) {
+  const size_t num_vehicles = static_cast<size_t>(state.range(0));
+  std::vector<std::unique_ptr<PluginFixture>> plugins;
+  for (size_t i = 0; i < num_vehicles; i++) {
+    plugins.emplace_back(
+        std::make_unique<PluginFixture>(kModes[i % 3], ControlMode::YAW_ANGLE, false));
+  }
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+
+  for (auto _ : state) {
+    for (auto &plugin : plugins) {
+      plugin->plugin().updateState(plugin->pose(), plugin->twist());
+      plugin->plugin().computeOutput(0.001, pose_out, twist_out, thrust_out);
+    }
+    benchmark::DoNotOptimize(twist_out);
+  }
+  state.SetItemsProcessed(state.iterations() * num_vehicles);
+}
+
+void BM_BatchComputeOutput(benchmark::State &state) {
+  const size_t num_vehicles = static_cast<size_t>(state.range(0));
+  SpeedControllerBatch batch(num_vehicles);
+
+  // Same configuration as the plugin fixtures
+  auto node = std::make_shared<as2::Node>("speed_controller_batch_benchmark");
+  Plugin plugin;
+  plugin.initialize(node.get());
+  plugin.parametersCallback(getDefaultParameters(false));
+
+  UAV_state vehicle_state;
+  vehicle_state.position = Eigen::Vector3d(1.0, -2.0, 3.0);
+  vehicle_state.velocity = Eigen::Vector3d(0.5, -0.5, 0.2);
+  UAV_state reference;
+  reference.position = Eigen::Vector3d(2.0, 1.0, 1.5);
+  reference.velocity = Eigen::Vector3d(0.3, 0.2, 0.1);
+  reference.yaw.x()  = 0.5;
+
+  for (size_t i = 0; i < num_vehicles; i++) {
+    batch.setGains(i, plugin.getGains());
+    batch.setMode(i, kModes[i % 3], ControlMode::YAW_ANGLE, false, true);
+    batch.setSpeedLimits(i, Eigen::Vector3d(1.5, 1.5, 1.0));
+    batch.updateState(i, vehicle_state);
+    batch.updateReference(i, reference);
+  }
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < num_vehicles; i++) {
+      batch.updateState(i, vehicle_state);
+    }
+    batch.computeOutput(0.001);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * num_vehicles);
+}
+
+}  // namespace
+
+BENCHMARK(BM_PluginsComputeOutput)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_BatchComputeOutput)->RangeMultiplier(4)->Range(1, 1024);
+
+int main(int argc, char **argv) {
+  rclcpp::init(argc, argv);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  rclcpp::shutdown();
+  return 0;
+}
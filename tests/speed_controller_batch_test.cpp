@@ -0,0 +1,179 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_batch_test.cpp
+ *  \brief      Tests for the structure-of-arrays speed controller engine.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "speed_controller_batch.hpp"
+
+namespace {
+
+using as2_msgs::msg::ControlMode;
+using namespace controller_plugin_speed_controller;
+
+ControllerGains makeProportionalGains(double kp) {
+  ControllerGains gains;
+  gains.position.kp   = Eigen::Vector3d::Constant(kp);
+  gains.speed.kp      = Eigen::Vector3d::Constant(kp);
+  gains.trajectory.kp = Eigen::Vector3d::Constant(kp);
+  gains.trajectory.kd = Eigen::Vector3d::Constant(1.0);
+  gains.trajectory.alpha = 1.0;
+  gains.yaw.kp        = kp;
+  return gains;
+}
+
+UAV_state makeState(const Eigen::Vector3d &position,
+                    const Eigen::Vector3d &velocity,
+                    double yaw,
+                    double yaw_rate = 0.0) {
+  UAV_state state;
+  state.position = position;
+  state.velocity = velocity;
+  state.yaw.x()  = yaw;
+  state.yaw.y()  = yaw_rate;
+  return state;
+}
+
+TEST(SpeedControllerBatchTest, PositionModeIsProportionalAndSaturated) {
+  SpeedControllerBatch batch(1);
+  batch.setGains(0, makeProportionalGains(2.0));
+  ASSERT_TRUE(batch.setMode(0, ControlMode::POSITION, ControlMode::YAW_ANGLE));
+  batch.setSpeedLimits(0, Eigen::Vector3d(1.0, 10.0, 0.0));
+  batch.updateState(0, makeState(Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), 0.0));
+  batch.updateReference(0,
+                        makeState(Eigen::Vector3d(1.0, 2.0, -3.0), Eigen::Vector3d::Zero(), 0.5));
+
+  batch.computeOutput(0.01);
+  UAV_command command = batch.getOutput(0);
+  EXPECT_DOUBLE_EQ(command.velocity.x(), 1.0);
+  EXPECT_DOUBLE_EQ(command.velocity.y(), 4.0);
+  EXPECT_DOUBLE_EQ(command.velocity.z(), -6.0);  // Zero limit leaves the axis free
+  EXPECT_DOUBLE_EQ(command.yaw_speed, 1.0);
+}
+
+TEST(SpeedControllerBatchTest, ProportionalLimitationKeepsDirection) {
+  SpeedControllerBatch batch(1);
+  batch.setGains(0, makeProportionalGains(1.0));
+  ASSERT_TRUE(batch.setMode(0, ControlMode::POSITION, ControlMode::YAW_SPEED, false, true));
+  batch.setSpeedLimits(0, Eigen::Vector3d(1.0, 1.0, 1.0));
+  batch.updateReference(0, makeState(Eigen::Vector3d(4.0, 2.0, 0.0), Eigen::Vector3d::Zero(), 0.0));
+
+  batch.computeOutput(0.01);
+  UAV_command command = batch.getOutput(0);
+  EXPECT_DOUBLE_EQ(command.velocity.x(), 1.0);
+  EXPECT_DOUBLE_EQ(command.velocity.y(), 0.5);
+  EXPECT_DOUBLE_EQ(command.velocity.z(), 0.0);
+}
+
+TEST(SpeedControllerBatchTest, SpeedBypassForwardsReference) {
+  SpeedControllerBatch batch(1);
+  batch.setGains(0, makeProportionalGains(3.0));
+  ASSERT_TRUE(batch.setMode(0, ControlMode::SPEED, ControlMode::YAW_SPEED, true));
+  batch.updateState(0, makeState(Eigen::Vector3d::Ones(), Eigen::Vector3d(0.1, 0.2, 0.3), 0.0));
+  batch.updateReference(
+      0, makeState(Eigen::Vector3d::Zero(), Eigen::Vector3d(1.0, -1.0, 0.5), 0.0, 0.7));
+
+  batch.computeOutput(0.01);
+  UAV_command command = batch.getOutput(0);
+  EXPECT_DOUBLE_EQ(command.velocity.x(), 1.0);
+  EXPECT_DOUBLE_EQ(command.velocity.y(), -1.0);
+  EXPECT_DOUBLE_EQ(command.velocity.z(), 0.5);
+  EXPECT_DOUBLE_EQ(command.yaw_speed, 0.7);
+}
+
+TEST(SpeedControllerBatchTest, YawErrorWrapsAround) {
+  SpeedControllerBatch batch(1);
+  batch.setGains(0, makeProportionalGains(1.0));
+  ASSERT_TRUE(batch.setMode(0, ControlMode::POSITION, ControlMode::YAW_ANGLE));
+  batch.updateState(0, makeState(Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), -M_PI + 0.1));
+  batch.updateReference(0, makeState(Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), M_PI - 0.1));
+
+  batch.computeOutput(0.01);
+  EXPECT_NEAR(batch.getOutput(0).yaw_speed, -0.2, 1e-12);
+}
+
+TEST(SpeedControllerBatchTest, SlotsAreIndependentAcrossModes) {
+  const uint8_t modes[] = {ControlMode::POSITION, ControlMode::SPEED, ControlMode::TRAJECTORY,
+                           ControlMode::HOVER};
+  const size_t num_slots = 4;
+
+  SpeedControllerBatch mixed(num_slots);
+  std::vector<SpeedControllerBatch> singles(num_slots, SpeedControllerBatch(1));
+  for (size_t i = 0; i < num_slots; i++) {
+    ControllerGains gains = makeProportionalGains(0.5 + i);
+    gains.position.ki     = Eigen::Vector3d::Constant(0.1);
+    gains.position.kd     = Eigen::Vector3d::Constant(0.2);
+    gains.position.alpha  = 0.5;
+    mixed.setGains(i, gains);
+    singles[i].setGains(0, gains);
+    ASSERT_TRUE(mixed.setMode(i, modes[i], ControlMode::YAW_ANGLE));
+    ASSERT_TRUE(singles[i].setMode(0, modes[i], ControlMode::YAW_ANGLE));
+  }
+
+  for (int tick = 0; tick < 50; tick++) {
+    for (size_t i = 0; i < num_slots; i++) {
+      const double t    = 0.01 * tick + i;
+      UAV_state state   = makeState(Eigen::Vector3d(std::sin(t), std::cos(t), t),
+                                    Eigen::Vector3d(std::cos(t), -std::sin(t), 1.0), 0.1 * t);
+      UAV_state reference =
+          makeState(Eigen::Vector3d(1.0, 2.0, 3.0), Eigen::Vector3d(0.5, 0.5, 0.0), 1.0);
+      mixed.updateState(i, state);
+      mixed.updateReference(i, reference);
+      singles[i].updateState(0, state);
+      singles[i].updateReference(0, reference);
+    }
+    mixed.computeOutput(0.01);
+    for (size_t i = 0; i < num_slots; i++) {
+      singles[i].computeOutput(0.01);
+      const UAV_command expected = singles[i].getOutput(0);
+      const UAV_command actual   = mixed.getOutput(i);
+      EXPECT_DOUBLE_EQ(actual.velocity.x(), expected.velocity.x());
+      EXPECT_DOUBLE_EQ(actual.velocity.y(), expected.velocity.y());
+      EXPECT_DOUBLE_EQ(actual.velocity.z(), expected.velocity.z());
+      EXPECT_DOUBLE_EQ(actual.yaw_speed, expected.yaw_speed);
+    }
+  }
+}
+
+TEST(SpeedControllerBatchTest, UnsupportedModesAreRejected) {
+  SpeedControllerBatch batch(1);
+  EXPECT_FALSE(batch.setMode(0, ControlMode::ACRO, ControlMode::YAW_ANGLE));
+  EXPECT_FALSE(batch.setMode(0, ControlMode::SPEED_IN_A_PLANE, ControlMode::YAW_ANGLE));
+  EXPECT_FALSE(batch.setMode(0, ControlMode::POSITION, 7));
+}
+
+}  // namespace
@@ -0,0 +1,295 @@
+/*!*******************************************************************************************
+ *  \file       tests/speed_controller_closed_loop_benchmark.cpp
+ *  \brief      Closed loop benchmark of the plugin tracking a trajectory with a first-order plant.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <time.h>
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "speed_controller_plugin_test_utils.hpp"
+#include "speed_controller_tuner.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::tuning::PlantModel;
+using controller_plugin_speed_controller::tuning::PlantState;
+using controller_plugin_speed_controller::tuning::stepPlant;
+
+// Circle tracked by every vehicle, published by a generator running at kGeneratorPeriod
+constexpr double kRadius          = 1.0;   // [m]
+constexpr double kAngularSpeed    = 0.4;   // [rad/s]
+constexpr double kHeight          = 1.5;   // [m]
+constexpr double kGeneratorPeriod = 0.02;  // [s]
+
+constexpr double kStartTime     = 1.0;  // [s], a zero stamp would be taken for now
+constexpr double kIterationTime = 0.5;  // Simulated [s] per benchmark iteration
+
+as2_msgs::msg::TrajectoryPoint circlePoint(double _time) {
+  const double angle = kAngularSpeed * _time;
+  const double speed = kRadius * kAngularSpeed;
+
+  as2_msgs::msg::TrajectoryPoint point;
+  point.header.stamp   = rclcpp::Time(static_cast<int64_t>(std::llround(_time * 1e9)));
+  point.position.x     = kRadius * std::cos(angle);
+  point.position.y     = kRadius * std::sin(angle);
+  point.position.z     = kHeight;
+  point.twist.x        = -speed * std::sin(angle);
+  point.twist.y        = speed * std::cos(angle);
+  point.acceleration.x = -speed * kAngularSpeed * std::cos(angle);
+  point.acceleration.y = -speed * kAngularSpeed * std::sin(angle);
+  point.yaw_angle      = static_cast<float>(std::remainder(angle + M_PI_2, 2.0 * M_PI));
+  return point;
+}
+
+/**
+ * @brief Plugin in TRAJECTORY mode closing the loop on the point mass the tuner evaluates
+ * candidates on
+ */
+class ClosedLoopVehicle {
+public:
+  explicit ClosedLoopVehicle(double _dt)
+      : fixture_(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false), dt_(_dt) {
+    plugin().parametersCallback(
+        {rclcpp::Parameter("trajectory_feedforward.look_ahead", plant_.velocity_time_constant),
+         rclcpp::Parameter("trajectory_feedforward.yaw_rate", true)});
+
+    // Start on the trajectory, with the generator one period ahead
+    const as2_msgs::msg::TrajectoryPoint start = circlePoint(kStartTime);
+    plugin().updateReference(start);
+    next_point_time_ = kStartTime + kGeneratorPeriod;
+    plugin().updateReference(circlePoint(next_point_time_));
+
+    state_.position = Eigen::Vector3d(start.position.x, start.position.y, start.position.z);
+    state_.velocity = Eigen::Vector3d(start.twist.x, start.twist.y, start.twist.z);
+    state_.yaw      = start.yaw_angle;
+  }
+
+  // One control tick and plant step, returns the squared position error after the step
+  double tick() {
+    const double time = kStartTime + static_cast<double>(ticks_) * dt_;
+    if (time >= next_point_time_) {
+      next_point_time_ += kGeneratorPeriod;
+      plugin().updateReference(circlePoint(next_point_time_));
+    }
+
+    auto &pose              = fixture_.pose();
+    auto &twist             = fixture_.twist();
+    pose.header.stamp       = rclcpp::Time(static_cast<int64_t>(std::llround(time * 1e9)));
+    twist.header.stamp      = pose.header.stamp;
+    pose.pose.position.x    = state_.position.x();
+    pose.pose.position.y    = state_.position.y();
+    pose.pose.position.z    = state_.position.z();
+    pose.pose.orientation.x = 0.0;
+    pose.pose.orientation.y = 0.0;
+    pose.pose.orientation.z = std::sin(0.5 * state_.yaw);
+    pose.pose.orientation.w = std::cos(0.5 * state_.yaw);
+    twist.twist.linear.x    = state_.velocity.x();
+    twist.twist.linear.y    = state_.velocity.y();
+    twist.twist.linear.z    = state_.velocity.z();
+    twist.twist.angular.z   = state_.yaw_rate;
+    plugin().updateState(pose, twist);
+    // A failed tick leaves the last command applied, as a flight controller would
+    plugin().computeOutput(dt_, pose_out_, twist_out_, thrust_out_);
+
+    const Eigen::Vector3d command(twist_out_.twist.linear.x, twist_out_.twist.linear.y,
+                                  twist_out_.twist.linear.z);
+    stepPlant(plant_, command, twist_out_.twist.angular.z, dt_, state_);
+    ticks_++;
+
+    const as2_msgs::msg::TrajectoryPoint reference = circlePoint(time + dt_);
+    const Eigen::Vector3d error =
+        Eigen::Vector3d(reference.position.x, reference.position.y, reference.position.z) -
+        state_.position;
+    return error.squaredNorm();
+  }
+
+private:
+  Plugin &plugin() { return fixture_.plugin(); }
+
+  PluginFixture fixture_;
+  double dt_;
+  double next_point_time_ = 0.0;
+  uint64_t ticks_         = 0;
+
+  PlantModel plant_;
+  PlantState state_;
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+// Reusable rendezvous of a fixed number of threads
+class Barrier {
+public:
+  explicit Barrier(size_t _count) : count_(_count) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t generation = generation_;
+    if (++waiting_ == count_) {
+      waiting_ = 0;
+      generation_++;
+      lock.unlock();
+      released_.notify_all();
+      return;
+    }
+    released_.wait(lock, [this, generation]() { return generation_ != generation; });
+  }
+
+private:
+  const size_t count_;
+  size_t waiting_      = 0;
+  uint64_t generation_ = 0;
+  std::mutex mutex_;
+  std::condition_variable released_;
+};
+
+double processCpuTime() {
+  timespec time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return static_cast<double>(time.tv_sec) + 1e-9 * static_cast<double>(time.tv_nsec);
+}
+
+// Args: loop rate [Hz], vehicles, threads. The vehicles are split into contiguous chunks, one
+// per thread, and every thread steps all of its vehicles on each tick. The workers are started
+// once and meet the benchmark thread at a barrier before and after every iteration
+void BM_ClosedLoop(benchmark::State &state) {
+  const double rate         = static_cast<double>(state.range(0));
+  const size_t num_vehicles = static_cast<size_t>(state.range(1));
+  const size_t num_threads  = static_cast<size_t>(state.range(2));
+  const size_t ticks        = static_cast<size_t>(std::lround(kIterationTime * rate));
+
+  std::vector<std::unique_ptr<ClosedLoopVehicle>> vehicles;
+  vehicles.reserve(num_vehicles);
+  for (size_t i = 0; i < num_vehicles; i++) {
+    vehicles.emplace_back(std::make_unique<ClosedLoopVehicle>(1.0 / rate));
+  }
+
+  std::vector<double> squared_error(num_threads, 0.0);
+  auto run = [&](size_t _thread) {
+    const size_t begin = _thread * num_vehicles / num_threads;
+    const size_t end   = (_thread + 1) * num_vehicles / num_threads;
+    double sum         = 0.0;
+    for (size_t tick = 0; tick < ticks; tick++) {
+      for (size_t i = begin; i < end; i++) {
+        sum += vehicles[i]->tick();
+      }
+    }
+    squared_error[_thread] += sum;
+  };
+
+  Barrier start(num_threads);
+  Barrier done(num_threads);
+  bool finished = false;  // Read by the workers past the start barrier
+  std::vector<std::thread> workers;
+  workers.reserve(num_threads);
+  for (size_t thread = 1; thread < num_threads; thread++) {
+    workers.emplace_back([&, thread]() {
+      while (true) {
+        start.wait();
+        if (finished) {
+          return;
+        }
+        run(thread);
+        done.wait();
+      }
+    });
+  }
+
+  const double cpu_start = processCpuTime();
+  for (auto _ : state) {
+    start.wait();
+    run(0);
+    done.wait();
+  }
+  const double cpu_time = processCpuTime() - cpu_start;
+
+  finished = true;
+  start.wait();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  double total_squared_error = 0.0;
+  for (double error : squared_error) {
+    total_squared_error += error;
+  }
+  const double vehicle_ticks =
+      static_cast<double>(state.iterations()) * static_cast<double>(ticks * num_vehicles);
+  state.counters["vehicle_ticks"] = benchmark::Counter(vehicle_ticks, benchmark::Counter::kIsRate);
+  // Simulated seconds per second, below 1 the vehicles can not be run at the loop rate
+  state.counters["realtime_factor"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * kIterationTime, benchmark::Counter::kIsRate);
+  state.counters["cpu_ns_per_tick"] = 1e9 * cpu_time / vehicle_ticks;
+  state.counters["rmse_m"]          = std::sqrt(total_squared_error / vehicle_ticks);
+}
+
+void closedLoopArguments(benchmark::internal::Benchmark *_benchmark) {
+  for (int64_t rate : {100, 500, 2000}) {
+    for (int64_t vehicles : {1, 10, 100, 1000}) {
+      for (int64_t threads : {1, 2, 4, 8}) {
+        if (threads <= vehicles) {
+          _benchmark->Args({rate, vehicles, threads});
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_ClosedLoop)
+    ->Apply(closedLoopArguments)
+    ->ArgNames({"rate", "vehicles", "threads"})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv) {
+  rclcpp::init(argc, argv);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,100 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_control_law_benchmark.cpp
+ *  \brief      Tick cost of the control law for each scalar type.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include "speed_controller_control_law.hpp"
+
+namespace {
+
+using as2_msgs::msg::ControlMode;
+using namespace controller_plugin_speed_controller;
+
+ControllerGains makeGains() {
+  ControllerGains gains;
+  for (PIDGains3D *pid : {&gains.position, &gains.speed, &gains.trajectory}) {
+    pid->kp             = Eigen::Vector3d(1.0, 1.0, 2.0);
+    pid->ki             = Eigen::Vector3d(0.01, 0.01, 0.02);
+    pid->kd             = Eigen::Vector3d(0.1, 0.1, 0.2);
+    pid->antiwindup_cte = 5.0;
+    pid->alpha          = 0.1;
+  }
+  gains.yaw.kp    = 1.0;
+  gains.yaw.ki    = 0.01;
+  gains.yaw.kd    = 0.1;
+  gains.yaw.alpha = 0.1;
+  return gains;
+}
+
+// The control mode is the benchmark argument
+template <typename Scalar>
+void BM_ControlLawComputeOutput(benchmark::State &state) {
+  ControlLaw<Scalar> law;
+  law.setGains(makeGains());
+  law.setMode(static_cast<uint8_t>(state.range(0)), ControlMode::YAW_ANGLE, false, true);
+  law.setSpeedLimits(Eigen::Vector3d(1.5, 1.5, 1.0));
+
+  UAV_state vehicle_state;
+  vehicle_state.position = Eigen::Vector3d(1.0, -2.0, 3.0);
+  vehicle_state.velocity = Eigen::Vector3d(0.5, -0.5, 0.2);
+  UAV_state reference;
+  reference.position = Eigen::Vector3d(2.0, 1.0, 1.5);
+  reference.velocity = Eigen::Vector3d(0.3, 0.2, 0.1);
+  reference.yaw.x()  = 0.5;
+  law.updateReference(reference);
+
+  for (auto _ : state) {
+    vehicle_state.position.x() += 1e-6;
+    law.updateState(vehicle_state);
+    law.computeOutput(0.01);
+    UAV_command command = law.getOutput();
+    benchmark::DoNotOptimize(command);
+  }
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_ControlLawComputeOutput, double)
+    ->Arg(ControlMode::POSITION)
+    ->Arg(ControlMode::TRAJECTORY);
+BENCHMARK_TEMPLATE(BM_ControlLawComputeOutput, float)
+    ->Arg(ControlMode::POSITION)
+    ->Arg(ControlMode::TRAJECTORY);
+BENCHMARK_TEMPLATE(BM_ControlLawComputeOutput, FixedQ16)
+    ->Arg(ControlMode::POSITION)
+    ->Arg(ControlMode::TRAJECTORY);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,228 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_control_law_test.cpp
+ *  \brief      Accuracy of the float and fixed point control laws against the double one.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "speed_controller_batch.hpp"
+#include "speed_controller_control_law.hpp"
+
+namespace {
+
+using as2_msgs::msg::ControlMode;
+using namespace controller_plugin_speed_controller;
+
+constexpr double kDt    = 0.01;
+constexpr int kNumTicks = 1000;
+
+ControllerGains makeGains(bool _reset_integral) {
+  ControllerGains gains;
+  for (PIDGains3D *pid :
+       {&gains.position, &gains.speed, &gains.trajectory, &gains.speed_in_a_plane_speed}) {
+    pid->kp             = Eigen::Vector3d(1.5, 1.5, 2.0);
+    pid->ki             = Eigen::Vector3d(0.05, 0.05, 0.1);
+    pid->kd             = Eigen::Vector3d(0.2, 0.2, 0.3);
+    pid->antiwindup_cte = 2.0;
+    pid->alpha          = 0.3;
+    pid->reset_integral = _reset_integral;
+  }
+  gains.speed_in_a_plane_height.kp             = 2.0;
+  gains.speed_in_a_plane_height.ki             = 0.1;
+  gains.speed_in_a_plane_height.kd             = 0.3;
+  gains.speed_in_a_plane_height.antiwindup_cte = 2.0;
+  gains.speed_in_a_plane_height.alpha          = 0.3;
+  gains.yaw.kp                                 = 2.0;
+  gains.yaw.ki                                 = 0.05;
+  gains.yaw.kd                                 = 0.1;
+  gains.yaw.alpha                              = 0.3;
+  return gains;
+}
+
+// Moving reference with the position, velocity and yaw of a figure eight
+UAV_state makeReference(int _tick) {
+  const double t = _tick * kDt;
+  UAV_state reference;
+  reference.position = Eigen::Vector3d(3.0 * std::sin(0.5 * t), 1.5 * std::sin(t), 2.0);
+  reference.velocity = Eigen::Vector3d(1.5 * std::cos(0.5 * t), 1.5 * std::cos(t), 0.0);
+  reference.yaw.x()  = std::remainder(0.3 * t, 2.0 * M_PI);
+  reference.yaw.y()  = 0.3;
+  return reference;
+}
+
+// Point mass tracking the commanded velocity with a first order lag, and the yaw rate directly
+void stepPlant(UAV_state &_state, const UAV_command &_command) {
+  constexpr double kTimeConstant = 0.2;
+  _state.velocity += (_command.velocity - _state.velocity) * (kDt / kTimeConstant);
+  _state.position += _state.velocity * kDt;
+  _state.yaw.x() = std::remainder(_state.yaw.x() + _command.yaw_speed * kDt, 2.0 * M_PI);
+}
+
+struct CommandError {
+  double velocity  = 0.0;
+  double yaw_speed = 0.0;
+};
+
+// Runs the double law in closed loop and Scalar on the same states and references, returns the
+// largest command difference. The integral reset is left off: it is discontinuous at errors
+// within the quantization step of zero, where both laws may legitimately take different branches
+template <typename Scalar>
+CommandError compareToDouble(uint8_t _control_mode, uint8_t _yaw_mode, bool _proportional) {
+  ControlLaw<double> reference_law;
+  ControlLaw<Scalar> law;
+  reference_law.setGains(makeGains(false));
+  law.setGains(makeGains(false));
+  EXPECT_TRUE(reference_law.setMode(_control_mode, _yaw_mode, false, _proportional));
+  EXPECT_TRUE(law.setMode(_control_mode, _yaw_mode, false, _proportional));
+  reference_law.setSpeedLimits(Eigen::Vector3d(2.0, 2.0, 1.0));
+  law.setSpeedLimits(Eigen::Vector3d(2.0, 2.0, 1.0));
+
+  UAV_state state;
+  CommandError error;
+  for (int i = 0; i < kNumTicks; i++) {
+    const UAV_state reference = makeReference(i);
+    reference_law.updateState(state);
+    reference_law.updateReference(reference);
+    law.updateState(state);
+    law.updateReference(reference);
+    reference_law.computeOutput(kDt);
+    law.computeOutput(kDt);
+
+    const UAV_command expected = reference_law.getOutput();
+    const UAV_command actual   = law.getOutput();
+    error.velocity  = std::max(error.velocity, (actual.velocity - expected.velocity).norm());
+    error.yaw_speed = std::max(error.yaw_speed, std::abs(actual.yaw_speed - expected.yaw_speed));
+    stepPlant(state, expected);
+  }
+  return error;
+}
+
+struct ModeCase {
+  uint8_t control_mode;
+  uint8_t yaw_mode;
+  bool proportional_limitation;
+};
+
+constexpr ModeCase kModeCases[] = {
+    {ControlMode::POSITION, ControlMode::YAW_ANGLE, false},
+    {ControlMode::POSITION, ControlMode::YAW_ANGLE, true},
+    {ControlMode::SPEED, ControlMode::YAW_SPEED, false},
+    {ControlMode::SPEED_IN_A_PLANE, ControlMode::YAW_ANGLE, false},
+    {ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, true},
+};
+
+TEST(ControlLawTest, DoubleMatchesTheBatchEngine) {
+  for (const auto &mode : {kModeCases[0], kModeCases[1], kModeCases[2], kModeCases[4]}) {
+    ControlLaw<double> law;
+    SpeedControllerBatch batch(1);
+    law.setGains(makeGains(true));
+    batch.setGains(0, makeGains(true));
+    ASSERT_TRUE(law.setMode(mode.control_mode, mode.yaw_mode, false, mode.proportional_limitation));
+    ASSERT_TRUE(batch.setMode(0, mode.control_mode, mode.yaw_mode, false,
+                              mode.proportional_limitation));
+    law.setSpeedLimits(Eigen::Vector3d(2.0, 2.0, 1.0));
+    batch.setSpeedLimits(0, Eigen::Vector3d(2.0, 2.0, 1.0));
+
+    UAV_state state;
+    for (int i = 0; i < kNumTicks; i++) {
+      law.updateState(state);
+      law.updateReference(makeReference(i));
+      batch.updateState(0, state);
+      batch.updateReference(0, makeReference(i));
+      law.computeOutput(kDt);
+      batch.computeOutput(kDt);
+
+      const UAV_command command = law.getOutput();
+      ASSERT_LT((command.velocity - batch.getOutput(0).velocity).norm(), 1e-12) << i;
+      ASSERT_NEAR(command.yaw_speed, batch.getOutput(0).yaw_speed, 1e-12) << i;
+      stepPlant(state, command);
+    }
+  }
+}
+
+TEST(ControlLawTest, FloatStaysCloseToDouble) {
+  for (const auto &mode : kModeCases) {
+    const CommandError error =
+        compareToDouble<float>(mode.control_mode, mode.yaw_mode, mode.proportional_limitation);
+    EXPECT_LT(error.velocity, 1e-5) << static_cast<int>(mode.control_mode);
+    EXPECT_LT(error.yaw_speed, 1e-5) << static_cast<int>(mode.control_mode);
+  }
+}
+
+TEST(ControlLawTest, FixedPointStaysCloseToDouble) {
+  for (const auto &mode : kModeCases) {
+    const CommandError error =
+        compareToDouble<FixedQ16>(mode.control_mode, mode.yaw_mode, mode.proportional_limitation);
+    EXPECT_LT(error.velocity, 1e-3) << static_cast<int>(mode.control_mode);
+    EXPECT_LT(error.yaw_speed, 1e-3) << static_cast<int>(mode.control_mode);
+  }
+}
+
+TEST(ControlLawTest, RejectsUnknownModes) {
+  ControlLaw<float> law;
+  EXPECT_FALSE(law.setMode(ControlMode::ACRO, ControlMode::YAW_ANGLE));
+  EXPECT_FALSE(law.setMode(ControlMode::POSITION, 255));
+}
+
+TEST(FixedQ16Test, RoundsAndSaturates) {
+  EXPECT_EQ(FixedQ16(1.0).raw(), FixedQ16::kOne);
+  EXPECT_EQ(FixedQ16(-0.5).raw(), -FixedQ16::kOne / 2);
+  EXPECT_NEAR(static_cast<double>(FixedQ16(0.1)), 0.1, 1.0 / FixedQ16::kOne);
+
+  EXPECT_NEAR(static_cast<double>(FixedQ16(1.5) * FixedQ16(-2.25)), -3.375, 1e-9);
+  EXPECT_NEAR(static_cast<double>(FixedQ16(1.0) / FixedQ16(3.0)), 1.0 / 3.0, 1.0 / FixedQ16::kOne);
+  EXPECT_NEAR(static_cast<double>(FixedQ16(-7.0) / FixedQ16(2.0)), -3.5, 1e-9);
+
+  EXPECT_EQ((FixedQ16(30000.0) + FixedQ16(30000.0)).raw(), std::numeric_limits<int32_t>::max());
+  EXPECT_EQ((FixedQ16(-300.0) * FixedQ16(300.0)).raw(), std::numeric_limits<int32_t>::min());
+  EXPECT_EQ((FixedQ16(1.0) / FixedQ16(0.0)).raw(), std::numeric_limits<int32_t>::max());
+
+  EXPECT_EQ(FixedQ16(1e30).raw(), std::numeric_limits<int32_t>::max());
+  EXPECT_EQ(FixedQ16(-1e30).raw(), std::numeric_limits<int32_t>::min());
+  EXPECT_EQ(FixedQ16(std::numeric_limits<double>::infinity()).raw(),
+            std::numeric_limits<int32_t>::max());
+  EXPECT_EQ(FixedQ16(-std::numeric_limits<double>::infinity()).raw(),
+            std::numeric_limits<int32_t>::min());
+  EXPECT_EQ(FixedQ16(std::numeric_limits<double>::quiet_NaN()).raw(), 0);
+
+  EXPECT_EQ(static_cast<double>(floor(FixedQ16(2.75))), 2.0);
+  EXPECT_EQ(static_cast<double>(floor(FixedQ16(-2.25))), -3.0);
+  EXPECT_EQ(static_cast<double>(abs(FixedQ16(-1.25))), 1.25);
+}
+
+}  // namespace
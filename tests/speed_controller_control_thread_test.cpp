@@ -0,0 +1,236 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_control_thread_test.cpp
+ *  \brief      Tests of the real-time control thread and of the plugin real-time mode.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "speed_controller_control_thread.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::ControlThread;
+using controller_plugin_speed_controller::RealtimeSettings;
+using controller_plugin_speed_controller::RealtimeStatus;
+
+RealtimeSettings unprivilegedSettings(double period) {
+  RealtimeSettings settings;
+  settings.period      = period;
+  settings.lock_memory = false;
+  return settings;
+}
+
+TEST(ControlThreadTest, TicksAtThePeriod) {
+  ControlThread thread;
+  std::atomic<int> ticks{0};
+  std::atomic<double> dt_sum{0.0};
+
+  const RealtimeStatus status =
+      thread.start(unprivilegedSettings(0.002), [&ticks, &dt_sum](double dt) {
+        dt_sum.store(dt_sum.load() + dt);
+        ticks.fetch_add(1);
+      });
+  ASSERT_TRUE(status.started);
+  EXPECT_TRUE(thread.running());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  thread.stop();
+  EXPECT_FALSE(thread.running());
+
+  // Loaded machines miss deadlines, only check that the dt follows the wall clock
+  ASSERT_GT(ticks.load(), 5);
+  EXPECT_EQ(thread.ticks(), static_cast<uint64_t>(ticks.load()));
+  EXPECT_GT(dt_sum.load() / ticks.load(), 0.0015);
+  EXPECT_LT(dt_sum.load() / ticks.load(), 0.02);
+}
+
+TEST(ControlThreadTest, RestartsWithNewSettings) {
+  ControlThread thread;
+  std::atomic<int> first{0};
+  std::atomic<int> second{0};
+  thread.start(unprivilegedSettings(0.001), [&first](double) { first.fetch_add(1); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  thread.start(unprivilegedSettings(0.001), [&second](double) { second.fetch_add(1); });
+
+  const int first_ticks = first.load();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  thread.stop();
+  EXPECT_EQ(first.load(), first_ticks);
+  EXPECT_GT(second.load(), 0);
+}
+
+class RealtimePluginTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+
+  static std::vector<rclcpp::Parameter> realtimeParameters(bool enabled) {
+    return {rclcpp::Parameter("realtime.enabled", enabled),
+            rclcpp::Parameter("realtime.period", 0.001),
+            rclcpp::Parameter("realtime.lock_memory", false)};
+  }
+
+  // The first output of the control thread, false if none within a second
+  bool waitForOutput(Plugin &plugin) {
+    for (int i = 0; i < 1000; i++) {
+      if (plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_)) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+TEST_F(RealtimePluginTest, QueuedInputsReachTheControlThread) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+  ASSERT_TRUE(plugin.parametersCallback(realtimeParameters(true)).successful);
+  ASSERT_TRUE(plugin.isRealtimeActive());
+
+  plugin.updateState(fixture.pose(), fixture.twist());
+  plugin.updateReference(makeTwist(plugin.getInputTwistFrameId(), 1.0));
+  ASSERT_TRUE(waitForOutput(plugin));
+
+  // Bypass forwards the twist reference
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, 1.5);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.y, 0.5);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, 0.1);
+  EXPECT_EQ(twist_out_.header.frame_id, plugin.getOutputTwistFrameId());
+  EXPECT_GT(plugin.getControlThread().ticks(), 0u);
+
+  ASSERT_TRUE(plugin.parametersCallback(realtimeParameters(false)).successful);
+  EXPECT_FALSE(plugin.isRealtimeActive());
+  EXPECT_FALSE(plugin.getControlThread().running());
+  EXPECT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+}
+
+TEST_F(RealtimePluginTest, ModeChangeWaitsForNewInputs) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+  ASSERT_TRUE(plugin.parametersCallback(realtimeParameters(true)).successful);
+  plugin.updateState(fixture.pose(), fixture.twist());
+  plugin.updateReference(makeTwist(plugin.getInputTwistFrameId(), 1.0));
+  ASSERT_TRUE(waitForOutput(plugin));
+
+  ASSERT_TRUE(plugin.setMode(makeMode(ControlMode::POSITION, ControlMode::YAW_ANGLE,
+                                      ControlMode::LOCAL_ENU_FRAME),
+                             makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                      ControlMode::LOCAL_ENU_FRAME)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  plugin.updateState(makePose(plugin.getInputPoseFrameId(), 0.0),
+                     makeTwist(plugin.getInputTwistFrameId(), 0.0));
+  plugin.updateReference(makePose(plugin.getInputPoseFrameId(), 1.0));
+  ASSERT_TRUE(waitForOutput(plugin));
+  EXPECT_GT(twist_out_.twist.linear.x, 0.0);
+}
+
+TEST_F(RealtimePluginTest, KeepsTickingWhileTheConfigurationChanges) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+  ASSERT_TRUE(plugin.parametersCallback(realtimeParameters(true)).successful);
+  plugin.updateState(fixture.pose(), fixture.twist());
+  plugin.updateReference(makeTwist(plugin.getInputTwistFrameId(), 1.0));
+  ASSERT_TRUE(waitForOutput(plugin));
+
+  // The metrics timer and the telemetry file are created and destroyed outside the control lock
+  const std::string path = ::testing::TempDir() + "control_thread_telemetry.bin";
+  const uint64_t ticks   = plugin.getControlThread().ticks();
+  for (int i = 0; i < 20; i++) {
+    const bool enabled = i % 2 == 0;
+    ASSERT_TRUE(plugin
+                    .parametersCallback({rclcpp::Parameter("latency_metrics.enabled", enabled),
+                                         rclcpp::Parameter("telemetry.enabled", enabled),
+                                         rclcpp::Parameter("telemetry.file", path)})
+                    .successful);
+    EXPECT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+    EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, 1.5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_TRUE(plugin.getControlThread().running());
+  EXPECT_GT(plugin.getControlThread().ticks(), ticks);
+  std::remove(path.c_str());
+}
+
+TEST_F(RealtimePluginTest, SerializesConcurrentInputCallbacks) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+  ASSERT_TRUE(plugin.parametersCallback(realtimeParameters(true)).successful);
+
+  // A multithreaded executor may run the state and reference callbacks at once
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 4; i++) {
+    callers.emplace_back([&plugin, &fixture, i]() {
+      const auto twist = makeTwist(plugin.getInputTwistFrameId(), 1.0);
+      for (int j = 0; j < 2000; j++) {
+        if (i % 2 == 0) {
+          plugin.updateState(fixture.pose(), fixture.twist());
+        } else {
+          plugin.updateReference(twist);
+        }
+        if (j % 64 == 0) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto &caller : callers) {
+    caller.join();
+  }
+
+  ASSERT_TRUE(waitForOutput(plugin));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, 1.5);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.y, 0.5);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, 0.1);
+}
+
+}  // namespace
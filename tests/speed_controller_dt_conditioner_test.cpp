@@ -0,0 +1,166 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_dt_conditioner_test.cpp
+ *  \brief      Tests of the control tick dt conditioning.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "speed_controller_dt_conditioner.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::discreteFilterAlpha;
+using controller_plugin_speed_controller::DtConditioner;
+using controller_plugin_speed_controller::DtCorrection;
+
+void configure(DtConditioner &conditioner, double outlier_ratio) {
+  conditioner.setMinDt(0.001);
+  conditioner.setMaxDt(0.05);
+  conditioner.setOutlierRatio(outlier_ratio);
+  conditioner.setNominalDt(0.01);
+}
+
+TEST(DtConditionerTest, ClampsToTheLimits) {
+  DtConditioner conditioner;
+  configure(conditioner, 0.0);
+  EXPECT_DOUBLE_EQ(conditioner.condition(0.0), 0.001);
+  EXPECT_DOUBLE_EQ(conditioner.condition(1.0), 0.05);
+  EXPECT_DOUBLE_EQ(conditioner.condition(0.02), 0.02);
+
+  EXPECT_EQ(conditioner.ticks(), 3u);
+  EXPECT_EQ(conditioner.correctedTicks(), 2u);
+  EXPECT_EQ(conditioner.corrections(DtCorrection::CLAMPED_LOW), 1u);
+  EXPECT_EQ(conditioner.corrections(DtCorrection::CLAMPED_HIGH), 1u);
+  EXPECT_EQ(conditioner.corrections(DtCorrection::OUTLIER), 0u);
+}
+
+TEST(DtConditionerTest, ReplacesOutliersWithTheMean) {
+  DtConditioner conditioner;
+  configure(conditioner, 3.0);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_DOUBLE_EQ(conditioner.condition(0.01), 0.01);
+  }
+  EXPECT_DOUBLE_EQ(conditioner.condition(0.002), 0.01);
+  EXPECT_NEAR(conditioner.condition(0.04), conditioner.meanDt(), 1e-3);
+  EXPECT_EQ(conditioner.corrections(DtCorrection::OUTLIER), 2u);
+  EXPECT_EQ(conditioner.correctedTicks(), 2u);
+}
+
+TEST(DtConditionerTest, FollowsALastingRateChange) {
+  DtConditioner conditioner;
+  configure(conditioner, 1.5);
+  double dt = 0.0;
+  for (int i = 0; i < 50; i++) {
+    dt = conditioner.condition(0.02);
+  }
+  EXPECT_DOUBLE_EQ(dt, 0.02);
+  EXPECT_NEAR(conditioner.meanDt(), 0.02, 1e-3);
+  EXPECT_LT(conditioner.corrections(DtCorrection::OUTLIER), 10u);
+}
+
+TEST(DtConditionerTest, DiscreteAlphaKeepsTheFilterTimeConstant) {
+  const double alpha = 0.1;
+  EXPECT_DOUBLE_EQ(discreteFilterAlpha(alpha, 0.01, 0.01), alpha);
+
+  // Two half ticks decay the filter state as much as one nominal tick
+  const double half = discreteFilterAlpha(alpha, 0.005, 0.01);
+  EXPECT_NEAR((1.0 - half) * (1.0 - half), 1.0 - alpha, 1e-12);
+  EXPECT_LT(half, alpha);
+
+  // Pass-through and frozen filters are left as they are
+  EXPECT_DOUBLE_EQ(discreteFilterAlpha(1.0, 0.005, 0.01), 1.0);
+  EXPECT_DOUBLE_EQ(discreteFilterAlpha(0.0, 0.005, 0.01), 0.0);
+}
+
+class DtConditioningPluginTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+TEST_F(DtConditioningPluginTest, ShortTicksRunWithTheMeanDt) {
+  PluginFixture conditioned(ControlMode::SPEED, ControlMode::YAW_ANGLE, false);
+  PluginFixture nominal(ControlMode::SPEED, ControlMode::YAW_ANGLE, false);
+  conditioned.plugin().parametersCallback({rclcpp::Parameter("dt_conditioning.enabled", true)});
+
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(conditioned.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+    ASSERT_TRUE(nominal.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  }
+
+  geometry_msgs::msg::TwistStamped expected;
+  ASSERT_TRUE(conditioned.plugin().computeOutput(0.0005, pose_out_, twist_out_, thrust_out_));
+  ASSERT_TRUE(nominal.plugin().computeOutput(0.01, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, expected.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, expected.twist.angular.z);
+
+  const DtConditioner &conditioner = conditioned.plugin().getDtConditioner();
+  EXPECT_EQ(conditioner.ticks(), 6u);
+  EXPECT_EQ(conditioner.correctedTicks(), 1u);
+  EXPECT_EQ(conditioner.corrections(DtCorrection::CLAMPED_LOW), 1u);
+  EXPECT_EQ(conditioner.corrections(DtCorrection::OUTLIER), 1u);
+  EXPECT_EQ(nominal.plugin().getDtConditioner().ticks(), 0u);
+}
+
+TEST_F(DtConditioningPluginTest, ExactDiscretizationIsNeutralAtTheNominalDt) {
+  PluginFixture exact(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  PluginFixture nominal(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  exact.plugin().parametersCallback({rclcpp::Parameter("dt_conditioning.enabled", true),
+                                     rclcpp::Parameter("dt_conditioning.exact_discretization",
+                                                       true)});
+
+  geometry_msgs::msg::TwistStamped expected;
+  for (int i = 0; i < 5; i++) {
+    exact.pose().pose.position.x += 0.01;
+    nominal.pose().pose.position.x += 0.01;
+    exact.plugin().updateState(exact.pose(), exact.twist());
+    nominal.plugin().updateState(nominal.pose(), nominal.twist());
+    ASSERT_TRUE(exact.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+    ASSERT_TRUE(nominal.plugin().computeOutput(0.01, pose_out_, expected, thrust_out_));
+    EXPECT_NEAR(twist_out_.twist.linear.x, expected.twist.linear.x, 1e-12);
+  }
+}
+
+}  // namespace
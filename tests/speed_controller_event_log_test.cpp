@@ -0,0 +1,186 @@
+/*!*******************************************************************************************
+ *  \file       tests/speed_controller_event_log_test.cpp
+ *  \brief      Tests of the throttled event log of the control path.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "speed_controller_event_log.hpp"
+
+namespace {
+
+using controller_plugin_speed_controller::EventLog;
+using controller_plugin_speed_controller::LogEvent;
+using controller_plugin_speed_controller::LogRecord;
+
+// Threads of the process
+size_t threadCount() {
+  size_t threads = 0;
+  if (DIR *tasks = opendir("/proc/self/task")) {
+    while (const dirent *task = readdir(tasks)) {
+      threads += task->d_name[0] != '.';
+    }
+    closedir(tasks);
+  }
+  return threads;
+}
+
+std::vector<LogRecord> drainAll(EventLog &_log) {
+  std::vector<LogRecord> records;
+  _log.drain([&records](const LogRecord &_record) { records.push_back(_record); });
+  return records;
+}
+
+TEST(EventLogTest, ThrottlesEachEventSeparately) {
+  EventLog log(std::chrono::hours(1));
+  for (int i = 0; i < 10; i++) {
+    log.report(LogEvent::POSE_FRAME_MISMATCH, 1, 0);
+  }
+  EXPECT_TRUE(log.report(LogEvent::STATE_NOT_RECEIVED));
+  EXPECT_EQ(log.count(LogEvent::POSE_FRAME_MISMATCH), 10u);
+  EXPECT_EQ(log.count(LogEvent::STATE_NOT_RECEIVED), 1u);
+
+  const std::vector<LogRecord> records = drainAll(log);
+  ASSERT_EQ(records.size(), 2u);
+  EXPECT_EQ(records[0].event, LogEvent::POSE_FRAME_MISMATCH);
+  EXPECT_EQ(records[0].frame, 1u);
+  EXPECT_EQ(records[0].expected_frame, 0u);
+  EXPECT_EQ(records[1].event, LogEvent::STATE_NOT_RECEIVED);
+  EXPECT_EQ(records[1].frame, LogRecord::kNoFrame);
+}
+
+TEST(EventLogTest, NextRecordCarriesTheSuppressedReports) {
+  EventLog log(std::chrono::hours(1));
+  for (int i = 0; i < 5; i++) {
+    log.report(LogEvent::TRAJECTORY_BUFFER_FULL);
+  }
+  ASSERT_EQ(drainAll(log).size(), 1u);
+
+  log.setThrottlePeriod(std::chrono::nanoseconds(0));
+  ASSERT_TRUE(log.report(LogEvent::TRAJECTORY_BUFFER_FULL));
+  const std::vector<LogRecord> records = drainAll(log);
+  ASSERT_EQ(records.size(), 1u);
+  EXPECT_EQ(records[0].suppressed, 4u);
+}
+
+TEST(EventLogTest, TruncatesTheDetail) {
+  EventLog log;
+  const std::string detail(2 * LogRecord::kDetailSize, 'x');
+  ASSERT_TRUE(log.report(LogEvent::TWIST_CONVERSION, LogRecord::kNoFrame, 1, detail.c_str()));
+  const std::vector<LogRecord> records = drainAll(log);
+  ASSERT_EQ(records.size(), 1u);
+  EXPECT_EQ(std::strlen(records[0].detail.data()), LogRecord::kDetailSize - 1);
+}
+
+TEST(EventLogTest, CountsTheRecordsThatDoNotFit) {
+  EventLog log(std::chrono::nanoseconds(0));
+  for (size_t i = 0; i < EventLog::kCapacity + 5; i++) {
+    log.report(LogEvent::REFERENCE_QUEUE_FULL);
+  }
+  EXPECT_EQ(log.dropped(), 5u);
+  EXPECT_EQ(drainAll(log).size(), EventLog::kCapacity);
+  EXPECT_TRUE(log.report(LogEvent::REFERENCE_QUEUE_FULL));
+}
+
+TEST(EventLogTest, DrainThreadDeliversEveryQueuedRecord) {
+  constexpr uint64_t kReports = 2000;
+  EventLog log(std::chrono::nanoseconds(0));
+  std::mutex mutex;
+  uint64_t delivered = 0;
+  log.start(
+      [&](const LogRecord &) {
+        std::lock_guard<std::mutex> lock(mutex);
+        delivered++;
+      },
+      std::chrono::milliseconds(1));
+
+  // Two producers, as updateState and computeOutput may report from different threads
+  auto produce = [&log]() {
+    for (uint64_t i = 0; i < kReports / 2; i++) {
+      log.report(LogEvent::STATE_NOT_RECEIVED);
+      if (i % 16 == 0) {
+        std::this_thread::yield();
+      }
+    }
+  };
+  std::thread first(produce);
+  std::thread second(produce);
+  first.join();
+  second.join();
+  log.stop();
+
+  EXPECT_EQ(log.count(LogEvent::STATE_NOT_RECEIVED), kReports);
+  EXPECT_EQ(delivered + log.dropped(), kReports);
+}
+
+TEST(EventLogTest, StartedLogsShareOneDrainThread) {
+  constexpr size_t kLogs = 100;
+  const size_t threads   = threadCount();
+  std::atomic<size_t> delivered{0};
+  std::vector<std::unique_ptr<EventLog>> logs;
+  for (size_t i = 0; i < kLogs; i++) {
+    logs.push_back(std::make_unique<EventLog>());
+    logs.back()->start([&delivered](const LogRecord &) { delivered.fetch_add(1); },
+                       std::chrono::milliseconds(1));
+    logs.back()->report(LogEvent::STATE_NOT_RECEIVED);
+  }
+  EXPECT_EQ(threadCount(), threads + 1);
+
+  for (int i = 0; i < 1000 && delivered.load() < kLogs; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(delivered.load(), kLogs);
+
+  // A stopped log is no longer drained, the thread ends with the last one
+  logs.front()->stop();
+  logs.front()->report(LogEvent::UNKNOWN_CONTROL_MODE);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(delivered.load(), kLogs);
+  EXPECT_EQ(drainAll(*logs.front()).size(), 1u);
+  logs.clear();
+  EXPECT_EQ(threadCount(), threads);
+}
+
+}  // namespace
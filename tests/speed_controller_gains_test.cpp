@@ -0,0 +1,126 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_gains_test.cpp
+ *  \brief      Tests for the staged gain sets hand-off.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "speed_controller_gains.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller;
+using namespace speed_controller_test_utils;
+
+TEST(TripleBufferTest, ConsumerNeverSeesTornValues) {
+  TripleBuffer<ControllerGains> buffer;
+  std::atomic<bool> done{false};
+
+  std::thread producer([&]() {
+    for (int i = 1; i <= 20000; i++) {
+      ControllerGains &gains = buffer.back();
+      double value           = static_cast<double>(i);
+      gains.position.kp      = Eigen::Vector3d::Constant(value);
+      gains.yaw.kp           = value;
+      buffer.publish();
+    }
+    done = true;
+  });
+
+  double last_value = 0.0;
+  while (!done) {
+    buffer.update();
+    const ControllerGains &gains = buffer.front();
+    ASSERT_EQ(gains.position.kp.x(), gains.position.kp.y());
+    ASSERT_EQ(gains.position.kp.y(), gains.position.kp.z());
+    ASSERT_EQ(gains.position.kp.z(), gains.yaw.kp);
+    ASSERT_GE(gains.yaw.kp, last_value);
+    last_value = gains.yaw.kp;
+  }
+  producer.join();
+  buffer.update();
+  EXPECT_EQ(buffer.front().yaw.kp, 20000.0);
+}
+
+TEST(TripleBufferTest, UpdateOnlyReportsNewValues) {
+  TripleBuffer<PIDGains> buffer;
+  EXPECT_FALSE(buffer.update());
+  buffer.back().kp = 1.0;
+  buffer.publish();
+  EXPECT_TRUE(buffer.update());
+  EXPECT_EQ(buffer.front().kp, 1.0);
+  EXPECT_FALSE(buffer.update());
+}
+
+class StagedGainsTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+};
+
+TEST_F(StagedGainsTest, StagedGainsReachTheControllerOnTheNextTick) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, false);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("staged_gains", true)});
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  std::vector<rclcpp::Parameter> zero_gains;
+  for (const std::string gain : {"kp", "ki", "kd"}) {
+    for (const std::string axis : {"x", "y", "z"}) {
+      zero_gains.emplace_back("speed_control." + gain + "." + axis, 0.0);
+    }
+  }
+  plugin.parametersCallback(zero_gains);
+
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  EXPECT_DOUBLE_EQ(twist_out.twist.linear.x, 0.0);
+  EXPECT_DOUBLE_EQ(twist_out.twist.linear.y, 0.0);
+  EXPECT_DOUBLE_EQ(twist_out.twist.linear.z, 0.0);
+
+  plugin.parametersCallback({rclcpp::Parameter("speed_control.kp.x", 2.0)});
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  EXPECT_NE(twist_out.twist.linear.x, 0.0);
+  EXPECT_DOUBLE_EQ(twist_out.twist.linear.y, 0.0);
+}
+
+}  // namespace
@@ -0,0 +1,136 @@
+/*!*******************************************************************************************
+ *  \file       tests/speed_controller_limit_profile_test.cpp
+ *  \brief      Tests of the time-scheduled speed limit profiles.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "speed_controller_limit_profile.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::SpeedLimitKnot;
+using controller_plugin_speed_controller::SpeedLimitProfile;
+
+SpeedLimitKnot makeKnot(double time, double limit) {
+  SpeedLimitKnot knot;
+  knot.time   = time;
+  knot.limits = Eigen::Vector3d(limit, limit, 0.5 * limit);
+  return knot;
+}
+
+TEST(SpeedLimitProfileTest, InterpolatesBetweenKnotsAndHoldsTheEnds) {
+  SpeedLimitProfile profile;
+  ASSERT_TRUE(profile.push(makeKnot(1.0, 1.0)));
+  ASSERT_TRUE(profile.push(makeKnot(2.0, 3.0)));
+
+  Eigen::Vector3d limits = Eigen::Vector3d::Zero();
+  ASSERT_TRUE(profile.update(0.0, limits));
+  EXPECT_EQ(limits, makeKnot(0.0, 1.0).limits);
+  ASSERT_TRUE(profile.update(1.5, limits));
+  EXPECT_DOUBLE_EQ(limits.x(), 2.0);
+  EXPECT_DOUBLE_EQ(limits.z(), 1.0);
+  ASSERT_TRUE(profile.update(5.0, limits));
+  EXPECT_EQ(limits, makeKnot(0.0, 3.0).limits);
+}
+
+TEST(SpeedLimitProfileTest, OnlyReportsChanges) {
+  SpeedLimitProfile profile;
+  ASSERT_TRUE(profile.push(makeKnot(0.0, 1.0)));
+  ASSERT_TRUE(profile.push(makeKnot(1.0, 1.0)));
+  ASSERT_TRUE(profile.push(makeKnot(2.0, 2.0)));
+
+  Eigen::Vector3d limits = Eigen::Vector3d::Zero();
+  EXPECT_TRUE(profile.update(0.0, limits));
+  // Flat between the first two knots
+  EXPECT_FALSE(profile.update(0.5, limits));
+  EXPECT_FALSE(profile.update(1.0, limits));
+  EXPECT_TRUE(profile.update(1.5, limits));
+  EXPECT_TRUE(profile.update(2.0, limits));
+  EXPECT_FALSE(profile.update(3.0, limits));
+
+  // Going back in time restarts from the first knot
+  EXPECT_TRUE(profile.update(1.5, limits));
+  EXPECT_DOUBLE_EQ(limits.x(), 1.5);
+}
+
+TEST(SpeedLimitProfileTest, RejectsKnotsOutOfOrderAndBeyondTheCapacity) {
+  SpeedLimitProfile profile;
+  ASSERT_TRUE(profile.push(makeKnot(1.0, 1.0)));
+  EXPECT_FALSE(profile.push(makeKnot(1.0, 2.0)));
+  EXPECT_FALSE(profile.push(makeKnot(0.5, 2.0)));
+
+  profile.clear();
+  for (size_t i = 0; i < SpeedLimitProfile::kCapacity; i++) {
+    ASSERT_TRUE(profile.push(makeKnot(static_cast<double>(i), 1.0)));
+  }
+  EXPECT_FALSE(profile.push(makeKnot(1000.0, 1.0)));
+  EXPECT_EQ(profile.size(), SpeedLimitProfile::kCapacity);
+}
+
+TEST(SpeedLimitProfileTest, PluginRampsTheSpeedLimits) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+
+  // Position error of 1 m per axis, well above the limits at the start of the ramp
+  auto max_speed_at = [&](int32_t sec, uint32_t nanosec) {
+    fixture.pose().header.stamp.sec     = sec;
+    fixture.pose().header.stamp.nanosec = nanosec;
+    plugin.updateState(fixture.pose(), fixture.twist());
+    EXPECT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+    return std::max(std::abs(twist_out.twist.linear.x), std::abs(twist_out.twist.linear.y));
+  };
+
+  plugin.updateSpeedLimitProfile({makeKnot(100.0, 0.2), makeKnot(101.0, 0.6)});
+  EXPECT_NEAR(max_speed_at(100, 0), 0.2, 1e-9);
+  EXPECT_NEAR(max_speed_at(100, 500000000), 0.4, 1e-9);
+  EXPECT_NEAR(max_speed_at(102, 0), 0.6, 1e-9);
+
+  // Limits from the twist references are kept aside while the profile runs
+  plugin.updateReference(makeTwist(plugin.getInputTwistFrameId(), 10.0));
+  EXPECT_NEAR(max_speed_at(103, 0), 0.6, 1e-9);
+  plugin.updateSpeedLimitProfile({});
+  EXPECT_GT(max_speed_at(104, 0), 0.6);
+}
+
+}  // namespace
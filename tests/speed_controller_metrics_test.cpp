@@ -0,0 +1,144 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_metrics_test.cpp
+ *  \brief      Tests for the latency histograms and the plugin hot path metrics.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "speed_controller_metrics.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::LatencyHistogram;
+using controller_plugin_speed_controller::LatencyProbe;
+using controller_plugin_speed_controller::RejectedCall;
+
+TEST(LatencyHistogramTest, BucketsAreContiguous) {
+  for (size_t i = 1; i < LatencyHistogram::kNumBuckets; i++) {
+    const uint64_t lower = LatencyHistogram::bucketUpperBound(i - 1) + 1;
+    EXPECT_EQ(LatencyHistogram::bucketIndex(lower), i);
+    EXPECT_EQ(LatencyHistogram::bucketIndex(LatencyHistogram::bucketUpperBound(i)), i);
+  }
+  EXPECT_EQ(LatencyHistogram::bucketIndex(LatencyHistogram::kMaxValue),
+            LatencyHistogram::kNumBuckets - 1);
+}
+
+TEST(LatencyHistogramTest, PercentilesAreWithinBucketPrecision) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.percentile(0.5), 0u);
+
+  for (uint64_t value = 1; value <= 10000; value++) {
+    histogram.record(value * 1000);
+  }
+  const double tolerance = 1.0 / LatencyHistogram::kSubBuckets;
+  EXPECT_EQ(histogram.count(), 10000u);
+  EXPECT_EQ(histogram.max(), 10000000u);
+  EXPECT_NEAR(histogram.percentile(0.5), 5.0e6, 5.0e6 * tolerance);
+  EXPECT_NEAR(histogram.percentile(0.99), 9.9e6, 9.9e6 * tolerance);
+  EXPECT_EQ(histogram.percentile(1.0), histogram.max());
+
+  histogram.reset();
+  EXPECT_EQ(histogram.count(), 0u);
+  EXPECT_EQ(histogram.max(), 0u);
+}
+
+class PluginMetricsTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+TEST_F(PluginMetricsTest, NothingIsRecordedWhileDisabled) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  const auto &metrics = plugin.getLatencyMetrics();
+  EXPECT_EQ(metrics.histogram(ControlMode::POSITION, LatencyProbe::COMPUTE_OUTPUT).count(), 0u);
+  EXPECT_EQ(metrics.histogram(ControlMode::POSITION, LatencyProbe::UPDATE_STATE).count(), 0u);
+}
+
+TEST_F(PluginMetricsTest, CallsAreRecordedPerControlMode) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("latency_metrics.enabled", true)});
+
+  for (int i = 0; i < 10; i++) {
+    plugin.updateState(fixture.pose(), fixture.twist());
+    plugin.updateReference(makePose(plugin.getInputPoseFrameId(), 1.0));
+    ASSERT_TRUE(plugin.computeOutput(0.01 + 1e-4 * i, pose_out_, twist_out_, thrust_out_));
+  }
+
+  const auto &metrics = plugin.getLatencyMetrics();
+  EXPECT_EQ(metrics.histogram(ControlMode::POSITION, LatencyProbe::UPDATE_STATE).count(), 10u);
+  EXPECT_EQ(metrics.histogram(ControlMode::POSITION, LatencyProbe::UPDATE_REFERENCE).count(), 10u);
+  EXPECT_EQ(metrics.histogram(ControlMode::POSITION, LatencyProbe::COMPUTE_OUTPUT).count(), 10u);
+  EXPECT_EQ(metrics.histogram(ControlMode::POSITION, LatencyProbe::DT_JITTER).count(), 9u);
+  EXPECT_NEAR(metrics.histogram(ControlMode::POSITION, LatencyProbe::DT_JITTER).max(), 1e5,
+              1e5 / LatencyHistogram::kSubBuckets);
+  EXPECT_EQ(metrics.histogram(ControlMode::SPEED, LatencyProbe::COMPUTE_OUTPUT).count(), 0u);
+}
+
+TEST_F(PluginMetricsTest, RejectedCallsAreCounted) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("latency_metrics.enabled", true)});
+
+  const ControlMode mode_in =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  ASSERT_TRUE(plugin.setMode(mode_in, mode_in));
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  plugin.updateState(makePose("unknown_frame", 0.0), fixture.twist());
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  plugin.updateState(fixture.pose(), fixture.twist());
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  const auto &metrics = plugin.getLatencyMetrics();
+  EXPECT_EQ(metrics.rejected(RejectedCall::STATE_NOT_RECEIVED), 2u);
+  EXPECT_EQ(metrics.rejected(RejectedCall::FRAME_MISMATCH), 1u);
+  EXPECT_EQ(metrics.rejected(RejectedCall::REFERENCE_NOT_RECEIVED), 1u);
+}
+
+}  // namespace
@@ -0,0 +1,176 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_parameters_test.cpp
+ *  \brief      Tests for the static parameter schema and dispatch table.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+
+#include "speed_controller_parameters.hpp"
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller::parameters;
+using namespace speed_controller_test_utils;
+
+TEST(ParameterSchemaTest, EveryNameResolvesToItsOwnEntry) {
+  for (size_t i = 0; i < kNumParameters; i++) {
+    EXPECT_EQ(findParameter(kParameterSchema[i].name), static_cast<int>(i))
+        << kParameterSchema[i].name;
+  }
+}
+
+TEST(ParameterSchemaTest, UnknownNamesAreRejected) {
+  EXPECT_EQ(findParameter(""), -1);
+  EXPECT_EQ(findParameter("position_control"), -1);
+  EXPECT_EQ(findParameter("position_control.kp.w"), -1);
+  EXPECT_EQ(findParameter("yaw_control.kp.x"), -1);
+  EXPECT_EQ(findParameter("use_bypass "), -1);
+}
+
+TEST(ParameterSchemaTest, GroupMasksPartitionTheSchema) {
+  ParameterMask all;
+  for (uint8_t group = 0; group < static_cast<uint8_t>(ParameterGroup::COUNT); group++) {
+    ParameterMask mask = groupMask(static_cast<ParameterGroup>(group));
+    EXPECT_TRUE(mask.any());
+    EXPECT_TRUE((all & mask).none());
+    all |= mask;
+  }
+  EXPECT_EQ(all, kAllParametersMask);
+}
+
+TEST(ParameterSchemaTest, DefaultParametersMatchTheSchemaTypes) {
+  for (const auto &param : getDefaultParameters(false)) {
+    const auto &descriptor = kParameterSchema[findParameter(param.get_name())];
+    switch (descriptor.type()) {
+      case ParameterType::BOOL:
+        EXPECT_EQ(param.get_type(), rclcpp::ParameterType::PARAMETER_BOOL) << param.get_name();
+        break;
+      case ParameterType::INTEGER:
+        EXPECT_EQ(param.get_type(), rclcpp::ParameterType::PARAMETER_INTEGER) << param.get_name();
+        break;
+      case ParameterType::DOUBLE:
+        EXPECT_EQ(param.get_type(), rclcpp::ParameterType::PARAMETER_DOUBLE) << param.get_name();
+        break;
+      case ParameterType::STRING:
+        EXPECT_EQ(param.get_type(), rclcpp::ParameterType::PARAMETER_STRING) << param.get_name();
+        break;
+    }
+  }
+}
+
+TEST(ParameterSchemaTest, DefaultParametersCoverTheSchema) {
+  std::set<std::string> names;
+  for (const auto &param : getDefaultParameters(false)) {
+    EXPECT_GE(findParameter(param.get_name()), 0) << param.get_name();
+    names.insert(param.get_name());
+  }
+  EXPECT_EQ(names.size(), kNumParameters);
+}
+
+TEST(ParameterSchemaTest, SetModeWaitsForCompleteGroups) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  auto node = std::make_shared<as2::Node>("speed_controller_parameters_test");
+  Plugin plugin;
+  plugin.initialize(node.get());
+
+  const auto mode_in =
+      makeMode(ControlMode::POSITION, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  const auto mode_out =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+
+  auto params = getDefaultParameters(false);
+  std::vector<rclcpp::Parameter> missing_one;
+  for (const auto &param : params) {
+    if (param.get_name() != "position_control.kd.z") {
+      missing_one.push_back(param);
+    }
+  }
+  plugin.parametersCallback(missing_one);
+  EXPECT_FALSE(plugin.setMode(mode_in, mode_out));
+
+  plugin.parametersCallback({rclcpp::Parameter("position_control.kd.z", 0.1)});
+  EXPECT_TRUE(plugin.setMode(mode_in, mode_out));
+}
+
+TEST(ParameterSchemaTest, LoadParametersReadsTheWholeNode) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  auto node = std::make_shared<as2::Node>("speed_controller_parameters_test");
+  for (const auto &param : getDefaultParameters(false)) {
+    node->declare_parameter(param.get_name(), param.get_parameter_value());
+  }
+  Plugin plugin;
+  plugin.initialize(node.get());
+
+  const auto mode_in =
+      makeMode(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, ControlMode::LOCAL_ENU_FRAME);
+  const auto mode_out =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  EXPECT_EQ(plugin.getMissingParameters(mode_in),
+            groupMask(ParameterGroup::PLUGIN) | groupMask(ParameterGroup::POSITION) |
+                groupMask(ParameterGroup::TRAJECTORY) | groupMask(ParameterGroup::YAW));
+
+  EXPECT_TRUE(plugin.loadParameters());
+  EXPECT_TRUE(plugin.getMissingParameters().none());
+  EXPECT_TRUE(plugin.getMissingParameters(mode_in).none());
+  EXPECT_TRUE(plugin.setMode(mode_in, mode_out));
+}
+
+TEST(ParameterSchemaTest, MistypedValuesAreRejected) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  auto node = std::make_shared<as2::Node>("speed_controller_parameters_test");
+  Plugin plugin;
+  plugin.initialize(node.get());
+  plugin.parametersCallback(getDefaultParameters(false));
+  const double kp = plugin.getGains().speed.kp.x();
+
+  auto result = plugin.parametersCallback({rclcpp::Parameter("speed_control.kp.x", 2.0),
+                                           rclcpp::Parameter("speed_control.kd.x", true)});
+  EXPECT_FALSE(result.successful);
+  EXPECT_DOUBLE_EQ(plugin.getGains().speed.kp.x(), kp);
+
+  result = plugin.parametersCallback({rclcpp::Parameter("position_control.rate_divider", 2.0)});
+  EXPECT_FALSE(result.successful);
+}
+
+}  // namespace
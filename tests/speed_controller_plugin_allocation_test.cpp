@@ -0,0 +1,210 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_plugin_allocation_test.cpp
+ *  \brief      Checks that the steady-state control tick does not allocate.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <tuple>
+
+#include "speed_controller_plugin_test_utils.hpp"
+
+// Allocation hook, only counts while armed
+static std::atomic<bool> g_count_allocations{false};
+static std::atomic<uint64_t> g_allocations{0};
+
+void *operator new(std::size_t size) {
+  if (g_count_allocations.load(std::memory_order_relaxed)) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+using namespace speed_controller_test_utils;
+
+// Long enough to defeat the small string optimization on generated frame ids
+const char *kLongNamespace = "speed_controller_allocation_test_drone";
+
+class AllocationGuard {
+public:
+  AllocationGuard() {
+    g_allocations.store(0);
+    g_count_allocations.store(true);
+  }
+  ~AllocationGuard() { g_count_allocations.store(false); }
+  uint64_t allocations() const { return g_allocations.load(); }
+};
+
+// control mode, yaw mode, use bypass, output reference frame
+using ModeParams = std::tuple<uint8_t, uint8_t, bool, uint8_t>;
+
+class AllocationTest : public ::testing::TestWithParam<ModeParams> {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+};
+
+TEST_P(AllocationTest, SteadyStateTickDoesNotAllocate) {
+  const auto [control_mode, yaw_mode, use_bypass, output_frame] = GetParam();
+  PluginFixture fixture(control_mode, yaw_mode, use_bypass, output_frame, kLongNamespace);
+  Plugin &plugin = fixture.plugin();
+
+  auto pose         = makePose(plugin.getInputPoseFrameId(), 0.0);
+  auto twist        = makeTwist(plugin.getInputTwistFrameId(), 0.0);
+  auto ref_pose     = makePose(plugin.getInputPoseFrameId(), 1.0);
+  auto ref_twist    = makeTwist(plugin.getInputTwistFrameId(), 1.0);
+  auto ref_traj     = makeTrajectoryPoint(0.0);
+  ASSERT_GT(plugin.getOutputTwistFrameId().size(), 15u);
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+
+  // First tick writes the output frame id into the message
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  EXPECT_EQ(twist_out.header.frame_id, plugin.getOutputTwistFrameId());
+
+  AllocationGuard guard;
+  for (int i = 0; i < 1000; i++) {
+    pose.pose.position.x += 1e-3;
+    twist.twist.linear.x += 1e-3;
+    ref_pose.pose.position.y += 1e-3;
+    ref_twist.twist.linear.y += 1e-3;
+    ref_traj.position.z += 1e-3;
+
+    plugin.updateState(pose, twist);
+    plugin.updateReference(ref_pose);
+    plugin.updateReference(ref_twist);
+    plugin.updateReference(ref_traj);
+    ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  }
+  EXPECT_EQ(guard.allocations(), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllModes,
+    AllocationTest,
+    ::testing::Values(
+        ModeParams{ControlMode::HOVER, ControlMode::YAW_ANGLE, false, ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::POSITION, ControlMode::YAW_ANGLE, false,
+                   ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::POSITION, ControlMode::YAW_SPEED, false,
+                   ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::SPEED, ControlMode::YAW_ANGLE, false, ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::SPEED, ControlMode::YAW_SPEED, true, ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::SPEED, ControlMode::YAW_SPEED, false, ControlMode::BODY_FLU_FRAME},
+        ModeParams{ControlMode::SPEED_IN_A_PLANE, ControlMode::YAW_ANGLE, false,
+                   ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::SPEED_IN_A_PLANE, ControlMode::YAW_SPEED, true,
+                   ControlMode::BODY_FLU_FRAME},
+        ModeParams{ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false,
+                   ControlMode::LOCAL_ENU_FRAME},
+        ModeParams{ControlMode::TRAJECTORY, ControlMode::YAW_SPEED, false,
+                   ControlMode::LOCAL_ENU_FRAME}));
+
+TEST(AllocationTest, OutputFrameIdFollowsModeChanges) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true,
+                        ControlMode::BODY_FLU_FRAME, kLongNamespace);
+  Plugin &plugin = fixture.plugin();
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  const std::string flu_frame_id = twist_out.header.frame_id;
+  EXPECT_EQ(flu_frame_id, plugin.getOutputTwistFrameId());
+
+  ASSERT_TRUE(
+      plugin.setMode(makeMode(ControlMode::POSITION, ControlMode::YAW_ANGLE,
+                              ControlMode::LOCAL_ENU_FRAME),
+                     makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                              ControlMode::LOCAL_ENU_FRAME)));
+  plugin.updateState(makePose(plugin.getInputPoseFrameId(), 0.0),
+                     makeTwist(plugin.getInputTwistFrameId(), 0.0));
+  plugin.updateReference(makePose(plugin.getInputPoseFrameId(), 1.0));
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  EXPECT_EQ(twist_out.header.frame_id, plugin.getOutputTwistFrameId());
+  EXPECT_NE(twist_out.header.frame_id, flu_frame_id);
+}
+
+TEST(AllocationTest, LoanedOutputMatchesCopiedOutput) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture copied(ControlMode::POSITION, ControlMode::YAW_ANGLE, false,
+                       ControlMode::BODY_FLU_FRAME, kLongNamespace);
+  PluginFixture loaned(ControlMode::POSITION, ControlMode::YAW_ANGLE, false,
+                       ControlMode::BODY_FLU_FRAME, kLongNamespace);
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+
+  // Stands in for a buffer owned by the middleware, header preset once for the mode
+  geometry_msgs::msg::TwistStamped loaned_twist;
+  loaned.plugin().presetOutputHeader(loaned_twist.header);
+  EXPECT_EQ(loaned_twist.header.frame_id, loaned.plugin().getOutputTwistFrameId());
+
+  AllocationGuard guard;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(copied.plugin().computeOutput(0.01, pose_out, twist_out, thrust_out));
+    ASSERT_TRUE(loaned.plugin().computeLoanedOutput(0.01, loaned_twist.twist));
+    EXPECT_DOUBLE_EQ(loaned_twist.twist.linear.x, twist_out.twist.linear.x);
+    EXPECT_DOUBLE_EQ(loaned_twist.twist.linear.y, twist_out.twist.linear.y);
+    EXPECT_DOUBLE_EQ(loaned_twist.twist.linear.z, twist_out.twist.linear.z);
+    EXPECT_DOUBLE_EQ(loaned_twist.twist.angular.z, twist_out.twist.angular.z);
+  }
+  // Only the first copied tick writes its frame id
+  EXPECT_LE(guard.allocations(), 1u);
+  EXPECT_EQ(loaned_twist.header.frame_id, twist_out.header.frame_id);
+}
+
+}  // namespace
@@ -0,0 +1,498 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_plugin_benchmark.cpp
+ *  \brief      Benchmarks for the speed controller plugin hot path.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "speed_controller_plugin_test_utils.hpp"
+
+// Global allocation counter, used to report allocations per iteration
+static std::atomic<uint64_t> g_allocations{0};
+
+void *operator new(std::size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+using namespace speed_controller_test_utils;
+
+void setAllocationCounter(benchmark::State &state, uint64_t allocations_start) {
+  state.counters["allocs_per_iter"] = benchmark::Counter(
+      static_cast<double>(g_allocations.load() - allocations_start),
+      benchmark::Counter::kAvgIterations);
+}
+
+// L1 data cache read misses of the calling thread, from the kernel perf events
+class L1MissCounter {
+public:
+  L1MissCounter() {
+    perf_event_attr attr{};
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.size           = sizeof(attr);
+    attr.config         = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~L1MissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  bool valid() const { return fd_ >= 0; }
+
+  void start() {
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  uint64_t stop() {
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count = 0;
+    return read(fd_, &count, sizeof(count)) == sizeof(count) ? count : 0;
+  }
+
+private:
+  int fd_ = -1;
+};
+
+void BM_ComputeOutput(benchmark::State &state,
+                      uint8_t control_mode,
+                      uint8_t yaw_mode,
+                      bool use_bypass) {
+  PluginFixture fixture(control_mode, yaw_mode, use_bypass);
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  const double dt = 0.001;
+
+  // Warm up the output message so the frame id buffer is already allocated
+  if (!fixture.plugin().computeOutput(dt, pose_out, twist_out, thrust_out)) {
+    state.SkipWithError("computeOutput rejected the tick");
+    return;
+  }
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    bool valid = fixture.plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+    benchmark::DoNotOptimize(valid);
+    benchmark::DoNotOptimize(twist_out);
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+// Same tick as BM_ComputeOutput/position with the latency probes recording
+void BM_ComputeOutputLatencyMetrics(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  fixture.plugin().parametersCallback({rclcpp::Parameter("latency_metrics.enabled", true)});
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  const double dt = 0.001;
+  fixture.plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    bool valid = fixture.plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+    benchmark::DoNotOptimize(valid);
+    benchmark::DoNotOptimize(twist_out);
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+// Same tick as BM_ComputeOutput/position with every tick recorded to a telemetry file
+void BM_ComputeOutputTelemetry(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  const std::string path = "/tmp/speed_controller_benchmark_telemetry.bin";
+  fixture.plugin().parametersCallback(
+      {rclcpp::Parameter("telemetry.enabled", true), rclcpp::Parameter("telemetry.file", path)});
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  const double dt = 0.001;
+  fixture.plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    bool valid = fixture.plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+    benchmark::DoNotOptimize(valid);
+    benchmark::DoNotOptimize(twist_out);
+  }
+  setAllocationCounter(state, allocations_start);
+  state.counters["dropped"] =
+      static_cast<double>(fixture.plugin().getTelemetryRecorder()->dropped());
+  fixture.plugin().parametersCallback({rclcpp::Parameter("telemetry.enabled", false)});
+  std::remove(path.c_str());
+}
+
+// Plugins ticked round robin, as in a process running several controllers: with enough of them
+// each tick starts with the plugin evicted from L1, and its footprint decides the misses.
+// Without access to perf events (see /proc/sys/kernel/perf_event_paranoid) only time is reported
+void BM_ComputeOutputL1Misses(benchmark::State &state) {
+  L1MissCounter counter;
+
+  std::vector<std::unique_ptr<PluginFixture>> fixtures;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    fixtures.push_back(
+        std::make_unique<PluginFixture>(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false));
+  }
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  const double dt = 0.001;
+  for (auto &fixture : fixtures) {
+    fixture->plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+  }
+
+  uint64_t misses = 0;
+  for (auto _ : state) {
+    if (counter.valid()) {
+      counter.start();
+    }
+    for (auto &fixture : fixtures) {
+      bool valid = fixture->plugin().computeOutput(dt, pose_out, twist_out, thrust_out);
+      benchmark::DoNotOptimize(valid);
+    }
+    if (counter.valid()) {
+      misses += counter.stop();
+    }
+  }
+  if (counter.valid()) {
+    state.counters["l1d_misses_per_tick"] = benchmark::Counter(
+        static_cast<double>(misses) / static_cast<double>(fixtures.size()),
+        benchmark::Counter::kAvgIterations);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_UpdateState(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  auto &pose  = fixture.pose();
+  auto &twist = fixture.twist();
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    pose.pose.position.x += 1e-6;
+    fixture.plugin().updateState(pose, twist);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+// ENU twist rotated into the FLU frame with the cached yaw, instead of a TF lookup per tick
+void BM_UpdateStateRotatedTwist(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, false,
+                        ControlMode::BODY_FLU_FRAME);
+  auto &pose = fixture.pose();
+  auto twist = makeTwist(fixture.plugin().getInputPoseFrameId(), 0.0);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    pose.pose.position.x += 1e-6;
+    fixture.plugin().updateState(pose, twist);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+// Caller side of the real-time mode: the converted state is queued to the control thread
+void BM_UpdateStateRealtime(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  fixture.plugin().parametersCallback({rclcpp::Parameter("realtime.enabled", true),
+                                       rclcpp::Parameter("realtime.period", 0.001),
+                                       rclcpp::Parameter("realtime.lock_memory", false)});
+  auto &pose  = fixture.pose();
+  auto &twist = fixture.twist();
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    pose.pose.position.x += 1e-6;
+    fixture.plugin().updateState(pose, twist);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+// Misconfigured odometry: every state is rejected, the error goes through the event log
+void BM_UpdateStateFrameMismatch(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  const auto pose = makePose("map", 0.0);
+  auto &twist     = fixture.twist();
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    fixture.plugin().updateState(pose, twist);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+void BM_UpdateReferencePose(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  auto pose = makePose(fixture.plugin().getInputPoseFrameId(), 1.0);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    pose.pose.position.x += 1e-6;
+    fixture.plugin().updateReference(pose);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+void BM_UpdateReferenceTwist(benchmark::State &state, uint8_t control_mode) {
+  PluginFixture fixture(control_mode, ControlMode::YAW_SPEED, false);
+  auto twist = makeTwist(fixture.plugin().getInputTwistFrameId(), 1.0);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    twist.twist.linear.x += 1e-6;
+    fixture.plugin().updateReference(twist);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+void BM_UpdateReferenceTrajectory(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  auto point = makeTrajectoryPoint(0.0);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    point.position.x += 1e-6;
+    fixture.plugin().updateReference(point);
+    benchmark::ClobberMemory();
+  }
+  setAllocationCounter(state, allocations_start);
+}
+
+void BM_ParametersCallbackBulkReload(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  const auto params = getDefaultParameters(false);
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    auto result = fixture.plugin().parametersCallback(params);
+    benchmark::DoNotOptimize(result);
+  }
+  setAllocationCounter(state, allocations_start);
+  state.SetItemsProcessed(state.iterations() * params.size());
+}
+
+void BM_StartupToFirstSetMode(benchmark::State &state) {
+  auto node = std::make_shared<as2::Node>("speed_controller_benchmark");
+  for (const auto &param : getDefaultParameters(false)) {
+    node->declare_parameter(param.get_name(), param.get_parameter_value());
+  }
+  const auto mode_in =
+      makeMode(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, ControlMode::LOCAL_ENU_FRAME);
+  const auto mode_out =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+
+  for (auto _ : state) {
+    auto plugin = std::make_unique<Plugin>();
+    plugin->initialize(node.get());
+    bool result = plugin->loadParameters() && plugin->setMode(mode_in, mode_out);
+    benchmark::DoNotOptimize(result);
+  }
+}
+
+// Cycles through the modes with the state arriving every 4 ticks and the references every 10,
+// counting the ticks after each switch that produce no command and the step in the first one
+void BM_ModeSwitchTicksLost(benchmark::State &state) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("mode_handoff.enabled", state.range(0) != 0)});
+
+  const uint8_t control_modes[] = {ControlMode::TRAJECTORY, ControlMode::SPEED,
+                                   ControlMode::POSITION};
+  const auto mode_out =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  const auto point = makeTrajectoryPoint(0.0);
+  constexpr int kTicksPerMode = 20;
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  plugin.computeOutput(0.01, pose_out, twist_out, thrust_out);
+
+  uint64_t switches    = 0;
+  uint64_t ticks_lost  = 0;
+  double switch_step   = 0.0;
+  double last_output_x = twist_out.twist.linear.x;
+  size_t next_mode     = 0;
+
+  uint64_t allocations_start = g_allocations.load();
+  for (auto _ : state) {
+    plugin.setMode(makeMode(control_modes[next_mode], ControlMode::YAW_ANGLE,
+                            ControlMode::LOCAL_ENU_FRAME),
+                   mode_out);
+    next_mode = (next_mode + 1) % 3;
+    const auto pose            = makePose(plugin.getInputPoseFrameId(), 0.0);
+    const auto twist           = makeTwist(plugin.getInputTwistFrameId(), 0.0);
+    const auto reference_pose  = makePose(plugin.getInputPoseFrameId(), 1.0);
+    const auto reference_twist = makeTwist(plugin.getInputTwistFrameId(), 1.0);
+    bool first_command = true;
+    ++switches;
+
+    for (int tick = 0; tick < kTicksPerMode; ++tick) {
+      if (tick % 4 == 3) {
+        plugin.updateState(pose, twist);
+      }
+      if (tick % 10 == 9) {
+        plugin.updateReference(reference_twist);
+        plugin.updateReference(reference_pose);
+        plugin.updateReference(point);
+      }
+      if (plugin.computeOutput(0.01, pose_out, twist_out, thrust_out)) {
+        if (first_command) {
+          switch_step   = std::max(switch_step, std::abs(twist_out.twist.linear.x - last_output_x));
+          first_command = false;
+        }
+        last_output_x = twist_out.twist.linear.x;
+      } else {
+        ++ticks_lost;
+      }
+    }
+  }
+  setAllocationCounter(state, allocations_start);
+  state.counters["ticks_lost_per_switch"] =
+      static_cast<double>(ticks_lost) / static_cast<double>(switches);
+  state.counters["max_switch_step_x"] = switch_step;
+}
+
+}  // namespace
+
+// HOVER always runs with YAW_ANGLE, setMode overrides the requested yaw mode
+BENCHMARK_CAPTURE(BM_ComputeOutput, hover, ControlMode::HOVER, ControlMode::YAW_ANGLE, false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  position_yaw_angle,
+                  ControlMode::POSITION,
+                  ControlMode::YAW_ANGLE,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  position_yaw_speed,
+                  ControlMode::POSITION,
+                  ControlMode::YAW_SPEED,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  speed_yaw_angle,
+                  ControlMode::SPEED,
+                  ControlMode::YAW_ANGLE,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  speed_yaw_speed,
+                  ControlMode::SPEED,
+                  ControlMode::YAW_SPEED,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  speed_bypass_yaw_angle,
+                  ControlMode::SPEED,
+                  ControlMode::YAW_ANGLE,
+                  true);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  speed_bypass_yaw_speed,
+                  ControlMode::SPEED,
+                  ControlMode::YAW_SPEED,
+                  true);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  speed_in_a_plane_yaw_angle,
+                  ControlMode::SPEED_IN_A_PLANE,
+                  ControlMode::YAW_ANGLE,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  speed_in_a_plane_yaw_speed,
+                  ControlMode::SPEED_IN_A_PLANE,
+                  ControlMode::YAW_SPEED,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  trajectory_yaw_angle,
+                  ControlMode::TRAJECTORY,
+                  ControlMode::YAW_ANGLE,
+                  false);
+BENCHMARK_CAPTURE(BM_ComputeOutput,
+                  trajectory_yaw_speed,
+                  ControlMode::TRAJECTORY,
+                  ControlMode::YAW_SPEED,
+                  false);
+
+BENCHMARK(BM_ComputeOutputLatencyMetrics);
+BENCHMARK(BM_ComputeOutputTelemetry);
+BENCHMARK(BM_ComputeOutputL1Misses)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_UpdateState);
+BENCHMARK(BM_UpdateStateRotatedTwist);
+BENCHMARK(BM_UpdateStateRealtime);
+BENCHMARK(BM_UpdateStateFrameMismatch);
+BENCHMARK(BM_UpdateReferencePose);
+BENCHMARK_CAPTURE(BM_UpdateReferenceTwist, position_limits, ControlMode::POSITION);
+BENCHMARK_CAPTURE(BM_UpdateReferenceTwist, speed, ControlMode::SPEED);
+BENCHMARK(BM_UpdateReferenceTrajectory);
+BENCHMARK(BM_ParametersCallbackBulkReload);
+BENCHMARK(BM_StartupToFirstSetMode);
+BENCHMARK(BM_ModeSwitchTicksLost)->Arg(0)->Arg(1);
+
+int main(int argc, char **argv) {
+  rclcpp::init(argc, argv);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  rclcpp::shutdown();
+  return 0;
+}
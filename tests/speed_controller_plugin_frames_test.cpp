@@ -0,0 +1,181 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_plugin_frames_test.cpp
+ *  \brief      Tests for the ENU/FLU twist conversion of the speed controller plugin.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::LogEvent;
+
+class FramesTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+
+  // UAV heading north, so ENU x is FLU -y
+  static geometry_msgs::msg::PoseStamped makeNorthPose(const std::string &frame_id) {
+    geometry_msgs::msg::PoseStamped pose = makePose(frame_id, 0.0);
+    pose.pose.orientation.z              = std::sin(M_PI / 4.0);
+    pose.pose.orientation.w              = std::cos(M_PI / 4.0);
+    return pose;
+  }
+
+  static geometry_msgs::msg::TwistStamped makeForwardTwist(const std::string &frame_id) {
+    geometry_msgs::msg::TwistStamped twist;
+    twist.header.frame_id = frame_id;
+    twist.twist.linear.x  = 1.0;
+    twist.twist.linear.z  = 0.5;
+    twist.twist.angular.z = 0.2;
+    return twist;
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+TEST_F(FramesTest, EnuReferenceIsRotatedToFluOutput) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true,
+                        ControlMode::BODY_FLU_FRAME);
+  Plugin &plugin               = fixture.plugin();
+  const std::string &enu_frame = plugin.getInputPoseFrameId();
+  ASSERT_NE(plugin.getOutputTwistFrameId(), enu_frame);
+
+  plugin.updateState(makeNorthPose(enu_frame), makeTwist(enu_frame, 0.0));
+  plugin.updateReference(makeForwardTwist(enu_frame));
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  EXPECT_EQ(twist_out_.header.frame_id, plugin.getOutputTwistFrameId());
+  EXPECT_NEAR(twist_out_.twist.linear.x, 0.0, 1e-9);
+  EXPECT_NEAR(twist_out_.twist.linear.y, -1.0, 1e-9);
+  EXPECT_NEAR(twist_out_.twist.linear.z, 0.5, 1e-9);
+  EXPECT_NEAR(twist_out_.twist.angular.z, 0.2, 1e-9);
+}
+
+TEST_F(FramesTest, FluReferenceIsRotatedToEnuOutput) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true,
+                        ControlMode::LOCAL_ENU_FRAME);
+  PluginFixture flu_fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true,
+                            ControlMode::BODY_FLU_FRAME);
+  Plugin &plugin               = fixture.plugin();
+  const std::string &enu_frame = plugin.getInputPoseFrameId();
+  const std::string flu_frame  = flu_fixture.plugin().getOutputTwistFrameId();
+
+  plugin.updateState(makeNorthPose(enu_frame), makeTwist(flu_frame, 0.0));
+  plugin.updateReference(makeForwardTwist(flu_frame));
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  EXPECT_EQ(twist_out_.header.frame_id, enu_frame);
+  EXPECT_NEAR(twist_out_.twist.linear.x, 0.0, 1e-9);
+  EXPECT_NEAR(twist_out_.twist.linear.y, 1.0, 1e-9);
+  EXPECT_NEAR(twist_out_.twist.linear.z, 0.5, 1e-9);
+}
+
+TEST_F(FramesTest, StateInDesiredFramesIsNotRotated) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, false,
+                        ControlMode::BODY_FLU_FRAME);
+  PluginFixture reference(ControlMode::SPEED, ControlMode::YAW_SPEED, false,
+                          ControlMode::BODY_FLU_FRAME);
+  Plugin &plugin = fixture.plugin();
+
+  // Same FLU state with and without a heading must give the same command
+  plugin.updateState(makeNorthPose(plugin.getInputPoseFrameId()), fixture.twist());
+  geometry_msgs::msg::TwistStamped reference_out;
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  ASSERT_TRUE(reference.plugin().computeOutput(0.01, pose_out_, reference_out, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, reference_out.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.y, reference_out.twist.linear.y);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.z, reference_out.twist.linear.z);
+}
+
+TEST_F(FramesTest, UnrelatedFramesWithoutTransformAreRejected) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true,
+                        ControlMode::BODY_FLU_FRAME);
+  Plugin &plugin = fixture.plugin();
+
+  ASSERT_TRUE(plugin.setMode(
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME),
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::BODY_FLU_FRAME)));
+  plugin.updateReference(makeForwardTwist(plugin.getInputTwistFrameId()));
+  plugin.updateState(fixture.pose(), makeTwist("unknown_frame", 0.0));
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_EQ(plugin.getEventLog().count(LogEvent::TWIST_CONVERSION), 1u);
+}
+
+TEST_F(FramesTest, PoseFrameMismatchesAreCountedWithoutBlocking) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, false);
+  Plugin &plugin = fixture.plugin();
+
+  // A misconfigured odometry source: every state is rejected, only the first one is logged
+  const geometry_msgs::msg::PoseStamped pose = makePose("map", 0.0);
+  for (int i = 0; i < 200; i++) {
+    plugin.updateState(pose, fixture.twist());
+  }
+  EXPECT_EQ(plugin.getEventLog().count(LogEvent::POSE_FRAME_MISMATCH), 200u);
+  EXPECT_EQ(plugin.getEventLog().dropped(), 0u);
+}
+
+TEST_F(FramesTest, PluginsShareTheTfHandlerOfTheirNode) {
+  auto node       = std::make_shared<as2::Node>("speed_controller_test");
+  auto other_node = std::make_shared<as2::Node>("speed_controller_test", "other");
+
+  Plugin first;
+  Plugin second;
+  Plugin other;
+  first.initialize(node.get());
+  second.initialize(node.get());
+  other.initialize(other_node.get());
+  ASSERT_NE(first.getTfHandler(), nullptr);
+  EXPECT_EQ(first.getTfHandler(), second.getTfHandler());
+  EXPECT_NE(first.getTfHandler(), other.getTfHandler());
+
+  // An injected handler is used as is, e.g. one for the plugins of several nodes
+  Plugin injected;
+  injected.setTfHandler(other.getTfHandler());
+  injected.initialize(node.get());
+  EXPECT_EQ(injected.getTfHandler(), other.getTfHandler());
+}
+
+}  // namespace
@@ -0,0 +1,283 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_plugin_pipeline_test.cpp
+ *  \brief      Tests for the control-mode pipeline selection of the speed controller plugin.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+
+class PipelineTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+TEST_F(PipelineTest, BypassChangeReselectsPipeline) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin       = fixture.plugin();
+  const auto ref_twist  = makeTwist(plugin.getInputTwistFrameId(), 1.0);
+
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, ref_twist.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.y, ref_twist.twist.linear.y);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.z, ref_twist.twist.linear.z);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, ref_twist.twist.angular.z);
+
+  plugin.parametersCallback({rclcpp::Parameter("use_bypass", false)});
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_NE(twist_out_.twist.linear.x, ref_twist.twist.linear.x);
+
+  plugin.parametersCallback({rclcpp::Parameter("use_bypass", true)});
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, ref_twist.twist.linear.x);
+}
+
+TEST_F(PipelineTest, HoverRunsPositionControlLaw) {
+  PluginFixture hover(ControlMode::HOVER, ControlMode::YAW_ANGLE, false);
+  PluginFixture position(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+
+  // Hover holds the current state, so drive both plugins to the same reference
+  position.plugin().updateReference(makePose(position.plugin().getInputPoseFrameId(), 0.0));
+
+  geometry_msgs::msg::TwistStamped position_out;
+  ASSERT_TRUE(hover.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  ASSERT_TRUE(position.plugin().computeOutput(0.01, pose_out_, position_out, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, position_out.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.y, position_out.twist.linear.y);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.z, position_out.twist.linear.z);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, position_out.twist.angular.z);
+}
+
+TEST_F(PipelineTest, UnsupportedModesFailToCompute) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+
+  const ControlMode mode_out =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  for (const auto &mode_in :
+       {makeMode(ControlMode::ACRO, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME),
+        makeMode(ControlMode::SPEED, 3, ControlMode::LOCAL_ENU_FRAME)}) {
+    ASSERT_TRUE(plugin.setMode(mode_in, mode_out));
+    plugin.updateState(fixture.pose(), fixture.twist());
+    plugin.updateReference(makeTwist(plugin.getInputTwistFrameId(), 1.0));
+    EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  }
+}
+
+TEST_F(PipelineTest, RateDividersHoldSkippedLoops) {
+  PluginFixture divided(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  PluginFixture translation(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  PluginFixture yaw(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  divided.plugin().parametersCallback({rclcpp::Parameter("position_control.rate_divider", 2),
+                                       rclcpp::Parameter("yaw_control.rate_divider", 3)});
+
+  // Translation runs on ticks 0 and 2, yaw on ticks 0 and 3, each with the dt since its last run
+  std::vector<geometry_msgs::msg::TwistStamped> outputs(4);
+  for (auto &output : outputs) {
+    ASSERT_TRUE(divided.plugin().computeOutput(0.01, pose_out_, output, thrust_out_));
+  }
+
+  geometry_msgs::msg::TwistStamped expected;
+  ASSERT_TRUE(translation.plugin().computeOutput(0.01, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(outputs[0].twist.linear.x, expected.twist.linear.x);
+  EXPECT_DOUBLE_EQ(outputs[1].twist.linear.x, expected.twist.linear.x);
+  ASSERT_TRUE(translation.plugin().computeOutput(0.02, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(outputs[2].twist.linear.x, expected.twist.linear.x);
+  EXPECT_DOUBLE_EQ(outputs[2].twist.linear.z, expected.twist.linear.z);
+  EXPECT_DOUBLE_EQ(outputs[3].twist.linear.x, expected.twist.linear.x);
+  EXPECT_NE(outputs[2].twist.linear.x, outputs[0].twist.linear.x);
+
+  ASSERT_TRUE(yaw.plugin().computeOutput(0.01, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(outputs[0].twist.angular.z, expected.twist.angular.z);
+  EXPECT_DOUBLE_EQ(outputs[1].twist.angular.z, expected.twist.angular.z);
+  EXPECT_DOUBLE_EQ(outputs[2].twist.angular.z, expected.twist.angular.z);
+  ASSERT_TRUE(yaw.plugin().computeOutput(0.03, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(outputs[3].twist.angular.z, expected.twist.angular.z);
+}
+
+TEST_F(PipelineTest, ModeChangeRunsDividedLoopsImmediately) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("position_control.rate_divider", 10),
+                             rclcpp::Parameter("yaw_control.rate_divider", 10)});
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  const ControlMode mode =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  ASSERT_TRUE(plugin.setMode(mode, mode));
+  plugin.updateState(fixture.pose(), fixture.twist());
+  auto ref_twist            = makeTwist(plugin.getInputTwistFrameId(), 2.0);
+  ref_twist.twist.angular.z = 0.7;
+  plugin.updateReference(ref_twist);
+
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, ref_twist.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, ref_twist.twist.angular.z);
+}
+
+TEST_F(PipelineTest, StateTriggeredTicksHoldUntilNewState) {
+  PluginFixture triggered(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  PluginFixture timed(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  triggered.plugin().parametersCallback({rclcpp::Parameter("state_triggered", true)});
+
+  auto pose             = triggered.pose();
+  auto twist            = triggered.twist();
+  pose.header.stamp.sec = 10;
+  twist.header.stamp    = pose.header.stamp;
+  triggered.plugin().updateState(pose, twist);
+  timed.plugin().updateState(pose, twist);
+
+  // The first tick has no previous state stamp and uses the timer dt
+  geometry_msgs::msg::TwistStamped expected;
+  ASSERT_TRUE(triggered.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  ASSERT_TRUE(timed.plugin().computeOutput(0.01, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, expected.twist.linear.x);
+
+  // Without a new state the PIDs are not stepped again
+  for (int i = 0; i < 3; i++) {
+    geometry_msgs::msg::TwistStamped held;
+    ASSERT_TRUE(triggered.plugin().computeOutput(0.01, pose_out_, held, thrust_out_));
+    EXPECT_DOUBLE_EQ(held.twist.linear.x, expected.twist.linear.x);
+    EXPECT_DOUBLE_EQ(held.twist.angular.z, expected.twist.angular.z);
+  }
+
+  pose.pose.position.x += 0.1;
+
+  pose.header.stamp.nanosec = 50000000;
+  twist.header.stamp        = pose.header.stamp;
+  triggered.plugin().updateState(pose, twist);
+  timed.plugin().updateState(pose, twist);
+  ASSERT_TRUE(triggered.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  ASSERT_TRUE(timed.plugin().computeOutput(0.05, pose_out_, expected, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, expected.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, expected.twist.angular.z);
+}
+
+TEST_F(PipelineTest, StateTriggeredModeIsOptIn) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+
+  geometry_msgs::msg::TwistStamped first;
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, first, thrust_out_));
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  // The integral term keeps growing on every timer tick
+  EXPECT_NE(twist_out_.twist.linear.x, first.twist.linear.x);
+}
+
+TEST_F(PipelineTest, ModeChangeWaitsForInputsWithoutHandoff) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+
+  ASSERT_TRUE(plugin.setMode(makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                      ControlMode::LOCAL_ENU_FRAME),
+                             makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                      ControlMode::LOCAL_ENU_FRAME)));
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+}
+
+TEST_F(PipelineTest, ModeHandoffKeepsTheCommandContinuous) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("mode_handoff.enabled", true)});
+
+  geometry_msgs::msg::TwistStamped previous;
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, previous, thrust_out_));
+
+  ASSERT_TRUE(plugin.setMode(makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                      ControlMode::LOCAL_ENU_FRAME),
+                             makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                      ControlMode::LOCAL_ENU_FRAME)));
+
+  // The first tick after the switch repeats the outgoing command
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.x, previous.twist.linear.x);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.y, previous.twist.linear.y);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.z, previous.twist.linear.z);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.angular.z, previous.twist.angular.z);
+
+  // Then it moves towards the incoming controller without steps
+  for (int i = 0; i < 200; ++i) {
+    previous = twist_out_;
+    ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+    EXPECT_NEAR(twist_out_.twist.linear.x, previous.twist.linear.x, 0.05);
+    EXPECT_NEAR(twist_out_.twist.linear.y, previous.twist.linear.y, 0.05);
+    EXPECT_NEAR(twist_out_.twist.linear.z, previous.twist.linear.z, 0.05);
+  }
+}
+
+TEST_F(PipelineTest, ModeHandoffRotatesTheCommandToTheNewFrame) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, true,
+                        ControlMode::BODY_FLU_FRAME);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback({rclcpp::Parameter("mode_handoff.enabled", true)});
+
+  geometry_msgs::msg::TwistStamped previous;
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, previous, thrust_out_));
+  ASSERT_EQ(previous.header.frame_id, plugin.getInputTwistFrameId());
+
+  ASSERT_TRUE(plugin.setMode(makeMode(ControlMode::POSITION, ControlMode::YAW_ANGLE,
+                                      ControlMode::LOCAL_ENU_FRAME),
+                             makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                      ControlMode::LOCAL_ENU_FRAME)));
+  ASSERT_TRUE(plugin.computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_EQ(twist_out_.header.frame_id, plugin.getInputTwistFrameId());
+  EXPECT_NE(twist_out_.header.frame_id, previous.header.frame_id);
+
+  // Same horizontal speed, same vertical speed, rotated by the yaw of the fixture pose
+  const double yaw = 2.0 * std::atan2(0.1, 0.995);
+  EXPECT_NEAR(twist_out_.twist.linear.x,
+              std::cos(yaw) * previous.twist.linear.x - std::sin(yaw) * previous.twist.linear.y,
+              1e-3);
+  EXPECT_NEAR(twist_out_.twist.linear.y,
+              std::sin(yaw) * previous.twist.linear.x + std::cos(yaw) * previous.twist.linear.y,
+              1e-3);
+  EXPECT_DOUBLE_EQ(twist_out_.twist.linear.z, previous.twist.linear.z);
+}
+
+}  // namespace
@@ -0,0 +1,201 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_plugin_test_utils.hpp
+ *  \brief      Shared helpers for the speed controller plugin tests and benchmarks.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef __SP_PLUGIN_TEST_UTILS_H__
+#define __SP_PLUGIN_TEST_UTILS_H__
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "as2_core/node.hpp"
+#include "speed_controller_plugin.hpp"
+
+namespace speed_controller_test_utils {
+
+using as2_msgs::msg::ControlMode;
+using controller_plugin_speed_controller::Plugin;
+
+inline std::vector<rclcpp::Parameter> getDefaultParameters(bool use_bypass) {
+  std::vector<rclcpp::Parameter> params = {
+      rclcpp::Parameter("proportional_limitation", true),
+      rclcpp::Parameter("use_bypass", use_bypass),
+      rclcpp::Parameter("realtime.enabled", false),
+      rclcpp::Parameter("realtime.priority", 0),
+      rclcpp::Parameter("realtime.cpu", -1),
+      rclcpp::Parameter("realtime.period", 0.01),
+      rclcpp::Parameter("realtime.lock_memory", false),
+      rclcpp::Parameter("staged_gains", false),
+      rclcpp::Parameter("latency_metrics.enabled", false),
+      rclcpp::Parameter("latency_metrics.period", 1.0),
+      rclcpp::Parameter("position_control.rate_divider", 1),
+      rclcpp::Parameter("yaw_control.rate_divider", 1),
+      rclcpp::Parameter("state_triggered", false),
+      rclcpp::Parameter("state_prediction.enabled", false),
+      rclcpp::Parameter("state_prediction.time_constant", 0.0),
+      rclcpp::Parameter("mode_handoff.enabled", false),
+      rclcpp::Parameter("mode_handoff.time_constant", 0.2),
+      rclcpp::Parameter("dt_conditioning.enabled", false),
+      rclcpp::Parameter("dt_conditioning.min_dt", 0.001),
+      rclcpp::Parameter("dt_conditioning.max_dt", 0.05),
+      rclcpp::Parameter("dt_conditioning.outlier_ratio", 3.0),
+      rclcpp::Parameter("dt_conditioning.nominal_dt", 0.01),
+      rclcpp::Parameter("dt_conditioning.exact_discretization", false),
+      rclcpp::Parameter("telemetry.enabled", false),
+      rclcpp::Parameter("telemetry.file", "speed_controller_telemetry.bin"),
+      rclcpp::Parameter("trajectory_feedforward.look_ahead", 0.0),
+      rclcpp::Parameter("trajectory_feedforward.yaw_rate", false),
+  };
+  const std::vector<std::string> controllers_3d = {"position_control", "speed_control",
+                                                   "trajectory_control"};
+  for (const auto &controller : controllers_3d) {
+    params.emplace_back(controller + ".reset_integral", false);
+    params.emplace_back(controller + ".antiwindup_cte", 5.0);
+    params.emplace_back(controller + ".alpha", 0.1);
+    for (const std::string axis : {"x", "y", "z"}) {
+      params.emplace_back(controller + ".kp." + axis, 1.0);
+      params.emplace_back(controller + ".ki." + axis, 0.01);
+      params.emplace_back(controller + ".kd." + axis, 0.1);
+    }
+  }
+  params.emplace_back("speed_in_a_plane_control.reset_integral", false);
+  params.emplace_back("speed_in_a_plane_control.antiwindup_cte", 5.0);
+  params.emplace_back("speed_in_a_plane_control.alpha", 0.1);
+  params.emplace_back("speed_in_a_plane_control.height.kp", 1.0);
+  params.emplace_back("speed_in_a_plane_control.height.ki", 0.01);
+  params.emplace_back("speed_in_a_plane_control.height.kd", 0.1);
+  for (const std::string axis : {"x", "y"}) {
+    params.emplace_back("speed_in_a_plane_control.speed.kp." + axis, 1.0);
+    params.emplace_back("speed_in_a_plane_control.speed.ki." + axis, 0.01);
+    params.emplace_back("speed_in_a_plane_control.speed.kd." + axis, 0.1);
+  }
+  params.emplace_back("yaw_control.reset_integral", false);
+  params.emplace_back("yaw_control.antiwindup_cte", 5.0);
+  params.emplace_back("yaw_control.alpha", 0.1);
+  params.emplace_back("yaw_control.kp", 1.0);
+  params.emplace_back("yaw_control.ki", 0.01);
+  params.emplace_back("yaw_control.kd", 0.1);
+  return params;
+}
+
+inline ControlMode makeMode(uint8_t control_mode, uint8_t yaw_mode, uint8_t reference_frame) {
+  ControlMode mode;
+  mode.control_mode    = control_mode;
+  mode.yaw_mode        = yaw_mode;
+  mode.reference_frame = reference_frame;
+  return mode;
+}
+
+inline geometry_msgs::msg::PoseStamped makePose(const std::string &frame_id, double offset) {
+  geometry_msgs::msg::PoseStamped pose;
+  pose.header.frame_id    = frame_id;
+  pose.pose.position.x    = 1.0 + offset;
+  pose.pose.position.y    = -2.0 + offset;
+  pose.pose.position.z    = 3.0 + offset;
+  pose.pose.orientation.z = 0.1;
+  pose.pose.orientation.w = 0.995;
+  return pose;
+}
+
+inline geometry_msgs::msg::TwistStamped makeTwist(const std::string &frame_id, double offset) {
+  geometry_msgs::msg::TwistStamped twist;
+  twist.header.frame_id = frame_id;
+  twist.twist.linear.x  = 0.5 + offset;
+  twist.twist.linear.y  = -0.5 + offset;
+  twist.twist.linear.z  = 0.2 + offset;
+  twist.twist.angular.z = 0.1;
+  return twist;
+}
+
+inline as2_msgs::msg::TrajectoryPoint makeTrajectoryPoint(double offset) {
+  as2_msgs::msg::TrajectoryPoint point;
+  point.position.x = 2.0 + offset;
+  point.position.y = 1.0 + offset;
+  point.position.z = 1.5 + offset;
+  point.twist.x    = 0.3;
+  point.twist.y    = 0.2;
+  point.twist.z    = 0.1;
+  point.yaw_angle  = 0.5;
+  return point;
+}
+
+/**
+ * @brief Plugin instance attached to its own node, configured with all parameters and with
+ * valid state and references for the requested mode
+ */
+class PluginFixture {
+public:
+  PluginFixture(uint8_t control_mode,
+                uint8_t yaw_mode,
+                bool use_bypass,
+                uint8_t output_reference_frame = ControlMode::LOCAL_ENU_FRAME,
+                const std::string &node_namespace = "") {
+    node_ = std::make_shared<as2::Node>("speed_controller_test", node_namespace);
+    plugin_.initialize(node_.get());
+    plugin_.parametersCallback(getDefaultParameters(use_bypass));
+
+    ControlMode mode_in  = makeMode(control_mode, yaw_mode, ControlMode::LOCAL_ENU_FRAME);
+    ControlMode mode_out = makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED,
+                                    output_reference_frame);
+    if (!plugin_.setMode(mode_in, mode_out)) {
+      throw std::runtime_error("Could not set control mode");
+    }
+
+    pose_  = makePose(plugin_.getInputPoseFrameId(), 0.0);
+    twist_ = makeTwist(plugin_.getInputTwistFrameId(), 0.0);
+    plugin_.updateState(pose_, twist_);
+
+    // Speed limits are taken from the twist reference in POSITION mode
+    plugin_.updateReference(makeTwist(plugin_.getInputTwistFrameId(), 1.0));
+    plugin_.updateReference(makePose(plugin_.getInputPoseFrameId(), 1.0));
+    plugin_.updateReference(makeTrajectoryPoint(0.0));
+  }
+
+  Plugin &plugin() { return plugin_; }
+  geometry_msgs::msg::PoseStamped &pose() { return pose_; }
+  geometry_msgs::msg::TwistStamped &twist() { return twist_; }
+
+private:
+  std::shared_ptr<as2::Node> node_;
+  Plugin plugin_;
+  geometry_msgs::msg::PoseStamped pose_;
+  geometry_msgs::msg::TwistStamped twist_;
+};
+
+}  // namespace speed_controller_test_utils
+
+#endif
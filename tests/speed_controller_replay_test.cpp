@@ -0,0 +1,235 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_replay_test.cpp
+ *  \brief      Tests for the offline replay of recorded control streams.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "speed_controller_plugin_test_utils.hpp"
+#include "speed_controller_replay.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using namespace controller_plugin_speed_controller::replay;
+
+TraceRecord makeRecord(TraceRecordType type, double time, std::vector<double> data) {
+  TraceRecord record;
+  record.type = type;
+  record.time = time;
+  std::copy(data.begin(), data.end(), record.data);
+  return record;
+}
+
+// Trajectory tracking from a hovering state: 2 s of a circle, references at 10 Hz, ticks at 100 Hz
+std::vector<TraceRecord> makeTrajectoryTrace() {
+  std::vector<TraceRecord> records;
+  records.push_back(makeRecord(TraceRecordType::MODE, 1.0,
+                               {ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE,
+                                ControlMode::LOCAL_ENU_FRAME, ControlMode::LOCAL_ENU_FRAME}));
+  for (int i = 0; i < 200; i++) {
+    const double time = 1.0 + 0.01 * i;
+    if (i % 10 == 0) {
+      records.push_back(makeRecord(
+          TraceRecordType::TRAJECTORY_REFERENCE, time,
+          {std::cos(time), std::sin(time), 1.0, -std::sin(time), std::cos(time), 0.0,
+           -std::cos(time), -std::sin(time), 0.0, time}));
+    }
+    const double lag = 0.2;
+    records.push_back(makeRecord(TraceRecordType::STATE, time,
+                                 {std::cos(time - lag), std::sin(time - lag), 0.9, 0.0, 0.0,
+                                  std::sin(0.5 * (time - lag)), std::cos(0.5 * (time - lag)),
+                                  -std::sin(time - lag), std::cos(time - lag), 0.0, 1.0}));
+    records.push_back(makeRecord(TraceRecordType::TICK, time, {0.01}));
+  }
+  return records;
+}
+
+ReplayCase makeCase(const std::string &name, double kp) {
+  ReplayCase replay_case{name, getDefaultParameters(false)};
+  for (const std::string axis : {"x", "y", "z"}) {
+    replay_case.parameters.emplace_back("trajectory_control.kp." + axis, kp);
+  }
+  return replay_case;
+}
+
+void expectEqualOutputs(const ReplayOutput &a, const ReplayOutput &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a.time[i], b.time[i]) << i;
+    EXPECT_EQ(a.valid[i], b.valid[i]) << i;
+    EXPECT_EQ(a.linear_x[i], b.linear_x[i]) << i;
+    EXPECT_EQ(a.linear_y[i], b.linear_y[i]) << i;
+    EXPECT_EQ(a.linear_z[i], b.linear_z[i]) << i;
+    EXPECT_EQ(a.yaw_rate[i], b.yaw_rate[i]) << i;
+  }
+}
+
+TEST(ReplayTest, TraceFilesRoundTrip) {
+  const std::vector<TraceRecord> records = makeTrajectoryTrace();
+  const std::string path                 = ::testing::TempDir() + "replay_round_trip.trace";
+  writeTrace(path, records);
+
+  const Trace trace = Trace::open(path);
+  ASSERT_EQ(trace.size(), records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(trace.begin()[i].type, records[i].type);
+    EXPECT_EQ(trace.begin()[i].time, records[i].time);
+    EXPECT_EQ(trace.begin()[i].data[3], records[i].data[3]);
+  }
+
+  expectEqualOutputs(replay(trace, makeCase("file", 1.0)),
+                     replay(Trace(records), makeCase("memory", 1.0)));
+  std::remove(path.c_str());
+}
+
+TEST(ReplayTest, InvalidTraceFilesThrow) {
+  const std::string path = ::testing::TempDir() + "replay_invalid.trace";
+  std::ofstream(path) << "not a trace, but long enough for a header";
+  EXPECT_THROW(Trace::open(path), std::runtime_error);
+  std::remove(path.c_str());
+  EXPECT_THROW(Trace::open(path), std::runtime_error);
+}
+
+TEST(ReplayTest, ReplayIsDeterministic) {
+  const Trace trace(makeTrajectoryTrace());
+  const ReplayOutput first  = replay(trace, makeCase("first", 1.0));
+  const ReplayOutput second = replay(trace, makeCase("second", 1.0));
+
+  ASSERT_EQ(first.size(), 200u);
+  EXPECT_TRUE(first.valid.back());
+  EXPECT_NE(first.linear_x.back(), 0.0);
+  expectEqualOutputs(first, second);
+}
+
+TEST(ReplayTest, ParallelReplayMatchesSerialReplay) {
+  const Trace trace(makeTrajectoryTrace());
+  std::vector<ReplayCase> cases;
+  for (int i = 0; i < 8; i++) {
+    cases.push_back(makeCase("kp_" + std::to_string(i), 0.5 + 0.25 * i));
+  }
+
+  const std::vector<ReplayOutput> outputs = replay(trace, cases, 4);
+  ASSERT_EQ(outputs.size(), cases.size());
+  for (size_t i = 0; i < cases.size(); i++) {
+    EXPECT_EQ(outputs[i].name, cases[i].name);
+    expectEqualOutputs(outputs[i], replay(trace, cases[i]));
+  }
+  EXPECT_NE(outputs.front().linear_x.back(), outputs.back().linear_x.back());
+}
+
+TEST(ReplayTest, ReplayMatchesTheLivePlugin) {
+  PluginFixture fixture(ControlMode::SPEED, ControlMode::YAW_SPEED, false);
+  Plugin &plugin = fixture.plugin();
+  plugin.parametersCallback(makeCase("live", 1.0).parameters);
+
+  const std::vector<TraceRecord> records = {
+      makeRecord(TraceRecordType::MODE, 1.0,
+                 {ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME,
+                  ControlMode::LOCAL_ENU_FRAME}),
+      makeRecord(TraceRecordType::STATE, 1.0, {1.0, -2.0, 3.0, 0.0, 0.0, 0.1, 0.995, 0.5, -0.5,
+                                               0.2, 0.1}),
+      makeRecord(TraceRecordType::TWIST_REFERENCE, 1.0, {1.5, 0.5, 1.2, 0.1}),
+      makeRecord(TraceRecordType::TICK, 1.0, {0.01}),
+      makeRecord(TraceRecordType::TICK, 1.01, {0.01}),
+  };
+  const ReplayOutput output = replay(Trace(records), makeCase("replay", 1.0));
+
+  geometry_msgs::msg::PoseStamped pose = makePose(plugin.getInputPoseFrameId(), 0.0);
+  pose.header.stamp.sec                = 1;
+  geometry_msgs::msg::TwistStamped twist = makeTwist(plugin.getInputTwistFrameId(), 0.0);
+  twist.header.stamp                     = pose.header.stamp;
+  plugin.updateState(pose, twist);
+  plugin.updateReference(makeTwist(plugin.getInputTwistFrameId(), 1.0));
+
+  ASSERT_EQ(output.size(), 2u);
+  for (size_t i = 0; i < output.size(); i++) {
+    geometry_msgs::msg::PoseStamped pose_out;
+    geometry_msgs::msg::TwistStamped twist_out;
+    as2_msgs::msg::Thrust thrust_out;
+    ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+    EXPECT_TRUE(output.valid[i]);
+    EXPECT_EQ(output.linear_x[i], twist_out.twist.linear.x);
+    EXPECT_EQ(output.linear_y[i], twist_out.twist.linear.y);
+    EXPECT_EQ(output.linear_z[i], twist_out.twist.linear.z);
+    EXPECT_EQ(output.yaw_rate[i], twist_out.twist.angular.z);
+  }
+}
+
+TEST(ReplayTest, PredictionUsesTheTraceTime) {
+  // The state is 30 ms old at the tick in trace time, the wall clock is seconds or years ahead
+  const double latency = 0.03;
+  auto makeRecords     = [latency](double _displacement) {
+    const double velocity[3] = {0.5, -0.5, 0.2};
+    return std::vector<TraceRecord>{
+        makeRecord(TraceRecordType::MODE, 1.0,
+                   {ControlMode::POSITION, ControlMode::YAW_ANGLE, ControlMode::LOCAL_ENU_FRAME,
+                    ControlMode::LOCAL_ENU_FRAME}),
+        makeRecord(TraceRecordType::POSE_REFERENCE, 1.0, {2.0, 1.0, 3.0, 0.0, 0.0, 0.0, 1.0}),
+        makeRecord(TraceRecordType::STATE, 1.0,
+                   {1.0 + velocity[0] * _displacement, -2.0 + velocity[1] * _displacement,
+                    3.0 + velocity[2] * _displacement, 0.0, 0.0, 0.1, 0.995, velocity[0],
+                    velocity[1], velocity[2], 0.1}),
+        makeRecord(TraceRecordType::TICK, 1.0 + latency, {0.01}),
+    };
+  };
+
+  ReplayCase predicted_case = makeCase("predicted", 1.0);
+  predicted_case.parameters.emplace_back("state_prediction.enabled", true);
+  Replayer predicted(predicted_case);
+  ReplayOutput predicted_output;
+  for (const TraceRecord &record : makeRecords(0.0)) {
+    predicted.apply(record, predicted_output);
+  }
+  EXPECT_NEAR(predicted.plugin().getInputLatency(), latency, 1e-9);
+
+  // Without prediction, the state extrapolated by hand over the same latency
+  const ReplayOutput expected = replay(Trace(makeRecords(latency)), makeCase("expected", 1.0));
+  ASSERT_EQ(predicted_output.size(), 1u);
+  ASSERT_EQ(expected.size(), 1u);
+  EXPECT_TRUE(predicted_output.valid[0]);
+  EXPECT_NEAR(predicted_output.linear_x[0], expected.linear_x[0], 1e-9);
+  EXPECT_NEAR(predicted_output.linear_y[0], expected.linear_y[0], 1e-9);
+  EXPECT_NEAR(predicted_output.linear_z[0], expected.linear_z[0], 1e-9);
+
+  expectEqualOutputs(predicted_output, replay(Trace(makeRecords(0.0)), predicted_case));
+}
+
+}  // namespace
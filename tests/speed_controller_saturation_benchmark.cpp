@@ -0,0 +1,134 @@
+/*!*******************************************************************************************
+ *  \file       tests/speed_controller_saturation_benchmark.cpp
+ *  \brief      Benchmarks of the branch-free speed saturation kernel.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+#include "pid_controller/PID_3D.hpp"
+#include "speed_controller_batch.hpp"
+#include "speed_controller_saturation.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller;
+
+constexpr size_t kNumCommands = 1024;
+
+// Shuffled commands, range(0) percent of them above the limits, half with proportional
+// limitation, so branchy code can not predict which path each vehicle takes
+struct Commands {
+  using Array = SpeedControllerBatch::Array;
+
+  std::array<Array, 3> command;
+  std::array<Array, 3> limit;
+  Array proportional;
+  Array active;
+
+  explicit Commands(int _saturated_percent) {
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<double> inside(-0.9, 0.9);
+    std::uniform_real_distribution<double> outside(1.1, 3.0);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::bernoulli_distribution coin(0.5);
+
+    for (size_t axis = 0; axis < 3; axis++) {
+      command[axis].resize(kNumCommands);
+      limit[axis].assign(kNumCommands, 1.0);
+    }
+    proportional.resize(kNumCommands);
+    active.assign(kNumCommands, 1.0);
+    for (size_t i = 0; i < kNumCommands; i++) {
+      const bool saturated = percent(generator) < _saturated_percent;
+      for (size_t axis = 0; axis < 3; axis++) {
+        command[axis][i] = inside(generator);
+      }
+      if (saturated) {
+        command[coin(generator) ? 0 : 1][i] = (coin(generator) ? 1.0 : -1.0) * outside(generator);
+      }
+      proportional[i] = coin(generator) ? 1.0 : 0.0;
+    }
+  }
+};
+
+// The commands are restored before each pass, that copy is part of both benchmarks
+void BM_SaturateCommands(benchmark::State &state) {
+  const Commands commands(static_cast<int>(state.range(0)));
+  std::array<Commands::Array, 3> work = commands.command;
+
+  for (auto _ : state) {
+    for (size_t axis = 0; axis < 3; axis++) {
+      std::copy(commands.command[axis].begin(), commands.command[axis].end(), work[axis].begin());
+    }
+    saturateCommands(work[0].data(), work[1].data(), work[2].data(), commands.limit[0].data(),
+                     commands.limit[1].data(), commands.limit[2].data(),
+                     commands.proportional.data(), commands.active.data(), kNumCommands);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kNumCommands);
+}
+
+void BM_SaturateOutputPerVehicle(benchmark::State &state) {
+  const Commands commands(static_cast<int>(state.range(0)));
+  std::array<Commands::Array, 3> work = commands.command;
+  pid_controller::PIDController3D pid;
+
+  for (auto _ : state) {
+    for (size_t axis = 0; axis < 3; axis++) {
+      std::copy(commands.command[axis].begin(), commands.command[axis].end(), work[axis].begin());
+    }
+    for (size_t i = 0; i < kNumCommands; i++) {
+      const Eigen::Vector3d limits(commands.limit[0][i], commands.limit[1][i],
+                                   commands.limit[2][i]);
+      const Eigen::Vector3d saturated = pid.saturateOutput(
+          Eigen::Vector3d(work[0][i], work[1][i], work[2][i]), limits,
+          commands.proportional[i] > 0.0);
+      work[0][i] = saturated.x();
+      work[1][i] = saturated.y();
+      work[2][i] = saturated.z();
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kNumCommands);
+}
+
+}  // namespace
+
+BENCHMARK(BM_SaturateCommands)->Arg(0)->Arg(50)->Arg(100);
+BENCHMARK(BM_SaturateOutputPerVehicle)->Arg(0)->Arg(50)->Arg(100);
+
+BENCHMARK_MAIN();
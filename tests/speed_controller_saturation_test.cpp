@@ -0,0 +1,128 @@
+/*!*******************************************************************************************
+ *  \file       tests/speed_controller_saturation_test.cpp
+ *  \brief      Tests of the branch-free speed saturation kernel.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "pid_controller/PID_3D.hpp"
+#include "speed_controller_saturation.hpp"
+
+namespace {
+
+using namespace controller_plugin_speed_controller;
+
+// Commands around the limits, with some unlimited axes
+struct RandomCase {
+  Eigen::Vector3d command;
+  Eigen::Vector3d limits;
+};
+
+std::vector<RandomCase> makeCases(size_t _count) {
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> command(-3.0, 3.0);
+  std::uniform_real_distribution<double> limit(0.5, 2.0);
+  std::bernoulli_distribution unlimited(0.2);
+
+  std::vector<RandomCase> cases(_count);
+  for (auto &random_case : cases) {
+    for (int i = 0; i < 3; i++) {
+      random_case.command[i] = command(generator);
+      random_case.limits[i]  = unlimited(generator) ? 0.0 : limit(generator);
+    }
+  }
+  return cases;
+}
+
+TEST(SaturationTest, MatchesThePidSaturation) {
+  pid_controller::PIDController3D pid;
+  for (const bool proportional : {false, true}) {
+    for (const auto &random_case : makeCases(1000)) {
+      const Eigen::Vector3d expected =
+          pid.saturateOutput(random_case.command, random_case.limits, proportional);
+      Eigen::Vector3d command = random_case.command;
+      saturateCommand(command, random_case.limits, proportional);
+      for (int i = 0; i < 3; i++) {
+        EXPECT_DOUBLE_EQ(command[i], expected[i]);
+      }
+    }
+  }
+}
+
+TEST(SaturationTest, KeepsZeroAndUnlimitedCommands) {
+  Eigen::Vector3d command = Eigen::Vector3d::Zero();
+  saturateCommand(command, Eigen::Vector3d(1.0, 1.0, 1.0), true);
+  EXPECT_EQ(command, Eigen::Vector3d::Zero());
+
+  command = Eigen::Vector3d(100.0, -50.0, 3.0);
+  saturateCommand(command, Eigen::Vector3d::Zero(), true);
+  EXPECT_EQ(command, Eigen::Vector3d(100.0, -50.0, 3.0));
+  saturateCommand(command, Eigen::Vector3d::Zero(), false);
+  EXPECT_EQ(command, Eigen::Vector3d(100.0, -50.0, 3.0));
+}
+
+TEST(SaturationTest, ColumnsMatchTheSingleVehicleKernel) {
+  const std::vector<RandomCase> cases = makeCases(37);
+  const size_t count                  = cases.size();
+  std::vector<double> x(count), y(count), z(count);
+  std::vector<double> limit_x(count), limit_y(count), limit_z(count);
+  std::vector<double> proportional(count), active(count);
+  for (size_t i = 0; i < count; i++) {
+    x[i]            = cases[i].command.x();
+    y[i]            = cases[i].command.y();
+    z[i]            = cases[i].command.z();
+    limit_x[i]      = saturation::effectiveLimit(cases[i].limits.x());
+    limit_y[i]      = saturation::effectiveLimit(cases[i].limits.y());
+    limit_z[i]      = saturation::effectiveLimit(cases[i].limits.z());
+    proportional[i] = i % 2 == 0 ? 1.0 : 0.0;
+    active[i]       = i % 3 == 0 ? 0.0 : 1.0;
+  }
+
+  saturateCommands(x.data(), y.data(), z.data(), limit_x.data(), limit_y.data(), limit_z.data(),
+                   proportional.data(), active.data(), count);
+
+  for (size_t i = 0; i < count; i++) {
+    Eigen::Vector3d expected = cases[i].command;
+    if (active[i] > 0.0) {
+      saturateCommand(expected, cases[i].limits, proportional[i] > 0.0);
+    }
+    EXPECT_EQ(x[i], expected.x());
+    EXPECT_EQ(y[i], expected.y());
+    EXPECT_EQ(z[i], expected.z());
+  }
+}
+
+}  // namespace
@@ -0,0 +1,156 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_spsc_queue_test.cpp
+ *  \brief      Tests of the single producer / single consumer queue.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "speed_controller_spsc_queue.hpp"
+
+namespace {
+
+using controller_plugin_speed_controller::SpinLock;
+using controller_plugin_speed_controller::SpscQueue;
+
+TEST(SpscQueueTest, KeepsTheOrderAndTheCapacity) {
+  SpscQueue<int, 4> queue;
+  int value = 0;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.pop(value));
+
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.push(i));
+  }
+  EXPECT_FALSE(queue.push(4));
+  EXPECT_EQ(queue.size(), 4u);
+
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(SpscQueueTest, WrapsAround) {
+  SpscQueue<int, 4> queue;
+  int value = 0;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(queue.push(i));
+    ASSERT_TRUE(queue.push(i + 100));
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, i);
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, i + 100);
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, TransfersEveryValueBetweenThreads) {
+  constexpr uint64_t kValues = 100000;
+  SpscQueue<uint64_t, 64> queue;
+
+  std::thread producer([&queue]() {
+    for (uint64_t i = 0; i < kValues;) {
+      if (queue.push(i)) {
+        i++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  uint64_t value    = 0;
+  while (expected < kValues) {
+    if (queue.pop(value)) {
+      ASSERT_EQ(value, expected);
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, SerializedProducersDeliverEveryValueOnce) {
+  constexpr int kProducers        = 4;
+  constexpr uint64_t kValues      = 20000;  // Per producer
+  constexpr uint64_t kProducerBit = 32;
+  SpscQueue<uint64_t, 64> queue;
+  SpinLock producer_lock;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.emplace_back([&queue, &producer_lock, p]() {
+      for (uint64_t i = 0; i < kValues;) {
+        std::unique_lock<SpinLock> lock(producer_lock);
+        if (queue.push((static_cast<uint64_t>(p) << kProducerBit) | i)) {
+          i++;
+        } else {
+          lock.unlock();
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Each producer's values arrive once and in the order they were pushed
+  std::array<uint64_t, kProducers> expected{};
+  uint64_t received = 0;
+  uint64_t value    = 0;
+  while (received < kProducers * kValues) {
+    if (queue.pop(value)) {
+      const uint64_t producer = value >> kProducerBit;
+      ASSERT_LT(producer, static_cast<uint64_t>(kProducers));
+      ASSERT_EQ(value & ((uint64_t{1} << kProducerBit) - 1), expected[producer]);
+      expected[producer]++;
+      received++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+}  // namespace
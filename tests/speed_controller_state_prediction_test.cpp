@@ -0,0 +1,151 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_state_prediction_test.cpp
+ *  \brief      Tests for the latency-compensated state prediction.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "speed_controller_plugin_test_utils.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::LatencyProbe;
+using controller_plugin_speed_controller::predictFirstOrder;
+
+class StatePredictionTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+  }
+
+  // Pose and twist of the fixture, stamped _age seconds ago
+  static void stampState(PluginFixture &_fixture, double _age) {
+    const rclcpp::Time stamp = rclcpp::Clock().now() - rclcpp::Duration::from_seconds(_age);
+    _fixture.pose().header.stamp  = stamp;
+    _fixture.twist().header.stamp = stamp;
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out_;
+  geometry_msgs::msg::TwistStamped twist_out_;
+  as2_msgs::msg::Thrust thrust_out_;
+};
+
+TEST(PredictFirstOrderTest, ZeroTimeConstantHoldsTheValue) {
+  double integral;
+  EXPECT_DOUBLE_EQ(predictFirstOrder(2.0, 5.0, 0.0, 0.1, integral), 2.0);
+  EXPECT_DOUBLE_EQ(integral, 0.2);
+}
+
+TEST(PredictFirstOrderTest, LagConvergesToTheTarget) {
+  double integral;
+  const double tau = 0.05;
+  EXPECT_NEAR(predictFirstOrder(2.0, 5.0, tau, tau, integral), 5.0 - 3.0 * std::exp(-1.0), 1e-12);
+  EXPECT_NEAR(integral, 5.0 * tau - 3.0 * tau * (1.0 - std::exp(-1.0)), 1e-12);
+
+  Eigen::Vector3d displacement;
+  const Eigen::Vector3d value = predictFirstOrder<Eigen::Vector3d>(
+      Eigen::Vector3d::Zero(), Eigen::Vector3d::Ones(), tau, 100.0 * tau, displacement);
+  EXPECT_NEAR(value.x(), 1.0, 1e-12);
+  EXPECT_NEAR(displacement.z(), 100.0 * tau - tau, 1e-9);
+}
+
+TEST_F(StatePredictionTest, ConstantVelocityPredictionMatchesExtrapolatedState) {
+  PluginFixture predicted(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  PluginFixture extrapolated(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  predicted.plugin().parametersCallback({rclcpp::Parameter("state_prediction.enabled", true)});
+
+  const double age = 0.05;
+  stampState(predicted, age);
+  predicted.plugin().updateState(predicted.pose(), predicted.twist());
+  ASSERT_TRUE(predicted.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  const double latency = predicted.plugin().getInputLatency();
+  EXPECT_GE(latency, age);
+  EXPECT_LT(latency, age + 0.05);
+
+  auto &pose = extrapolated.pose();
+  pose.pose.position.x += extrapolated.twist().twist.linear.x * latency;
+  pose.pose.position.y += extrapolated.twist().twist.linear.y * latency;
+  pose.pose.position.z += extrapolated.twist().twist.linear.z * latency;
+  extrapolated.plugin().updateState(pose, extrapolated.twist());
+
+  geometry_msgs::msg::TwistStamped expected;
+  ASSERT_TRUE(extrapolated.plugin().computeOutput(0.01, pose_out_, expected, thrust_out_));
+  // The latency of the extrapolated state is only known to within the time between ticks
+  EXPECT_NEAR(twist_out_.twist.linear.x, expected.twist.linear.x, 1e-3);
+  EXPECT_NEAR(twist_out_.twist.linear.y, expected.twist.linear.y, 1e-3);
+  EXPECT_NEAR(twist_out_.twist.linear.z, expected.twist.linear.z, 1e-3);
+  EXPECT_NE(twist_out_.twist.angular.z, expected.twist.angular.z);
+}
+
+TEST_F(StatePredictionTest, PredictionHorizonIsCapped) {
+  PluginFixture capped(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  PluginFixture stale(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  for (PluginFixture *fixture : {&capped, &stale}) {
+    fixture->plugin().parametersCallback({rclcpp::Parameter("state_prediction.enabled", true)});
+    stampState(*fixture, 0.2);
+  }
+  stampState(stale, 5.0);
+  capped.plugin().updateState(capped.pose(), capped.twist());
+  stale.plugin().updateState(stale.pose(), stale.twist());
+
+  geometry_msgs::msg::TwistStamped capped_out;
+  ASSERT_TRUE(stale.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  ASSERT_TRUE(capped.plugin().computeOutput(0.01, pose_out_, capped_out, thrust_out_));
+  EXPECT_GT(stale.plugin().getInputLatency(), 4.9);
+  EXPECT_NEAR(twist_out_.twist.linear.x, capped_out.twist.linear.x, 1e-3);
+}
+
+TEST_F(StatePredictionTest, LatencyIsOnlyMeasuredWhenRequested) {
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  stampState(fixture, 0.05);
+  fixture.plugin().updateState(fixture.pose(), fixture.twist());
+  ASSERT_TRUE(fixture.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_EQ(fixture.plugin().getInputLatency(), 0.0);
+
+  fixture.plugin().parametersCallback({rclcpp::Parameter("latency_metrics.enabled", true)});
+  ASSERT_TRUE(fixture.plugin().computeOutput(0.01, pose_out_, twist_out_, thrust_out_));
+  EXPECT_GE(fixture.plugin().getInputLatency(), 0.05);
+  EXPECT_EQ(fixture.plugin()
+                .getLatencyMetrics()
+                .histogram(ControlMode::POSITION, LatencyProbe::INPUT_LATENCY)
+                .count(),
+            1u);
+}
+
+}  // namespace
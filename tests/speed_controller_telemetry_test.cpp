@@ -0,0 +1,257 @@
+/*!*******************************************************************************************
+ *  \file       tests/speed_controller_telemetry_test.cpp
+ *  \brief      Tests of the telemetry recorder, file format and reader.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "speed_controller_plugin_test_utils.hpp"
+#include "speed_controller_telemetry.hpp"
+#include "speed_controller_telemetry_reader.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::TELEMETRY_TRANSLATION_LOOP;
+using controller_plugin_speed_controller::TELEMETRY_VALID;
+using controller_plugin_speed_controller::TELEMETRY_YAW_LOOP;
+using controller_plugin_speed_controller::TelemetryReader;
+using controller_plugin_speed_controller::TelemetryRecord;
+using controller_plugin_speed_controller::TelemetryRecorder;
+
+TelemetryRecord makeRecord(size_t i) {
+  TelemetryRecord record;
+  record.time         = 0.001 * static_cast<double>(i);
+  record.dt           = 0.001;
+  record.control_mode = static_cast<uint8_t>(i % 7);
+  record.error[2]     = static_cast<double>(i);
+  record.command[3]   = -static_cast<double>(i);
+  return record;
+}
+
+// Waits for the flush thread to write _count records
+bool waitWritten(const TelemetryRecorder &_recorder, uint64_t _count) {
+  for (int i = 0; i < 1000 && _recorder.written() < _count; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return _recorder.written() == _count;
+}
+
+TEST(TelemetryTest, RecordsRoundTripThroughTheFile) {
+  const std::string path = ::testing::TempDir() + "telemetry_round_trip.bin";
+  TelemetryRecorder recorder;
+  TelemetryRecord record;
+  EXPECT_FALSE(recorder.record(record));
+  ASSERT_TRUE(recorder.start(path, std::chrono::milliseconds(1)));
+
+  // More than the ring and the first mapping of the file hold
+  const size_t count = 5000;
+  for (size_t i = 0; i < count; i++) {
+    record = makeRecord(i);
+    ASSERT_TRUE(recorder.record(record));
+    if (i % 1000 == 999) {
+      ASSERT_TRUE(waitWritten(recorder, i + 1));
+    }
+  }
+  recorder.stop();
+  EXPECT_EQ(recorder.written(), count);
+  EXPECT_EQ(recorder.dropped(), 0u);
+
+  const TelemetryReader reader = TelemetryReader::open(path);
+  ASSERT_EQ(reader.size(), count);
+  const int tick    = reader.findField("tick");
+  const int mode    = reader.findField("control_mode");
+  const int error_z = reader.findField("error.z");
+  const int yaw     = reader.findField("command.yaw");
+  ASSERT_GE(tick, 0);
+  ASSERT_GE(mode, 0);
+  ASSERT_GE(error_z, 0);
+  ASSERT_GE(yaw, 0);
+  EXPECT_EQ(reader.findField("error.w"), -1);
+  for (size_t i = 0; i < count; i += 499) {
+    EXPECT_EQ(reader.value(i, tick), static_cast<double>(i));
+    EXPECT_EQ(reader.value(i, mode), static_cast<double>(i % 7));
+    EXPECT_EQ(reader.value(i, error_z), static_cast<double>(i));
+    EXPECT_EQ(reader.value(i, yaw), -static_cast<double>(i));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TelemetryTest, RecordsBeyondTheRingAreDropped) {
+  const std::string path = ::testing::TempDir() + "telemetry_dropped.bin";
+  TelemetryRecorder recorder;
+  ASSERT_TRUE(recorder.start(path, std::chrono::hours(1)));
+  TelemetryRecord record;
+  for (size_t i = 0; i < TelemetryRecorder::kCapacity + 10; i++) {
+    recorder.record(record);
+  }
+  EXPECT_EQ(recorder.dropped(), 10u);
+  recorder.stop();
+  EXPECT_EQ(recorder.written(), TelemetryRecorder::kCapacity);
+
+  // Ticks keep counting over the dropped records
+  recorder.start(path);
+  EXPECT_TRUE(recorder.record(record));
+  EXPECT_EQ(record.tick, TelemetryRecorder::kCapacity + 10);
+  recorder.stop();
+  EXPECT_EQ(TelemetryReader::open(path).size(), 1u);
+  std::remove(path.c_str());
+}
+
+TEST(TelemetryTest, ExportsCsvAndRejectsOtherFiles) {
+  const std::string path = ::testing::TempDir() + "telemetry_csv.bin";
+  TelemetryRecorder recorder;
+  ASSERT_TRUE(recorder.start(path));
+  for (size_t i = 0; i < 3; i++) {
+    TelemetryRecord record = makeRecord(i + 1);
+    recorder.record(record);
+  }
+  recorder.stop();
+
+  std::ostringstream csv;
+  TelemetryReader::open(path).writeCsv(csv);
+  std::istringstream lines(csv.str());
+  std::string line;
+  ASSERT_TRUE(std::getline(lines, line));
+  EXPECT_EQ(line.rfind("tick,time,dt,control_mode,yaw_mode,flags,saturated,", 0), 0u);
+  ASSERT_TRUE(std::getline(lines, line));
+  EXPECT_EQ(line.rfind("0,0.001,0.001,1,0,0,0,", 0), 0u);
+  size_t rows = 1;
+  while (std::getline(lines, line)) {
+    rows++;
+  }
+  EXPECT_EQ(rows, 3u);
+
+  std::ofstream(path, std::ios::trunc) << std::string(8192, 'x');
+  EXPECT_THROW(TelemetryReader::open(path), std::runtime_error);
+  std::remove(path.c_str());
+  EXPECT_THROW(TelemetryReader::open(path), std::runtime_error);
+}
+
+TEST(TelemetryTest, PluginRecordsTheHeightLoop) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  const std::string path = ::testing::TempDir() + "telemetry_plugin.bin";
+  PluginFixture fixture(ControlMode::SPEED_IN_A_PLANE, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  EXPECT_EQ(plugin.getTelemetryRecorder(), nullptr);
+  plugin.parametersCallback(
+      {rclcpp::Parameter("telemetry.enabled", true), rclcpp::Parameter("telemetry.file", path)});
+  ASSERT_NE(plugin.getTelemetryRecorder(), nullptr);
+  ASSERT_TRUE(plugin.getTelemetryRecorder()->active());
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  const size_t ticks = 10;
+  for (size_t i = 0; i < ticks; i++) {
+    ASSERT_TRUE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+  }
+  plugin.parametersCallback({rclcpp::Parameter("telemetry.enabled", false)});
+  EXPECT_FALSE(plugin.getTelemetryRecorder()->active());
+
+  const TelemetryReader reader = TelemetryReader::open(path);
+  ASSERT_EQ(reader.size(), ticks);
+  auto value = [&](size_t _record, const char *_name) {
+    const int field = reader.findField(_name);
+    EXPECT_GE(field, 0) << _name;
+    return reader.value(_record, field);
+  };
+  for (size_t i = 0; i < ticks; i++) {
+    EXPECT_EQ(value(i, "control_mode"), ControlMode::SPEED_IN_A_PLANE);
+    EXPECT_EQ(value(i, "flags"), TELEMETRY_TRANSLATION_LOOP | TELEMETRY_YAW_LOOP | TELEMETRY_VALID);
+    // Height error is a position error, with kp = 1 in the default parameters
+    const double height_error = value(i, "reference.position.z") - value(i, "state.position.z");
+    EXPECT_DOUBLE_EQ(value(i, "error.z"), height_error);
+    EXPECT_DOUBLE_EQ(value(i, "proportional.z"), height_error);
+    EXPECT_DOUBLE_EQ(value(i, "proportional.z") + value(i, "integral_derivative.z"),
+                     value(i, "controller_output.z"));
+    EXPECT_DOUBLE_EQ(value(i, "controller_output.x"), value(i, "command.x"));
+    EXPECT_DOUBLE_EQ(value(i, "proportional.yaw") + value(i, "integral_derivative.yaw"),
+                     value(i, "command.yaw"));
+  }
+  EXPECT_NEAR(value(ticks - 1, "time") - value(0, "time"), 0.01 * (ticks - 1), 1e-9);
+  std::remove(path.c_str());
+}
+
+TEST(TelemetryTest, RestartsWaitForTheTickInProgress) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture fixture(ControlMode::POSITION, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+
+  std::atomic<bool> stop{false};
+  std::thread control([&]() {
+    geometry_msgs::msg::PoseStamped pose_out;
+    geometry_msgs::msg::TwistStamped twist_out;
+    as2_msgs::msg::Thrust thrust_out;
+    // Paced so that the ring never fills
+    while (!stop.load()) {
+      plugin.computeOutput(0.001, pose_out, twist_out, thrust_out);
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+
+  // Each file only holds the ticks recorded while it was open, without gaps
+  const std::string path = ::testing::TempDir() + "telemetry_restart.bin";
+  for (int i = 0; i < 20; i++) {
+    plugin.parametersCallback(
+        {rclcpp::Parameter("telemetry.enabled", true), rclcpp::Parameter("telemetry.file", path)});
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    plugin.parametersCallback({rclcpp::Parameter("telemetry.enabled", false)});
+
+    const TelemetryReader reader = TelemetryReader::open(path);
+    ASSERT_EQ(reader.size(), plugin.getTelemetryRecorder()->written());
+    const int tick = reader.findField("tick");
+    for (size_t record = 1; record < reader.size(); record++) {
+      ASSERT_EQ(reader.value(record, tick) - reader.value(0, tick), static_cast<double>(record));
+    }
+  }
+  EXPECT_EQ(plugin.getTelemetryRecorder()->dropped(), 0u);
+  stop.store(true);
+  control.join();
+  std::remove(path.c_str());
+}
+
+}  // namespace
@@ -0,0 +1,398 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_trajectory_buffer_test.cpp
+ *  \brief      Tests for the trajectory reference look-ahead buffer.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "speed_controller_plugin_test_utils.hpp"
+#include "speed_controller_trajectory_buffer.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using controller_plugin_speed_controller::TrajectoryBuffer;
+using controller_plugin_speed_controller::TrajectorySample;
+
+// p(t) = t^3 - 2 t^2 + t, exactly represented by a cubic Hermite segment
+TrajectorySample cubicSample(double time) {
+  TrajectorySample sample;
+  sample.time         = time;
+  sample.position     = Eigen::Vector3d::Constant(time * time * time - 2.0 * time * time + time);
+  sample.velocity     = Eigen::Vector3d::Constant(3.0 * time * time - 4.0 * time + 1.0);
+  sample.acceleration = Eigen::Vector3d::Constant(6.0 * time - 4.0);
+  sample.yaw          = time;
+  return sample;
+}
+
+TEST(TrajectoryBufferTest, EmptyBufferHasNoReference) {
+  TrajectoryBuffer buffer;
+  TrajectorySample sample;
+  EXPECT_FALSE(buffer.sample(0.0, sample));
+}
+
+TEST(TrajectoryBufferTest, HermiteSegmentsReproduceCubicTrajectories) {
+  TrajectoryBuffer buffer;
+  for (double time = 0.0; time <= 1.0; time += 0.25) {
+    buffer.push(cubicSample(time));
+  }
+
+  TrajectorySample sample;
+  for (double time = 0.0; time < 1.0; time += 0.01) {
+    ASSERT_TRUE(buffer.sample(time, sample));
+    const TrajectorySample expected = cubicSample(time);
+    EXPECT_NEAR(sample.position.x(), expected.position.x(), 1e-12) << time;
+    EXPECT_NEAR(sample.velocity.x(), expected.velocity.x(), 1e-12) << time;
+    EXPECT_NEAR(sample.yaw, expected.yaw, 1e-12) << time;
+  }
+  // Samples behind the current segment are released
+  EXPECT_EQ(buffer.size(), 2u);
+}
+
+TEST(TrajectoryBufferTest, ExtrapolationIsBounded) {
+  TrajectoryBuffer buffer(0.1);
+  TrajectorySample start;
+  start.time         = 1.0;
+  start.velocity     = Eigen::Vector3d(1.0, 0.0, 0.0);
+  start.acceleration = Eigen::Vector3d(0.0, 2.0, 0.0);
+  buffer.push(start);
+
+  TrajectorySample sample;
+  ASSERT_TRUE(buffer.sample(0.5, sample));
+  EXPECT_EQ(sample.position, start.position);
+
+  ASSERT_TRUE(buffer.sample(1.05, sample));
+  EXPECT_NEAR(sample.position.x(), 0.05, 1e-12);
+  EXPECT_NEAR(sample.position.y(), 0.0025, 1e-12);
+  EXPECT_NEAR(sample.velocity.y(), 0.1, 1e-12);
+
+  ASSERT_TRUE(buffer.sample(1.08, sample));
+  EXPECT_NEAR(sample.position.x(), 0.08, 1e-12);
+  EXPECT_NEAR(sample.velocity.y(), 0.16, 1e-12);
+}
+
+TEST(TrajectoryBufferTest, ReferenceIsHeldPastTheExtrapolationCap) {
+  TrajectoryBuffer buffer(0.1);
+  TrajectorySample start;
+  start.time         = 1.0;
+  start.velocity     = Eigen::Vector3d(1.0, 0.0, 0.0);
+  start.acceleration = Eigen::Vector3d(0.0, 2.0, 0.0);
+  buffer.push(start);
+
+  TrajectorySample sample;
+  for (double time : {1.2, 5.0}) {
+    ASSERT_TRUE(buffer.sample(time, sample));
+    EXPECT_NEAR(sample.position.x(), 0.1, 1e-12) << time;
+    EXPECT_NEAR(sample.position.y(), 0.01, 1e-12) << time;
+    EXPECT_EQ(sample.velocity, Eigen::Vector3d::Zero()) << time;
+    EXPECT_EQ(sample.acceleration, Eigen::Vector3d::Zero()) << time;
+  }
+}
+
+TEST(TrajectoryBufferTest, OlderSampleRestartsTheTrajectory) {
+  TrajectoryBuffer buffer;
+  buffer.push(cubicSample(1.0));
+  buffer.push(cubicSample(2.0));
+  buffer.push(cubicSample(2.0));
+  EXPECT_EQ(buffer.size(), 2u);
+
+  buffer.push(cubicSample(0.5));
+  EXPECT_EQ(buffer.size(), 1u);
+
+  for (size_t i = 0; i < TrajectoryBuffer::kCapacity + 4; i++) {
+    buffer.push(cubicSample(1.0 + i));
+  }
+  EXPECT_EQ(buffer.size(), TrajectoryBuffer::kCapacity);
+}
+
+TEST(TrajectoryBufferTest, TruncationKeepsTheSamplesBefore) {
+  TrajectoryBuffer buffer;
+  for (double time = 0.0; time <= 1.0; time += 0.25) {
+    buffer.push(cubicSample(time));
+  }
+  buffer.truncate(0.5);
+  ASSERT_EQ(buffer.size(), 2u);
+  EXPECT_EQ(buffer.newest().time, 0.25);
+
+  // The replacing samples continue the trajectory instead of restarting it
+  buffer.push(cubicSample(0.6));
+  EXPECT_EQ(buffer.size(), 3u);
+  buffer.truncate(-1.0);
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(TrajectoryBufferTest, YawIsInterpolatedAcrossTheWrap) {
+  TrajectoryBuffer buffer;
+  TrajectorySample start, end;
+  start.yaw = M_PI - 0.1;
+  end.time  = 1.0;
+  end.yaw   = -M_PI + 0.1;
+  buffer.push(start);
+  buffer.push(end);
+
+  TrajectorySample sample;
+  ASSERT_TRUE(buffer.sample(0.5, sample));
+  EXPECT_NEAR(std::abs(sample.yaw), M_PI, 1e-12);
+}
+
+TEST(TrajectoryBufferTest, EvaluationLooksAheadWithoutReleasing) {
+  TrajectoryBuffer buffer;
+  for (double time = 0.0; time <= 1.0; time += 0.25) {
+    buffer.push(cubicSample(time));
+  }
+
+  TrajectorySample sample;
+  ASSERT_TRUE(buffer.evaluate(0.6, sample));
+  EXPECT_NEAR(sample.position.x(), cubicSample(0.6).position.x(), 1e-12);
+  EXPECT_NEAR(sample.acceleration.x(), cubicSample(0.6).acceleration.x(), 1e-12);
+  EXPECT_NEAR(sample.yaw_rate, 1.0, 1e-12);
+  EXPECT_EQ(buffer.size(), 5u);
+
+  // Past the newest sample the yaw is held
+  ASSERT_TRUE(buffer.evaluate(1.05, sample));
+  EXPECT_EQ(sample.yaw_rate, 0.0);
+  EXPECT_EQ(buffer.size(), 5u);
+}
+
+TEST(TrajectoryBufferTest, PluginTracksInterpolatedReference) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture interpolated(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  PluginFixture current(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  rclcpp::Clock clock;
+
+  // Same straight line, sampled around now or only at now
+  auto point = [&](double offset) {
+    as2_msgs::msg::TrajectoryPoint traj = makeTrajectoryPoint(0.0);
+    const int64_t stamp = clock.now().nanoseconds() + static_cast<int64_t>(offset * 1e9);
+    traj.header.stamp   = rclcpp::Time(stamp);
+    traj.position.x += traj.twist.x * offset;
+    traj.position.y += traj.twist.y * offset;
+    traj.position.z += traj.twist.z * offset;
+    return traj;
+  };
+  interpolated.plugin().updateReference(point(-0.02));
+  interpolated.plugin().updateReference(point(0.02));
+  current.plugin().updateReference(point(0.0));
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped interpolated_out, current_out;
+  as2_msgs::msg::Thrust thrust_out;
+  ASSERT_TRUE(interpolated.plugin().computeOutput(0.01, pose_out, interpolated_out, thrust_out));
+  ASSERT_TRUE(current.plugin().computeOutput(0.01, pose_out, current_out, thrust_out));
+  EXPECT_NEAR(interpolated_out.twist.linear.x, current_out.twist.linear.x, 1e-3);
+  EXPECT_NEAR(interpolated_out.twist.linear.y, current_out.twist.linear.y, 1e-3);
+  EXPECT_NEAR(interpolated_out.twist.linear.z, current_out.twist.linear.z, 1e-3);
+}
+
+TEST(TrajectoryBufferTest, PluginConsumesWholeSegments) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture points(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  PluginFixture joints(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  PluginFixture current(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  rclcpp::Clock clock;
+  const int64_t now = clock.now().nanoseconds();
+  const as2_msgs::msg::TrajectoryPoint origin = makeTrajectoryPoint(0.0);
+
+  // Straight line from 0.1 s in the past to 0.1 s ahead, as points and as joints
+  std::vector<as2_msgs::msg::TrajectoryPoint> segment;
+  trajectory_msgs::msg::JointTrajectory joint_segment;
+  joint_segment.header.stamp = rclcpp::Time(now - 100000000);
+  joint_segment.joint_names  = {"yaw", "z", "x", "y"};
+  for (int i = 0; i <= 10; i++) {
+    const double offset                 = -0.1 + 0.02 * i;
+    as2_msgs::msg::TrajectoryPoint traj = origin;
+    traj.header.stamp                   = rclcpp::Time(now + static_cast<int64_t>(offset * 1e9));
+    traj.position.x += traj.twist.x * offset;
+    traj.position.y += traj.twist.y * offset;
+    traj.position.z += traj.twist.z * offset;
+    segment.push_back(traj);
+
+    trajectory_msgs::msg::JointTrajectoryPoint joint_point;
+    joint_point.time_from_start.nanosec = static_cast<uint32_t>(20000000 * i);
+
+    joint_point.positions  = {traj.yaw_angle, traj.position.z, traj.position.x, traj.position.y};
+    joint_point.velocities = {0.0, traj.twist.z, traj.twist.x, traj.twist.y};
+    joint_segment.points.push_back(joint_point);
+  }
+  points.plugin().updateReference(segment);
+  joints.plugin().updateReference(joint_segment);
+  as2_msgs::msg::TrajectoryPoint now_point = origin;
+  now_point.header.stamp                   = rclcpp::Time(now);
+  current.plugin().updateReference(now_point);
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped points_out, joints_out, current_out;
+  as2_msgs::msg::Thrust thrust_out;
+  ASSERT_TRUE(points.plugin().computeOutput(0.01, pose_out, points_out, thrust_out));
+  ASSERT_TRUE(joints.plugin().computeOutput(0.01, pose_out, joints_out, thrust_out));
+  ASSERT_TRUE(current.plugin().computeOutput(0.01, pose_out, current_out, thrust_out));
+  EXPECT_NEAR(points_out.twist.linear.x, current_out.twist.linear.x, 1e-3);
+  EXPECT_NEAR(points_out.twist.linear.y, current_out.twist.linear.y, 1e-3);
+  EXPECT_NEAR(points_out.twist.linear.z, current_out.twist.linear.z, 1e-3);
+  EXPECT_NEAR(joints_out.twist.linear.x, current_out.twist.linear.x, 1e-3);
+  EXPECT_NEAR(joints_out.twist.linear.y, current_out.twist.linear.y, 1e-3);
+  EXPECT_NEAR(joints_out.twist.linear.z, current_out.twist.linear.z, 1e-3);
+  EXPECT_NEAR(joints_out.twist.angular.z, current_out.twist.angular.z, 1e-3);
+}
+
+TEST(TrajectoryBufferTest, JointTrajectoryWithoutPositionJointsIsIgnored) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture fixture(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  Plugin &plugin = fixture.plugin();
+  const ControlMode mode_out =
+      makeMode(ControlMode::SPEED, ControlMode::YAW_SPEED, ControlMode::LOCAL_ENU_FRAME);
+  ASSERT_TRUE(plugin.setMode(
+      makeMode(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, ControlMode::LOCAL_ENU_FRAME),
+      mode_out));
+  plugin.updateState(fixture.pose(), fixture.twist());
+
+  trajectory_msgs::msg::JointTrajectory joint_segment;
+  joint_segment.joint_names = {"x", "y", "yaw"};
+  joint_segment.points.resize(2);
+  plugin.updateReference(joint_segment);
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped twist_out;
+  as2_msgs::msg::Thrust thrust_out;
+  EXPECT_FALSE(plugin.computeOutput(0.01, pose_out, twist_out, thrust_out));
+}
+
+TEST(TrajectoryBufferTest, PluginFeedsTheTrajectoryForward) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture feedforward(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  PluginFixture feedback(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  constexpr double kLookAhead = 0.2;
+  feedforward.plugin().parametersCallback(
+      {rclcpp::Parameter("trajectory_feedforward.look_ahead", kLookAhead),
+       rclcpp::Parameter("trajectory_feedforward.yaw_rate", true)});
+  rclcpp::Clock clock;
+
+  // Constant acceleration and a yaw rate of 0.4 rad/s through the current state
+  const as2_msgs::msg::TrajectoryPoint base = makeTrajectoryPoint(0.0);
+  auto point = [&](double offset) {
+    as2_msgs::msg::TrajectoryPoint traj = base;
+    const int64_t stamp = clock.now().nanoseconds() + static_cast<int64_t>(offset * 1e9);
+    traj.header.stamp   = rclcpp::Time(stamp);
+    traj.position.x += traj.twist.x * offset;
+    traj.position.y += traj.twist.y * offset;
+    traj.position.z += traj.twist.z * offset;
+    traj.acceleration.x = 0.5;
+    traj.acceleration.y = -0.25;
+    traj.acceleration.z = 0.1;
+    traj.yaw_angle      = 0.2 + 0.4 * offset;
+    return traj;
+  };
+  for (PluginFixture *fixture : {&feedforward, &feedback}) {
+    fixture->pose().pose.position.x = base.position.x;
+    fixture->pose().pose.position.y = base.position.y;
+    fixture->pose().pose.position.z = base.position.z;
+    fixture->plugin().updateState(fixture->pose(), fixture->twist());
+    fixture->plugin().updateReference(point(-0.5));
+    fixture->plugin().updateReference(point(0.5));
+  }
+
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped feedforward_out, feedback_out;
+  as2_msgs::msg::Thrust thrust_out;
+  ASSERT_TRUE(feedforward.plugin().computeOutput(0.01, pose_out, feedforward_out, thrust_out));
+  ASSERT_TRUE(feedback.plugin().computeOutput(0.01, pose_out, feedback_out, thrust_out));
+  EXPECT_NEAR(feedforward_out.twist.linear.x - feedback_out.twist.linear.x, kLookAhead * 0.5,
+              1e-3);
+  EXPECT_NEAR(feedforward_out.twist.linear.y - feedback_out.twist.linear.y, kLookAhead * -0.25,
+              1e-3);
+  EXPECT_NEAR(feedforward_out.twist.linear.z - feedback_out.twist.linear.z, kLookAhead * 0.1,
+              1e-3);
+  EXPECT_NEAR(feedforward_out.twist.angular.z - feedback_out.twist.angular.z, 0.4, 1e-3);
+}
+
+TEST(TrajectoryBufferTest, PluginSegmentReplacesTheOverlappedTail) {
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  PluginFixture replaced(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  PluginFixture current(ControlMode::TRAJECTORY, ControlMode::YAW_ANGLE, false);
+  const int64_t now = 100000000000;  // [ns], control time of both plugins
+
+  // Straight line through the origin point at now, moved by _offset along x
+  auto point = [now](int64_t _time, double _offset) {
+    as2_msgs::msg::TrajectoryPoint traj = makeTrajectoryPoint(0.0);
+    const double elapsed                = 1e-9 * static_cast<double>(_time - now);
+    traj.header.stamp                   = rclcpp::Time(_time);
+    traj.position.x += traj.twist.x * elapsed + _offset;
+    traj.position.y += traj.twist.y * elapsed;
+    traj.position.z += traj.twist.z * elapsed;
+    return traj;
+  };
+  for (PluginFixture *fixture : {&replaced, &current}) {
+    fixture->pose().header.stamp  = rclcpp::Time(now);
+    fixture->twist().header.stamp = fixture->pose().header.stamp;
+    fixture->plugin().updateState(fixture->pose(), fixture->twist());
+  }
+
+  // From 0.1 s in the past to 0.3 s ahead, then a segment 1 m away from 0.1 s ahead
+  std::vector<as2_msgs::msg::TrajectoryPoint> first, second;
+  for (int64_t i = 0; i < 5; i++) {
+    first.push_back(point(now + (i - 1) * 100000000, 0.0));
+  }
+  for (int64_t i = 0; i < 3; i++) {
+    second.push_back(point(now + (i + 1) * 100000000, 1.0));
+  }
+  replaced.plugin().updateReference(first);
+  replaced.plugin().updateReference(second);
+  current.plugin().updateReference(std::vector<as2_msgs::msg::TrajectoryPoint>{point(now, 0.0)});
+
+  // Until the new segment starts the reference is still the first one
+  geometry_msgs::msg::PoseStamped pose_out;
+  geometry_msgs::msg::TwistStamped replaced_out, current_out;
+  as2_msgs::msg::Thrust thrust_out;
+  ASSERT_TRUE(replaced.plugin().computeOutput(0.01, pose_out, replaced_out, thrust_out));
+  ASSERT_TRUE(current.plugin().computeOutput(0.01, pose_out, current_out, thrust_out));
+  EXPECT_NEAR(replaced_out.twist.linear.x, current_out.twist.linear.x, 1e-9);
+  EXPECT_NEAR(replaced_out.twist.linear.y, current_out.twist.linear.y, 1e-9);
+  EXPECT_NEAR(replaced_out.twist.linear.z, current_out.twist.linear.z, 1e-9);
+}
+
+}  // namespace
@@ -0,0 +1,174 @@
+/*!*******************************************************************************************
+ *  \file       speed_controller_tuner_test.cpp
+ *  \brief      Tests for the closed-loop gain tuner.
+ *  \authors    Miguel Fernández Cortizas
+ *              Pedro Arias Pérez
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "speed_controller_plugin_test_utils.hpp"
+#include "speed_controller_tuner.hpp"
+
+namespace {
+
+using namespace speed_controller_test_utils;
+using namespace controller_plugin_speed_controller::replay;
+using namespace controller_plugin_speed_controller::tuning;
+
+TraceRecord makeRecord(TraceRecordType type, double time, std::vector<double> data) {
+  TraceRecord record;
+  record.type = type;
+  record.time = time;
+  std::copy(data.begin(), data.end(), record.data);
+  return record;
+}
+
+// 3 s position step from the origin, speed limited to 2 m/s
+Trace makeStepTrace() {
+  std::vector<TraceRecord> records = {
+      makeRecord(TraceRecordType::MODE, 1.0,
+                 {ControlMode::POSITION, ControlMode::YAW_ANGLE, ControlMode::LOCAL_ENU_FRAME,
+                  ControlMode::LOCAL_ENU_FRAME}),
+      makeRecord(TraceRecordType::STATE, 1.0, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0}),
+      makeRecord(TraceRecordType::TWIST_REFERENCE, 1.0, {2.0, 2.0, 2.0, 1.0}),
+      makeRecord(TraceRecordType::POSE_REFERENCE, 1.0,
+                 {1.0, 0.5, 1.0, 0.0, 0.0, std::sin(0.25), std::cos(0.25)}),
+  };
+  for (int i = 0; i < 300; i++) {
+    records.push_back(makeRecord(TraceRecordType::TICK, 1.0 + 0.01 * i, {0.01}));
+  }
+  return Trace(records);
+}
+
+ReplayCase makeCase(double kp) {
+  ReplayCase replay_case{"", getDefaultParameters(false)};
+  for (const std::string axis : {"x", "y", "z"}) {
+    replay_case.parameters.emplace_back("position_control.kp." + axis, kp);
+  }
+  return replay_case;
+}
+
+TuningConfig makeConfig() {
+  TuningConfig config;
+  config.base = makeCase(1.0).parameters;
+  config.ranges.push_back(
+      {{"position_control.kp.x", "position_control.kp.y", "position_control.kp.z"}, 0.1, 3.0,
+       true});
+  config.ranges.push_back({{"yaw_control.kp"}, 0.1, 3.0, false});
+  config.candidates = 16;
+  config.seed       = 7;
+  config.threads    = 4;
+  return config;
+}
+
+TEST(TunerTest, ClosedLoopCostRanksGains) {
+  const Trace trace = makeStepTrace();
+  const double slow = evaluate(trace, makeCase(0.1), PlantModel());
+  const double fast = evaluate(trace, makeCase(1.0), PlantModel());
+
+  ASSERT_TRUE(std::isfinite(slow));
+  ASSERT_TRUE(std::isfinite(fast));
+  EXPECT_LT(fast, slow);
+  // Without any motion the cost is the squared initial error
+  EXPECT_NEAR(evaluate(trace, makeCase(0.0), PlantModel()), 2.25 + 0.25, 0.3);
+}
+
+TEST(TunerTest, TraceWithoutValidTicksHasInfiniteCost) {
+  const Trace trace({makeRecord(TraceRecordType::TICK, 1.0, {0.01})});
+  EXPECT_TRUE(std::isinf(evaluate(trace, makeCase(1.0), PlantModel())));
+}
+
+TEST(TunerTest, TuningIsDeterministicAndRanked) {
+  const Trace trace                      = makeStepTrace();
+  const TuningConfig config              = makeConfig();
+  const std::vector<TuningResult> first  = tune(trace, config);
+  const std::vector<TuningResult> second = tune(trace, config);
+
+  ASSERT_EQ(first.size(), config.candidates);
+  ASSERT_EQ(second.size(), config.candidates);
+  bool base_evaluated = false;
+  for (size_t i = 0; i < first.size(); i++) {
+    ASSERT_EQ(first[i].gains.size(), 4u);
+    EXPECT_EQ(first[i].cost, second[i].cost);
+    EXPECT_EQ(first[i].gains[0].as_double(), second[i].gains[0].as_double());
+    EXPECT_EQ(first[i].gains[0].as_double(), first[i].gains[2].as_double());
+    if (i > 0) {
+      EXPECT_LE(first[i - 1].cost, first[i].cost);
+    }
+    base_evaluated |= first[i].gains[0].as_double() == 1.0 &&
+                      first[i].gains[3].as_double() == 1.0;
+  }
+  EXPECT_TRUE(base_evaluated);
+  EXPECT_LE(first.front().cost, evaluate(trace, makeCase(1.0), PlantModel()));
+}
+
+TEST(TunerTest, WritesNestedParametersFile) {
+  const std::string path = ::testing::TempDir() + "tuner_parameters.yaml";
+  writeParametersYaml(path, {rclcpp::Parameter("use_bypass", true),
+                             rclcpp::Parameter("position_control.kp.x", 1.0),
+                             rclcpp::Parameter("yaw_control.kp", 0.1),
+                             rclcpp::Parameter("position_control.kp.y", 0.25)});
+
+  std::stringstream contents;
+  contents << std::ifstream(path).rdbuf();
+  EXPECT_EQ(contents.str(),
+            "/**:\n"
+            "  ros__parameters:\n"
+            "    use_bypass: true\n"
+            "    position_control:\n"
+            "      kp:\n"
+            "        x: 1.0\n"
+            "        y: 0.25\n"
+            "    yaw_control:\n"
+            "      kp: 0.1\n");
+  std::remove(path.c_str());
+}
+
+TEST(TunerTest, MergeReplacesAndAppendsParameters) {
+  const auto merged = mergeParameters(
+      {rclcpp::Parameter("a", 1.0), rclcpp::Parameter("b", 2.0)},
+      {rclcpp::Parameter("b", 3.0), rclcpp::Parameter("c", 4.0)});
+  ASSERT_EQ(merged.size(), 3u);
+  EXPECT_EQ(merged[0].as_double(), 1.0);
+  EXPECT_EQ(merged[1].as_double(), 3.0);
+  EXPECT_EQ(merged[2].get_name(), "c");
+}
+
+}  // namespace
@@ -29,12 +29,11 @@ foreach(TEST_SOURCE ${TEST_SOURCES})
   math(EXPR final_length  "${name_length}-4") # remove .cpp of the name
   string(SUBSTRING ${_src_filename} 0 ${final_length} TEST_NAME)
   
-  add_executable(${TEST_NAME}_test ${TEST_SOURCE})
-  ament_target_dependencies(${TEST_NAME}_test  ${PROJECT_DEPENDENCIES})
-  target_link_libraries(${TEST_NAME}_test gtest_main)
+  add_executable(${TEST_NAME} ${TEST_SOURCE})
+  ament_target_dependencies(${TEST_NAME}  ${PROJECT_DEPENDENCIES})
+  target_link_libraries(${TEST_NAME} ${PROJECT_NAME} ${PROJECT_NAME}_replay gtest_main)
 
   # add the test executable to the list of executables to build
-  gtest_discover_tests(${TEST_NAME}_test)
+  gtest_discover_tests(${TEST_NAME})
 
   endforeach()
-